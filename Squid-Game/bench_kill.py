@@ -0,0 +1,97 @@
+"""Time to turn the players into #DET/#DEP payloads, the way the server did
+before PyroBitmap (a scan of every player for the dead IDs, then a
+bitstring BitArray per page) against the bitmap kept up to date with each
+change. Eliminates every player one at a time in a random order, making
+the payloads after each elimination as a click does, and again with
+nothing changed as the heartbeat does, and checks both ways give the same
+payloads.
+
+Usage: python3 bench_kill.py [players ...]    (456 and 4096 by default)
+"""
+
+import random
+import sys
+import time
+
+from transmit import PAGE_BITS, PyroBitmap, chunks
+
+try:
+    import bitstring
+except ImportError:
+    bitstring = None
+
+
+def scan_payloads(alive):
+    # webserver.py's dead_player_ids and transmit.py's Board.kill as they were
+    ids = [id for id, is_alive in alive.items() if not is_alive]
+    pages = max([1] + [id // PAGE_BITS + 1 for id in ids])
+    payloads = []
+    for page in range(pages):
+        indices = (id % PAGE_BITS for id in ids if id // PAGE_BITS == page)
+        bits = bitstring.BitArray('0x' + ('0' * 128))
+        bits.set(1, indices)
+        final_bit_str = "".join(byte_str[::-1] for byte_str in chunks(bits.bin, 8))
+        payloads.append(bitstring.BitArray(f'0b{final_bit_str}').hex)
+    return payloads
+
+
+def bitmap_payloads(bitmap):
+    # What the server posts to the writers and they send
+    bitmap = bitmap.copy()
+    return [bitmap.page_hex(page) for page in range(len(bitmap.pages))]
+
+
+def percentile(samples, p):
+    return samples[min(len(samples) - 1, int(p / 100 * len(samples)))] * 1e6
+
+
+def report(name, clicks, heartbeats):
+    clicks.sort()
+    heartbeats.sort()
+    print(f'  {name:8} click p50 {percentile(clicks, 50):8.1f} p99 {percentile(clicks, 99):8.1f} us   '
+          f'heartbeat p50 {percentile(heartbeats, 50):8.1f} us')
+
+
+def run(players, seed=1):
+    # Board IDs 0 to players - 1, so 4096 players fill the eight pages
+    order = list(range(players))
+    random.Random(seed).shuffle(order)
+    alive = {n: True for n in order}
+    bitmap = PyroBitmap()
+    scan = ([], [])
+    incremental = ([], [])
+    mismatches = 0
+
+    for n in order:
+        alive[n] = False
+        start = time.perf_counter()
+        bitmap.set(n, True)
+        made = bitmap_payloads(bitmap)
+        incremental[0].append(time.perf_counter() - start)
+        start = time.perf_counter()
+        bitmap_payloads(bitmap)
+        incremental[1].append(time.perf_counter() - start)
+
+        if bitstring is not None:
+            start = time.perf_counter()
+            expected = scan_payloads(alive)
+            scan[0].append(time.perf_counter() - start)
+            start = time.perf_counter()
+            scan_payloads(alive)
+            scan[1].append(time.perf_counter() - start)
+            mismatches += made != expected
+
+    print(f'{players} players, {len(bitmap.pages)} pages')
+    if bitstring is not None:
+        report('scan', *scan)
+    report('bitmap', *incremental)
+    if bitstring is None:
+        print('  bitstring is not installed, so the old path was not run')
+    else:
+        print(f'  payload mismatches {mismatches}')
+    return mismatches
+
+
+if __name__ == '__main__':
+    counts = [int(arg) for arg in sys.argv[1:]] or [456, 4096]
+    sys.exit(1 if sum(run(players) for players in counts) else 0)
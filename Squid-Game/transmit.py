@@ -1,8 +1,36 @@
 import serial
 import argparse
-import bitstring
+import atexit
 import time
 import datetime
+import queue
+import struct
+import threading
+
+# Binary UART frames (see beastsquib_uart_frame_type_t in espnow_example.h)
+UART_ARM = 0x01
+UART_PAGE = 0x02
+UART_DELTA = 0x03
+UART_DELAY = 0x04
+UART_ACK = 0x80
+UART_NAK = 0x81
+UART_TRACE = 0x82
+UART_NAK_CRC = 1
+UART_DELTA_CLEAR = 0x8000
+UART_MAX_PAYLOAD = 128
+UART_REPLY_TIMEOUT = 0.2
+UART_RETRIES = 3
+
+# Kill bitmap pages (BEASTSQUIB_PAGE_BITS in espnow_example.h)
+PAGE_BITS = 512
+PAGE_BYTES = PAGE_BITS // 8
+MAX_BOARDS = 8 * PAGE_BITS   # BEASTSQUIB_MAX_BOARDS
+
+# Trace files (see beastsquib_trace_type_t in espnow_example.h)
+TRACE_MAGIC = b'BSQTRACE'
+TRACE_UART = 1
+TRACE_TX = 2
+TRACE_RX = 3
 
 def log(msg, **kwargs):
     time_str = datetime.datetime.now().strftime("%I:%M:%S %p")
@@ -13,70 +41,582 @@ def chunks(lst, n):
     for i in range(0, len(lst), n):
         yield lst[i:i + n]
 
+def crc16_le(data):
+    """The ESP ROM crc16_le, seeded with 0xFFFF as the firmware does."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return ~crc & 0xFFFF
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_at = 0
+    for byte in data:
+        if byte == 0:
+            out[code_at] = len(out) - code_at
+            code_at = len(out)
+            out.append(0)
+            continue
+        out.append(byte)
+        if len(out) - code_at == 0xFF:
+            out[code_at] = 0xFF
+            code_at = len(out)
+            out.append(0)
+    out[code_at] = len(out) - code_at
+    return bytes(out)
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('bad COBS block')
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+class PyroBitmap(object):
+    """Board IDs to detonate, in the layout get_bit reads on the boards:
+    bit id % 8 of byte id % 512 // 8 of page id // 512. Changed one ID at a
+    time; a page's hex for #DET/#DEP is made the first time it is asked for
+    after a change and kept until the next one."""
+
+    def __init__(self, ids=()):
+        self.pages = [bytearray(PAGE_BYTES)]
+        self._hex = [None]
+        self.count = 0
+        for id in ids:
+            self.set(id, True)
+
+    def set(self, id, dead):
+        """Returns whether the bit changed."""
+        page, byte, mask = id // PAGE_BITS, id % PAGE_BITS // 8, 1 << (id % 8)
+        while page >= len(self.pages):
+            self.pages.append(bytearray(PAGE_BYTES))
+            self._hex.append(None)
+        bits = self.pages[page]
+        if bool(bits[byte] & mask) == dead:
+            return False
+        bits[byte] ^= mask
+        self._hex[page] = None
+        self.count += 1 if dead else -1
+        return True
+
+    def page_bytes(self, page):
+        return bytes(self.pages[page]) if page < len(self.pages) else bytes(PAGE_BYTES)
+
+    def page_hex(self, page):
+        if page >= len(self.pages):
+            return '00' * PAGE_BYTES
+        if self._hex[page] is None:
+            self._hex[page] = self.pages[page].hex()
+        return self._hex[page]
+
+    def ids(self):
+        return [page * PAGE_BITS + byte * 8 + bit
+                for page, bits in enumerate(self.pages)
+                for byte, value in enumerate(bits) if value
+                for bit in range(8) if value & (1 << bit)]
+
+    def changes(self, old):
+        """IDs set since old, then IDs cleared since, with UART_DELTA_CLEAR."""
+        set_ids, cleared = [], []
+        for page in range(max(len(self.pages), len(old.pages))):
+            new_bits, old_bits = self.page_bytes(page), old.page_bytes(page)
+            if new_bits == old_bits:
+                continue
+            for byte, (new, was) in enumerate(zip(new_bits, old_bits)):
+                for bit in range(8):
+                    if (new ^ was) & (1 << bit):
+                        id = page * PAGE_BITS + byte * 8 + bit
+                        (set_ids if new & (1 << bit) else cleared).append(id)
+        return set_ids + [id | UART_DELTA_CLEAR for id in cleared]
+
+    def copy(self):
+        bitmap = PyroBitmap()
+        bitmap.pages = [bytearray(bits) for bits in self.pages]
+        bitmap._hex = list(self._hex)
+        bitmap.count = self.count
+        return bitmap
+
+    def __eq__(self, other):
+        return isinstance(other, PyroBitmap) and all(
+            self.page_bytes(page) == other.page_bytes(page)
+            for page in range(max(len(self.pages), len(other.pages))))
+
+
+class Trace(object):
+    """Writes a trace for host/replay: the bytes the server writes to a board,
+    and the frames the board streams back while #TRC,1; is on.
+
+    Board records carry the board's clock. They reach the host a varying
+    time after being made, never before, so they are moved onto the host
+    clock by the smallest offset seen between the two. A record that would
+    still land before the one written ahead of it is written at the same
+    time instead."""
+
+    def __init__(self, path):
+        self.file = open(path, 'wb', buffering=1 << 16)
+        self.file.write(TRACE_MAGIC)
+        self.lock = threading.Lock()
+        self.last_us = None
+        self.board_us = None
+        self.board_offset = None
+        self.board_seq = None
+        self.dropped = 0
+        atexit.register(self.close)
+
+    def _write(self, kind, data, at_us):
+        if self.last_us is None:
+            self.last_us = at_us
+        delta = min(max(0, at_us - self.last_us), 0xFFFFFFFF)
+        self.last_us += delta
+        self.file.write(struct.pack('<IBH', delta, kind, len(data)) + data)
+
+    def uart(self, data):
+        with self.lock:
+            if not self.file.closed:
+                self._write(TRACE_UART, data, time.monotonic_ns() // 1000)
+
+    def board(self, seq, payload):
+        """One BEASTSQUIB_UART_TRACE frame, from its type on."""
+        if len(payload) < 5:
+            return
+        kind, board_time = struct.unpack('<BI', payload[:5])
+        with self.lock:
+            if self.file.closed:
+                return
+            now_us = time.monotonic_ns() // 1000
+            if self.board_seq is not None:
+                self.dropped += (seq - self.board_seq - 1) & 0xFF
+            self.board_seq = seq
+            # The board's clock wraps every 71 minutes
+            if self.board_us is None:
+                self.board_us = board_time
+            else:
+                self.board_us += (board_time - self.board_us) & 0xFFFFFFFF
+            offset = now_us - self.board_us
+            if self.board_offset is None or offset < self.board_offset:
+                self.board_offset = offset
+            self._write(kind, payload[5:], self.board_us + self.board_offset)
+
+    def close(self):
+        with self.lock:
+            if not self.file.closed:
+                self.file.close()
+                if self.dropped:
+                    log(f"trace: the board dropped {self.dropped} records")
+
+
 class Board(object):
-    def __init__(self, device):
-        self.serial = serial.serial_for_url(device, 115200, do_not_open=True)
+    def __init__(self, device, baud=115200, binary=False, trace=None):
+        self.serial = serial.serial_for_url(device, baud, do_not_open=True)
         self.serial.dtr = False
         self.serial.rts = False
         self.serial.open()
+        self.pages = 1
+
+        # In binary mode the transmitter is sent frames instead of ASCII
+        # commands, and answers each with an ACK or NAK. A reader thread
+        # separates those, and the frames a board streams while tracing,
+        # from the log lines it prints.
+        self.binary = binary
+        self.trace = trace
+        self.seq = 0
+        self.sent_bitmap = None
+        self.send_lock = threading.Lock()
+        self.threaded = binary or trace is not None
+        if self.threaded:
+            self.lines = queue.Queue()
+            self.replies = queue.Queue()
+            threading.Thread(target=self._read_loop, daemon=True).start()
+
+    def _read_loop(self):
+        frame = None
+        line = bytearray()
+        while True:
+            for byte in self.serial.read(self.serial.in_waiting or 1):
+                if byte == 0:
+                    if frame:
+                        self._handle_reply(frame)
+                        frame = None
+                    else:
+                        frame = bytearray()
+                elif frame is not None:
+                    frame.append(byte)
+                else:
+                    line.append(byte)
+                    if byte == ord('\n'):
+                        self.lines.put(bytes(line))
+                        line = bytearray()
+
+    def _handle_reply(self, frame):
+        try:
+            raw = cobs_decode(frame)
+        except ValueError:
+            return
+        if len(raw) >= 4 and crc16_le(raw[:-2]) == struct.unpack('<H', raw[-2:])[0]:
+            if raw[1] == UART_TRACE:
+                if self.trace is not None:
+                    self.trace.board(raw[0], raw[2:-2])
+                return
+            self.replies.put(raw[:-2])
+
+    def _send_frame(self, frame_type, payload):
+        """Sends one binary frame until it is acknowledged. Returns False if it never was."""
+        with self.send_lock:
+            self.seq = (self.seq + 1) & 0xFF
+            raw = bytes([self.seq, frame_type]) + payload
+            wire = b'\0' + cobs_encode(raw + struct.pack('<H', crc16_le(raw))) + b'\0'
+
+            for attempt in range(UART_RETRIES):
+                self._write(wire)
+                deadline = time.monotonic() + UART_REPLY_TIMEOUT
+                while True:
+                    try:
+                        reply = self.replies.get(timeout=max(0, deadline - time.monotonic()))
+                    except queue.Empty:
+                        break
+                    if reply[0] != self.seq:
+                        continue
+                    if reply[1] == UART_ACK:
+                        return True
+                    reason = reply[2] if len(reply) > 2 else 0
+                    if reason != UART_NAK_CRC:
+                        log(f"error: frame type {frame_type} refused, reason {reason}")
+                        return False
+                    break
+
+            log(f"error: frame type {frame_type} not acknowledged")
+            return False
+
+    def read_line(self):
+        if self.threaded:
+            return self.lines.get()
+        return self.serial.read_until()
+
+    def _write(self, data):
+        if self.trace is not None:
+            self.trace.uart(data)
+        self.serial.write(data)
 
     def write_str(self, string):
         log(f">>> {string}")
-        self.serial.write(string.encode('utf-8'))
+        self._write(string.encode('utf-8'))
 
     def set_id(self, number):
-        padded_num = str(number).zfill(3)
+        if not 0 <= number < MAX_BOARDS:
+            raise ValueError(f'board IDs go from 0 to {MAX_BOARDS - 1}')
+        padded_num = str(number).zfill(3 if number < 1000 else 4)
         self.write_str(f'#SID,{padded_num};')
 
+    def set_relay(self, enabled):
+        self.write_str(f'#RLY,{1 if enabled else 0};')
+
     def read_id(self):
         self.write_str(f'#RID,;')
         self.serial.read_until('\n')
 
     def kill(self, ids):
-        indices = (id for id in ids)
-        bits = bitstring.BitArray('0x' + ('0' * 128))
-        bits.set(1, indices)
+        self.kill_bitmap(PyroBitmap(ids))
+
+    def kill_bitmap(self, bitmap):
+        # Once IDs past 511 are in use, keep sending every page up to there
+        # so pages that empty out are cleared too.
+        self.pages = max(self.pages, len(bitmap.pages))
 
-        final_bit_str = "".join(byte_str[::-1] for byte_str in chunks(bits.bin, 8))
-        final_bits = bitstring.BitArray(f'0b{final_bit_str}')
-        self.write_str(f'#DET,{final_bits.hex};')
+        if self.binary:
+            self._kill_binary(bitmap)
+            return
+
+        for page in range(self.pages):
+            if self.pages == 1:
+                self.write_str(f'#DET,{bitmap.page_hex(page)};')
+            else:
+                self.write_str(f'#DEP,{page},{bitmap.page_hex(page)};')
+
+    def _kill_binary(self, bitmap):
+        # Only what changed since the last acknowledged update, or every
+        # page again when nothing did, which repairs a transmitter that reset.
+        if self.sent_bitmap is not None and bitmap != self.sent_bitmap:
+            entries = bitmap.changes(self.sent_bitmap)
+            ok = all(self._send_frame(UART_DELTA, struct.pack(f'<{len(chunk)}H', *chunk))
+                     for chunk in chunks(entries, UART_MAX_PAYLOAD // 2))
+        else:
+            ok = True
+            for page in range(self.pages):
+                ok = self._send_frame(UART_PAGE, bytes([page]) + bitmap.page_bytes(page)) and ok
+        self.sent_bitmap = bitmap.copy() if ok else None
 
     def arm(self, armed):
+        if self.binary:
+            self._send_frame(UART_ARM, bytes([1 if armed else 0]))
+            return
         self.write_str(f'#ARM,{1 if armed else 0};')
 
+    def set_delay(self, ms):
+        if self.binary:
+            self._send_frame(UART_DELAY, struct.pack('<H', ms))
+            return
+        self.write_str(f'#DLY,{str(ms).zfill(4)};')
+
+    def confirmed(self):
+        # IDs that report having detonated, every ID heard lately, and the
+        # number of status slots: IDs from there on never report
+        detonated, heard, slots = set(), set(), None
+        for page in range(self.pages):
+            self.write_str(f'#CFM,{page};')
+            # Skip any log output ahead of the reply
+            line = ''
+            for _ in range(20):
+                line = self.read_line().decode('utf-8', 'replace').strip()
+                if line.startswith('#CFM'):
+                    break
+            fields = line.rstrip(';').split(',')
+            if len(fields) != 5 or fields[0] != '#CFM':
+                log(f"error: unexpected reply {line!r}")
+                continue
+            slots = int(fields[4])
+            for ids, hex_bits in ((detonated, fields[2]), (heard, fields[3])):
+                for i, byte in enumerate(bytes.fromhex(hex_bits)):
+                    ids.update(page * 512 + i * 8 + bit for bit in range(8) if byte & (1 << bit))
+        return detonated, heard, slots
+
+    def latency(self, clear=False):
+        # The counters line, then one line per receive path stage
+        self.write_str('#LAT,1;' if clear else '#LAT,;')
+        counters, stages = {}, {}
+        for _ in range(40):
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if not line.startswith('#LAT,'):
+                continue
+            fields = line.rstrip(';').split(',')[1:]
+            if fields[0].startswith('cpu='):
+                counters = dict(field.split('=') for field in fields)
+                continue
+            buckets = [int(count) for count in fields[3].split('.')]
+            stages[fields[0]] = (int(fields[1][2:]), int(fields[2][4:]), buckets)
+            if fields[0] == 'fire':
+                break
+        return counters, stages
+
+    def flight_recorder(self, saved=False):
+        # One line per event, up to the #FLR,end line
+        name = '#FLS' if saved else '#FLR'
+        self.write_str(f'{name},;')
+        events = []
+        while True:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if not line.startswith(name + ','):
+                continue
+            fields = line.rstrip(';').split(',')[1:]
+            if fields[0] in ('end', 'none'):
+                return events
+            events.append(fields)
+
+    def power(self):
+        # A single #PWR line of name=value pairs
+        self.write_str('#PWR,;')
+        while True:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if line.startswith('#PWR,'):
+                return {name: int(value) for name, value in
+                        (field.split('=') for field in line.rstrip(';').split(',')[1:])}
+
+    def boot(self):
+        # Reset reason, then each boot stage as begin+duration in us or '-'
+        self.write_str('#BPR,;')
+        while True:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if line.startswith('#BPR,'):
+                return dict(field.split('=') for field in line.rstrip(';').split(',')[1:])
+
+    def group(self):
+        # A single #TXG line of name=value pairs
+        self.write_str('#TXG,;')
+        while True:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if line.startswith('#TXG,'):
+                return {name: int(value) for name, value in
+                        (field.split('=') for field in line.rstrip(';').split(',')[1:])}
+
+    def channels(self):
+        # A summary line, then one line per channel
+        self.write_str('#CHS,;')
+        summary, channels = None, {}
+        while summary is None or len(channels) < summary['count']:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if not line.startswith('#CHS,'):
+                continue
+            fields = line.rstrip(';').split(',')[1:]
+            if fields[0].startswith('count='):
+                summary = {name: int(value) for name, value in (field.split('=') for field in fields)}
+            else:
+                channels[int(fields[0])] = {name: int(value) for name, value in
+                                            (field.split('=') for field in fields[1:])}
+        return summary, channels
+
+    def set_trace(self, enabled):
+        # Streaming on or off, then the #TRC line of name=value pairs
+        self.write_str(f'#TRC,{1 if enabled else 0};')
+        while True:
+            line = self.read_line().decode('utf-8', 'replace').strip()
+            if line.startswith('#TRC,'):
+                return {name: int(value) for name, value in
+                        (field.split('=') for field in line.rstrip(';').split(',')[1:])}
+
     def reset(self):
         self.serial.dtr = False
         self.serial.dtr = True
 
 
 if __name__ == '__main__':
+    def open_board(args):
+        return Board(args.device, args.baud, args.binary, Trace(args.trace) if args.trace else None)
+
     def set_board_id(args):
-        board = Board(args.device)
+        if not 0 <= args.number < MAX_BOARDS:
+            parser.error(f'board IDs go from 0 to {MAX_BOARDS - 1}')
+        board = open_board(args)
         time.sleep(1)
         board.set_id(args.number)
 
+    def set_relay(args):
+        board = open_board(args)
+        time.sleep(1)
+        board.set_relay(args.enabled == 'on')
+
     def read_board_id(args):
-        board = Board(args.device)
+        board = open_board(args)
         time.sleep(1)
         board.read_id()
 
     def kill(args):
-        board = Board(args.device)
+        board = open_board(args)
         time.sleep(1)
         board.kill(args.ids)
 
     def arm(args):
-        board = Board(args.device)
+        board = open_board(args)
         time.sleep(1)
         board.arm(True)
 
     def disarm(args):
-        board = Board(args.device)
+        board = open_board(args)
         time.sleep(1)
         board.arm(False)
 
+    def set_delay(args):
+        board = open_board(args)
+        time.sleep(1)
+        board.set_delay(args.ms)
+
+    def confirmed(args):
+        board = open_board(args)
+        board.pages = args.pages
+        time.sleep(1)
+        detonated, heard, slots = board.confirmed()
+        print('detonated:', ' '.join(str(id) for id in sorted(detonated)))
+        print('heard:', ' '.join(str(id) for id in sorted(heard)))
+        if slots is not None:
+            print(f'no status slot: IDs {slots} and above')
+
+    def latency(args):
+        board = open_board(args)
+        time.sleep(1)
+        counters, stages = board.latency(args.clear)
+        mhz = int(counters.get('cpu', 160))
+        print(' '.join(f'{name}={value}' for name, value in counters.items() if name != 'cpu'))
+        for name, (count, longest, buckets) in stages.items():
+            # Bucket b holds times below 2^(b+6) cycles
+            def percentile(p):
+                seen = 0
+                for b, n in enumerate(buckets):
+                    seen += n
+                    if seen > p * (count - 1):
+                        return (1 << (b + 6)) / mhz
+                return longest / mhz
+            print(f'{name:8} n {count:8}  p50 <{percentile(0.5):.1f} us  p99 <{percentile(0.99):.1f} us  '
+                  f'max {longest / mhz:.1f} us' if count else f'{name:8} n 0')
+
+    def flight(args):
+        board = open_board(args)
+        time.sleep(1)
+        for ticks, *event in board.flight_recorder(args.saved):
+            print(f'{int(ticks) / 1000:10.3f} s  {" ".join(event)}')
+
+    def power(args):
+        board = open_board(args)
+        time.sleep(1)
+        p = board.power()
+        print(f"low power {'on' if p['low_power'] else 'off'}, up {p['uptime'] / 1000:.0f} s")
+        print(f"timer     {p['irqs']} interrupts, {p['irq_per_s']} per s")
+        print(f"radio     on {p['radio_on']}%, {p['sleeps']} sleeps, {p['sleep_ms'] / 1000:.1f} s asleep")
+        print(f"current   ~{p['est_ma']} mA")
+
+    def boot(args):
+        board = open_board(args)
+        time.sleep(1)
+        b = board.boot()
+        print(f"reset       {b.pop('reset')}")
+        for stage, timing in b.items():
+            if timing == '-':
+                print(f"{stage:<12}-")
+            else:
+                begin, took = (int(t) for t in timing.split('+'))
+                print(f"{stage:<12}{begin / 1000:8.1f} ms  took {took / 1000:.1f} ms")
+
+    def group(args):
+        board = open_board(args)
+        time.sleep(1)
+        g = board.group()
+        if 'id' in g:
+            print(f"transmitter {g['id']}, {'on duty' if g['duty'] else 'off duty'}"
+                  f"{', hot standby' if g['standby'] else ''}")
+            print(f"duty        {g['takeovers']} takeovers, {g['handovers']} handovers")
+            print(f"held back   {g['holds']} times for a newer state")
+            heard = 'heard'
+        else:
+            heard = 'applied'
+        print(f"sequence    epoch {g['epoch']}, frame {g['seq']}")
+        for id in range(8):
+            if g[f'tx{id}']:
+                print(f"tx {id}        {g[f'tx{id}']} frames {heard}")
+
+    def channels(args):
+        board = open_board(args)
+        time.sleep(1)
+        summary, channels = board.channels()
+        mode = 'hop' if summary['hop'] else ('locked' if summary['locked'] else 'scanning')
+        print(f"on channel {summary['channel']}" + (f", {mode}" if summary['count'] > 1 else ''))
+        print(f"changes    {summary['switches']}, {summary['scans']} scans")
+        for channel, c in channels.items():
+            print(f"channel {channel:<3}{c['frames']:8} frames  {c['lost']:6} lost  {c['listen_ms'] / 1000:8.1f} s listening")
+
+    def trace(args):
+        if not args.trace:
+            parser.error('trace needs --trace')
+        board = open_board(args)
+        time.sleep(1)
+        if not board.set_trace(True)['on']:
+            log("error: this board was built without CONFIG_ESPNOW_TRACE")
+            return
+        log(f"tracing to {args.trace}, ^C to stop")
+        try:
+            while True:
+                print(board.read_line().decode('utf-8', 'replace'), end='')
+        except KeyboardInterrupt:
+            pass
+        t = board.set_trace(False)
+        log(f"{t['made']} records made, {t['dropped']} dropped by the board")
+
     def reset(args):
-        board = Board(args.device)
+        board = open_board(args)
         board.reset()
         time.sleep(1)
 
@@ -84,11 +624,18 @@ if __name__ == '__main__':
     subparsers = parser.add_subparsers()
 
     parser.add_argument('--device', type=str, help='The location of the USB device the board is mounted to (/dev/ttyXXX)')
+    parser.add_argument('--baud', type=int, help='Serial baud rate, as set in menuconfig. Defaults to 115200', default=115200)
+    parser.add_argument('--binary', action='store_true', help='Talk to a transmitter in binary frames instead of ASCII commands', default=False)
+    parser.add_argument('--trace', type=str, help='Write what is sent to the board, and what it streams back while tracing, to this trace file')
 
     set_board_id_command = subparsers.add_parser('set-board-id')
     set_board_id_command.add_argument('number', type=int)
     set_board_id_command.set_defaults(func=set_board_id)
 
+    set_relay_command = subparsers.add_parser('set-relay')
+    set_relay_command.add_argument('enabled', choices=['on', 'off'])
+    set_relay_command.set_defaults(func=set_relay)
+
     read_board_id_command = subparsers.add_parser('read-board-id')
     read_board_id_command.set_defaults(func=read_board_id)
 
@@ -102,6 +649,37 @@ if __name__ == '__main__':
     disarm_command = subparsers.add_parser('disarm')
     disarm_command.set_defaults(func=disarm)
 
+    set_delay_command = subparsers.add_parser('set-delay')
+    set_delay_command.add_argument('ms', type=int)
+    set_delay_command.set_defaults(func=set_delay)
+
+    confirmed_command = subparsers.add_parser('confirmed')
+    confirmed_command.add_argument('--pages', type=int, help='Bitmap pages to read. Defaults to 1', default=1)
+    confirmed_command.set_defaults(func=confirmed)
+
+    latency_command = subparsers.add_parser('latency')
+    latency_command.add_argument('--clear', action='store_true', help='Start the histograms again after reading them', default=False)
+    latency_command.set_defaults(func=latency)
+
+    flight_command = subparsers.add_parser('flight')
+    flight_command.add_argument('--saved', action='store_true', help='Read the copy saved on the first detonation', default=False)
+    flight_command.set_defaults(func=flight)
+
+    power_command = subparsers.add_parser('power')
+    power_command.set_defaults(func=power)
+
+    boot_command = subparsers.add_parser('boot')
+    boot_command.set_defaults(func=boot)
+
+    group_command = subparsers.add_parser('group')
+    group_command.set_defaults(func=group)
+
+    channels_command = subparsers.add_parser('channels')
+    channels_command.set_defaults(func=channels)
+
+    trace_command = subparsers.add_parser('trace')
+    trace_command.set_defaults(func=trace)
+
     reset_command = subparsers.add_parser('reset')
     reset_command.set_defaults(func=reset)
 
@@ -1,11 +1,14 @@
 import argparse
 import asyncio
+import atexit
 import json
 import websockets
 import os
+import queue
 import threading
 import time
-from transmit import Board, log
+import zlib
+from transmit import Board, PyroBitmap, Trace, log
 from json import JSONEncoder
 import argparse
 
@@ -28,12 +31,31 @@ def default_players(count: int):
     }
 
 class PlayerController(object):
+    """Keeps the players in memory, and on disk as a snapshot (filename, the
+    state.json format) plus a journal of the changes made since
+    (filename + '.journal').
+
+    Changes are queued for a writer thread, which appends them to the
+    journal with one fsync per batch and now and then folds the journal
+    into a new snapshot, so the event handler never waits on the disk. The
+    journal starts with the CRC of the snapshot it follows; a journal left
+    over from another snapshot (state.json replaced or deleted by hand) is
+    ignored."""
+
+    JOURNAL_SUFFIX = '.journal'
+    COMPACT_RECORDS = 1024   # Journal records that trigger a new snapshot
+    COMPACT_INTERVAL = 10    # Seconds before a journal with anything in it is folded in
+
     def __init__(self, filename: str, default_player_count: int, is_revive_allowed: bool=False):
         self.is_revive_allowed = is_revive_allowed
+        self.filename = filename
+        self.journal_filename = filename + self.JOURNAL_SUFFIX
+        snapshot = None
         if os.path.exists(filename):
             try:
-                with open(filename) as existing_file:
-                    raw_players = json.load(existing_file)
+                with open(filename, 'rb') as existing_file:
+                    snapshot = existing_file.read()
+                    raw_players = json.loads(snapshot)
                     self.players = {}
                     for n, player_json in raw_players.items():
                         new_player = Player(
@@ -45,16 +67,116 @@ class PlayerController(object):
             except BaseException as err:
                 log(f'existing JSON file was malformed ({err}), moving to {filename}.malformed')
                 self.players = default_players(default_player_count)
+                snapshot = None
         else:
             self.players = default_players(default_player_count)
+        if snapshot is not None:
+            self._replay_journal(zlib.crc32(snapshot))
+        # Kept up to date with every change, for the transmitters
+        self.dead = PyroBitmap(n for n, player in self.players.items() if not player.is_alive)
+
+        self._lock = threading.Lock()
+        self._disk_lock = threading.Lock()
+        self._pending = queue.Queue()
+        self._journal_records = 0
+        self._journal = None
+        self.write_state_to_file(self._snapshot())
+        threading.Thread(target=self._write_loop, daemon=True).start()
+        atexit.register(self.close)
+
+    def _replay_journal(self, crc):
+        try:
+            with open(self.journal_filename, 'rb') as journal:
+                lines = journal.read().split(b'\n')
+        except FileNotFoundError:
+            return
+        try:
+            header = json.loads(lines[0])
+        except ValueError:
+            header = None
+        if not isinstance(header, dict) or header.get('snapshot') != crc:
+            log(f'ignoring {self.journal_filename}, it does not follow {self.filename}')
+            return
+        # The last line is empty, or a record cut short by a crash
+        replayed = 0
+        for line in lines[1:-1]:
+            try:
+                number, is_alive = json.loads(line)
+            except ValueError:
+                break
+            if number in self.players:
+                self.players[number].is_alive = bool(is_alive)
+                replayed += 1
+        log(f'replayed {replayed} changes from {self.journal_filename}')
+
+    def _snapshot(self):
+        return {n: player.is_alive for n, player in self.players.items()}
 
-        self._file = open(filename, 'w+')
-        self.write_state_to_file()
+    def write_state_to_file(self, alive):
+        """Replaces the snapshot with `alive` and starts an empty journal after it."""
+        players = {n: Player(is_alive=is_alive, number=n) for n, is_alive in alive.items()}
+        data = json.dumps(players, cls=DumpEncoder, indent=2, sort_keys=True).encode('utf-8')
+        temporary = self.filename + '.tmp'
+        with open(temporary, 'wb') as snapshot_file:
+            snapshot_file.write(data)
+            snapshot_file.flush()
+            os.fsync(snapshot_file.fileno())
+        os.replace(temporary, self.filename)
 
-    def write_state_to_file(self):
-        self._file.seek(0)
-        json.dump(self.players, self._file, cls=DumpEncoder, indent=2, sort_keys=True)
-        self._file.truncate()
+        if self._journal is not None:
+            os.close(self._journal)
+        self._journal = os.open(self.journal_filename, os.O_WRONLY | os.O_CREAT | os.O_TRUNC | os.O_APPEND, 0o644)
+        os.write(self._journal, json.dumps({'snapshot': zlib.crc32(data)}).encode('utf-8') + b'\n')
+        os.fsync(self._journal)
+        self._journal_records = 0
+        self._compacted_at = time.monotonic()
+
+    def _append(self, records):
+        if records:
+            os.write(self._journal, b''.join(b'[%d,%d]\n' % record for record in records))
+            os.fsync(self._journal)
+            self._journal_records += len(records)
+
+    def _take_pending(self, records):
+        while True:
+            try:
+                records.append(self._pending.get_nowait())
+            except queue.Empty:
+                return records
+
+    def _compact(self):
+        # The snapshot has to hold exactly what the journal does, so nothing
+        # may be queued between taking the two
+        with self._lock:
+            records = self._take_pending([])
+            alive = self._snapshot()
+        # A crash after the snapshot is replaced leaves a journal that no
+        # longer matches it, which is ignored, so it only has to be whole
+        # until then
+        self._append(records)
+        self.write_state_to_file(alive)
+
+    def _write_loop(self):
+        while True:
+            wait = max(0, self._compacted_at + self.COMPACT_INTERVAL - time.monotonic())
+            try:
+                records = self._take_pending([self._pending.get(timeout=wait if self._journal_records else None)])
+            except queue.Empty:
+                records = []
+            try:
+                with self._disk_lock:
+                    self._append(records)
+                    if self._journal_records >= self.COMPACT_RECORDS or \
+                            (self._journal_records and time.monotonic() - self._compacted_at >= self.COMPACT_INTERVAL):
+                        self._compact()
+            except OSError as err:
+                log(f'error: could not write the state ({err})')
+                time.sleep(1)
+
+    def close(self):
+        # Folds everything in, so state.json alone has the whole state
+        with self._disk_lock:
+            self._compact()
 
     def set_player_liveness(self, number, is_alive):
         if is_alive and not self.is_revive_allowed:
@@ -63,7 +185,11 @@ class PlayerController(object):
 
         player = self.players[number]
         if player:
-            player.is_alive = is_alive
+            if player.is_alive != is_alive:
+                with self._lock:
+                    player.is_alive = is_alive
+                    self._pending.put((number, 1 if is_alive else 0))
+                self.dead.set(number, not is_alive)
             log(f'player {number} has been {"revived" if is_alive else "eliminated"}')
         else:
             log(f'error: unknown player {number}')
@@ -81,15 +207,121 @@ class PlayerController(object):
         })
 
     def dead_player_ids(self):
-        ids = []
-        for id, player in self.players.items():
-            if not player.is_alive:
-                ids.append(id)
-        return ids
+        return self.dead.ids()
+
+class Boards(object):
+    """Every transmitter of the game gets the same commands.
 
+    kill and arm only post the state wanted and return. Each transmitter
+    has a writer thread, the only one writing to its port, which sends the
+    newest state as soon as the port is free, so updates posted while it is
+    busy go out as one. A second after it last sent anything it sends the
+    whole state again, so a transmitter that reset catches up; a standby
+    stays quiet until it has had both."""
 
-    def __del__(self):
-        self._file.close()
+    def __init__(self, boards):
+        self.boards = boards
+        self.armed = False
+        self.dead = None                    # PyroBitmap, None until kills are posted
+        self.changed = threading.Condition()
+        self.writers = [SerialWriter(board, self) for board in boards]
+
+    def start(self):
+        for writer in self.writers:
+            threading.Thread(target=writer.run, daemon=True).start()
+
+    def _post(self, **state):
+        with self.changed:
+            for name, value in state.items():
+                setattr(self, name, value)
+            now = time.monotonic()
+            for writer in self.writers:
+                writer.posted(now)
+            self.changed.notify_all()
+
+    def kill(self, dead):
+        # A copy, as the writers read it while the game goes on
+        self._post(dead=dead.copy())
+
+    def arm(self, armed):
+        self._post(armed=armed)
+
+class SerialWriter(object):
+    HEARTBEAT = 1            # Seconds without sending before the whole state goes again
+    REPORT_INTERVAL = 60     # Seconds between metrics lines
+
+    def __init__(self, board, boards):
+        self.board = board
+        self.boards = boards
+        self.pending = 0
+        self.pending_since = None
+        self.sent_dead = None
+        self.sent_armed = False
+        self.updates = 0
+        self.coalesced = 0
+        self.heartbeats = 0
+        self.latency = []
+        self.reported_at = time.monotonic()
+
+    def posted(self, now):
+        # Called with boards.changed held
+        if self.pending_since is None:
+            self.pending_since = now
+        self.pending += 1
+
+    def run(self):
+        heartbeat_at = time.monotonic() + self.HEARTBEAT
+        while True:
+            with self.boards.changed:
+                self.boards.changed.wait_for(lambda: self.pending, timeout=max(0, heartbeat_at - time.monotonic()))
+                dead, armed = self.boards.dead, self.boards.armed
+                since, pending = self.pending_since, self.pending
+                self.pending_since, self.pending = None, 0
+
+            heartbeat = since is None
+            send_dead = dead is not None and (heartbeat or dead != self.sent_dead)
+            send_arm = (heartbeat and dead is not None) or armed != self.sent_armed
+            if not send_dead and not send_arm:
+                if heartbeat:
+                    heartbeat_at = time.monotonic() + self.HEARTBEAT
+                continue
+
+            try:
+                # Disarming goes first, arming last, after the bitmap it arms
+                if send_arm and not armed:
+                    self.board.arm(False)
+                if send_dead:
+                    self.board.kill_bitmap(dead)
+                if send_arm and armed:
+                    self.board.arm(True)
+                self.sent_dead, self.sent_armed = dead, armed
+            except OSError as err:
+                log(f'error: could not write to {self.board.serial.port} ({err})')
+                self.sent_dead = None
+                time.sleep(self.HEARTBEAT)
+
+            done = time.monotonic()
+            heartbeat_at = done + self.HEARTBEAT
+            if heartbeat:
+                self.heartbeats += 1
+            else:
+                self.updates += 1
+                self.coalesced += pending - 1
+                self.latency.append(done - since)
+            if done - self.reported_at >= self.REPORT_INTERVAL:
+                self.report(done)
+
+    def report(self, now):
+        if self.latency:
+            latency = sorted(self.latency)
+            def percentile(p):
+                return latency[min(len(latency) - 1, int(p / 100 * len(latency)))] * 1000
+            log(f'{self.board.serial.port}: {self.updates} updates, {self.coalesced} coalesced, '
+                f'{self.heartbeats} heartbeats, click-to-serial p50 {percentile(50):.1f} '
+                f'p99 {percentile(99):.1f} max {latency[-1] * 1000:.1f} ms')
+        self.updates = self.coalesced = self.heartbeats = 0
+        self.latency = []
+        self.reported_at = now
 
 class Server(object):
     def __init__(self, player_controller, board, disable_kills):
@@ -115,10 +347,8 @@ class Server(object):
                     for number_to_toggle in numbers_to_toggle:
                         is_alive = action == "revive"
                         self.player_controller.set_player_liveness(number_to_toggle, is_alive)
-                    self.player_controller.write_state_to_file()
-                    dead_players = self.player_controller.dead_player_ids()
                     if not self.disable_kills:
-                        self.board.kill(dead_players)
+                        self.board.kill(self.player_controller.dead)
                     update_data = self.player_controller.generate_update_event()
                     websockets.broadcast(self.connected_clients, update_data)
                 elif action == "arm":
@@ -139,32 +369,37 @@ class Server(object):
 
 async def main():
     parser = argparse.ArgumentParser()
-    parser.add_argument('device', help='The file on disk where the device is mounted')
+    parser.add_argument('device', nargs='+', help='The file on disk where the device is mounted, one per transmitter')
     parser.add_argument('--players', type=int, help='The number of players playing, defaults to 456', default=456)
     parser.add_argument('--allow-revive', action='store_true', help='Whether to allow reviving players. Defaults to False.', default=False)
     parser.add_argument('--disable-kills', action='store_true', help='Whether to send detonation reqeusts to boards. Defaults to False.', default=False)
+    parser.add_argument('--baud', type=int, help='Serial baud rate, as set in menuconfig. Defaults to 115200', default=115200)
+    parser.add_argument('--binary', action='store_true', help='Send binary frames to the transmitter instead of ASCII commands. Defaults to False.', default=False)
+    parser.add_argument('--trace', type=str, help='Trace each transmitter to this file, with .1, .2 and so on added after the first')
     args = parser.parse_args()
-    board = Board(args.device)
+
+    def trace(i):
+        if not args.trace:
+            return None
+        return Trace(args.trace if i == 0 else f'{args.trace}.{i}')
+
+    board = Boards([Board(device, args.baud, args.binary, trace(i)) for i, device in enumerate(args.device)])
     player_controller = PlayerController('state.json', default_player_count=args.players, is_revive_allowed=args.allow_revive)
 
-    def read_loop():
+    def read_loop(transmitter):
         while True:
-            line = board.serial.read_until()
+            line = transmitter.read_line()
             log(f'<<< {line.decode("utf-8", "ignore")}', end='')
             time.sleep(0.1)
 
-    def send_detonation_loop():
-        while True:
-            time.sleep(1)
-            dead_players = player_controller.dead_player_ids()
-            if not args.disable_kills:
-                board.kill(dead_players)
-
-    read_thread = threading.Thread(target=read_loop)
-    read_thread.start()
+    for transmitter in board.boards:
+        if args.trace:
+            transmitter.write_str('#TRC,1;')
+        threading.Thread(target=read_loop, args=(transmitter,)).start()
 
-    detonation_update_loop = threading.Thread(target=send_detonation_loop)
-    detonation_update_loop.start()
+    if not args.disable_kills:
+        board.kill(player_controller.dead)
+    board.start()
 
     server = Server(player_controller, board, args.disable_kills)
     async with websockets.serve(server.run, "0.0.0.0", 8765):
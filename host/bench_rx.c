@@ -0,0 +1,492 @@
+/* Receive path benchmark
+
+   Pushes synthetic ESP-NOW frames through the real receive pipeline
+   (beastsquib_espnow_recv_cb -> beastsquib_espnow_task ->
+   beastsquib_validate_espnow_data_checksum -> espnow_broadcast_packet_recv_cb)
+   and reports throughput, per-frame latency percentiles and heap traffic,
+   next to the board's own #LAT histograms of each stage.
+
+   Frames are delivered in batches and the handler task is then run until
+   it has nothing left to do. Only the newest state frame of a batch for
+   each bitmap page is applied; the rest are overwritten in the page's
+   mailbox. A frame's latency is
+   measured from entry into the receive callback to the end of the handler
+   run that followed it, so larger batches include waiting time.
+
+   The receive path must not touch the heap; the benchmark fails if any
+   allocation is made while frames are flowing.
+
+   Usage: bench_rx [-n frames] [-b batch] [-c corrupt_percent] [-f foreign_percent]
+                   [-d duplicate_percent] [-p pages] [-L] [-i board_id] [-s seed]
+
+   Frames mix sparse ID lists with bitmap pages drawn from the first -p
+   pages, some followed by recently set IDs, so some of them do not carry
+   the receiver's own bit.
+
+   Corrupt frames pass the admission filter and fail the CRC; foreign frames
+   carry another magic number and are rejected before the hand-off;
+   duplicates repeat the previous frame's sequence number and must be
+   suppressed as stale. -L sends version 1 frames (a single 512-bit bitmap)
+   without sequence numbers.
+
+   Each frame is stamped with a fresh sequence number and CRC before it is
+   delivered. Stamping is not counted in the reported time.
+
+   Afterwards, for a board on each page in turn, a burst sets the board's
+   bit on its own page followed by a frame for every other page, all
+   delivered before the handler runs; the benchmark fails if the board does
+   not detonate.
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+
+#define BENCH_LEGACY_FRAME_LEN 200
+#define BENCH_FRAME_VARIANTS 256
+#define BENCH_MAX_BATCH 64
+#define BENCH_MAX_SPARSE_IDS 32
+#define BENCH_MAX_RECENT_IDS 20
+
+typedef struct {
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    int len;
+    int corrupt_at;
+    bool valid;
+    bool foreign;
+    bool duplicate;
+    bool armed;
+    bool covers;                          // Carries the receiver's own bit
+    bool detonate;
+} bench_frame_t;
+
+static bench_frame_t bench_frames[BENCH_FRAME_VARIANTS];
+static uint8_t bench_wire[BENCH_MAX_BATCH][ESP_NOW_MAX_DATA_LEN];
+static int bench_wire_len[BENCH_MAX_BATCH];
+static uint8_t bench_previous[ESP_NOW_MAX_DATA_LEN];
+static int bench_previous_len;
+
+static uint32_t bench_rand(uint32_t *state)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void bench_set_bit(uint8_t *bits, int id)
+{
+    bits[id / 8] |= (1 << (id % 8));
+}
+
+static bool bench_get_bit(const uint8_t *bits, int id)
+{
+    return (bits[id / 8] & (1 << (id % 8))) != 0;
+}
+
+/* The mailbox a frame goes to, as espnow_state_slot picks it. */
+static int bench_slot(const bench_frame_t *frame, bool legacy)
+{
+    const beastsquib_espnow_frame_t *data = (const beastsquib_espnow_frame_t *)frame->data;
+
+    if (legacy || BEASTSQUIB_FRAME_ENCODING(data->encoding) == BEASTSQUIB_ENCODING_SPARSE) {
+        return 0;
+    }
+    return data->page;
+}
+
+/* Version 1 frame: one 512-bit bitmap, padded to the length old
+ * transmitters sent. */
+static void bench_build_legacy(bench_frame_t *frame, int id, uint32_t *seed)
+{
+    beastsquib_espnow_data_t *data = (beastsquib_espnow_data_t *)frame->data;
+
+    data->armed = (bench_rand(seed) % 8) != 0;
+    for (int i = 0; i < sizeof(data->pyro_bits); i ++) {
+        data->pyro_bits[i] = bench_rand(seed);
+    }
+    frame->len = BENCH_LEGACY_FRAME_LEN;
+    frame->armed = data->armed == 1;
+    frame->covers = true;
+    frame->detonate = bench_get_bit(data->pyro_bits, id);
+}
+
+/* Version 3 frame: a quarter are sparse ID lists, the rest bitmap pages. */
+static void bench_build_v3(bench_frame_t *frame, int id, int pages, uint32_t *seed)
+{
+    beastsquib_espnow_frame_t *data = (beastsquib_espnow_frame_t *)frame->data;
+
+    data->armed = (bench_rand(seed) % 8) != 0;
+    frame->armed = data->armed == 1;
+
+    if (bench_rand(seed) % 4 == 0) {
+        int count = bench_rand(seed) % BENCH_MAX_SPARSE_IDS;
+        bool includes_own = bench_rand(seed) % 2;
+
+        data->encoding = BEASTSQUIB_ENCODING_SPARSE;
+        frame->detonate = false;
+        for (int i = 0; i < count; i ++) {
+            uint16_t set = (includes_own && i == count / 2) ? id : bench_rand(seed) % (pages * BEASTSQUIB_PAGE_BITS);
+            data->payload[2*i] = set & 0xFF;
+            data->payload[2*i + 1] = set >> 8;
+            frame->detonate |= (set == id);
+        }
+        frame->len = sizeof(beastsquib_espnow_frame_t) + count * sizeof(uint16_t);
+        frame->covers = true;
+    } else {
+        data->encoding = BEASTSQUIB_ENCODING_BITMAP;
+        data->page = bench_rand(seed) % pages;
+        for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+            data->payload[i] = bench_rand(seed);
+        }
+        frame->len = sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES;
+        frame->covers = data->page == id / BEASTSQUIB_PAGE_BITS;
+        frame->detonate = bench_get_bit(data->payload, id % BEASTSQUIB_PAGE_BITS);
+
+        // Half the bitmap frames repeat recently set IDs after the page.
+        // Listing the receiver tells it to detonate even from another page.
+        if (bench_rand(seed) % 2) {
+            uint8_t *recent = data->payload + BEASTSQUIB_PAGE_BYTES;
+            int count = bench_rand(seed) % BENCH_MAX_RECENT_IDS;
+            bool includes_own = (bench_rand(seed) % 2) && (!frame->covers || frame->detonate);
+
+            data->encoding = BEASTSQUIB_ENCODING_BITMAP_RECENT;
+            for (int i = 0; i < count; i ++) {
+                uint16_t set = bench_rand(seed) % (pages * BEASTSQUIB_PAGE_BITS);
+                if (includes_own && i == count / 2) {
+                    set = id;
+                } else if (set == id) {
+                    set = (id + 1) % (pages * BEASTSQUIB_PAGE_BITS);
+                }
+                recent[2*i] = set & 0xFF;
+                recent[2*i + 1] = set >> 8;
+                if (set == id) {
+                    frame->covers = true;
+                    frame->detonate = true;
+                }
+            }
+            frame->len += count * sizeof(uint16_t);
+        }
+    }
+}
+
+static void bench_build_frames(int id, int pages, bool legacy, int corrupt_percent,
+                               int foreign_percent, int duplicate_percent, uint32_t seed)
+{
+    for (int f = 0; f < BENCH_FRAME_VARIANTS; f ++) {
+        bench_frame_t *frame = &bench_frames[f];
+
+        memset(frame->data, 0, sizeof(frame->data));
+        if (legacy) {
+            bench_build_legacy(frame, id, &seed);
+        } else {
+            bench_build_v3(frame, id, pages, &seed);
+        }
+
+        // Inside the epoch and sequence number of a version 3 frame, the
+        // bitmap of a version 1 frame; either way only the CRC catches it
+        frame->corrupt_at = 12 + bench_rand(&seed) % 6;
+        frame->valid = (int)(bench_rand(&seed) % 100) >= corrupt_percent;
+        frame->foreign = (int)(bench_rand(&seed) % 100) < foreign_percent;
+        frame->duplicate = (int)(bench_rand(&seed) % 100) < duplicate_percent;
+        if (frame->foreign) {
+            frame->valid = false;
+        }
+    }
+}
+
+/* Produces the bytes put on the air for a frame: a fresh sequence number
+ * and CRC, or a repeat of the previous frame for duplicates. Returns the
+ * frame length. */
+static int bench_stamp(const bench_frame_t *frame, uint8_t *wire, bool legacy)
+{
+    beastsquib_espnow_send_param_t send_param = {
+        .magic = BEASTSQUIB_MAGIC_NUMBER,
+        .len = frame->len,
+        .buffer = wire,
+    };
+    beastsquib_espnow_frame_t *data = (beastsquib_espnow_frame_t *)wire;
+
+    if (frame->duplicate && bench_previous_len > 0) {
+        memcpy(wire, bench_previous, bench_previous_len);
+        return bench_previous_len;
+    }
+
+    memcpy(wire, frame->data, frame->len);
+
+    if (legacy) {
+        data->magic = BEASTSQUIB_MAGIC_NUMBER;
+        data->version = 1;
+        data->crc = 0;
+        data->crc = crc16_le(UINT16_MAX, wire, frame->len);
+    } else {
+        beastsquib_espnow_data_prepare(&send_param);
+    }
+
+    if (!frame->valid) {
+        wire[frame->corrupt_at] ^= 0x5A;
+    }
+
+    if (frame->foreign) {
+        data->magic ^= 0x10000;
+    }
+
+    memcpy(bench_previous, wire, frame->len);
+    bench_previous_len = frame->len;
+
+    return frame->len;
+}
+
+/* An armed bitmap frame for one page, with only the given board's bit set
+ * if detonate. */
+static int bench_page_frame(uint8_t *wire, int page, int id, bool detonate)
+{
+    bench_frame_t frame = { .valid = true };
+    beastsquib_espnow_frame_t *data = (beastsquib_espnow_frame_t *)frame.data;
+
+    data->armed = 1;
+    data->encoding = BEASTSQUIB_ENCODING_BITMAP;
+    data->page = page;
+    if (detonate) {
+        bench_set_bit(data->payload, id % BEASTSQUIB_PAGE_BITS);
+    }
+    frame.len = sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES;
+    return bench_stamp(&frame, wire, false);
+}
+
+/* For a board on each page: a burst setting its bit, then a frame for
+ * every other page, all in before the handler runs. Returns the pages
+ * whose board did not detonate. */
+static int bench_interleaved_pages(const uint8_t *tx_mac)
+{
+    int saved_id = board_id;
+    int lost = 0;
+
+    for (int own = 0; own < BEASTSQUIB_MAX_PAGES; own ++) {
+        board_id = own * BEASTSQUIB_PAGE_BITS + 5;
+
+        int len = bench_page_frame(bench_wire[0], own, board_id, false);
+        host_espnow_recv_cb(tx_mac, bench_wire[0], len);
+        host_run_task("beastsquib_espnow_task");
+
+        len = bench_page_frame(bench_wire[0], own, board_id, true);
+        host_espnow_recv_cb(tx_mac, bench_wire[0], len);
+        for (int page = 0; page < BEASTSQUIB_MAX_PAGES; page ++) {
+            if (page != own) {
+                len = bench_page_frame(bench_wire[0], page, board_id, false);
+                host_espnow_recv_cb(tx_mac, bench_wire[0], len);
+            }
+        }
+        host_run_task("beastsquib_espnow_task");
+
+        lost += host_gpio_level[GPIO_OUTPUT_PYRO] != HIGH;
+    }
+
+    board_id = saved_id;
+    return lost;
+}
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(const uint32_t *sorted, size_t count, double p)
+{
+    size_t idx = (size_t)(p * (double)(count - 1));
+    return sorted[idx];
+}
+
+/* Upper bound in ns of the bucket holding the p'th time of an on-board histogram. */
+static uint32_t bench_hist_percentile(const beastsquib_latency_hist_t *hist, double p)
+{
+    uint32_t target = (uint32_t)(p * (double)(hist->count - 1));
+    uint32_t seen = 0;
+    int b = 0;
+
+    for (; b < BEASTSQUIB_LATENCY_BUCKETS - 1; b ++) {
+        seen += hist->bucket[b];
+        if (seen > target) {
+            break;
+        }
+    }
+    return (uint32_t)(((uint64_t)1 << (b + BEASTSQUIB_LATENCY_MIN_BITS)) * 1000 / CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ);
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = 2000000;
+    int batch = 1;
+    int corrupt_percent = 0;
+    int foreign_percent = 0;
+    int duplicate_percent = 0;
+    int pages = 1;
+    bool legacy = false;
+    int id = 217;
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:c:f:d:p:Li:s:")) != -1) {
+        switch (opt) {
+            case 'n': frames = strtoull(optarg, NULL, 10); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'c': corrupt_percent = atoi(optarg); break;
+            case 'f': foreign_percent = atoi(optarg); break;
+            case 'd': duplicate_percent = atoi(optarg); break;
+            case 'p': pages = atoi(optarg); break;
+            case 'L': legacy = true; break;
+            case 'i': id = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-b batch] [-c corrupt_percent] [-f foreign_percent] [-d duplicate_percent] [-p pages] [-L] [-i board_id] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    int max_id = (legacy ? 1 : pages) * BEASTSQUIB_PAGE_BITS - 1;
+    if (batch < 1 || batch > BENCH_MAX_BATCH || frames == 0 || pages < 1 || pages > BEASTSQUIB_MAX_PAGES ||
+        id < 0 || id > max_id || seed == 0) {
+        fprintf(stderr, "invalid arguments (batch 1..%d, pages 1..%d, board_id 0..%d, seed != 0)\n",
+                BENCH_MAX_BATCH, BEASTSQUIB_MAX_PAGES, max_id);
+        return 2;
+    }
+
+    if (beastsquib_espnow_init() != ESP_OK || host_espnow_recv_cb == NULL) {
+        fprintf(stderr, "espnow init failed\n");
+        return 1;
+    }
+    board_id = id;
+
+    bench_build_frames(id, pages, legacy, corrupt_percent, foreign_percent, duplicate_percent, seed);
+
+    uint32_t *latency = host_malloc(frames * sizeof(uint32_t));
+    uint64_t *recv_at = host_malloc(batch * sizeof(uint64_t));
+    if (latency == NULL || recv_at == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    const uint8_t tx_mac[ESP_NOW_ETH_ALEN] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+    bool model_armed = false;
+    int model_pyro = LOW;
+    size_t mismatches = 0;
+    size_t valid_frames = 0;
+
+    uint64_t allocs_before = host_heap_allocs;
+    uint64_t frees_before = host_heap_frees;
+    uint64_t gpio_before = host_gpio_writes;
+    uint64_t elapsed = 0;
+    const bench_frame_t *previous = NULL;
+
+    size_t sent = 0;
+    while (sent < frames) {
+        const bench_frame_t *last[BEASTSQUIB_MAX_PAGES] = { NULL };
+        int last_at[BEASTSQUIB_MAX_PAGES];
+        int in_batch = 0;
+
+        for (int k = 0; k < batch && sent + k < frames; k ++) {
+            const bench_frame_t *frame = &bench_frames[(sent + k) % BENCH_FRAME_VARIANTS];
+            bench_wire_len[k] = bench_stamp(frame, bench_wire[k], legacy);
+        }
+
+        for (; in_batch < batch && sent + in_batch < frames; in_batch ++) {
+            const bench_frame_t *frame = &bench_frames[(sent + in_batch) % BENCH_FRAME_VARIANTS];
+            recv_at[in_batch] = host_now_ns();
+            host_espnow_recv_cb(tx_mac, bench_wire[in_batch], bench_wire_len[in_batch]);
+
+            // A duplicate carries the previous frame's contents
+            if (frame->duplicate && previous != NULL) {
+                frame = previous;
+            } else {
+                previous = frame;
+            }
+            valid_frames += frame->valid;
+            if (!frame->foreign) {
+                int slot = bench_slot(frame, legacy);
+                last[slot] = frame;
+                last_at[slot] = in_batch;
+            }
+        }
+
+        // Newest admitted state per page wins: those frames of the batch
+        // are applied, in the order they arrived
+        for (int k = 0; k < in_batch; k ++) {
+            for (int slot = 0; slot < BEASTSQUIB_MAX_PAGES; slot ++) {
+                if (last[slot] == NULL || last_at[slot] != k || !last[slot]->valid) {
+                    continue;
+                }
+                model_armed = last[slot]->armed;
+                if (model_armed && last[slot]->covers) {
+                    model_pyro = last[slot]->detonate ? HIGH : LOW;
+                }
+            }
+        }
+
+        host_run_task("beastsquib_espnow_task");
+        uint64_t done = host_now_ns();
+
+        for (int k = 0; k < in_batch; k ++) {
+            latency[sent + k] = (uint32_t)(done - recv_at[k]);
+        }
+        elapsed += done - recv_at[0];
+        sent += in_batch;
+
+        if (pyro_armed != model_armed || host_gpio_level[GPIO_OUTPUT_PYRO] != model_pyro) {
+            mismatches ++;
+        }
+    }
+
+    uint64_t allocs = host_heap_allocs - allocs_before;
+    uint64_t frees = host_heap_frees - frees_before;
+    uint64_t gpio_writes = host_gpio_writes - gpio_before;
+
+    qsort(latency, frames, sizeof(uint32_t), bench_compare_u32);
+
+    printf("frames          %zu (%zu valid, batch %d)\n", frames, valid_frames, batch);
+    printf("elapsed         %.3f s\n", (double)elapsed / 1e9);
+    printf("throughput      %.0f frames/s\n", (double)frames * 1e9 / (double)elapsed);
+    printf("latency ns      p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+           bench_percentile(latency, frames, 0.50),
+           bench_percentile(latency, frames, 0.90),
+           bench_percentile(latency, frames, 0.99),
+           bench_percentile(latency, frames, 0.999),
+           latency[frames - 1]);
+    printf("heap per frame  allocs %.3f  frees %.3f\n",
+           (double)allocs / (double)frames, (double)frees / (double)frames);
+    printf("gpio writes     %llu\n", (unsigned long long)gpio_writes);
+    printf("rx rejects      magic %u  short %u  version %u  source %u  format %u  crc %u\n",
+           rx_stats.admit[BEASTSQUIB_RX_REJECT_MAGIC], rx_stats.admit[BEASTSQUIB_RX_REJECT_SHORT],
+           rx_stats.admit[BEASTSQUIB_RX_REJECT_VERSION], rx_stats.admit[BEASTSQUIB_RX_REJECT_SOURCE],
+           rx_stats.admit[BEASTSQUIB_RX_REJECT_FORMAT], rx_stats.crc_fail);
+    printf("rx drops        ring full %u  state overwritten %u  stale %u  lost %u\n",
+           rx_stats.ring_full, rx_stats.state_overwritten, rx_stats.stale, rx_stats.lost);
+    for (int stage = 0; stage < BEASTSQUIB_LATENCY_MAX; stage ++) {
+        static const char *const names[BEASTSQUIB_LATENCY_MAX] = { "admit", "wake", "handle", "fire" };
+        const beastsquib_latency_hist_t *hist = &rx_latency[stage];
+        if (hist->count == 0) {
+            continue;
+        }
+        printf("#LAT %-10s n %u  p50 <%u  p99 <%u  max %u ns\n", names[stage], (unsigned)hist->count,
+               bench_hist_percentile(hist, 0.50), bench_hist_percentile(hist, 0.99),
+               (unsigned)((uint64_t)hist->max * 1000 / CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ));
+    }
+    printf("state mismatch  %zu\n", mismatches);
+
+    int pages_lost = bench_interleaved_pages(tx_mac);
+    printf("interleaved     %d of %d pages lost\n", pages_lost, BEASTSQUIB_MAX_PAGES);
+
+    host_free(recv_at);
+    host_free(latency);
+
+    if (allocs != 0 || frees != 0) {
+        fprintf(stderr, "receive path used the heap\n");
+        return 1;
+    }
+
+    return (mismatches == 0 && pages_lost == 0) ? 0 : 1;
+}
@@ -0,0 +1,470 @@
+/* Transmit scheduler benchmark
+
+   Simulates a game on a virtual clock and measures command-to-air latency:
+   the time from the transmitter finishing parsing a #DET command to the
+   first frame carrying it leaving the radio, and to the first such frame a
+   receiver actually hears under random frame loss.
+
+   Commands are fed through the real UART command handler and frames are
+   produced by the real tx_transmit_step. The task's blocking wait is
+   modelled on FreeRTOS ticks: a wait of N ticks ends on the Nth tick
+   boundary after the call, and a notification ends it immediately. The
+   legacy mode reproduces the old fixed vTaskDelay(100 ms) loop.
+
+   The server re-sends the unchanged bitmap every second, as webserver.py
+   does, so repeated state is part of the load. Once every player has been
+   eliminated the bitmap is cleared and a new game starts. Games with more
+   than 512 players are sent with one #DEP command per bitmap page.
+
+   Airtime is reported in frames and bytes per second, so the effect of the
+   sparse encoding early in a game shows up in the byte rate.
+
+   -B runs the event-driven scheduler with the server on the ASCII commands
+   and then on binary UART frames: a DELTA of the IDs changed since the
+   last update, or one PAGE frame per page when nothing changed. The serial
+   line reports bytes each way per update (echo or ACKs) and the time they
+   take at CONFIG_ESPNOW_UART_BAUD and at 921600 baud. Any NAK fails the run.
+
+   -F runs the event-driven scheduler at 1%, 5% and 20% loss, with and
+   without recent IDs repeated in every frame (CONFIG_ESPNOW_FEC). The
+   repeats only matter once the bitmap spans several pages, so use it with
+   more than 512 players.
+
+   Usage: bench_tx [-n commands] [-m mean_gap_ms] [-p loss_percent] [-P players] [-B] [-F] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define BENCH_REFRESH_MS 1000.0
+#define BENCH_MAX_PENDING 16
+
+typedef struct {
+    double issued_at;
+    int id;
+    bool on_air;
+} bench_command_t;
+
+static bench_command_t bench_pending[BENCH_MAX_PENDING];
+static int bench_pending_count;
+
+static double bench_now;
+static double *bench_air_latency;
+static double *bench_rx_latency;
+static size_t bench_air_count;
+static size_t bench_rx_count;
+static uint64_t bench_frames_sent;
+static uint64_t bench_bytes_sent;
+static int bench_players;
+static double bench_loss;
+static uint32_t bench_seed;
+
+static bool bench_binary;
+static uint8_t bench_sent_bits[BEASTSQUIB_MAX_BOARDS / 8];
+static uint8_t bench_uart_seq;
+static uint64_t bench_updates;
+static uint64_t bench_serial_in;
+static uint64_t bench_serial_out;
+static uint64_t bench_uart_frames;
+static uint64_t bench_acks;
+
+static uint32_t bench_rand(void)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = bench_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bench_seed = x;
+    return x;
+}
+
+static double bench_uniform(void)
+{
+    return (bench_rand() + 0.5) / 4294967296.0;
+}
+
+static bool bench_bit_set(const uint8_t *bits, int id)
+{
+    return (bits[id / 8] & (1 << (id % 8))) != 0;
+}
+
+static bool bench_id_listed(const uint8_t *ids, int count, int id)
+{
+    for (int i = 0; i < count; i ++) {
+        if ((ids[2*i] | (ids[2*i + 1] << 8)) == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Whether a frame tells board id to detonate. */
+static bool bench_frame_sets(const beastsquib_espnow_frame_t *frame, int len, int id)
+{
+    int payload_len = len - sizeof(beastsquib_espnow_frame_t);
+
+    if (BEASTSQUIB_FRAME_ENCODING(frame->encoding) == BEASTSQUIB_ENCODING_SPARSE) {
+        return bench_id_listed(frame->payload, payload_len / sizeof(uint16_t), id);
+    }
+
+    if (frame->page == id / BEASTSQUIB_PAGE_BITS) {
+        return bench_bit_set(frame->payload, id % BEASTSQUIB_PAGE_BITS);
+    }
+
+    return BEASTSQUIB_FRAME_ENCODING(frame->encoding) == BEASTSQUIB_ENCODING_BITMAP_RECENT &&
+           bench_id_listed(frame->payload + BEASTSQUIB_PAGE_BYTES,
+                           (payload_len - BEASTSQUIB_PAGE_BYTES) / sizeof(uint16_t), id);
+}
+
+/* esp_now_send hook: matches the frame against outstanding commands. */
+static void bench_on_send(const uint8_t *mac, const uint8_t *data, int len)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+    bool heard = bench_uniform() >= bench_loss;
+
+    bench_frames_sent ++;
+    bench_bytes_sent += len;
+
+    for (int i = 0; i < bench_pending_count; i ++) {
+        bench_command_t *cmd = &bench_pending[i];
+        if (!bench_frame_sets(frame, len, cmd->id)) {
+            continue;
+        }
+
+        if (!cmd->on_air) {
+            cmd->on_air = true;
+            bench_air_latency[bench_air_count ++] = bench_now - cmd->issued_at;
+        }
+
+        if (heard) {
+            bench_rx_latency[bench_rx_count ++] = bench_now - cmd->issued_at;
+            bench_pending[i] = bench_pending[-- bench_pending_count];
+            i --;
+        }
+    }
+}
+
+/* uart_write_bytes hook: counts the board's replies and checks that each
+ * binary frame was acknowledged. Replies are written whole. */
+static void bench_on_uart_write(const char *data, size_t len)
+{
+    uint8_t buf[16];
+
+    bench_serial_out += len;
+    if (len < 3 || len - 2 > sizeof(buf)) {
+        return;
+    }
+
+    memcpy(buf, data + 1, len - 2);
+    if (uart_cobs_decode(buf, len - 2) >= 4 && buf[0] == bench_uart_seq && buf[1] == BEASTSQUIB_UART_ACK) {
+        bench_acks ++;
+    }
+}
+
+/* What uart_event_task does with a chunk of received bytes. */
+static void bench_uart_receive(uint8_t *data, size_t len)
+{
+    bench_serial_in += len;
+    size_t text_len = uart_frame_feed(data, len);
+    uart_command_feed(data, text_len);
+    bench_serial_out += text_len;
+}
+
+/* Sends one binary UART frame. */
+static void bench_feed_frame(uint8_t type, const uint8_t *payload, int len)
+{
+    uint8_t raw[BEASTSQUIB_UART_MAX_PAYLOAD + 4];
+    uint8_t wire[BEASTSQUIB_UART_MAX_ENCODED + 2];
+    int wire_len = 0;
+
+    raw[0] = ++ bench_uart_seq;
+    raw[1] = type;
+    memcpy(raw + 2, payload, len);
+    uint16_t crc = crc16_le(UINT16_MAX, raw, len + 2);
+    raw[len + 2] = crc & 0xFF;
+    raw[len + 3] = crc >> 8;
+
+    wire[wire_len ++] = 0;
+    wire_len += uart_cobs_encode(raw, len + 4, wire + wire_len);
+    wire[wire_len ++] = 0;
+    bench_uart_frames ++;
+    bench_uart_receive(wire, wire_len);
+}
+
+/* Sends the bitmap as transmit.py does in binary mode: the IDs changed since
+ * the last update, or every page again when nothing changed. */
+static void bench_feed_binary(const uint8_t *bits, int pages)
+{
+    uint8_t payload[BEASTSQUIB_UART_MAX_PAYLOAD];
+    int count = 0;
+
+    for (int i = 0; i < pages * BEASTSQUIB_PAGE_BYTES; i ++) {
+        uint8_t changed = bits[i] ^ bench_sent_bits[i];
+        while (changed != 0) {
+            uint16_t id = i * 8 + __builtin_ctz(changed);
+            uint16_t entry = bench_bit_set(bits, id) ? id : (id | BEASTSQUIB_UART_DELTA_CLEAR);
+            payload[2*count] = entry & 0xFF;
+            payload[2*count + 1] = entry >> 8;
+            if (++ count == BEASTSQUIB_UART_MAX_PAYLOAD / sizeof(uint16_t)) {
+                bench_feed_frame(BEASTSQUIB_UART_DELTA, payload, count * sizeof(uint16_t));
+                count = 0;
+            }
+            changed &= changed - 1;
+        }
+    }
+
+    if (count > 0) {
+        bench_feed_frame(BEASTSQUIB_UART_DELTA, payload, count * sizeof(uint16_t));
+    } else if (memcmp(bits, bench_sent_bits, pages * BEASTSQUIB_PAGE_BYTES) == 0) {
+        for (int page = 0; page < pages; page ++) {
+            payload[0] = page;
+            memcpy(payload + 1, bits + page * BEASTSQUIB_PAGE_BYTES, BEASTSQUIB_PAGE_BYTES);
+            bench_feed_frame(BEASTSQUIB_UART_PAGE, payload, 1 + BEASTSQUIB_PAGE_BYTES);
+        }
+    }
+
+    memcpy(bench_sent_bits, bits, pages * BEASTSQUIB_PAGE_BYTES);
+}
+
+/* Sends the bitmap as the server would: #DET for a single page, one #DEP
+ * per page otherwise. */
+static void bench_feed_det(const uint8_t *bits)
+{
+    int pages = (bench_players + BEASTSQUIB_PAGE_BITS - 1) / BEASTSQUIB_PAGE_BITS;
+    char command[7 + 128 + 1];
+
+    bench_updates ++;
+    if (bench_binary) {
+        bench_feed_binary(bits, pages);
+        return;
+    }
+
+    for (int page = 0; page < pages; page ++) {
+        const uint8_t *page_bits = bits + page * BEASTSQUIB_PAGE_BYTES;
+        int start = (pages == 1) ? 5 : 7;
+
+        if (pages == 1) {
+            memcpy(command, "#DET,", 5);
+        } else {
+            snprintf(command, sizeof(command), "#DEP,%d,", page);
+        }
+        for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+            snprintf(command + start + 2 * i, 3, "%02x", page_bits[i]);
+        }
+        command[start + 128] = ';';
+        bench_uart_receive((uint8_t *)command, start + 128 + 1);
+    }
+}
+
+static int bench_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_report(const char *what, double *samples, size_t count)
+{
+    if (count == 0) {
+        printf("  %-16s no samples\n", what);
+        return;
+    }
+    qsort(samples, count, sizeof(double), bench_compare_double);
+    printf("  %-16s p50 %6.1f  p90 %6.1f  p99 %6.1f  p99.9 %6.1f  max %6.1f ms\n", what,
+           samples[(size_t)(0.50 * (count - 1))], samples[(size_t)(0.90 * (count - 1))],
+           samples[(size_t)(0.99 * (count - 1))], samples[(size_t)(0.999 * (count - 1))],
+           samples[count - 1]);
+}
+
+static double bench_tick_after(double now, uint32_t ticks)
+{
+    return (floor(now / portTICK_RATE_MS) + ticks) * portTICK_RATE_MS;
+}
+
+static void bench_run(const char *label, bool legacy, size_t commands, double mean_gap_ms, uint32_t seed)
+{
+    host_task_t *task = (host_task_t *)tx_transmit_task_handle;
+    beastsquib_espnow_send_param_t *send_param = task->arg;
+    uint8_t bits[BEASTSQUIB_MAX_BOARDS / 8];
+
+    memset(&global_tx_data, 0, sizeof(global_tx_data));
+    memset(bits, 0, sizeof(bits));
+    tx_burst_remaining = 0;
+    tx_dirty_pages = 0;
+    tx_burst_pages = 0;
+    tx_next_page = 0;
+    tx_recent_head = 0;
+    tx_change_count = 0;
+    task->notify_count = 0;
+    bench_pending_count = 0;
+    bench_air_count = 0;
+    bench_rx_count = 0;
+    bench_frames_sent = 0;
+    bench_bytes_sent = 0;
+    bench_seed = seed;
+    memset(bench_sent_bits, 0, sizeof(bench_sent_bits));
+    bench_updates = 0;
+    bench_serial_in = 0;
+    bench_serial_out = 0;
+    bench_uart_frames = 0;
+    bench_acks = 0;
+
+    double next_send = 0;
+    double next_command = -mean_gap_ms * log(bench_uniform());
+    double next_refresh = BENCH_REFRESH_MS;
+    size_t issued = 0;
+    int eliminated = 0;
+
+    bench_now = 0;
+    while (issued < commands || bench_pending_count > 0) {
+        if (issued < commands && next_command <= next_send && next_command <= next_refresh) {
+            // A new elimination arrives from the server
+            bench_now = next_command;
+            if (eliminated == bench_players && bench_pending_count == 0) {
+                memset(bits, 0, sizeof(bits));
+                eliminated = 0;
+            }
+            if (eliminated == bench_players) {
+                // Wait for the last elimination to be heard before a new game
+                next_command = next_send + 1;
+                continue;
+            }
+            int id = eliminated ++ * 37 % bench_players;
+            bits[id / 8] |= (1 << (id % 8));
+            if (bench_pending_count < BENCH_MAX_PENDING) {
+                bench_pending[bench_pending_count ++] = (bench_command_t) {
+                    .issued_at = bench_now, .id = id, .on_air = false,
+                };
+            }
+            issued ++;
+            bench_feed_det(bits);
+            next_command = bench_now - mean_gap_ms * log(bench_uniform());
+
+            if (!legacy && task->notify_count > 0) {
+                next_send = bench_now;
+            }
+        } else if (next_refresh <= next_send) {
+            // The server's once-a-second resend of the same state
+            bench_now = next_refresh;
+            bench_feed_det(bits);
+            next_refresh += BENCH_REFRESH_MS;
+
+            if (!legacy && task->notify_count > 0) {
+                next_send = bench_now;
+            }
+        } else {
+            bench_now = next_send;
+            bool state_changed = task->notify_count > 0;
+            task->notify_count = 0;
+            uint32_t wait_ms = tx_transmit_step(send_param, state_changed);
+
+            if (legacy) {
+                next_send = bench_tick_after(bench_now, 100 / portTICK_RATE_MS);
+            } else {
+                uint32_t wait = (wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+                next_send = bench_tick_after(bench_now, wait == 0 ? 1 : wait);
+            }
+        }
+    }
+
+    printf("%s\n", label);
+    printf("  %-16s %.1f frames/s, %.0f bytes/s\n", "airtime",
+           bench_frames_sent * 1000.0 / bench_now, bench_bytes_sent * 1000.0 / bench_now);
+    printf("  %-16s %.1f bytes in, %.1f out per update, %.2f ms at %d baud, %.2f ms at 921600\n", "serial",
+           (double)bench_serial_in / bench_updates, (double)bench_serial_out / bench_updates,
+           bench_serial_in * 10000.0 / bench_updates / CONFIG_ESPNOW_UART_BAUD, CONFIG_ESPNOW_UART_BAUD,
+           bench_serial_in * 10000.0 / bench_updates / 921600);
+    bench_report("command-to-air", bench_air_latency, bench_air_count);
+    bench_report("command-to-rx", bench_rx_latency, bench_rx_count);
+
+    if (bench_acks != bench_uart_frames) {
+        printf("  %llu of %llu binary frames not acknowledged\n",
+               (unsigned long long)(bench_uart_frames - bench_acks), (unsigned long long)bench_uart_frames);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t commands = 20000;
+    double mean_gap_ms = 2000;
+    int loss_percent = 10;
+    int players = 456;
+    bool fec_sweep = false;
+    bool binary_compare = false;
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:p:P:BFs:")) != -1) {
+        switch (opt) {
+            case 'n': commands = strtoull(optarg, NULL, 10); break;
+            case 'm': mean_gap_ms = atof(optarg); break;
+            case 'p': loss_percent = atoi(optarg); break;
+            case 'P': players = atoi(optarg); break;
+            case 'B': binary_compare = true; break;
+            case 'F': fec_sweep = true; break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n commands] [-m mean_gap_ms] [-p loss_percent] [-P players] [-B] [-F] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (commands == 0 || mean_gap_ms <= 0 || loss_percent < 0 || loss_percent >= 100 ||
+        players < 1 || players > BEASTSQUIB_MAX_BOARDS || seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    if (beastsquib_espnow_init() != ESP_OK || tx_transmit_task_handle == NULL) {
+        fprintf(stderr, "espnow init failed\n");
+        return 1;
+    }
+
+    bench_loss = loss_percent / 100.0;
+    bench_players = players;
+    bench_air_latency = host_malloc(commands * sizeof(double));
+    bench_rx_latency = host_malloc(commands * sizeof(double));
+    host_espnow_send_hook = bench_on_send;
+    host_uart_write_hook = bench_on_uart_write;
+
+    if (fec_sweep) {
+        static const int sweep_loss[] = { 1, 5, 20 };
+
+        printf("%zu commands, %d players, mean gap %.0f ms, tick %d ms, burst %u x %u ms, heartbeat %u ms, "
+               "recent changes repeated %u, frame budget %d bytes\n",
+               commands, players, mean_gap_ms, portTICK_RATE_MS, tx_timing.burst_count,
+               tx_timing.burst_spacing_ms, tx_timing.heartbeat_ms, tx_fec_depth, CONFIG_ESPNOW_SEND_LEN);
+
+        for (int i = 0; i < sizeof(sweep_loss) / sizeof(sweep_loss[0]); i ++) {
+            char label[64];
+            bench_loss = sweep_loss[i] / 100.0;
+            for (int fec = 0; fec <= 1; fec ++) {
+                tx_fec_enabled = fec;
+                snprintf(label, sizeof(label), "%d%% loss, %s", sweep_loss[i], fec ? "recent IDs repeated" : "no repeats");
+                bench_run(label, false, commands, mean_gap_ms, seed);
+            }
+        }
+    } else {
+        printf("%zu commands, %d players, mean gap %.0f ms, %d%% frame loss, tick %d ms, burst %u x %u ms, heartbeat %u ms\n",
+               commands, players, mean_gap_ms, loss_percent, portTICK_RATE_MS,
+               tx_timing.burst_count, tx_timing.burst_spacing_ms, tx_timing.heartbeat_ms);
+
+        if (binary_compare) {
+            bench_run("event-driven scheduler, ASCII commands", false, commands, mean_gap_ms, seed);
+            bench_binary = true;
+            bench_run("event-driven scheduler, binary UART frames", false, commands, mean_gap_ms, seed);
+        } else {
+            bench_run("legacy 100 ms loop", true, commands, mean_gap_ms, seed);
+            bench_run("event-driven scheduler", false, commands, mean_gap_ms, seed);
+        }
+    }
+
+    host_free(bench_air_latency);
+    host_free(bench_rx_latency);
+
+    return 0;
+}
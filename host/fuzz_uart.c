@@ -0,0 +1,302 @@
+/* UART command parser fuzz and throughput test
+
+   Builds a stream of ASCII commands mixed with garbage and feeds it through
+   the real uart_command_feed on the transmitter build.
+
+   The stream is made of three kinds of segment:
+   - valid commands that change transmitter state (#DET, #DEP, #ARM, #DLY,
+     #TID, #TXS), with hex digits in random case;
+   - the same commands broken in one way: a bad character in a field, a
+     field one character short or long, an extra field, an unknown name or
+     a missing ';' so the next '#' cuts the command off;
+   - runs of random bytes other than '#' and ';' between commands.
+
+   The first pass feeds one segment at a time and checks the transmitter
+   state after each: a valid command must have taken effect and a broken
+   one must have changed nothing. The second pass feeds the whole stream
+   again in chunks of 1 to 120 bytes, as UART events deliver it, and reports
+   the parser's throughput. Both passes check the counters: every valid
+   command is counted as run and every '#' as exactly one outcome.
+
+   Exits 1 on any mismatch.
+
+   Usage: fuzz_uart [-n megabytes] [-g garbage_percent] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <time.h>
+
+#define FUZZ_MAX_SEGMENT 512
+
+typedef struct {
+    uint8_t pyro_bits[BEASTSQUIB_MAX_PAGES][BEASTSQUIB_PAGE_BYTES];
+    uint8_t armed;
+    uint16_t delay_ms;
+    uint16_t test_id;
+    beastsquib_tx_timing_t timing;
+} fuzz_state_t;
+
+static uint32_t fuzz_seed;
+static int fuzz_garbage_percent;
+static uint64_t fuzz_valid;
+static uint64_t fuzz_commands;
+static uint64_t fuzz_failures;
+
+static uint32_t fuzz_rand(void)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = fuzz_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    fuzz_seed = x;
+    return x;
+}
+
+static void fuzz_snapshot(fuzz_state_t *state)
+{
+    memcpy(state->pyro_bits, global_tx_data.pyro_bits, sizeof(state->pyro_bits));
+    state->armed = global_tx_data.armed;
+    state->delay_ms = tx_detonate_delay_ms;
+    state->test_id = test_board_id;
+    state->timing = tx_timing;
+}
+
+static bool fuzz_state_equal(const fuzz_state_t *a, const fuzz_state_t *b)
+{
+    return memcmp(a->pyro_bits, b->pyro_bits, sizeof(a->pyro_bits)) == 0 &&
+           a->armed == b->armed && a->delay_ms == b->delay_ms && a->test_id == b->test_id &&
+           a->timing.burst_count == b->timing.burst_count &&
+           a->timing.burst_spacing_ms == b->timing.burst_spacing_ms &&
+           a->timing.heartbeat_ms == b->timing.heartbeat_ms;
+}
+
+static int fuzz_hex(char *out, const uint8_t *bytes, int count)
+{
+    const char *digits = (fuzz_rand() & 1) ? "0123456789abcdef" : "0123456789ABCDEF";
+    for (int i = 0; i < count; i ++) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+    return 2 * count;
+}
+
+/* Writes a random valid command and the state it leaves behind. Returns its length. */
+static int fuzz_valid_command(char *out, fuzz_state_t *expect)
+{
+    uint8_t bits[BEASTSQUIB_PAGE_BYTES];
+    int len;
+
+    switch (fuzz_rand() % 6) {
+        case 0: {
+            for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+                bits[i] = fuzz_rand();
+            }
+            len = sprintf(out, "#DET,");
+            len += fuzz_hex(out + len, bits, BEASTSQUIB_PAGE_BYTES);
+            memcpy(expect->pyro_bits[0], bits, BEASTSQUIB_PAGE_BYTES);
+            break;
+        }
+        case 1: {
+            int page = fuzz_rand() % BEASTSQUIB_MAX_PAGES;
+            for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+                bits[i] = fuzz_rand();
+            }
+            len = sprintf(out, "#DEP,%d,", page);
+            len += fuzz_hex(out + len, bits, BEASTSQUIB_PAGE_BYTES);
+            memcpy(expect->pyro_bits[page], bits, BEASTSQUIB_PAGE_BYTES);
+            break;
+        }
+        case 2:
+            expect->armed = fuzz_rand() & 1;
+            len = sprintf(out, "#ARM,%d", expect->armed);
+            break;
+        case 3:
+            expect->delay_ms = fuzz_rand() % 10000;
+            len = sprintf(out, "#DLY,%04u", expect->delay_ms);
+            break;
+        case 4:
+            expect->test_id = fuzz_rand() % 10000;
+            len = sprintf(out, (fuzz_rand() & 1) || expect->test_id > 999 ? "#TID,%04u" : "#TID,%03u",
+                          expect->test_id);
+            break;
+        default:
+            expect->timing.burst_count = 1 + fuzz_rand() % 99;
+            expect->timing.burst_spacing_ms = fuzz_rand() % 1000;
+            expect->timing.heartbeat_ms = 10 + fuzz_rand() % 9990;
+            len = sprintf(out, "#TXS,%02u,%03u,%04u", expect->timing.burst_count,
+                          expect->timing.burst_spacing_ms, expect->timing.heartbeat_ms);
+            break;
+    }
+
+    out[len ++] = ';';
+    return len;
+}
+
+/* Breaks a valid command of len bytes so that no command accepts it. Returns its new length. */
+static int fuzz_break_command(char *out, int len)
+{
+    static const char bad[] = "ghjkmnpqrstuvwxyzGHJKMNPQRSTUVWXYZ!$%&*+-./:<=>?@[]^_{|}~ \r\n";
+    char *fields = memchr(out, ',', len);
+    int first = fields - out + 1;
+    int last = len - 1;
+    // #TID takes 3 or 4 digits, so change its length by two
+    int step = (memcmp(out + 1, "TID", 3) == 0) ? 2 : 1;
+
+    switch (fuzz_rand() % 6) {
+        case 0:
+            // A character that belongs in no field
+            out[first + fuzz_rand() % (last - first)] = bad[fuzz_rand() % (sizeof(bad) - 1)];
+            return len;
+        case 1:
+            // Short
+            out[last - step] = ';';
+            return len - step;
+        case 2:
+            // Long
+            for (int i = 0; i < step; i ++) {
+                out[last + i] = '0' + fuzz_rand() % 10;
+            }
+            out[last + step] = ';';
+            return len + step;
+        case 3:
+            // An extra field
+            out[last] = ',';
+            out[len] = '1';
+            out[len + 1] = ';';
+            return len + 2;
+        case 4:
+            // An unknown name
+            memcpy(out + 1, (fuzz_rand() & 1) ? "DEX" : "ZZZ", 3);
+            return len;
+        default:
+            // No ';', so the next '#' interrupts it
+            return len - 1;
+    }
+}
+
+static int fuzz_garbage(char *out)
+{
+    int len = 1 + fuzz_rand() % 64;
+    for (int i = 0; i < len; i ++) {
+        char c;
+        do {
+            c = fuzz_rand();
+        } while (c == '#' || c == ';');
+        out[i] = c;
+    }
+    return len;
+}
+
+static void fuzz_check(const char *what, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected) {
+        fprintf(stderr, "%s: %llu, expected %llu\n", what, (unsigned long long)actual, (unsigned long long)expected);
+        fuzz_failures ++;
+    }
+}
+
+/* Every '#' ends as exactly one outcome; the last command may still be open. */
+static void fuzz_check_counters(const char *pass)
+{
+    uint64_t outcomes = uart_stats.ok + uart_stats.unknown + uart_stats.format + uart_stats.overlong +
+                        uart_stats.interrupted + (uart_parser.active ? 1 : 0);
+
+    printf("  %-8s ok %llu  unknown %u  format %u  overlong %u  interrupted %u\n", pass,
+           (unsigned long long)uart_stats.ok, (unsigned)uart_stats.unknown, (unsigned)uart_stats.format,
+           (unsigned)uart_stats.overlong, (unsigned)uart_stats.interrupted);
+    fuzz_check("commands run", uart_stats.ok, fuzz_valid);
+    fuzz_check("command outcomes", outcomes, fuzz_commands);
+}
+
+int main(int argc, char **argv)
+{
+    int megabytes = 16;
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    fuzz_garbage_percent = 30;
+
+    while ((opt = getopt(argc, argv, "n:g:s:")) != -1) {
+        switch (opt) {
+            case 'n': megabytes = atoi(optarg); break;
+            case 'g': fuzz_garbage_percent = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n megabytes] [-g garbage_percent] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (megabytes < 1 || fuzz_garbage_percent < 0 || fuzz_garbage_percent > 100 || seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    fuzz_seed = seed;
+    size_t capacity = (size_t)megabytes << 20;
+    char *stream = host_malloc(capacity + FUZZ_MAX_SEGMENT);
+    size_t size = 0;
+    fuzz_state_t expect, actual;
+
+    // Pass 1: one segment at a time, checking the state after each
+    fuzz_snapshot(&expect);
+    while (size < capacity) {
+        char *segment = stream + size;
+        int len;
+
+        if (fuzz_rand() % 100 < (uint32_t)fuzz_garbage_percent) {
+            len = fuzz_garbage(segment);
+        } else if (fuzz_rand() & 1) {
+            len = fuzz_valid_command(segment, &expect);
+            fuzz_valid ++;
+            fuzz_commands ++;
+        } else {
+            fuzz_state_t ignored = expect;
+            len = fuzz_break_command(segment, fuzz_valid_command(segment, &ignored));
+            fuzz_commands ++;
+        }
+
+        uart_command_feed((const uint8_t *)segment, len);
+        fuzz_snapshot(&actual);
+        if (!fuzz_state_equal(&actual, &expect)) {
+            fprintf(stderr, "state mismatch after \"%.*s\"\n", len, segment);
+            fuzz_failures ++;
+            expect = actual;
+        }
+        size += len;
+    }
+
+    printf("%.1f MB, %llu commands (%llu valid), %d%% garbage segments\n", size / 1048576.0,
+           (unsigned long long)fuzz_commands, (unsigned long long)fuzz_valid, fuzz_garbage_percent);
+    fuzz_check_counters("checked");
+
+    // Pass 2: the whole stream in UART sized chunks, timed
+    memset(&uart_stats, 0, sizeof(uart_stats));
+    memset(&uart_parser, 0, sizeof(uart_parser));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t offset = 0; offset < size; ) {
+        size_t chunk = 1 + fuzz_rand() % 120;
+        if (chunk > size - offset) {
+            chunk = size - offset;
+        }
+        uart_command_feed((const uint8_t *)stream + offset, chunk);
+        offset += chunk;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    fuzz_check_counters("streamed");
+    printf("  %-8s %.1f MB/s, %.1f ns per byte\n", "rate", size / 1048576.0 / seconds, seconds * 1e9 / size);
+
+    host_free(stream);
+
+    if (fuzz_failures > 0) {
+        fprintf(stderr, "%llu failures\n", (unsigned long long)fuzz_failures);
+        return 1;
+    }
+    return 0;
+}
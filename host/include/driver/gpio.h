@@ -0,0 +1,33 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+#include "esp_system.h"
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+} gpio_int_type_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_OUTPUT_OD,
+} gpio_mode_t;
+
+typedef struct {
+    uint32_t pin_bit_mask;
+    gpio_mode_t mode;
+    int pull_up_en;
+    int pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef int gpio_num_t;
+
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HOST_DRIVER_HW_TIMER_H
+#define HOST_DRIVER_HW_TIMER_H
+
+#include "esp_system.h"
+
+typedef void (*hw_timer_callback_t)(void *arg);
+
+esp_err_t hw_timer_init(hw_timer_callback_t callback, void *arg);
+esp_err_t hw_timer_alarm_us(uint32_t value, bool reload);
+
+/* The callback most recently installed; the harness calls it to advance
+   the firmware clock. */
+extern hw_timer_callback_t host_hw_timer_cb;
+
+/* The alarm most recently set, and how many have been set. */
+extern uint32_t host_hw_timer_alarm;
+extern bool host_hw_timer_reload;
+extern uint64_t host_hw_timer_alarms;
+
+#endif
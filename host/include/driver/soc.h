@@ -0,0 +1,12 @@
+#ifndef HOST_DRIVER_SOC_H
+#define HOST_DRIVER_SOC_H
+
+#include "host_shim.h"
+
+/* CPU cycle counter, from host_clock_ns at the configured CPU frequency. */
+static inline uint32_t soc_get_ccount(void)
+{
+    return (uint32_t)(host_clock_ns() * CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ / 1000);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef HOST_DRIVER_UART_H
+#define HOST_DRIVER_UART_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+typedef enum {
+    UART_NUM_0 = 0,
+    UART_NUM_1,
+    UART_NUM_MAX,
+} uart_port_t;
+
+typedef enum {
+    UART_DATA_5_BITS,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS,
+} uart_word_length_t;
+
+typedef enum {
+    UART_PARITY_DISABLE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD,
+} uart_parity_t;
+
+typedef enum {
+    UART_STOP_BITS_1,
+    UART_STOP_BITS_1_5,
+    UART_STOP_BITS_2,
+} uart_stop_bits_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE,
+    UART_HW_FLOWCTRL_RTS,
+    UART_HW_FLOWCTRL_CTS,
+    UART_HW_FLOWCTRL_CTS_RTS,
+} uart_hw_flowcontrol_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+} uart_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+} uart_event_t;
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *config);
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int no_use);
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_EVENT_LOOP_H
+#define HOST_ESP_EVENT_LOOP_H
+
+#include "esp_system.h"
+
+esp_err_t esp_event_loop_create_default(void);
+
+#endif
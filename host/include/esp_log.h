@@ -0,0 +1,29 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include "host_shim.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define HOST_LOG(level, tag, format, ...) do {                  \
+        if ((int)(level) <= host_log_level) {                   \
+            host_log_write(level, tag, format, ##__VA_ARGS__);  \
+        }                                                       \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HOST_ESP_NOW_H
+#define HOST_ESP_NOW_H
+
+#include "esp_wifi.h"
+
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_KEY_LEN 16
+#define ESP_NOW_MAX_DATA_LEN 250
+
+typedef enum {
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL,
+} esp_now_send_status_t;
+
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;
+    esp_interface_t ifidx;
+    bool encrypt;
+    void *priv;
+} esp_now_peer_info_t;
+
+typedef void (*esp_now_send_cb_t)(const uint8_t *mac_addr, esp_now_send_status_t status);
+typedef void (*esp_now_recv_cb_t)(const uint8_t *mac_addr, const uint8_t *data, int data_len);
+
+esp_err_t esp_now_init(void);
+esp_err_t esp_now_deinit(void);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_set_pmk(const uint8_t *pmk);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+/* The callbacks most recently registered, so the harness can play the
+   part of the WiFi task. */
+extern esp_now_send_cb_t host_espnow_send_cb;
+extern esp_now_recv_cb_t host_espnow_recv_cb;
+
+#endif
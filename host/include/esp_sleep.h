@@ -0,0 +1,22 @@
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+#include "esp_system.h"
+
+typedef enum {
+    WIFI_NONE_SLEEP_T = 0,
+    WIFI_LIGHT_SLEEP_T,
+    WIFI_MODEM_SLEEP_T,
+} wifi_sleep_type_t;
+
+void esp_wifi_fpm_open(void);
+void esp_wifi_fpm_close(void);
+void esp_wifi_fpm_set_sleep_type(wifi_sleep_type_t type);
+esp_err_t esp_wifi_fpm_do_sleep(uint32_t sleep_time_in_us);
+void esp_wifi_fpm_do_wakeup(void);
+
+/* Forced modem sleeps asked for, and the length of the last one. */
+extern uint64_t host_fpm_sleeps;
+extern uint32_t host_fpm_sleep_us;
+
+#endif
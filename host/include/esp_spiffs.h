@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_SPIFFS_H
+#define HOST_ESP_SPIFFS_H
+
+#include "esp_system.h"
+
+typedef struct {
+    const char *base_path;
+    const char *partition_label;
+    size_t max_files;
+    bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf);
+
+#endif
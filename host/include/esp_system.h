@@ -0,0 +1,50 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include "host_shim.h"
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+
+#define ESP_ERROR_CHECK(x) do {                                        \
+        esp_err_t __err_rc = (x);                                      \
+        if (__err_rc != ESP_OK) {                                      \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x at %s:%d\n", \
+                    (int)__err_rc, __FILE__, __LINE__);                \
+            abort();                                                   \
+        }                                                              \
+    } while (0)
+
+const char *esp_err_to_name(esp_err_t code);
+
+uint32_t esp_random(void);
+
+typedef enum {
+    ESP_RST_UNKNOWN = 0,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+    ESP_RST_FAST_SW,
+} esp_reset_reason_t;
+
+/* Always ESP_RST_POWERON unless a harness sets host_reset_reason. */
+esp_reset_reason_t esp_reset_reason(void);
+extern esp_reset_reason_t host_reset_reason;
+
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include "host_shim.h"
+
+/* Microseconds since boot, from host_clock_ns. */
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include "esp_system.h"
+
+typedef enum {
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+} wifi_mode_t;
+
+typedef enum {
+    ESP_IF_WIFI_STA = 0,
+    ESP_IF_WIFI_AP,
+} esp_interface_t;
+
+typedef enum {
+    WIFI_STORAGE_FLASH,
+    WIFI_STORAGE_RAM,
+} wifi_storage_t;
+
+typedef struct {
+    int unused;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_max_tx_power(int8_t power);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_set_channel(uint8_t primary, int second);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include "host_shim.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef TickType_t portTickType;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+
+/* Nothing preempts anything on the host. */
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+#define taskENTER_CRITICAL() portENTER_CRITICAL()
+#define taskEXIT_CRITICAL() portEXIT_CRITICAL()
+#define portYIELD_FROM_ISR()
+
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+/* Queues never block on the host: a send to a full queue or a receive from
+   an empty one fails immediately, whatever the timeout. This lets the
+   harness drain a task loop by calling the task function directly. */
+typedef struct host_queue *QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/queue.h"
+
+#define vSemaphoreDelete(sem) vQueueDelete((QueueHandle_t)(sem))
+
+#endif
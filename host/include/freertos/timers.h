@@ -0,0 +1,15 @@
+#ifndef HOST_FREERTOS_TIMERS_H
+#define HOST_FREERTOS_TIMERS_H
+
+#include "freertos/task.h"
+
+/* Software timers are created but never run; a harness calls the
+   callback itself. */
+typedef void *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+#endif
@@ -0,0 +1,78 @@
+/* Host shim hooks
+
+   Thin stand-ins for the ESP8266 RTOS SDK so the squib firmware can be
+   compiled and driven on Linux. Everything here is single threaded: tasks
+   are never started, queues never block, and the harness calls the
+   firmware entry points directly.
+*/
+
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sdkconfig.h"
+
+/* Heap accounting. Every malloc/free made by firmware code is counted so
+   the harness can prove which paths touch the heap. */
+void *host_malloc(size_t size);
+void host_free(void *ptr);
+
+extern uint64_t host_heap_allocs;
+extern uint64_t host_heap_frees;
+
+#define malloc(size) host_malloc(size)
+#define free(ptr) host_free(ptr)
+
+/* Log output is suppressed unless this is raised (ESP_LOG_* levels). */
+extern int host_log_level;
+
+/* Monotonic nanoseconds, used for the firmware clock and benchmarks. */
+uint64_t host_now_ns(void);
+
+/* Firmware clock behind esp_timer_get_time. Defaults to host_now_ns; a
+   simulation can point it at a virtual clock. */
+extern uint64_t (*host_clock_ns)(void);
+
+/* GPIO trace: last level written per pin and total write count. */
+#define HOST_GPIO_COUNT 17
+extern int host_gpio_level[HOST_GPIO_COUNT];
+extern uint64_t host_gpio_writes;
+
+/* ESP-NOW: callbacks registered by the firmware, and a capture hook for
+   esp_now_send. */
+typedef void (*host_espnow_send_hook_t)(const uint8_t *mac, const uint8_t *data, int len);
+extern host_espnow_send_hook_t host_espnow_send_hook;
+
+/* Tasks created with xTaskCreate are recorded here rather than started. */
+typedef void (*host_task_fn_t)(void *arg);
+
+typedef struct {
+    host_task_fn_t fn;
+    void *arg;
+    const char *name;
+    uint32_t notify_count;
+} host_task_t;
+
+#define HOST_MAX_TASKS 8
+extern host_task_t host_tasks[HOST_MAX_TASKS];
+extern int host_task_count;
+
+/* Runs a recorded task by name until it has nothing left to do: blocking
+   calls that would wait (queue receive, notification take) return failure
+   instead. Returns false if no such task was created. */
+bool host_run_task(const char *name);
+
+/* UART: bytes written by the firmware are passed to this hook if set. */
+typedef void (*host_uart_write_hook_t)(const char *data, size_t len);
+extern host_uart_write_hook_t host_uart_write_hook;
+
+#endif
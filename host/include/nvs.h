@@ -0,0 +1,33 @@
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+
+#include "esp_system.h"
+
+/* In-memory key/value store standing in for the NVS partition. Contents
+   last for the life of the process; host_nvs_erase() wipes them. */
+
+typedef uint32_t nvs_handle;
+typedef nvs_handle nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode;
+
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE (ESP_ERR_NVS_BASE + 0x05)
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle);
+void nvs_close(nvs_handle handle);
+esp_err_t nvs_commit(nvs_handle handle);
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out_value);
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value);
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key);
+
+void host_nvs_erase(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_ROM_CRC_H
+#define HOST_ROM_CRC_H
+
+#include <stdint.h>
+
+/* Software equivalent of the ROM CRC16 (CCITT, reflected). */
+uint16_t crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_ROM_ETS_SYS_H
+#define HOST_ROM_ETS_SYS_H
+
+#include "host_shim.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_TCPIP_ADAPTER_H
+#define HOST_TCPIP_ADAPTER_H
+
+void tcpip_adapter_init(void);
+
+#endif
@@ -0,0 +1,489 @@
+/* Trace replay
+
+   Plays a trace written by transmit.py --trace (see beastsquib_trace_type_t)
+   back into the firmware on a virtual clock, at the pace it was recorded
+   or, with -f, as fast as it will go. Built as replay_tx and replay_rx, for
+   the transmitter and the receiver builds. Given the same trace, a replay
+   always does the same thing.
+
+   UART records go through the same path as the UART task's bytes: binary
+   frames first, then the ASCII commands. RX records go in through the
+   ESP-NOW receive callback; with -t, replay_rx hears the TX records too,
+   from the transmitter that sent them. The firmware boots a second before
+   the first record, the transmitter's task loop body runs when it is
+   notified or its wait ends, and on a receiver the ESPNOW task's loop body
+   does the same while hw_timer_callback runs every millisecond.
+
+   replay_tx compares the states carried by the frames it sends with those
+   in the trace's TX records, each taken as the run of frames with the same
+   armed state and bitmap page, and reports the first one that differs. A
+   state or two the transmitter still sent from before the trace began are
+   passed over.
+   With -w it writes the trace again with the frames it sent in place of
+   the recorded ones, which makes a trace of UART records alone into one to
+   compare later firmware with. replay_rx reports what the board made of
+   the frames and when it detonated and revived. Both report what each
+   record cost to handle.
+
+   Usage: replay_tx [-f] [-w out.trace] trace
+          replay_rx [-f] [-t] [-i board_id] trace
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define REPLAY_BOOT_US 1e6
+#define REPLAY_TICK_MS ((double)portTICK_RATE_MS)
+
+typedef struct {
+    double at_us;                         // Since the first record
+    uint8_t type;
+    uint16_t len;
+    const uint8_t *data;
+} replay_record_t;
+
+/* Frame states in the order they were sent, see replay_state_hash. */
+typedef struct {
+    uint64_t *hash;
+    double *at_us;
+    size_t count;
+    size_t max;
+} replay_states_t;
+
+static double replay_now_us;
+static FILE *replay_out;
+static double replay_out_us;
+static replay_states_t replay_sent;
+
+static uint64_t replay_clock_ns(void)
+{
+    return (uint64_t)((replay_now_us + REPLAY_BOOT_US) * 1000.0);
+}
+
+/* FNV-1a over the armed state, the page and the bitmap a frame carries, or
+ * 0 for anything that is not a state frame. */
+static uint64_t replay_state_hash(const uint8_t *data, int len)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t *bits;
+    int bits_len;
+
+    if (len < (int)sizeof(*frame) || frame->magic != BEASTSQUIB_MAGIC_NUMBER ||
+        (frame->version < 3 && len < (int)BEASTSQUIB_V1_DATA_LEN)) {
+        return 0;
+    }
+    if (frame->version >= 3) {
+        bits = frame->payload;
+        bits_len = len - sizeof(*frame);
+        if (BEASTSQUIB_FRAME_ENCODING(frame->encoding) != BEASTSQUIB_ENCODING_SPARSE &&
+            bits_len > BEASTSQUIB_PAGE_BYTES) {
+            bits_len = BEASTSQUIB_PAGE_BYTES;
+        }
+        hash = (hash ^ frame->page) * 0x100000001b3ull;
+    } else {
+        bits = ((const beastsquib_espnow_data_t *)data)->pyro_bits;
+        bits_len = BEASTSQUIB_PAGE_BYTES;
+    }
+    hash = (hash ^ (frame->armed & 0xFF)) * 0x100000001b3ull;
+    for (int i = 0; i < bits_len; i ++) {
+        hash = (hash ^ bits[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void replay_states_add(replay_states_t *s, const uint8_t *data, int len, double at_us)
+{
+    uint64_t hash = replay_state_hash(data, len);
+
+    if (hash == 0 || (s->count > 0 && s->hash[s->count - 1] == hash) || s->count == s->max) {
+        return;
+    }
+    s->hash[s->count] = hash;
+    s->at_us[s->count ++] = at_us;
+}
+
+static void replay_states_init(replay_states_t *s, size_t max)
+{
+    s->hash = host_malloc(max * sizeof(uint64_t));
+    s->at_us = host_malloc(max * sizeof(double));
+    s->count = 0;
+    s->max = max;
+}
+
+static void replay_write(uint8_t type, const uint8_t *data, int len)
+{
+    if (replay_out == NULL) {
+        return;
+    }
+    double delta = replay_now_us - replay_out_us;
+    beastsquib_trace_record_t record = {
+        .delta_us = (delta <= 0) ? 0 : (delta >= UINT32_MAX) ? UINT32_MAX : (uint32_t)delta,
+        .type = type,
+        .len = len,
+    };
+    replay_out_us += record.delta_us;
+    fwrite(&record, sizeof(record), 1, replay_out);
+    fwrite(data, 1, len, replay_out);
+}
+
+/* Frames the replayed firmware sends. */
+static void replay_capture(const uint8_t *mac, const uint8_t *data, int len)
+{
+#ifdef TX
+    replay_states_add(&replay_sent, data, len, replay_now_us);
+    replay_write(BEASTSQUIB_TRACE_TX, data, len);
+#endif
+}
+
+/* Reads a whole trace. Returns the record count, or -1 if it is not one. */
+static long replay_load(const char *path, replay_record_t **records)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = host_malloc(size > 0 ? size : 1);
+    if (fread(buf, 1, size, f) != (size_t)size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    if (size < BEASTSQUIB_TRACE_MAGIC_LEN || memcmp(buf, BEASTSQUIB_TRACE_MAGIC, BEASTSQUIB_TRACE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        return -1;
+    }
+
+    long count = 0;
+    for (long at = BEASTSQUIB_TRACE_MAGIC_LEN; at + (long)sizeof(beastsquib_trace_record_t) <= size; count ++) {
+        const beastsquib_trace_record_t *record = (const beastsquib_trace_record_t *)(buf + at);
+        at += sizeof(*record) + record->len;
+    }
+    *records = host_malloc((count > 0 ? count : 1) * sizeof(replay_record_t));
+
+    double at_us = 0;
+    long n = 0;
+    for (long at = BEASTSQUIB_TRACE_MAGIC_LEN; n < count; n ++) {
+        const beastsquib_trace_record_t *record = (const beastsquib_trace_record_t *)(buf + at);
+        at += sizeof(*record);
+        if (at + record->len > size) {
+            fprintf(stderr, "%s: cut short after %ld records\n", path, n);
+            break;
+        }
+        at_us += (n == 0) ? 0 : record->delta_us;
+        (*records)[n] = (replay_record_t) { at_us, record->type, record->len, buf + at };
+        at += record->len;
+    }
+    return n;
+}
+
+/* Waits for the wall clock to catch up with the trace at 1x. */
+static void replay_pace(uint64_t wall_start_ns, double at_us)
+{
+    uint64_t due = wall_start_ns + (uint64_t)(at_us * 1000.0);
+    uint64_t now = host_now_ns();
+    if (at_us > 0 && due > now) {
+        struct timespec ts = { (due - now) / 1000000000ull, (due - now) % 1000000000ull };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int replay_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+#ifdef TX
+/* Same as the loop body of tx_transmit_task in the normal build, with the
+ * notification taken by hand. */
+static TickType_t replay_tx_pass(beastsquib_espnow_send_param_t *send_param)
+{
+    static bool held = false;
+    host_task_t *task = (host_task_t *)tx_transmit_task_handle;
+    TickType_t wait;
+
+    bool state_changed = task->notify_count != 0;
+    task->notify_count = 0;
+    uint32_t standby_ms = tx_standby_wait_ms(state_changed || held);
+    if (standby_ms != 0)
+    {
+        held |= state_changed;
+        return (standby_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+    }
+    state_changed |= held;
+    held = false;
+    uint32_t wait_ms = tx_transmit_step(send_param, state_changed);
+
+    wait = (wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+    if (wait == 0) {
+        wait = 1;
+    }
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+    if (espnow_channel_tuned != espnow_channels.channel[0] && wait > 1) {
+        espnow_channel_tune(0);
+        wait --;
+    }
+#endif
+    return wait;
+}
+#else
+/* The ESPNOW task's loop body, see beastsquib_espnow_task. */
+static TickType_t replay_espnow_task(void)
+{
+    static uint8_t state_frame[ESPNOW_RX_SLOT_SIZE];
+    beastsquib_espnow_event_t evt;
+    uint32_t state_rx_ticks;
+    int state_len;
+
+    while (espnow_ring_pop(&evt)) {
+    }
+    while (espnow_state_take(state_frame, &state_len, &state_rx_ticks)) {
+        beastsquib_espnow_handle_frame(state_frame, state_len, state_rx_ticks);
+    }
+    if (rx_log_snapshot_due) {
+        rx_log_snapshot();
+    }
+    rx_status_poll();
+    TickType_t radio_wait = rx_radio_poll();
+    TickType_t wait = rx_relay_poll();
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+    TickType_t channel_wait = rx_channel_poll();
+    wait = (channel_wait < wait) ? channel_wait : wait;
+#endif
+    return (radio_wait < wait) ? radio_wait : wait;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    bool fast = false;
+    const char *out_path = NULL;
+    bool usage = false;
+    int opt;
+
+#ifdef TX
+    while ((opt = getopt(argc, argv, "fw:")) != -1) {
+        switch (opt) {
+            case 'f': fast = true; break;
+            case 'w': out_path = optarg; break;
+            default: usage = true; break;
+        }
+    }
+#else
+    bool hear_tx = false;
+    int id = 0;
+
+    while ((opt = getopt(argc, argv, "fti:")) != -1) {
+        switch (opt) {
+            case 'f': fast = true; break;
+            case 't': hear_tx = true; break;
+            case 'i': id = atoi(optarg); break;
+            default: usage = true; break;
+        }
+    }
+    usage |= id < 0 || id >= BEASTSQUIB_MAX_BOARDS;
+#endif
+    if (usage || optind != argc - 1) {
+#ifdef TX
+        fprintf(stderr, "usage: %s [-f] [-w out.trace] trace\n", argv[0]);
+#else
+        fprintf(stderr, "usage: %s [-f] [-t] [-i board_id] trace\n", argv[0]);
+#endif
+        return 2;
+    }
+
+    replay_record_t *records;
+    long count = replay_load(argv[optind], &records);
+    if (count < 0) {
+        return 1;
+    }
+    if (out_path != NULL) {
+        replay_out = fopen(out_path, "wb");
+        if (replay_out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+        fwrite(BEASTSQUIB_TRACE_MAGIC, 1, BEASTSQUIB_TRACE_MAGIC_LEN, replay_out);
+    }
+
+    double duration_us = (count > 0) ? records[count - 1].at_us : 0;
+    long uart = 0, tx = 0, rx = 0;
+    for (long i = 0; i < count; i ++) {
+        uart += records[i].type == BEASTSQUIB_TRACE_UART;
+        tx += records[i].type == BEASTSQUIB_TRACE_TX;
+        rx += records[i].type == BEASTSQUIB_TRACE_RX;
+    }
+    printf("%s: %ld records over %.1f s, %ld UART, %ld TX, %ld RX\n", argv[optind], count, duration_us / 1e6,
+           uart, tx, rx);
+
+    // Boot, a second before the first record
+    replay_now_us = -REPLAY_BOOT_US;
+    host_clock_ns = replay_clock_ns;
+    host_espnow_send_hook = replay_capture;
+    beastsquib_channels_init(&espnow_channels, "", CONFIG_ESPNOW_CHANNEL, false, rx_ticks_now());
+    if (beastsquib_espnow_init() != ESP_OK) {
+        return 1;
+    }
+
+#ifdef TX
+    size_t max_states = (size_t)(duration_us / 1000.0 / REPLAY_TICK_MS) + count + 1024;
+    replay_states_t recorded;
+    replay_states_init(&recorded, max_states);
+    replay_states_init(&replay_sent, max_states);
+    host_task_t *tx_task = (host_task_t *)tx_transmit_task_handle;
+    double wake_us = replay_now_us;
+#else
+    board_id = id;
+    hw_timer_init(hw_timer_callback, NULL);
+    host_task_t *task = (host_task_t *)beastsquib_espnow_task_handle;
+    double timer_us = replay_now_us + 1000.0;
+    double task_us = INFINITY;
+    int pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+    const uint8_t tx_mac[ESP_NOW_ETH_ALEN] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+    long fired = 0, revived = 0;
+#endif
+
+    double *cost_ns = host_malloc((count > 0 ? count : 1) * sizeof(double));
+    size_t costs = 0;
+    static uint8_t uart_buf[UINT16_MAX];
+    uint64_t wall_start = host_now_ns();
+    long next = 0;
+
+    while (1) {
+        double record_us = (next < count) ? records[next].at_us : INFINITY;
+#ifdef TX
+        double event_us = fmin(record_us, wake_us);
+#else
+        double event_us = fmin(record_us, fmin(timer_us, task_us));
+#endif
+        if (event_us > duration_us) {
+            break;
+        }
+        if (!fast) {
+            replay_pace(wall_start, event_us);
+        }
+        replay_now_us = event_us;
+        uint64_t started = host_now_ns();
+        bool is_record = event_us == record_us;
+#ifdef RX
+        bool timeout = false;
+#endif
+
+        if (is_record) {
+            const replay_record_t *r = &records[next ++];
+            switch (r->type) {
+                case BEASTSQUIB_TRACE_UART:
+                    memcpy(uart_buf, r->data, r->len);
+                    uart_command_feed(uart_buf, uart_frame_feed(uart_buf, r->len));
+                    replay_write(r->type, r->data, r->len);
+                    break;
+                case BEASTSQUIB_TRACE_TX:
+#ifdef TX
+                    replay_states_add(&recorded, r->data, r->len, r->at_us);
+#else
+                    if (hear_tx) {
+                        host_espnow_recv_cb(tx_mac, r->data, r->len);
+                    }
+#endif
+                    break;
+                case BEASTSQUIB_TRACE_RX:
+                    if (r->len > ESP_NOW_ETH_ALEN) {
+                        host_espnow_recv_cb(r->data, r->data + ESP_NOW_ETH_ALEN, r->len - ESP_NOW_ETH_ALEN);
+                    }
+                    replay_write(r->type, r->data, r->len);
+                    break;
+                default:
+                    break;
+            }
+        }
+#ifdef TX
+        if (!is_record || tx_task->notify_count != 0) {
+            wake_us = replay_now_us + 1000.0 * REPLAY_TICK_MS * replay_tx_pass(tx_task->arg);
+        }
+#else
+        else if (event_us == timer_us) {
+            timer_us += 1000.0;
+            host_hw_timer_cb(NULL);
+        } else {
+            task_us = INFINITY;
+            timeout = true;
+        }
+        if (timeout || task->notify_count != 0) {
+            task->notify_count = 0;
+            TickType_t wait = replay_espnow_task();
+            task_us = (wait == portMAX_DELAY) ? INFINITY : replay_now_us + 1000.0 * REPLAY_TICK_MS * wait;
+        }
+        if (host_gpio_level[GPIO_OUTPUT_PYRO] != pyro_level) {
+            pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+            printf("  %10.3f s  %s\n", replay_now_us / 1e6, (pyro_level == HIGH) ? "detonated" : "revived");
+            fired += pyro_level == HIGH;
+            revived += pyro_level != HIGH;
+        }
+#endif
+        if (is_record) {
+            cost_ns[costs ++] = host_now_ns() - started;
+        }
+    }
+
+    double wall_s = (host_now_ns() - wall_start) / 1e9;
+    printf("replayed in %.2f s, %.0fx\n", wall_s, (wall_s > 0) ? duration_us / 1e6 / wall_s : 0);
+    if (costs > 0) {
+        qsort(cost_ns, costs, sizeof(double), replay_compare);
+        printf("per record         p50 %6.1f  p99 %6.1f  max %7.1f us\n", cost_ns[costs / 2] / 1000.0,
+               cost_ns[(size_t)(0.99 * (costs - 1))] / 1000.0, cost_ns[costs - 1] / 1000.0);
+    }
+
+#ifdef TX
+    /* The transmitter was sending whatever it had before the trace began,
+     * and frames already on their way still carried it once the server's
+     * first command was written; the replay starts from nothing. */
+    size_t skip = 0;
+    while (skip < 2 && skip < recorded.count && replay_sent.count > 0 && recorded.hash[skip] != replay_sent.hash[0]) {
+        skip ++;
+    }
+    if (skip < recorded.count && replay_sent.count > 0 && recorded.hash[skip] != replay_sent.hash[0]) {
+        skip = 0;
+    }
+    size_t same = 0;
+    while (skip + same < recorded.count && same < replay_sent.count &&
+           recorded.hash[skip + same] == replay_sent.hash[same]) {
+        same ++;
+    }
+    size_t compared = recorded.count - skip;
+    printf("states             %zu recorded, %zu replayed", compared, replay_sent.count);
+    if (recorded.count == 0) {
+        printf("\n");
+    } else if (same == compared && same == replay_sent.count) {
+        printf(", identical\n");
+    } else if (same == compared || same == replay_sent.count) {
+        printf(", the same for the first %zu\n", same);
+    } else {
+        printf(", the same up to %zu, which differs: recorded at %.3f s, replayed at %.3f s\n", same,
+               recorded.at_us[skip + same] / 1e6, replay_sent.at_us[same] / 1e6);
+    }
+    bool ok = recorded.count == 0 || (same == compared && same == replay_sent.count);
+#else
+    uint32_t rejected = 0;
+    for (int i = 0; i < BEASTSQUIB_RX_REJECT_MAX; i ++) {
+        rejected += (i != BEASTSQUIB_RX_ADMIT) ? rx_stats.admit[i] : 0;
+    }
+    printf("frames             %u admitted, %u rejected, %u stale, %u lost\n", rx_stats.admit[BEASTSQUIB_RX_ADMIT],
+           rejected, rx_stats.stale, rx_stats.lost);
+    printf("pyro               %ld detonations, %ld revives, %u silence disarms\n", fired, revived,
+           rx_stats.silence_disarms);
+    bool ok = true;
+#endif
+
+    if (replay_out != NULL) {
+        fclose(replay_out);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,538 @@
+/* Host shim implementation
+
+   See include/host_shim.h. None of this is meant to model the SDK
+   faithfully; it is just enough for the firmware logic to run unmodified.
+*/
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_event_loop.h"
+#include "esp_timer.h"
+#include "tcpip_adapter.h"
+#include "esp_wifi.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "rom/crc.h"
+#include "driver/gpio.h"
+#include "driver/hw_timer.h"
+#include "esp_sleep.h"
+#include "freertos/timers.h"
+#include "driver/uart.h"
+#include "esp_spiffs.h"
+
+/* The shim itself must use the real allocator. */
+#undef malloc
+#undef free
+
+uint64_t host_heap_allocs;
+uint64_t host_heap_frees;
+int host_log_level = ESP_LOG_NONE;
+int host_gpio_level[HOST_GPIO_COUNT];
+uint64_t host_gpio_writes;
+host_espnow_send_hook_t host_espnow_send_hook;
+host_task_t host_tasks[HOST_MAX_TASKS];
+int host_task_count;
+static host_task_t *host_current_task;
+host_uart_write_hook_t host_uart_write_hook;
+esp_now_send_cb_t host_espnow_send_cb;
+esp_now_recv_cb_t host_espnow_recv_cb;
+hw_timer_callback_t host_hw_timer_cb;
+uint32_t host_hw_timer_alarm;
+bool host_hw_timer_reload;
+uint64_t host_hw_timer_alarms;
+uint64_t host_fpm_sleeps;
+uint32_t host_fpm_sleep_us;
+
+void *host_malloc(size_t size)
+{
+    host_heap_allocs ++;
+    return malloc(size);
+}
+
+void host_free(void *ptr)
+{
+    if (ptr != NULL) {
+        host_heap_frees ++;
+    }
+    free(ptr);
+}
+
+uint64_t host_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t (*host_clock_ns)(void) = host_now_ns;
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    va_list args;
+
+    fprintf(stderr, "%c (%s) ", letters[level], tag);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        default: return "UNKNOWN";
+    }
+}
+
+/* Queues */
+
+struct host_queue {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = calloc(length, item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue != NULL) {
+        free(queue->items);
+        free(queue);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout)
+{
+    (void)timeout;
+    if (queue->count == queue->length) {
+        return errQUEUE_FULL;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count ++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout)
+{
+    (void)timeout;
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count --;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->head = 0;
+    queue->count = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+/* Tasks */
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)stack_depth;
+    (void)priority;
+    if (host_task_count == HOST_MAX_TASKS) {
+        return pdFAIL;
+    }
+    host_tasks[host_task_count].fn = fn;
+    host_tasks[host_task_count].arg = arg;
+    host_tasks[host_task_count].name = name;
+    if (handle != NULL) {
+        *handle = &host_tasks[host_task_count];
+    }
+    host_task_count ++;
+    return pdPASS;
+}
+
+bool host_run_task(const char *name)
+{
+    for (int i = 0; i < host_task_count; i ++) {
+        if (strcmp(host_tasks[i].name, name) == 0) {
+            host_task_t *previous = host_current_task;
+            host_current_task = &host_tasks[i];
+            host_tasks[i].fn(host_tasks[i].arg);
+            host_current_task = previous;
+            return true;
+        }
+    }
+    return false;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    ((host_task_t *)task)->notify_count ++;
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    if (host_current_task == NULL || host_current_task->notify_count == 0) {
+        return 0;
+    }
+    uint32_t count = host_current_task->notify_count;
+    host_current_task->notify_count = clear_on_exit ? 0 : count - 1;
+    return count;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback)
+{
+    static int host_timer;
+
+    (void)name;
+    (void)period;
+    (void)auto_reload;
+    (void)id;
+    (void)callback;
+    return &host_timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)timer;
+    (void)ticks_to_wait;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_now_ns() / (1000000ULL * portTICK_PERIOD_MS));
+}
+
+/* System */
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)(host_clock_ns() / 1000);
+}
+
+esp_reset_reason_t host_reset_reason = ESP_RST_POWERON;
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return host_reset_reason;
+}
+
+uint32_t esp_random(void)
+{
+    static uint32_t state = 0x9e3779b9;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+
+/* NVS */
+
+#define HOST_NVS_ENTRIES 32
+#define HOST_NVS_KEY_LEN 32
+#define HOST_NVS_VALUE_LEN 256
+
+typedef struct {
+    bool used;
+    char ns[HOST_NVS_KEY_LEN];
+    char key[HOST_NVS_KEY_LEN];
+    size_t length;
+    uint8_t value[HOST_NVS_VALUE_LEN];
+} host_nvs_entry_t;
+
+static host_nvs_entry_t host_nvs[HOST_NVS_ENTRIES];
+static char host_nvs_namespaces[8][HOST_NVS_KEY_LEN];
+static int host_nvs_namespace_count;
+
+void host_nvs_erase(void)
+{
+    memset(host_nvs, 0, sizeof(host_nvs));
+}
+
+static host_nvs_entry_t *host_nvs_find(nvs_handle handle, const char *key, bool create)
+{
+    const char *ns = host_nvs_namespaces[handle];
+    host_nvs_entry_t *free_entry = NULL;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i ++) {
+        if (host_nvs[i].used) {
+            if (strcmp(host_nvs[i].ns, ns) == 0 && strcmp(host_nvs[i].key, key) == 0) {
+                return &host_nvs[i];
+            }
+        } else if (free_entry == NULL) {
+            free_entry = &host_nvs[i];
+        }
+    }
+
+    if (!create || free_entry == NULL) {
+        return NULL;
+    }
+    free_entry->used = true;
+    snprintf(free_entry->ns, sizeof(free_entry->ns), "%s", ns);
+    snprintf(free_entry->key, sizeof(free_entry->key), "%s", key);
+    return free_entry;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    (void)open_mode;
+    for (int i = 0; i < host_nvs_namespace_count; i ++) {
+        if (strcmp(host_nvs_namespaces[i], name) == 0) {
+            *out_handle = i;
+            return ESP_OK;
+        }
+    }
+    if (host_nvs_namespace_count == 8) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    snprintf(host_nvs_namespaces[host_nvs_namespace_count], HOST_NVS_KEY_LEN, "%s", name);
+    *out_handle = host_nvs_namespace_count ++;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle) { (void)handle; }
+esp_err_t nvs_commit(nvs_handle handle) { (void)handle; return ESP_OK; }
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    host_nvs_entry_t *entry = host_nvs_find(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    if (length > HOST_NVS_VALUE_LEN) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    host_nvs_entry_t *entry = host_nvs_find(handle, key, true);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return nvs_get_blob(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    host_nvs_entry_t *entry = host_nvs_find(handle, key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    entry->used = false;
+    return ESP_OK;
+}
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+void tcpip_adapter_init(void) { }
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { (void)config; return ESP_OK; }
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) { (void)storage; return ESP_OK; }
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) { (void)mode; return ESP_OK; }
+esp_err_t esp_wifi_set_max_tx_power(int8_t power) { (void)power; return ESP_OK; }
+esp_err_t esp_wifi_start(void) { return ESP_OK; }
+esp_err_t esp_wifi_set_channel(uint8_t primary, int second) { (void)primary; (void)second; return ESP_OK; }
+
+void esp_wifi_fpm_open(void) { }
+void esp_wifi_fpm_close(void) { }
+void esp_wifi_fpm_set_sleep_type(wifi_sleep_type_t type) { (void)type; }
+void esp_wifi_fpm_do_wakeup(void) { }
+
+esp_err_t esp_wifi_fpm_do_sleep(uint32_t sleep_time_in_us)
+{
+    host_fpm_sleeps ++;
+    host_fpm_sleep_us = sleep_time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf) { (void)conf; return ESP_ERR_NOT_FOUND; }
+
+/* ESP-NOW */
+
+esp_err_t esp_now_init(void) { return ESP_OK; }
+esp_err_t esp_now_deinit(void) { return ESP_OK; }
+esp_err_t esp_now_set_pmk(const uint8_t *pmk) { (void)pmk; return ESP_OK; }
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) { (void)peer; return ESP_OK; }
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    host_espnow_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    host_espnow_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (host_espnow_send_hook != NULL) {
+        host_espnow_send_hook(peer_addr, data, (int)len);
+    }
+    return ESP_OK;
+}
+
+uint16_t crc16_le(uint16_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i ++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+        }
+    }
+    return ~crc;
+}
+
+/* Drivers */
+
+esp_err_t gpio_config(const gpio_config_t *config) { (void)config; return ESP_OK; }
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= HOST_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_gpio_level[gpio_num] = level ? 1 : 0;
+    host_gpio_writes ++;
+    return ESP_OK;
+}
+
+esp_err_t hw_timer_init(hw_timer_callback_t callback, void *arg)
+{
+    (void)arg;
+    host_hw_timer_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t hw_timer_alarm_us(uint32_t value, bool reload)
+{
+    host_hw_timer_alarm = value;
+    host_hw_timer_reload = reload;
+    host_hw_timer_alarms ++;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *config)
+{
+    (void)uart_num;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int no_use)
+{
+    (void)uart_num;
+    (void)rx_buffer_size;
+    (void)tx_buffer_size;
+    (void)no_use;
+    if (uart_queue != NULL) {
+        *uart_queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+    }
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    (void)uart_num;
+    (void)buf;
+    (void)length;
+    (void)ticks_to_wait;
+    return 0;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size)
+{
+    (void)uart_num;
+    if (host_uart_write_hook != NULL) {
+        host_uart_write_hook(src, size);
+    }
+    return (int)size;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num) { (void)uart_num; return ESP_OK; }
@@ -0,0 +1,311 @@
+/* Channel diversity simulation
+
+   Runs the receivers' channel logic (beastsquib_channels_heard,
+   beastsquib_channels_poll) for a fleet of boards against a transmitter
+   that sends each frame on the next channel of the list in turn, as
+   tx_transmit_step does: a burst of three frames 10 ms apart per channel
+   on each state change and a heartbeat period's worth of heartbeats per
+   channel, each wait rounded up to a 10 ms tick. Three runs with the same
+   commands and the same interference:
+
+   - one channel, the first of the list, as before;
+   - every channel, receivers hopping with the transmitter;
+   - every channel, receivers locking onto the best one.
+
+   The first channel is busy with other gear in bursts averaging -o
+   seconds, with clean spells averaging -f seconds between them; while it
+   is busy a board loses -b percent of the frames on it. Every frame is
+   also lost with probability -p, plus up to 20% more per board and
+   channel, fixed for the run. Boards wake for every frame on their
+   channel and when the wait rx_channel_poll asked for ends, and change
+   channel at once.
+
+   Reports how long state changes take to reach the boards, how many reach
+   them within the one second silence timeout, how often a board goes
+   silent long enough to disarm, how often boards change channel and the
+   frames sent per second.
+
+   Usage: sim_channels [-n boards] [-c channels] [-p loss_percent] [-b busy_loss_percent]
+                       [-o busy_s] [-f clean_s] [-D dwell_ms] [-d seconds] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS 100.0
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_TICK_MS 10.0
+#define SIM_MEAN_COMMAND_GAP_MS 2000.0
+#define SIM_SILENCE_MS 1000.0
+
+typedef struct {
+    beastsquib_channels_t ch;
+    int extra_loss[BEASTSQUIB_MAX_CHANNELS];
+    double next_poll;
+    int state;                            // Newest state applied
+    double last_fresh;
+} sim_board_t;
+
+typedef struct {
+    double *samples;
+    size_t count;
+} sim_samples_t;
+
+typedef struct {
+    int boards;
+    const char *channels;
+    int loss_percent;
+    int busy_loss_percent;
+    double busy_ms;
+    double clean_ms;
+    uint32_t dwell_ms;
+    double duration_ms;
+    uint32_t seed;
+} sim_params_t;
+
+static double *sim_command_at;
+static int sim_max_commands;
+
+static uint32_t sim_xorshift(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static double sim_uniform(uint32_t *seed)
+{
+    return (sim_xorshift(seed) + 0.5) / 4294967296.0;
+}
+
+static double sim_exponential(uint32_t *seed, double mean)
+{
+    return -mean * log(sim_uniform(seed));
+}
+
+static double sim_ticks(double ms)
+{
+    double ticks = ceil(ms / SIM_TICK_MS - 1e-9);
+    return ((ticks < 1) ? 1 : ticks) * SIM_TICK_MS;
+}
+
+static void sim_add(sim_samples_t *s, double value)
+{
+    s->samples[s->count ++] = value;
+}
+
+static int sim_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double sim_percentile(const sim_samples_t *s, double p)
+{
+    size_t i = (size_t)(p / 100.0 * (s->count - 1) + 0.5);
+    return s->samples[i];
+}
+
+/* Calls beastsquib_channels_poll every time the board's ESPNOW task would
+ * have woken for it, up to now. */
+static void sim_poll(sim_board_t *b, double now, uint32_t dwell_ms)
+{
+    while (b->next_poll <= now) {
+        uint32_t wait = beastsquib_channels_poll(&b->ch, (uint32_t)b->next_poll, dwell_ms);
+        b->next_poll = (wait == UINT32_MAX) ? INFINITY : b->next_poll + sim_ticks(wait);
+    }
+}
+
+static void sim_run(const char *name, const sim_params_t *params, const char *channels, bool hop)
+{
+    uint32_t seed = params->seed;
+    uint32_t interference_seed = params->seed ^ 0x1f2e3d4c;
+    uint32_t command_seed = params->seed ^ 0x5a5a5a5a;
+    sim_board_t *boards = host_malloc(params->boards * sizeof(sim_board_t));
+    sim_samples_t latency = { host_malloc((size_t)sim_max_commands * params->boards * sizeof(double)), 0 };
+    beastsquib_channels_t tx;
+    size_t frames = 0, silences = 0, switches = 0;
+
+    beastsquib_channels_init(&tx, channels, 1, hop, 0);
+    for (int i = 0; i < params->boards; i ++) {
+        sim_board_t *b = &boards[i];
+        memset(b, 0, sizeof(*b));
+        beastsquib_channels_init(&b->ch, channels, 1, hop, 0);
+        for (int k = 0; k < BEASTSQUIB_MAX_CHANNELS; k ++) {
+            // The first channel fades the same whether it is alone or not
+            b->extra_loss[k] = sim_xorshift(&seed) % 21;
+        }
+        b->next_poll = 0;
+    }
+
+    // The first channel of the full list is the busy one
+    double busy_until = -1, clean_until = sim_exponential(&interference_seed, params->clean_ms);
+    double next_command = sim_exponential(&command_seed, SIM_MEAN_COMMAND_GAP_MS);
+    int commands = 0, frame_state = 0;
+    uint32_t seq = 0;
+    int rotation = 0, burst_left = 0;
+    double now = 0;
+
+    while (now < params->duration_ms) {
+        bool state_changed = false;
+
+        if (next_command <= now && commands < sim_max_commands - 1) {
+            // tx_state_changed wakes the transmit task, which sends at once
+            sim_command_at[++ commands] = next_command;
+            next_command += sim_exponential(&command_seed, SIM_MEAN_COMMAND_GAP_MS);
+            state_changed = true;
+        }
+
+        while (now >= clean_until && now >= busy_until) {
+            if (busy_until < clean_until) {
+                busy_until = clean_until + sim_exponential(&interference_seed, params->busy_ms);
+            } else {
+                clean_until = busy_until + sim_exponential(&interference_seed, params->clean_ms);
+            }
+        }
+        bool busy = now >= clean_until && now < busy_until;
+
+        if (state_changed || rotation == 0) {
+            frame_state = commands;
+        }
+        int index = rotation;
+        rotation = (rotation + 1) % tx.count;
+        seq ++;
+        frames ++;
+
+        for (int i = 0; i < params->boards; i ++) {
+            sim_board_t *b = &boards[i];
+            sim_poll(b, now, params->dwell_ms);
+            if (b->ch.current != index) {
+                continue;
+            }
+            int loss = params->loss_percent + b->extra_loss[index];
+            if (index == 0 && busy) {
+                loss += params->busy_loss_percent;
+            }
+            if ((int)(sim_xorshift(&seed) % 100) < loss) {
+                continue;
+            }
+
+            beastsquib_channels_heard(&b->ch, 1, seq, (uint32_t)now);
+            if (now - b->last_fresh > SIM_SILENCE_MS) {
+                silences ++;
+            }
+            b->last_fresh = now;
+            for (int s = b->state + 1; s <= frame_state; s ++) {
+                sim_add(&latency, now - sim_command_at[s]);
+            }
+            if (frame_state > b->state) {
+                b->state = frame_state;
+            }
+            // The ESPNOW task calls rx_channel_poll after every frame
+            b->next_poll = now;
+            sim_poll(b, now, params->dwell_ms);
+        }
+
+        if (state_changed) {
+            burst_left = SIM_BURST_FRAMES * tx.count;
+        }
+        if (burst_left > 0) {
+            burst_left --;
+        }
+        double wait = (burst_left > 0) ? SIM_BURST_SPACING_MS : sim_ticks(floor(SIM_HEARTBEAT_MS / tx.count));
+        now = (next_command < now + wait) ? fmax(next_command, now) : now + wait;
+    }
+
+    for (int i = 0; i < params->boards; i ++) {
+        sim_board_t *b = &boards[i];
+        sim_poll(b, now, params->dwell_ms);
+        if (now - b->last_fresh > SIM_SILENCE_MS) {
+            silences ++;
+        }
+        switches += b->ch.switches;
+    }
+
+    size_t reached = 0;
+    for (size_t i = 0; i < latency.count; i ++) {
+        reached += latency.samples[i] < SIM_SILENCE_MS;
+    }
+    size_t expected = (size_t)commands * params->boards;
+    double board_minutes = params->boards * params->duration_ms / 60000.0;
+
+    qsort(latency.samples, latency.count, sizeof(double), sim_compare);
+    printf("%s\n", name);
+    if (latency.count > 0) {
+        printf("  command-to-board   p50 %6.1f  p90 %6.1f  p99 %6.1f  max %7.1f ms\n", sim_percentile(&latency, 50),
+               sim_percentile(&latency, 90), sim_percentile(&latency, 99), latency.samples[latency.count - 1]);
+    }
+    printf("  reached in 1 s     %6.2f%%  silences %.2f per board-minute\n", 100.0 * reached / expected,
+           silences / board_minutes);
+    printf("  channel changes    %.1f per board-minute  frames %.1f/s\n", switches / board_minutes,
+           frames * 1000.0 / params->duration_ms);
+
+    host_free(latency.samples);
+    host_free(boards);
+}
+
+int main(int argc, char **argv)
+{
+    sim_params_t params = {
+        .boards = 200,
+        .channels = "1,6,11",
+        .loss_percent = 5,
+        .busy_loss_percent = 90,
+        .busy_ms = 8000,
+        .clean_ms = 8000,
+        .dwell_ms = 250,
+        .duration_ms = 600000,
+        .seed = 0x5eed1234,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:p:b:o:f:D:d:s:")) != -1) {
+        switch (opt) {
+            case 'n': params.boards = atoi(optarg); break;
+            case 'c': params.channels = optarg; break;
+            case 'p': params.loss_percent = atoi(optarg); break;
+            case 'b': params.busy_loss_percent = atoi(optarg); break;
+            case 'o': params.busy_ms = atof(optarg) * 1000.0; break;
+            case 'f': params.clean_ms = atof(optarg) * 1000.0; break;
+            case 'D': params.dwell_ms = atoi(optarg); break;
+            case 'd': params.duration_ms = atof(optarg) * 1000.0; break;
+            case 's': params.seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n boards] [-c channels] [-p loss_percent] [-b busy_loss_percent]\n"
+                                "          [-o busy_s] [-f clean_s] [-D dwell_ms] [-d seconds] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    beastsquib_channels_t list;
+    beastsquib_channels_init(&list, params.channels, 0, false, 0);
+    if (params.boards < 1 || list.count < 2 || params.loss_percent < 0 || params.busy_loss_percent < 0 ||
+        params.busy_ms <= 0 || params.clean_ms <= 0 || params.dwell_ms < 1 || params.duration_ms < 1000 ||
+        params.seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    sim_max_commands = params.duration_ms / SIM_MEAN_COMMAND_GAP_MS * 2 + 64;
+    sim_command_at = host_malloc(sim_max_commands * sizeof(double));
+
+    char first[4];
+    snprintf(first, sizeof(first), "%u", (unsigned)list.channel[0]);
+    printf("%d boards, channels %s, %d%% loss, %d%% more on channel %s for %.0f s in every %.0f s, %.0f s\n",
+           params.boards, params.channels, params.loss_percent, params.busy_loss_percent, first,
+           params.busy_ms / 1000.0, (params.busy_ms + params.clean_ms) / 1000.0, params.duration_ms / 1000.0);
+
+    sim_run("one channel", &params, first, false);
+    sim_run("every channel, hopping", &params, params.channels, true);
+    sim_run("every channel, locking", &params, params.channels, false);
+
+    host_free(sim_command_at);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/* Clock sync simulation
+
+   Runs the receivers' clock discipline (beastsquib_clock_sample and
+   beastsquib_clock_to_local) against a simulated transmitter and reports
+   how closely a scheduled detonation fires across the fleet.
+
+   Time is simulated in milliseconds. The transmitter clock is the
+   reference. Each receiver's hw_timer_ticks starts at a random boot time
+   and runs fast or slow by a random drift up to -d ppm. Every frame reaches
+   each receiver after the base delay plus an exponential jitter, or is lost.
+
+   Frames follow the transmit schedule: a heartbeat, and a burst of three
+   frames 10 ms apart whenever a detonation arrives. A detonation is
+   scheduled -D ms after it arrives at the transmitter. Each receiver
+   converts that time to its own ticks on the first frame it hears and fires
+   on the tick, or straight away if that tick has already passed ("late").
+   For comparison the report also shows boards firing as soon as they hear
+   a frame, which is what a delay of 0 does.
+
+   Usage: sim_clock [-r receivers] [-e events] [-d drift_ppm] [-j jitter_ms]
+                    [-b base_delay_ms] [-p loss_percent] [-D delay_ms] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS 100.0
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_WARMUP_MS 5000.0
+#define SIM_MEAN_EVENT_GAP_MS 2000.0
+
+typedef struct {
+    beastsquib_clock_t clock;
+    double boot_ms;
+    double rate;
+    bool heard;                           // Heard a frame of the current event
+    double fire;                          // True time it fires the current event
+    double first_rx;                      // True time it first heard the current event
+} sim_receiver_t;
+
+static uint32_t sim_seed;
+
+static uint32_t sim_rand(void)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = sim_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_seed = x;
+    return x;
+}
+
+static double sim_uniform(void)
+{
+    return (sim_rand() + 0.5) / 4294967296.0;
+}
+
+static uint32_t sim_local_ticks(const sim_receiver_t *rx, double t)
+{
+    return (uint32_t)floor((t + rx->boot_ms) * rx->rate);
+}
+
+static double sim_tick_time(const sim_receiver_t *rx, uint32_t tick)
+{
+    return tick / rx->rate - rx->boot_ms;
+}
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_report(const char *what, double *samples, size_t count)
+{
+    qsort(samples, count, sizeof(double), sim_compare_double);
+    printf("  %-22s p50 %6.2f  p90 %6.2f  p99 %6.2f  max %7.2f ms\n", what,
+           samples[(size_t)(0.50 * (count - 1))], samples[(size_t)(0.90 * (count - 1))],
+           samples[(size_t)(0.99 * (count - 1))], samples[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int receivers = 50;
+    int events = 1000;
+    double drift_ppm = 40;
+    double jitter_ms = 1.0;
+    double base_ms = 1.0;
+    int loss_percent = 10;
+    double delay_ms = 250;
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:e:d:j:b:p:D:s:")) != -1) {
+        switch (opt) {
+            case 'r': receivers = atoi(optarg); break;
+            case 'e': events = atoi(optarg); break;
+            case 'd': drift_ppm = atof(optarg); break;
+            case 'j': jitter_ms = atof(optarg); break;
+            case 'b': base_ms = atof(optarg); break;
+            case 'p': loss_percent = atoi(optarg); break;
+            case 'D': delay_ms = atof(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-r receivers] [-e events] [-d drift_ppm] [-j jitter_ms] "
+                        "[-b base_delay_ms] [-p loss_percent] [-D delay_ms] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (receivers < 2 || events < 1 || drift_ppm < 0 || jitter_ms < 0 || base_ms < 0 ||
+        loss_percent < 0 || loss_percent >= 100 || delay_ms < 1 || seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    sim_seed = seed;
+    double loss = loss_percent / 100.0;
+
+    sim_receiver_t *rx = host_malloc(receivers * sizeof(sim_receiver_t));
+    double *error = host_malloc((size_t)receivers * events * sizeof(double));
+    double *spread = host_malloc(events * sizeof(double));
+    double *spread_on_receipt = host_malloc(events * sizeof(double));
+    size_t error_count = 0;
+    size_t late = 0;
+
+    for (int i = 0; i < receivers; i ++) {
+        memset(&rx[i].clock, 0, sizeof(rx[i].clock));
+        rx[i].boot_ms = sim_uniform() * 600000.0;
+        rx[i].rate = 1.0 + (2.0 * sim_uniform() - 1.0) * drift_ppm * 1e-6;
+    }
+
+    double next_frame = 0;
+    double next_event = SIM_WARMUP_MS;
+    int burst_left = 0;
+    int event = -1;
+    uint32_t fire_at_ms = 0;
+
+    while (true) {
+        if (next_event <= next_frame) {
+            if (event >= 0) {
+                double lo = INFINITY, hi = -INFINITY, lo_rx = INFINITY, hi_rx = -INFINITY;
+                for (int i = 0; i < receivers; i ++) {
+                    lo = fmin(lo, rx[i].fire);
+                    hi = fmax(hi, rx[i].fire);
+                    lo_rx = fmin(lo_rx, rx[i].first_rx);
+                    hi_rx = fmax(hi_rx, rx[i].first_rx);
+                    error[error_count ++] = fabs(rx[i].fire - fire_at_ms);
+                }
+                spread[event] = hi - lo;
+                spread_on_receipt[event] = hi_rx - lo_rx;
+            }
+            if (++ event == events) {
+                break;
+            }
+
+            // A detonation reaches the transmitter and starts a burst
+            fire_at_ms = (uint32_t)floor(next_event) + (uint32_t)delay_ms;
+            for (int i = 0; i < receivers; i ++) {
+                rx[i].heard = false;
+            }
+            next_frame = next_event;
+            burst_left = SIM_BURST_FRAMES;
+            next_event += delay_ms + 200.0 - SIM_MEAN_EVENT_GAP_MS * log(sim_uniform());
+        }
+
+        double send_at = next_frame;
+        uint32_t tx_ms = (uint32_t)floor(send_at);
+        bool all_heard = true;
+
+        if (burst_left > 0) {
+            burst_left --;
+        }
+        next_frame += (burst_left > 0) ? SIM_BURST_SPACING_MS : SIM_HEARTBEAT_MS;
+
+        for (int i = 0; i < receivers; i ++) {
+            if (sim_uniform() >= loss) {
+                double arrival = send_at + base_ms - jitter_ms * log(sim_uniform());
+                uint32_t ticks = sim_local_ticks(&rx[i], arrival);
+                beastsquib_clock_sample(&rx[i].clock, tx_ms, ticks);
+
+                if (event >= 0 && !rx[i].heard) {
+                    uint32_t fire_tick = beastsquib_clock_to_local(&rx[i].clock, fire_at_ms);
+                    rx[i].heard = true;
+                    rx[i].first_rx = arrival;
+                    if ((int32_t)(fire_tick - ticks) <= 0) {
+                        rx[i].fire = arrival;
+                        late ++;
+                    } else {
+                        rx[i].fire = sim_tick_time(&rx[i], fire_tick);
+                    }
+                }
+            }
+            all_heard &= (event < 0 || rx[i].heard);
+        }
+
+        // Every receiver must have heard this event before the next one
+        if (!all_heard && next_event <= next_frame) {
+            next_event = next_frame + 1;
+        }
+    }
+
+    printf("%d receivers, %d events, drift +-%.0f ppm, delay %.1f ms + exp(%.1f ms), %d%% loss, "
+           "detonation delay %.0f ms\n", receivers, events, drift_ppm, base_ms, jitter_ms,
+           loss_percent, delay_ms);
+    printf("scheduled detonation\n");
+    sim_report("error vs. target", error, error_count);
+    sim_report("spread across boards", spread, events);
+    printf("  %-22s %zu of %zu\n", "late", late, error_count);
+    printf("firing on receipt\n");
+    sim_report("spread across boards", spread_on_receipt, events);
+
+    host_free(spread_on_receipt);
+    host_free(spread);
+    host_free(error);
+    host_free(rx);
+
+    return 0;
+}
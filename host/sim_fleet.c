@@ -0,0 +1,639 @@
+/* Fleet simulation
+
+   Plays a whole game against a fleet of receivers running the real
+   firmware, to compare transmit schedules before a production.
+
+   The transmitter is the transmitter build (sim_fleet_tx.c): the server's
+   commands go in through its UART parser and tx_transmit_task's loop body
+   runs whenever it is notified or its wait ends, on a virtual clock. Every
+   frame it sends is logged.
+
+   Each board is then the receiver build in a process of its own, forked
+   from a parent that never touches the firmware state, -J at a time.
+   Logged frames go in through the ESP-NOW receive callback, the ESPNOW
+   task's loop body runs when it is notified or its timeout ends, and
+   hw_timer_callback runs on the ticks where it has work: a scheduled
+   detonation, a status slot, the silence timeout or a disarm, as
+   rx_timer_arm works them out for the low power build. On the other ticks
+   it would only blink the LED, so they are skipped.
+
+   The board's clock runs up to -r ppm off the transmitter's, from a boot
+   up to 5 s before it. Every frame reaches it 1 ms plus up to -j ms after
+   being sent, never before the one sent ahead of it. Its link loses frames
+   with a probability fixed for the board, averaging -p percent, and goes
+   through bursts of total loss averaging -l ms, -e percent of the time.
+
+   The game is armed throughout and played in -R rounds: in each, every
+   player is killed at a random time in the first 80% and revived at its
+   end. The server sends a #DEP for each kill and resends the whole state
+   with #ARM every second, like webserver.py. A kill that finds its board
+   still fired from the round before, the revive never having reached it,
+   counts as detonating at once.
+
+   Reports, for each transmit schedule given with -S as a #TXS would set it
+   (bursts, spacing ms, heartbeat ms), how long kills take to detonate,
+   kills that never did, detonations with no kill outstanding and boards
+   disarmed by a second without frames.
+
+   Usage: sim_fleet [-n boards] [-d seconds] [-R rounds] [-p loss_percent] [-e burst_percent]
+                    [-l burst_ms] [-j jitter_ms] [-r drift_ppm] [-D delay_ms]
+                    [-S count,spacing_ms,heartbeat_ms]... [-J jobs] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include "sim_fleet.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define SIM_TICK_MS ((double)portTICK_RATE_MS)
+#define SIM_ARM_US 1e6
+#define SIM_GAME_START_US 5e6
+#define SIM_RESEND_US 1e6
+#define SIM_MAX_BOOT_US 5e6
+#define SIM_LATE_US 5e6
+#define SIM_MAX_ROUNDS 64
+#define SIM_MAX_STRATEGIES 8
+
+typedef struct {
+    int count;
+    int spacing_ms;
+    int heartbeat_ms;
+} sim_strategy_t;
+
+typedef struct {
+    int boards;
+    double duration_us;
+    int rounds;
+    double loss_percent;
+    double burst_percent;
+    double burst_ms;
+    double jitter_ms;
+    double drift_ppm;
+    int delay_ms;
+    int jobs;
+    uint32_t seed;
+} sim_params_t;
+
+typedef struct {
+    double at_us;                         // Sent, on the transmitter clock
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} sim_frame_t;
+
+typedef struct {
+    double at_us;
+    int board;
+} sim_kill_t;
+
+typedef struct {
+    float latency_ms[SIM_MAX_ROUNDS];     // Kill to detonation, negative if it never fired
+    uint32_t spurious;                    // Detonations with no kill outstanding
+    uint32_t silence_disarms;
+    uint32_t delivered;
+    uint32_t lost;
+    uint32_t status_sent;
+} sim_result_t;
+
+static sim_params_t sim_params;
+static sim_kill_t *sim_kills;             // Sorted by time
+static double *sim_kill_at;               // Per board and round
+static sim_frame_t *sim_frames;           // Shared with the forked transmitter
+static size_t *sim_frame_count;
+static size_t sim_max_frames;
+static sim_result_t *sim_results;         // Shared with the forked boards
+
+static double sim_now_us;
+static double sim_boot_us;
+static double sim_rate = 1.0;
+static uint32_t sim_status_sent;
+
+static uint32_t sim_xorshift(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static double sim_uniform(uint32_t *seed)
+{
+    return (sim_xorshift(seed) + 0.5) / 4294967296.0;
+}
+
+static double sim_exponential(uint32_t *seed, double mean)
+{
+    return -mean * log(sim_uniform(seed));
+}
+
+static int sim_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int sim_compare_kill(const void *a, const void *b)
+{
+    return sim_compare(&((const sim_kill_t *)a)->at_us, &((const sim_kill_t *)b)->at_us);
+}
+
+static double sim_round_us(void)
+{
+    return (sim_params.duration_us - SIM_GAME_START_US) / sim_params.rounds;
+}
+
+static double sim_round_end_us(int round)
+{
+    return SIM_GAME_START_US + (round + 1) * sim_round_us();
+}
+
+/* Local clock of whichever firmware is running. */
+static uint64_t sim_clock_ns(void)
+{
+    return (uint64_t)((sim_now_us - sim_boot_us) * sim_rate * 1000.0);
+}
+
+/* Transmitter */
+
+static void sim_tx_capture(const uint8_t *mac, const uint8_t *data, int len)
+{
+    if (*sim_frame_count >= sim_max_frames) {
+        fprintf(stderr, "frame log full\n");
+        exit(1);
+    }
+    sim_frame_t *f = &sim_frames[(*sim_frame_count) ++];
+    f->at_us = sim_now_us;
+    f->len = len;
+    memcpy(f->data, data, len);
+}
+
+static void sim_tx_send_page(const uint8_t *bits, int page)
+{
+    char command[16 + 2 * BEASTSQUIB_PAGE_BYTES];
+    int len = snprintf(command, sizeof(command), "#DEP,%d,", page);
+
+    for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+        len += snprintf(command + len, sizeof(command) - len, "%02X", bits[page * BEASTSQUIB_PAGE_BYTES + i]);
+    }
+    snprintf(command + len, sizeof(command) - len, ";");
+    fleet_tx_command(command);
+}
+
+/* Runs the transmitter through the game, logging every frame it sends. */
+static void sim_tx_run(const sim_strategy_t *strategy)
+{
+    int pages = (sim_params.boards + BEASTSQUIB_PAGE_BITS - 1) / BEASTSQUIB_PAGE_BITS;
+    uint8_t bits[BEASTSQUIB_MAX_PAGES * BEASTSQUIB_PAGE_BYTES] = { 0 };
+    size_t kills = (size_t)sim_params.boards * sim_params.rounds;
+    size_t next_kill = 0;
+    int round = 0;
+    double resend_us = SIM_ARM_US;
+    double wake_us = INFINITY;
+    char command[32];
+
+    sim_now_us = 0;
+    sim_boot_us = 0;
+    sim_rate = 1.0;
+    host_clock_ns = sim_clock_ns;
+    host_espnow_send_hook = sim_tx_capture;
+    fleet_tx_init();
+
+    snprintf(command, sizeof(command), "#TXS,%02d,%03d,%04d;", strategy->count, strategy->spacing_ms,
+             strategy->heartbeat_ms);
+    fleet_tx_command(command);
+    snprintf(command, sizeof(command), "#DLY,%04d;", sim_params.delay_ms);
+    fleet_tx_command(command);
+    wake_us = 0;
+
+    while (sim_now_us < sim_params.duration_us) {
+        double kill_us = (next_kill < kills) ? sim_kills[next_kill].at_us : INFINITY;
+        double end_us = (round < sim_params.rounds) ? sim_round_end_us(round) : INFINITY;
+        double next = fmin(fmin(kill_us, end_us), fmin(resend_us, wake_us));
+        bool timeout = false;
+
+        sim_now_us = next;
+        if (next == wake_us) {
+            timeout = true;
+        } else if (next == kill_us) {
+            int board = sim_kills[next_kill ++].board;
+            bits[board / 8] |= 1 << (board % 8);
+            sim_tx_send_page(bits, board / BEASTSQUIB_PAGE_BITS);
+        } else if (next == end_us) {
+            memset(bits, 0, sizeof(bits));
+            for (int page = 0; page < pages; page ++) {
+                sim_tx_send_page(bits, page);
+            }
+            round ++;
+        } else {
+            for (int page = 0; page < pages; page ++) {
+                sim_tx_send_page(bits, page);
+            }
+            fleet_tx_command("#ARM,1;");
+            resend_us += SIM_RESEND_US;
+        }
+
+        if (timeout || fleet_tx_notified()) {
+            wake_us = sim_now_us + 1000.0 * SIM_TICK_MS * fleet_tx_pass();
+        }
+    }
+}
+
+/* Boards */
+
+static void sim_board_sent(const uint8_t *mac, const uint8_t *data, int len)
+{
+    sim_status_sent ++;
+}
+
+/* The ESPNOW task's loop body, see beastsquib_espnow_task. */
+static TickType_t sim_espnow_task(void)
+{
+    static uint8_t state_frame[ESPNOW_RX_SLOT_SIZE];
+    beastsquib_espnow_event_t evt;
+    uint32_t state_rx_ticks;
+    int state_len;
+
+    while (espnow_ring_pop(&evt)) {
+    }
+    while (espnow_state_take(state_frame, &state_len, &state_rx_ticks)) {
+        beastsquib_espnow_handle_frame(state_frame, state_len, state_rx_ticks);
+    }
+    if (rx_log_snapshot_due) {
+        rx_log_snapshot();
+    }
+    rx_status_poll();
+    TickType_t radio_wait = rx_radio_poll();
+    TickType_t wait = rx_relay_poll();
+    return (radio_wait < wait) ? radio_wait : wait;
+}
+
+/* Simulated time of the board's local tick, half a microsecond in so that
+ * rounding never puts it on the tick before. */
+static double sim_board_tick_us(uint32_t tick)
+{
+    return sim_boot_us + (tick * 1000.0 + 0.5) / sim_rate;
+}
+
+/* The next tick hw_timer_callback has work on, as rx_timer_arm has it. */
+static double sim_timer_due_us(void)
+{
+    uint32_t now = rx_ticks_now();
+    int32_t wait = INT32_MAX;
+
+    if (!rx_silent) {
+        wait = (int32_t)(rx_last_frame_at + ESPNOW_SILENCE_TICKS_TIMEOUT + 1 - now);
+    } else if (pyro_armed) {
+        wait = 1;
+    }
+    if (pyro_fire_pending && (int32_t)(pyro_fire_at - now) < wait) {
+        wait = (int32_t)(pyro_fire_at - now);
+    }
+    if (rx_status_due && (int32_t)(rx_status_at - now) < wait) {
+        wait = (int32_t)(rx_status_at - now);
+    }
+    if (wait == INT32_MAX) {
+        return INFINITY;
+    }
+    return sim_board_tick_us(now + ((wait < 1) ? 1 : wait));
+}
+
+/* A kill that finds the board still fired, the revive before it never
+ * having reached it, is met at once. */
+static void sim_board_held(sim_result_t *result, const double *kill_at, double fired_us)
+{
+    for (int r = 0; r < sim_params.rounds; r ++) {
+        if (result->latency_ms[r] < 0 && fired_us <= kill_at[r] && kill_at[r] <= sim_now_us) {
+            result->latency_ms[r] = 0;
+        }
+    }
+}
+
+/* Runs one board through the game, in a process of its own. */
+static void sim_board_run(int board, sim_result_t *result)
+{
+    uint32_t seed = sim_params.seed ^ ((uint32_t)(board + 1) * 0x9e3779b9u);
+    const uint8_t tx_mac[ESP_NOW_ETH_ALEN] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+    const double *kill_at = &sim_kill_at[(size_t)board * sim_params.rounds];
+
+    if (seed == 0) {
+        seed = 1;
+    }
+    memset(result, 0, sizeof(*result));
+    for (int r = 0; r < sim_params.rounds; r ++) {
+        result->latency_ms[r] = -1;
+    }
+
+    sim_boot_us = -SIM_MAX_BOOT_US * sim_uniform(&seed);
+    sim_rate = 1.0 + (2.0 * sim_uniform(&seed) - 1.0) * sim_params.drift_ppm * 1e-6;
+    sim_now_us = sim_boot_us;
+    host_clock_ns = sim_clock_ns;
+    host_espnow_send_hook = sim_board_sent;
+
+    if (beastsquib_espnow_init() != ESP_OK) {
+        exit(1);
+    }
+    board_id = board;
+    hw_timer_init(hw_timer_callback, NULL);
+
+    // The link: a loss fixed for the board, and bursts of total loss
+    double link_loss = 2.0 * sim_params.loss_percent / 100.0 * sim_uniform(&seed);
+    double burst_mean_us = sim_params.burst_ms * 1000.0;
+    double clear_mean_us = (sim_params.burst_percent > 0) ?
+        burst_mean_us * (100.0 - sim_params.burst_percent) / sim_params.burst_percent : INFINITY;
+    bool in_burst = false;
+    double burst_switch_us = sim_exponential(&seed, clear_mean_us);
+
+    host_task_t *task = (host_task_t *)beastsquib_espnow_task_handle;
+    size_t frames = *sim_frame_count;
+    size_t next_frame = 0;
+    bool pending = false;
+    double arrival_us = INFINITY;
+    double last_arrival_us = 0;
+    double timer_us = sim_timer_due_us();
+    double task_us = INFINITY;
+    int pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+    double fired_us = 0;
+
+    while (1) {
+        // The next frame the link delivers, never ahead of the one before
+        while (!pending) {
+            arrival_us = INFINITY;
+            if (next_frame == frames) {
+                break;
+            }
+            const sim_frame_t *f = &sim_frames[next_frame];
+            while (burst_switch_us <= f->at_us) {
+                in_burst = !in_burst;
+                burst_switch_us += sim_exponential(&seed, in_burst ? burst_mean_us : clear_mean_us);
+            }
+            if (in_burst || sim_uniform(&seed) < link_loss) {
+                result->lost ++;
+                next_frame ++;
+                continue;
+            }
+            arrival_us = fmax(f->at_us + 1000.0 + 1000.0 * sim_params.jitter_ms * sim_uniform(&seed), last_arrival_us);
+            pending = true;
+        }
+
+        double next = fmin(arrival_us, fmin(timer_us, task_us));
+        bool timeout = false;
+        if (next >= sim_params.duration_us) {
+            break;
+        }
+        sim_now_us = next;
+
+        if (next == arrival_us) {
+            const sim_frame_t *f = &sim_frames[next_frame ++];
+            host_espnow_recv_cb(tx_mac, f->data, f->len);
+            result->delivered ++;
+            last_arrival_us = next;
+            pending = false;
+        } else if (next == timer_us) {
+            host_hw_timer_cb(NULL);
+        } else {
+            task_us = INFINITY;
+            timeout = true;
+        }
+
+        if (timeout || task->notify_count != 0) {
+            task->notify_count = 0;
+            TickType_t wait = sim_espnow_task();
+            task_us = (wait == portMAX_DELAY) ? INFINITY : sim_now_us + 1000.0 * SIM_TICK_MS * wait;
+        }
+        timer_us = sim_timer_due_us();
+
+        if (host_gpio_level[GPIO_OUTPUT_PYRO] != pyro_level) {
+            pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+            if (pyro_level == HIGH) {
+                int round = -1;
+                for (int r = 0; r < sim_params.rounds; r ++) {
+                    if (kill_at[r] <= sim_now_us && sim_now_us < sim_round_end_us(r) + SIM_LATE_US &&
+                        result->latency_ms[r] < 0) {
+                        round = r;
+                        break;
+                    }
+                }
+                if (round >= 0) {
+                    result->latency_ms[round] = (sim_now_us - kill_at[round]) / 1000.0;
+                } else {
+                    result->spurious ++;
+                }
+                fired_us = sim_now_us;
+            } else {
+                sim_board_held(result, kill_at, fired_us);
+            }
+        }
+    }
+    if (pyro_level == HIGH) {
+        sim_board_held(result, kill_at, fired_us);
+    }
+
+    result->silence_disarms = rx_stats.silence_disarms;
+    result->status_sent = sim_status_sent;
+}
+
+/* Plays the game with one transmit schedule and reports it. */
+static void sim_run(const sim_strategy_t *strategy)
+{
+    uint64_t started = host_now_ns();
+
+    *sim_frame_count = 0;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        sim_tx_run(strategy);
+        _exit(0);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "transmitter failed\n");
+        exit(1);
+    }
+
+    int running = 0;
+    for (int board = 0; board < sim_params.boards; board ++) {
+        if (running == sim_params.jobs) {
+            if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "board failed\n");
+                exit(1);
+            }
+            running --;
+        }
+        pid = fork();
+        if (pid == 0) {
+            sim_board_run(board, &sim_results[board]);
+            _exit(0);
+        }
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        running ++;
+    }
+    while (running > 0) {
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "board failed\n");
+            exit(1);
+        }
+        running --;
+    }
+
+    size_t kills = (size_t)sim_params.boards * sim_params.rounds;
+    double *latency = host_malloc(kills * sizeof(double));
+    size_t fired = 0, in_time = 0;
+    uint64_t spurious = 0, disarms = 0, disarmed_boards = 0, delivered = 0, lost = 0, status_sent = 0;
+
+    for (int board = 0; board < sim_params.boards; board ++) {
+        const sim_result_t *result = &sim_results[board];
+        for (int r = 0; r < sim_params.rounds; r ++) {
+            if (result->latency_ms[r] >= 0) {
+                latency[fired ++] = result->latency_ms[r];
+                in_time += result->latency_ms[r] < 1000.0;
+            }
+        }
+        spurious += result->spurious;
+        disarms += result->silence_disarms;
+        disarmed_boards += result->silence_disarms != 0;
+        delivered += result->delivered;
+        lost += result->lost;
+        status_sent += result->status_sent;
+    }
+    qsort(latency, fired, sizeof(double), sim_compare);
+
+    double seconds = sim_params.duration_us / 1e6;
+    double board_hours = sim_params.boards * seconds / 3600.0;
+    printf("%d x %d ms bursts, %d ms heartbeat: %.1f frames/s, %.1f%% lost\n", strategy->count,
+           strategy->spacing_ms, strategy->heartbeat_ms, *sim_frame_count / seconds,
+           100.0 * lost / (delivered + lost));
+    if (fired > 0) {
+        printf("  kill-to-detonate   p50 %6.1f  p90 %6.1f  p99 %6.1f  p99.9 %6.1f  max %7.1f ms\n",
+               latency[(size_t)(0.5 * (fired - 1))], latency[(size_t)(0.9 * (fired - 1))],
+               latency[(size_t)(0.99 * (fired - 1))], latency[(size_t)(0.999 * (fired - 1))], latency[fired - 1]);
+    }
+    printf("  fired in 1 s       %.3f%% of %zu kills  never %zu  spurious %llu\n", 100.0 * in_time / kills, kills,
+           kills - fired, (unsigned long long)spurious);
+    printf("  silence disarms    %llu on %llu boards, %.2f per board-hour\n", (unsigned long long)disarms,
+           (unsigned long long)disarmed_boards, disarms / board_hours);
+    printf("  status reports     %.1f/s from the fleet\n", status_sent / seconds);
+    printf("  ran %.1f board-hours in %.1f s\n", board_hours, (host_now_ns() - started) / 1e9);
+
+    host_free(latency);
+}
+
+static void *sim_shared(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    sim_strategy_t strategies[SIM_MAX_STRATEGIES];
+    int strategy_count = 0;
+    int opt;
+
+    sim_params = (sim_params_t) {
+        .boards = 456,
+        .duration_us = 3600e6,
+        .rounds = 6,
+        .loss_percent = 5,
+        .burst_percent = 1,
+        .burst_ms = 500,
+        .jitter_ms = 3,
+        .drift_ppm = 40,
+        .delay_ms = CONFIG_ESPNOW_DETONATE_DELAY,
+        .jobs = sysconf(_SC_NPROCESSORS_ONLN),
+        .seed = 0x5eed1234,
+    };
+
+    while ((opt = getopt(argc, argv, "n:d:R:p:e:l:j:r:D:S:J:s:")) != -1) {
+        switch (opt) {
+            case 'n': sim_params.boards = atoi(optarg); break;
+            case 'd': sim_params.duration_us = atof(optarg) * 1e6; break;
+            case 'R': sim_params.rounds = atoi(optarg); break;
+            case 'p': sim_params.loss_percent = atof(optarg); break;
+            case 'e': sim_params.burst_percent = atof(optarg); break;
+            case 'l': sim_params.burst_ms = atof(optarg); break;
+            case 'j': sim_params.jitter_ms = atof(optarg); break;
+            case 'r': sim_params.drift_ppm = atof(optarg); break;
+            case 'D': sim_params.delay_ms = atoi(optarg); break;
+            case 'J': sim_params.jobs = atoi(optarg); break;
+            case 's': sim_params.seed = strtoul(optarg, NULL, 0); break;
+            case 'S': {
+                sim_strategy_t *s = &strategies[strategy_count];
+                if (strategy_count == SIM_MAX_STRATEGIES ||
+                    sscanf(optarg, "%d,%d,%d", &s->count, &s->spacing_ms, &s->heartbeat_ms) != 3 ||
+                    s->count < 1 || s->count > 99 || s->spacing_ms < 0 || s->spacing_ms > 999 ||
+                    s->heartbeat_ms < 10 || s->heartbeat_ms > 9999) {
+                    fprintf(stderr, "invalid schedule %s\n", optarg);
+                    return 2;
+                }
+                strategy_count ++;
+                break;
+            }
+            default:
+                fprintf(stderr, "usage: %s [-n boards] [-d seconds] [-R rounds] [-p loss_percent] [-e burst_percent]\n"
+                                "          [-l burst_ms] [-j jitter_ms] [-r drift_ppm] [-D delay_ms]\n"
+                                "          [-S count,spacing_ms,heartbeat_ms]... [-J jobs] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (sim_params.boards < 1 || sim_params.boards > BEASTSQUIB_MAX_BOARDS || sim_params.rounds < 1 ||
+        sim_params.rounds > SIM_MAX_ROUNDS || sim_params.duration_us < SIM_GAME_START_US + 10e6 * sim_params.rounds ||
+        sim_params.loss_percent < 0 || sim_params.loss_percent > 50 || sim_params.burst_percent < 0 ||
+        sim_params.burst_percent >= 100 || sim_params.burst_ms <= 0 || sim_params.jitter_ms < 0 ||
+        sim_params.drift_ppm < 0 || sim_params.delay_ms < 0 || sim_params.delay_ms > 9999 || sim_params.jobs < 1 ||
+        sim_params.seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+    if (strategy_count == 0) {
+        strategies[strategy_count ++] = (sim_strategy_t) { 3, 10, CONFIG_ESPNOW_HEARTBEAT_PERIOD };
+        strategies[strategy_count ++] = (sim_strategy_t) { 2, 20, 250 };
+    }
+
+    // Every player is killed once a round, at the same times for every schedule
+    uint32_t seed = sim_params.seed;
+    size_t kills = (size_t)sim_params.boards * sim_params.rounds;
+    sim_kills = host_malloc(kills * sizeof(sim_kill_t));
+    sim_kill_at = host_malloc(kills * sizeof(double));
+    for (int board = 0; board < sim_params.boards; board ++) {
+        for (int r = 0; r < sim_params.rounds; r ++) {
+            size_t i = (size_t)board * sim_params.rounds + r;
+            sim_kill_at[i] = sim_round_end_us(r) - sim_round_us() * (1.0 - 0.8 * sim_uniform(&seed));
+            sim_kills[i] = (sim_kill_t) { sim_kill_at[i], board };
+        }
+    }
+    qsort(sim_kills, kills, sizeof(sim_kill_t), sim_compare_kill);
+
+    // At most a frame a tick, plus one for each command that wakes the transmit task
+    double resends = sim_params.duration_us / SIM_RESEND_US + 1;
+    sim_max_frames = (size_t)(sim_params.duration_us / 1000.0 / SIM_TICK_MS + kills +
+                              (resends + sim_params.rounds) * (BEASTSQUIB_MAX_PAGES + 1) + 1024);
+    sim_frame_count = sim_shared(sizeof(size_t));
+    sim_frames = sim_shared(sim_max_frames * sizeof(sim_frame_t));
+    sim_results = sim_shared(sim_params.boards * sizeof(sim_result_t));
+
+    printf("%d boards, %.0f s in %d rounds, %.1f%% loss with %.1f%% in %.0f ms bursts, %.0f ms jitter, "
+           "%.0f ppm, %d ms delay\n", sim_params.boards, sim_params.duration_us / 1e6, sim_params.rounds,
+           sim_params.loss_percent, sim_params.burst_percent, sim_params.burst_ms, sim_params.jitter_ms,
+           sim_params.drift_ppm, sim_params.delay_ms);
+    for (int i = 0; i < strategy_count; i ++) {
+        sim_run(&strategies[i]);
+    }
+
+    host_free(sim_kill_at);
+    host_free(sim_kills);
+    return 0;
+}
@@ -0,0 +1,21 @@
+/* Transmitter half of sim_fleet, see sim_fleet_tx.c. */
+
+#ifndef SIM_FLEET_H
+#define SIM_FLEET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Starts the transmitter on the current host clock. */
+void fleet_tx_init(void);
+
+/* Feeds a server command, e.g. "#ARM,1;", to the UART parser. */
+void fleet_tx_command(const char *command);
+
+/* Whether the transmit task has been notified since its last pass. */
+bool fleet_tx_notified(void);
+
+/* One pass of tx_transmit_task's loop. Returns the ticks it then waits. */
+uint32_t fleet_tx_pass(void);
+
+#endif
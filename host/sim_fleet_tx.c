@@ -0,0 +1,66 @@
+/* Transmitter half of sim_fleet
+
+   The transmitter build of the firmware, compiled on its own and linked
+   into the receiver build of sim_fleet with every symbol but these
+   wrappers made local, so that the two builds of espnow_example_main.c
+   can share one program. Frames go out through host_espnow_send_hook.
+*/
+
+#include "espnow_example_main.c"
+
+#include "sim_fleet.h"
+
+void fleet_tx_init(void)
+{
+    beastsquib_channels_init(&espnow_channels, "", CONFIG_ESPNOW_CHANNEL, false, rx_ticks_now());
+    beastsquib_espnow_init();
+}
+
+void fleet_tx_command(const char *command)
+{
+    uart_command_feed((const uint8_t *)command, strlen(command));
+}
+
+bool fleet_tx_notified(void)
+{
+    return ((host_task_t *)tx_transmit_task_handle)->notify_count != 0;
+}
+
+/* Same as the loop body of tx_transmit_task in the normal build, with the
+ * notification taken by hand. */
+uint32_t fleet_tx_pass(void)
+{
+    static beastsquib_espnow_send_param_t *send_param;
+    static bool held = false;
+    host_task_t *task = (host_task_t *)tx_transmit_task_handle;
+    TickType_t wait;
+
+    if (send_param == NULL) {
+        send_param = task->arg;
+    }
+
+    bool state_changed = task->notify_count != 0;
+    task->notify_count = 0;
+    uint32_t standby_ms = tx_standby_wait_ms(state_changed || held);
+    if (standby_ms != 0)
+    {
+        held |= state_changed;
+        return (standby_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+    }
+    state_changed |= held;
+    held = false;
+    uint32_t wait_ms = tx_transmit_step(send_param, state_changed);
+
+    // Round up to whole ticks, and never spin
+    wait = (wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+    if (wait == 0) {
+        wait = 1;
+    }
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+    if (espnow_channel_tuned != espnow_channels.channel[0] && wait > 1) {
+        espnow_channel_tune(0);
+        wait --;
+    }
+#endif
+    return wait;
+}
@@ -0,0 +1,335 @@
+/* Low power receive simulation
+
+   Drives one receiver built with CONFIG_ESPNOW_LOW_POWER through the real
+   firmware on a virtual clock: frames go in through the ESP-NOW receive
+   callback, the ESPNOW task's loop body runs when it is notified or its
+   timeout ends, and hw_timer_callback runs when the one-shot alarm it set
+   comes due. A frame that arrives while the radio is in the modem sleep
+   rx_radio_poll asked for is lost.
+
+   The transmitter is modelled as the low power tx_transmit_task sends:
+   a heartbeat every CONFIG_ESPNOW_HEARTBEAT_PERIOD ms of its clock, sent
+   on the first FreeRTOS tick after it, and a burst of three frames 10 ms
+   apart on each command, held for the next heartbeat unless it is within
+   a tick of one. Commands alternately set and clear the board's bit,
+   detonating -D ms after they reach the transmitter. Its clock runs -r ppm
+   off the board's, and frames arrive 1 ms plus up to -j ms after being
+   sent; each is lost with probability -p.
+
+   Reports the timer interrupt rate, the radio duty cycle and the #PWR
+   line the board would print, against the 1 kHz timer and an always-on
+   radio of the normal build, and how long commands take to fire.
+
+   Usage: sim_power [-d seconds] [-p loss_percent] [-j jitter_ms] [-r drift_ppm]
+                    [-D delay_ms] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS ((double)CONFIG_ESPNOW_HEARTBEAT_PERIOD)
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_TICK_MS ((double)portTICK_RATE_MS)
+#define SIM_MEAN_COMMAND_GAP_MS 3000.0
+#define SIM_FRAME_LEN (sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES)
+#define SIM_BOARD_ID 37
+#define SIM_MAX_COMMANDS 8192
+
+static uint32_t sim_seed;
+static double sim_now_us;
+
+/* Transmitter clock: tx ms = offset + rate * board ms. */
+static double sim_tx_offset_ms;
+static double sim_tx_rate;
+
+static uint32_t sim_xorshift(void)
+{
+    uint32_t x = sim_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_seed = x;
+    return x;
+}
+
+static double sim_uniform(void)
+{
+    return (sim_xorshift() + 0.5) / 4294967296.0;
+}
+
+static uint64_t sim_clock_ns(void)
+{
+    return (uint64_t)(sim_now_us * 1000.0);
+}
+
+static double sim_tx_ms(double board_us)
+{
+    return sim_tx_offset_ms + sim_tx_rate * board_us / 1000.0;
+}
+
+static double sim_board_us(double tx_ms)
+{
+    return (tx_ms - sim_tx_offset_ms) / sim_tx_rate * 1000.0;
+}
+
+/* The first transmitter tick at or after the heartbeat following tx_ms. */
+static double sim_next_heartbeat(double tx_ms, double tick_phase)
+{
+    double beat = floor(tx_ms / SIM_HEARTBEAT_MS) * SIM_HEARTBEAT_MS + SIM_HEARTBEAT_MS;
+    return beat + tick_phase;
+}
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_report(const char *what, double *samples, size_t count)
+{
+    if (count == 0) {
+        printf("  %-26s none\n", what);
+        return;
+    }
+    qsort(samples, count, sizeof(double), sim_compare_double);
+    printf("  %-26s p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f ms\n", what,
+           samples[(size_t)(0.50 * (count - 1))], samples[(size_t)(0.90 * (count - 1))],
+           samples[(size_t)(0.99 * (count - 1))], samples[count - 1]);
+}
+
+static uint64_t sim_status_sent;
+
+static void sim_send_hook(const uint8_t *mac, const uint8_t *data, int len)
+{
+    (void)mac;
+    (void)data;
+    if (len == sizeof(beastsquib_status_frame_t)) {
+        sim_status_sent ++;
+    }
+}
+
+static void sim_uart_hook(const char *data, size_t len)
+{
+    printf("  %.*s", (int)len, data);
+}
+
+/* One pass of the ESPNOW task's loop. Returns its next timeout in ticks. */
+static TickType_t sim_espnow_task(void)
+{
+    static uint8_t state_frame[ESPNOW_RX_SLOT_SIZE];
+    beastsquib_espnow_event_t evt;
+    uint32_t state_rx_ticks;
+    int state_len;
+
+    while (espnow_ring_pop(&evt)) {
+    }
+    while (espnow_state_take(state_frame, &state_len, &state_rx_ticks)) {
+        beastsquib_espnow_handle_frame(state_frame, state_len, state_rx_ticks);
+    }
+    if (rx_log_snapshot_due) {
+        rx_log_snapshot();
+    }
+    rx_status_poll();
+    TickType_t radio_wait = rx_radio_poll();
+    TickType_t wait = rx_relay_poll();
+    return (radio_wait < wait) ? radio_wait : wait;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 600;
+    int loss_percent = 5;
+    double jitter_ms = 2.0;
+    double drift_ppm = 40;
+    double delay_ms = CONFIG_ESPNOW_DETONATE_DELAY;
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:p:j:r:D:s:")) != -1) {
+        switch (opt) {
+            case 'd': seconds = atof(optarg); break;
+            case 'p': loss_percent = atoi(optarg); break;
+            case 'j': jitter_ms = atof(optarg); break;
+            case 'r': drift_ppm = atof(optarg); break;
+            case 'D': delay_ms = atof(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-d seconds] [-p loss_percent] [-j jitter_ms] [-r drift_ppm] "
+                        "[-D delay_ms] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (seconds < 10 || loss_percent < 0 || loss_percent >= 100 || jitter_ms < 0 || jitter_ms > 8 ||
+        drift_ppm < 0 || delay_ms < 0 || seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    sim_seed = seed;
+    host_clock_ns = sim_clock_ns;
+    host_espnow_send_hook = sim_send_hook;
+
+    if (beastsquib_espnow_init() != ESP_OK || host_espnow_recv_cb == NULL) {
+        fprintf(stderr, "espnow init failed\n");
+        return 1;
+    }
+    board_id = SIM_BOARD_ID;
+    hw_timer_init(hw_timer_callback, NULL);
+    hw_timer_alarm_us(1000, false);
+
+    host_task_t *task = (host_task_t *)beastsquib_espnow_task_handle;
+    const uint8_t tx_mac[ESP_NOW_ETH_ALEN] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+    uint8_t frame_buf[SIM_FRAME_LEN];
+    beastsquib_espnow_frame_t *frame = (beastsquib_espnow_frame_t *)frame_buf;
+    uint8_t page[BEASTSQUIB_PAGE_BYTES] = { 0 };
+    uint32_t seq = 0;
+    uint32_t fire_at_ms = 0;
+
+    sim_tx_offset_ms = 600000.0 * sim_uniform();
+    sim_tx_rate = 1.0 + (2.0 * sim_uniform() - 1.0) * drift_ppm * 1e-6;
+    double tick_phase = floor(SIM_TICK_MS * sim_uniform());
+
+    double end_us = seconds * 1e6;
+    double tx_send = sim_next_heartbeat(sim_tx_ms(0), tick_phase);
+    double arrival_us = sim_board_us(tx_send) + 1000.0 + 1000.0 * jitter_ms * sim_uniform();
+    int burst_left = 0;
+    double command_us = 2e6;
+    double timer_us = 1000.0;
+    double task_us = INFINITY;
+    uint64_t alarms_seen = host_hw_timer_alarms;
+    uint64_t sleeps_seen = host_fpm_sleeps;
+    double radio_asleep_until = 0;
+    double radio_sleep_us = 0;
+
+    double *fire = host_malloc(SIM_MAX_COMMANDS * sizeof(double));
+    double *fire_error = host_malloc(SIM_MAX_COMMANDS * sizeof(double));
+    size_t fire_count = 0;
+    size_t error_count = 0;
+    double set_at_us = -1;
+    double fire_target_us = 0;
+    int pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+    uint64_t sent = 0, heard = 0, asleep = 0, lost = 0, commands = 0;
+
+    while (sim_now_us < end_us) {
+        double next = fmin(fmin(arrival_us, command_us), fmin(timer_us, task_us));
+        bool timeout = false;
+        sim_now_us = next;
+
+        if (next == timer_us) {
+            timer_us = INFINITY;
+            host_hw_timer_cb(NULL);
+        } else if (next == task_us) {
+            task_us = INFINITY;
+            timeout = true;
+        } else if (next == command_us) {
+            // Alternately set and clear the board's bit
+            double tx_now = sim_tx_ms(sim_now_us);
+            bool set = !(page[SIM_BOARD_ID / 8] & (1 << (SIM_BOARD_ID % 8)));
+            page[SIM_BOARD_ID / 8] ^= 1 << (SIM_BOARD_ID % 8);
+            fire_at_ms = (set && delay_ms > 0) ? (uint32_t)tx_now + (uint32_t)delay_ms : 0;
+            if (set && fire_count < SIM_MAX_COMMANDS) {
+                set_at_us = sim_now_us;
+                fire_target_us = sim_board_us(tx_now + delay_ms);
+            }
+            commands ++;
+
+            // Within a tick of a heartbeat it goes out at once, otherwise on the next one
+            double since = fmod(tx_now, SIM_HEARTBEAT_MS);
+            tx_send = (since < SIM_TICK_MS) ? tx_now : sim_next_heartbeat(tx_now, tick_phase);
+            burst_left = SIM_BURST_FRAMES;
+            arrival_us = sim_board_us(tx_send) + 1000.0 + 1000.0 * jitter_ms * sim_uniform();
+            command_us = sim_now_us - 1000.0 * SIM_MEAN_COMMAND_GAP_MS * log(sim_uniform());
+            continue;
+        } else {
+            sent ++;
+            if (sim_now_us < radio_asleep_until) {
+                asleep ++;
+            } else if (sim_uniform() * 100 < loss_percent) {
+                lost ++;
+            } else {
+                memset(frame_buf, 0, sizeof(frame_buf));
+                frame->magic = BEASTSQUIB_MAGIC_NUMBER;
+                frame->version = BEASTSQUIB_PROTOCOL_VERSION;
+                frame->encoding = BEASTSQUIB_ENCODING_BITMAP;
+                frame->armed = 1;
+                frame->epoch = 1;
+                frame->seq = ++ seq;
+                frame->time_ms = (uint32_t)tx_send;
+                frame->fire_at_ms = fire_at_ms;
+                memcpy(frame->payload, page, BEASTSQUIB_PAGE_BYTES);
+                frame->crc = crc16_le(UINT16_MAX, frame_buf, sizeof(frame_buf));
+                host_espnow_recv_cb(tx_mac, frame_buf, sizeof(frame_buf));
+                heard ++;
+            }
+
+            if (burst_left > 0) {
+                burst_left --;
+            }
+            tx_send = (burst_left > 0) ? tx_send + SIM_BURST_SPACING_MS : sim_next_heartbeat(tx_send, tick_phase);
+            arrival_us = sim_board_us(tx_send) + 1000.0 + 1000.0 * jitter_ms * sim_uniform();
+        }
+
+        // The ESPNOW task runs whenever it has been notified or its timeout ends
+        if (task->notify_count > 0 || timeout) {
+            task->notify_count = 0;
+            TickType_t wait = sim_espnow_task();
+            task_us = (wait == portMAX_DELAY) ? INFINITY : sim_now_us + 1000.0 * SIM_TICK_MS * wait;
+        }
+
+        if (host_hw_timer_alarms != alarms_seen) {
+            alarms_seen = host_hw_timer_alarms;
+            timer_us = sim_now_us + host_hw_timer_alarm;
+        }
+        if (host_fpm_sleeps != sleeps_seen) {
+            sleeps_seen = host_fpm_sleeps;
+            radio_asleep_until = sim_now_us + host_fpm_sleep_us;
+            radio_sleep_us += host_fpm_sleep_us;
+        }
+
+        if (host_gpio_level[GPIO_OUTPUT_PYRO] != pyro_level) {
+            pyro_level = host_gpio_level[GPIO_OUTPUT_PYRO];
+            if (pyro_level == HIGH && set_at_us >= 0) {
+                fire[fire_count ++] = (sim_now_us - set_at_us) / 1000.0;
+                if (delay_ms > 0) {
+                    fire_error[error_count ++] = (sim_now_us - fire_target_us) / 1000.0;
+                }
+                set_at_us = -1;
+            }
+        }
+    }
+
+    double on_percent = 100.0 * (1.0 - radio_sleep_us / end_us);
+    double normal_ma = BEASTSQUIB_POWER_RX_MA;
+
+    printf("low power, heartbeat %d ms, window %d ms, %d%% loss, %.0f s\n", CONFIG_ESPNOW_HEARTBEAT_PERIOD,
+           CONFIG_ESPNOW_LOW_POWER_WINDOW, loss_percent, seconds);
+    printf("  %-26s %llu sent, %llu heard, %llu while asleep, %llu lost\n", "frames",
+           (unsigned long long)sent, (unsigned long long)heard, (unsigned long long)asleep,
+           (unsigned long long)lost);
+    printf("  %-26s %.1f per s, normal build %d per s\n", "timer interrupts",
+           rx_power.timer_irqs / seconds, 1000);
+    printf("  %-26s %.1f%%, %u sleeps, normal build 100%%\n", "radio on", on_percent,
+           (unsigned)rx_power.radio_sleeps);
+    printf("  %-26s %.1f mA, normal build %.1f mA\n", "estimated current",
+           (on_percent * BEASTSQUIB_POWER_RX_MA + (100.0 - on_percent) * BEASTSQUIB_POWER_MODEM_SLEEP_MA) / 100.0,
+           normal_ma);
+    printf("  %-26s %llu sent, %u silence disarms\n", "status reports",
+           (unsigned long long)sim_status_sent, (unsigned)rx_stats.silence_disarms);
+    sim_report("command-to-fire", fire, fire_count);
+    if (delay_ms > 0) {
+        sim_report("fire after target", fire_error, error_count);
+    }
+    printf("  %-26s %llu commands, %zu detonations\n", "commands", (unsigned long long)commands, fire_count);
+
+    host_uart_write_hook = sim_uart_hook;
+    uart_report_power();
+
+    host_free(fire);
+    host_free(fire_error);
+    return 0;
+}
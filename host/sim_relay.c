@@ -0,0 +1,479 @@
+/* Relay mesh simulation
+
+   Places boards at random on a field with the transmitter at the middle of
+   one short side, and runs the relay logic (beastsquib_relay_offer,
+   beastsquib_relay_duplicate, beastsquib_relay_take) on the boards chosen
+   as relays. Reports how many boards each state change reaches within the
+   silence timeout, how often a board goes silent long enough to disarm,
+   the latency added per hop, and the extra airtime. Every run is done
+   twice on the same field, without relays and with them.
+
+   A board hears another within -r metres unless the link is shadowed (set
+   pieces, crowds; -x percent of links, fixed for the run), and then loses
+   each frame with probability -p. The channel carries one frame at a time,
+   so relays queue behind each other and the transmitter. A relay's ESPNOW
+   task only wakes on a received frame or on a whole FreeRTOS tick, as on
+   the board.
+
+   Usage: sim_relay [-n boards] [-R relay_percent] [-W width_m] [-H height_m]
+                    [-r range_m] [-x shadow_percent] [-p loss_percent]
+                    [-t ttl] [-B backoff_ms] [-S suppress] [-d seconds] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS 100.0
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_MEAN_EVENT_GAP_MS 2000.0
+#define SIM_TICK_MS 10.0
+#define SIM_FRAME_LEN (sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES)
+#define SIM_MAX_HOPS 8
+
+typedef enum {
+    SIM_STATE,                            // State change at the transmitter
+    SIM_TX_SEND,                          // Transmitter sends its next frame
+    SIM_AIR_END,                          // A frame has been on the air and is received
+    SIM_WAKE,                             // A relay's ESPNOW task wakes on its timeout
+} sim_event_type_t;
+
+typedef struct {
+    double time;
+    sim_event_type_t type;
+    int node;                             // Sender for SIM_AIR_END, relay for SIM_WAKE
+    uint32_t gen;                         // Stale SIM_WAKE/SIM_TX_SEND events are skipped
+    int len;
+    uint8_t frame[SIM_FRAME_LEN];
+} sim_event_t;
+
+typedef struct {
+    double x, y;
+    bool is_relay;
+    uint32_t boot_ms;
+    double tick_phase;
+    uint32_t seq;                         // Newest frame applied
+    double last_fresh;                    // When it last applied a frame
+    int heard_event;                      // Newest state change it has heard
+    double heard_after;                   // How long after the change it heard it
+    uint32_t wake_gen;
+    beastsquib_relay_t relay;
+} sim_node_t;
+
+typedef struct {
+    double *samples;
+    size_t count;
+} sim_samples_t;
+
+static uint32_t sim_seed;
+static uint32_t sim_event_seed;           // State changes, so both runs get the same ones
+
+static sim_event_t *sim_heap;
+static size_t sim_heap_len;
+static size_t sim_heap_size;
+static double sim_channel_free;
+static double sim_airtime;
+
+static uint32_t sim_xorshift(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static uint32_t sim_rand(void)
+{
+    return sim_xorshift(&sim_seed);
+}
+
+static double sim_uniform(void)
+{
+    return (sim_rand() + 0.5) / 4294967296.0;
+}
+
+static void sim_push(const sim_event_t *evt)
+{
+    if (sim_heap_len == sim_heap_size) {
+        sim_heap_size = sim_heap_size ? 2 * sim_heap_size : 256;
+        sim_heap = realloc(sim_heap, sim_heap_size * sizeof(sim_event_t));
+    }
+
+    size_t i = sim_heap_len ++;
+    while (i > 0 && sim_heap[(i - 1) / 2].time > evt->time) {
+        sim_heap[i] = sim_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim_heap[i] = *evt;
+}
+
+static void sim_pop(sim_event_t *evt)
+{
+    *evt = sim_heap[0];
+    sim_event_t last = sim_heap[-- sim_heap_len];
+    size_t i = 0;
+
+    while (2 * i + 1 < sim_heap_len) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < sim_heap_len && sim_heap[child + 1].time < sim_heap[child].time) {
+            child ++;
+        }
+        if (last.time <= sim_heap[child].time) {
+            break;
+        }
+        sim_heap[i] = sim_heap[child];
+        i = child;
+    }
+    sim_heap[i] = last;
+}
+
+/* Puts a frame on the air as soon as the channel is free, after a short
+ * random contention window. 1 Mbit/s with the long preamble and about 43
+ * bytes of 802.11 and vendor action framing. */
+static void sim_send(int node, double ready, const uint8_t *frame, int len)
+{
+    sim_event_t evt;
+    double airtime = 0.192 + (len + 43) * 8 / 1000.0;
+    double start = fmax(ready, sim_channel_free) + 0.05 + 0.3 * sim_uniform();
+
+    sim_channel_free = start + airtime;
+    sim_airtime += airtime;
+
+    evt.time = sim_channel_free;
+    evt.type = SIM_AIR_END;
+    evt.node = node;
+    evt.gen = 0;
+    evt.len = len;
+    memcpy(evt.frame, frame, len);
+    sim_push(&evt);
+}
+
+/* The relay half of beastsquib_espnow_task after a wake-up at time t:
+ * rx_relay_poll, then block until the next tick interrupt that ends the
+ * timeout. */
+static void sim_relay_poll(sim_node_t *nodes, int i, double t, uint16_t suppress)
+{
+    sim_node_t *node = &nodes[i];
+    uint32_t now = node->boot_ms + (uint32_t)floor(t);
+
+    if (beastsquib_relay_take(&node->relay, now, suppress)) {
+        sim_send(i, t, node->relay.frame, node->relay.len);
+    }
+
+    int32_t wait_ms = beastsquib_relay_wait_ms(&node->relay, now);
+    node->wake_gen ++;
+    if (wait_ms >= 0) {
+        int ticks = (wait_ms + SIM_TICK_MS - 1) / SIM_TICK_MS;
+        double next_tick = node->tick_phase + ceil((t - node->tick_phase) / SIM_TICK_MS) * SIM_TICK_MS;
+        sim_event_t evt;
+
+        if (ticks == 0) {
+            ticks = 1;
+        }
+        if (next_tick <= t) {
+            next_tick += SIM_TICK_MS;
+        }
+        evt.time = next_tick + (ticks - 1) * SIM_TICK_MS;
+        evt.type = SIM_WAKE;
+        evt.node = i;
+        evt.gen = node->wake_gen;
+        evt.len = 0;
+        sim_push(&evt);
+    }
+}
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_sample(sim_samples_t *s, double value)
+{
+    if ((s->count & (s->count - 1)) == 0) {
+        s->samples = realloc(s->samples, (s->count ? 2 * s->count : 1) * sizeof(double));
+    }
+    s->samples[s->count ++] = value;
+}
+
+static void sim_report(const char *what, sim_samples_t *s)
+{
+    if (s->count == 0) {
+        return;
+    }
+    qsort(s->samples, s->count, sizeof(double), sim_compare_double);
+    printf("  %-22s p50 %6.1f  p90 %6.1f  p99 %6.1f  max %7.1f ms  (%zu)\n", what,
+           s->samples[(size_t)(0.50 * (s->count - 1))], s->samples[(size_t)(0.90 * (s->count - 1))],
+           s->samples[(size_t)(0.99 * (s->count - 1))], s->samples[s->count - 1], s->count);
+}
+
+typedef struct {
+    int boards;
+    int relay_percent;
+    double width, height, range;
+    int shadow_percent;
+    int loss_percent;
+    int ttl;
+    int backoff_ms;
+    int suppress;
+    double duration_ms;
+    uint32_t seed;
+} sim_params_t;
+
+static void sim_run(const sim_params_t *p, bool relays)
+{
+    // Node 0 is the transmitter
+    int n = p->boards + 1;
+    sim_node_t *nodes = calloc(n, sizeof(sim_node_t));
+    bool *link = calloc((size_t)n * n, sizeof(bool));
+    sim_samples_t latency[SIM_MAX_HOPS] = { 0 };
+    size_t reached = 0, missed = 0, silences = 0, frames = 0, relayed = 0, suppressed = 0;
+    int relay_count = 0;
+    double disarmed_ms = 0;
+
+    // The same field and relays for both runs
+    sim_seed = p->seed;
+    sim_event_seed = p->seed ^ 0x9e3779b9;
+    nodes[0].x = 0;
+    nodes[0].y = p->height / 2;
+    for (int i = 1; i < n; i ++) {
+        nodes[i].x = sim_uniform() * p->width;
+        nodes[i].y = sim_uniform() * p->height;
+        nodes[i].is_relay = relays && (int)(sim_rand() % 100) < p->relay_percent;
+        nodes[i].boot_ms = sim_rand() % 600000;
+        nodes[i].tick_phase = sim_uniform() * SIM_TICK_MS;
+        nodes[i].heard_event = -1;
+        relay_count += nodes[i].is_relay;
+    }
+    for (int i = 0; i < n; i ++) {
+        for (int j = i + 1; j < n; j ++) {
+            double d = hypot(nodes[i].x - nodes[j].x, nodes[i].y - nodes[j].y);
+            bool ok = d <= p->range && (int)(sim_rand() % 100) >= p->shadow_percent;
+            link[i * n + j] = link[j * n + i] = ok;
+        }
+    }
+
+    double loss = p->loss_percent / 100.0;
+    sim_heap_len = 0;
+    sim_channel_free = 0;
+    sim_airtime = 0;
+
+    uint8_t frame[SIM_FRAME_LEN];
+    beastsquib_espnow_frame_t *tx = (beastsquib_espnow_frame_t *)frame;
+    memset(frame, 0, sizeof(frame));
+    tx->magic = BEASTSQUIB_MAGIC_NUMBER;
+    tx->version = BEASTSQUIB_PROTOCOL_VERSION;
+    tx->encoding = BEASTSQUIB_ENCODING_BITMAP;
+    tx->armed = 1;
+    tx->epoch = 1;
+    tx->ttl = p->ttl;
+
+    int event = -1;
+    double event_time = 0;
+    uint32_t event_seq = 0;
+    int burst_left = 0;
+    uint32_t tx_gen = 0;
+
+    sim_event_t evt = { .time = 0, .type = SIM_TX_SEND, .gen = 0 };
+    sim_push(&evt);
+    evt.time = 1000.0;
+    evt.type = SIM_STATE;
+    sim_push(&evt);
+
+    while (sim_heap_len > 0) {
+        sim_pop(&evt);
+        double t = evt.time;
+        if (t > p->duration_ms) {
+            break;
+        }
+
+        switch (evt.type) {
+            case SIM_STATE:
+                // Boards that did not hear the previous change in time missed it
+                for (int i = 1; i < n && event >= 0; i ++) {
+                    if (nodes[i].heard_event == event && nodes[i].heard_after <= ESPNOW_SILENCE_TICKS_TIMEOUT) {
+                        reached ++;
+                    } else {
+                        missed ++;
+                    }
+                }
+                event ++;
+                event_time = t;
+                event_seq = tx->seq + 1;
+                burst_left = SIM_BURST_FRAMES;
+
+                // Send now, instead of at the next heartbeat
+                evt.type = SIM_TX_SEND;
+                evt.gen = ++ tx_gen;
+                sim_push(&evt);
+
+                evt.time = t + 1200.0 - SIM_MEAN_EVENT_GAP_MS * log((sim_xorshift(&sim_event_seed) + 0.5) / 4294967296.0);
+                evt.type = SIM_STATE;
+                sim_push(&evt);
+                break;
+
+            case SIM_TX_SEND:
+                if (evt.gen != tx_gen) {
+                    break;
+                }
+                tx->seq ++;
+                tx->time_ms = (uint32_t)floor(t);
+                tx->crc = 0;
+                tx->crc = crc16_le(UINT16_MAX, frame, SIM_FRAME_LEN);
+                sim_send(0, t, frame, SIM_FRAME_LEN);
+                frames ++;
+
+                if (burst_left > 0) {
+                    burst_left --;
+                }
+                evt.time = t + ((burst_left > 0) ? SIM_BURST_SPACING_MS : SIM_HEARTBEAT_MS);
+                evt.gen = ++ tx_gen;
+                sim_push(&evt);
+                break;
+
+            case SIM_AIR_END:
+                if (evt.node != 0) {
+                    frames ++;
+                }
+                for (int i = 1; i < n; i ++) {
+                    sim_node_t *node = &nodes[i];
+                    if (i == evt.node || !link[evt.node * n + i] || sim_uniform() < loss) {
+                        continue;
+                    }
+
+                    uint8_t data[SIM_FRAME_LEN];
+                    memcpy(data, evt.frame, evt.len);
+                    if (beastsquib_validate_espnow_data_checksum(data, evt.len) != 0) {
+                        continue;
+                    }
+
+                    const beastsquib_espnow_frame_t *rx = (const beastsquib_espnow_frame_t *)data;
+                    if (rx->seq > node->seq) {
+                        node->seq = rx->seq;
+                        if (t - node->last_fresh > ESPNOW_SILENCE_TICKS_TIMEOUT) {
+                            silences ++;
+                            disarmed_ms += t - node->last_fresh - ESPNOW_SILENCE_TICKS_TIMEOUT;
+                        }
+                        node->last_fresh = t;
+
+                        if (event >= 0 && rx->seq >= event_seq && node->heard_event != event) {
+                            int hops = p->ttl - rx->ttl;
+                            node->heard_event = event;
+                            node->heard_after = t - event_time;
+                            sim_sample(&latency[hops < SIM_MAX_HOPS ? hops : SIM_MAX_HOPS - 1], t - event_time);
+                        }
+
+                        if (node->is_relay) {
+                            beastsquib_relay_offer(&node->relay, data, evt.len, node->boot_ms + (uint32_t)floor(t),
+                                                   sim_rand() % (p->backoff_ms + 1));
+                        }
+                    } else {
+                        beastsquib_relay_duplicate(&node->relay, rx);
+                    }
+
+                    if (node->is_relay) {
+                        sim_relay_poll(nodes, i, t, p->suppress);
+                    }
+                }
+                break;
+
+            case SIM_WAKE:
+                if (evt.gen == nodes[evt.node].wake_gen) {
+                    sim_relay_poll(nodes, evt.node, t, p->suppress);
+                }
+                break;
+        }
+    }
+
+    // Time since the last frame at the end of the run counts as silence too
+    for (int i = 1; i < n; i ++) {
+        if (p->duration_ms - nodes[i].last_fresh > ESPNOW_SILENCE_TICKS_TIMEOUT) {
+            silences ++;
+            disarmed_ms += p->duration_ms - nodes[i].last_fresh - ESPNOW_SILENCE_TICKS_TIMEOUT;
+        }
+        relayed += nodes[i].relay.relayed;
+        suppressed += nodes[i].relay.suppressed;
+    }
+
+    size_t events_total = reached + missed;
+
+    printf("%s (%d relays)\n", relays ? "with relays" : "without relays", relay_count);
+    printf("  %-22s %.2f%% of %zu board-changes\n", "reached within 1 s",
+           events_total ? 100.0 * reached / events_total : 0.0, events_total);
+    printf("  %-22s %.2f per board-minute, disarmed %.2f%% of the time\n", "silences over 1 s",
+           silences * 60000.0 / (p->boards * p->duration_ms), 100.0 * disarmed_ms / (p->boards * p->duration_ms));
+    printf("  %-22s %.1f/s (%zu relayed, %zu suppressed), channel busy %.1f%%\n", "frames on air",
+           frames * 1000.0 / p->duration_ms, relayed, suppressed, 100.0 * sim_airtime / p->duration_ms);
+    for (int h = 0; h < SIM_MAX_HOPS; h ++) {
+        char what[32];
+        snprintf(what, sizeof(what), "latency, %d hop%s", h, h == 1 ? "" : "s");
+        sim_report(what, &latency[h]);
+        free(latency[h].samples);
+    }
+
+    free(link);
+    free(nodes);
+}
+
+int main(int argc, char **argv)
+{
+    sim_params_t p = {
+        .boards = 200,
+        .relay_percent = 10,
+        .width = 100,
+        .height = 50,
+        .range = 70,
+        .shadow_percent = 15,
+        .loss_percent = 5,
+        .ttl = CONFIG_ESPNOW_RELAY_TTL,
+        .backoff_ms = CONFIG_ESPNOW_RELAY_BACKOFF,
+        .suppress = CONFIG_ESPNOW_RELAY_SUPPRESS,
+        .duration_ms = 120000,
+        .seed = 0x5eed1234,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:R:W:H:r:x:p:t:B:S:d:s:")) != -1) {
+        switch (opt) {
+            case 'n': p.boards = atoi(optarg); break;
+            case 'R': p.relay_percent = atoi(optarg); break;
+            case 'W': p.width = atof(optarg); break;
+            case 'H': p.height = atof(optarg); break;
+            case 'r': p.range = atof(optarg); break;
+            case 'x': p.shadow_percent = atoi(optarg); break;
+            case 'p': p.loss_percent = atoi(optarg); break;
+            case 't': p.ttl = atoi(optarg); break;
+            case 'B': p.backoff_ms = atoi(optarg); break;
+            case 'S': p.suppress = atoi(optarg); break;
+            case 'd': p.duration_ms = atof(optarg) * 1000; break;
+            case 's': p.seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n boards] [-R relay_percent] [-W width_m] [-H height_m] "
+                        "[-r range_m] [-x shadow_percent] [-p loss_percent] [-t ttl] [-B backoff_ms] "
+                        "[-S suppress] [-d seconds] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (p.boards < 1 || p.relay_percent < 0 || p.relay_percent > 100 || p.width <= 0 || p.height <= 0 ||
+        p.range <= 0 || p.shadow_percent < 0 || p.shadow_percent > 100 || p.loss_percent < 0 ||
+        p.loss_percent >= 100 || p.ttl < 0 || p.ttl > 7 || p.backoff_ms < 0 || p.suppress < 1 ||
+        p.duration_ms < 5000 || p.seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    printf("%d boards on %.0fx%.0f m, range %.0f m, %d%% of links shadowed, %d%% loss, "
+           "ttl %d, back-off %d ms, suppress after %d\n", p.boards, p.width, p.height, p.range,
+           p.shadow_percent, p.loss_percent, p.ttl, p.backoff_ms, p.suppress);
+    sim_run(&p, false);
+    sim_run(&p, true);
+
+    return 0;
+}
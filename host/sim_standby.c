@@ -0,0 +1,737 @@
+/* Transmitter hot standby simulation
+
+   Places boards at random on a field with one transmitter at the middle
+   of each short side, and runs the transmitter group logic
+   (beastsquib_standby_heard, beastsquib_standby_holding,
+   beastsquib_standby_poll) on both. Reports how long each state change
+   takes to reach the boards of its page, how many reach them within the
+   silence timeout, how often a board goes silent long enough to disarm,
+   how many copies the boards drop and how often a board applies an older
+   page than it had. Runs on the same field with the same commands:
+
+   - one transmitter, built without CONFIG_ESPNOW_TX_GROUP;
+   - both, in hot standby: the one on duty sends heartbeats, and both send
+     every state change;
+   - both sending everything, without hot standby;
+   - both ways again with each change followed -c ms later by one on
+     another page;
+   - both in hot standby, with transmitter 0 losing power for -o seconds a
+     third of the way through, then booting again and joining the group.
+
+   The bitmap spans 4 pages, with the boards spread evenly over them, and
+   each change flips one bit of one page. The transmitters send one page
+   per frame in turn, and during a burst only the pages that changed, as
+   tx_build_frame does. Both transmitters get every command from the
+   server, in order and up to -k ms apart (20 by default), and the server
+   sends the whole state again every second, which is how a transmitter
+   that reset catches up. A board loses each frame from a transmitter with
+   probability -p, plus up to 30% more with distance across the field, and
+   85% on a shadowed link (-x percent of links, fixed for the run). The
+   transmitters hear each other with the same distance loss and no
+   shadowing. The channel carries one frame at a time. Boards take frames
+   with beastsquib_espnow_frame_is_fresh, as on the board.
+
+   Usage: sim_standby [-n boards] [-W width_m] [-H height_m] [-p loss_percent]
+                      [-x shadow_percent] [-T timeout_ms] [-o outage_s]
+                      [-c close_ms] [-k skew_ms] [-d seconds] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS 100.0
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_MEAN_EVENT_GAP_MS 2000.0
+#define SIM_RESEND_MS 1000.0
+#define SIM_FRAME_LEN (sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES)
+#define SIM_TX 2
+#define SIM_PAGES 4
+
+typedef enum {
+    SIM_STATE,                            // State change at the server
+    SIM_FOLLOW,                           // and the one close behind it
+    SIM_RESEND,                           // The server sends the whole state again
+    SIM_COMMAND,                          // A command reaches a transmitter
+    SIM_TX_WAKE,                          // A transmit task's wait ends
+    SIM_AIR_END,                          // A frame has been on the air and is received
+    SIM_TX_DOWN,                          // Transmitter 0 loses power
+    SIM_TX_UP,                            // and boots again
+} sim_event_type_t;
+
+typedef struct {
+    double time;
+    sim_event_type_t type;
+    int node;                             // Transmitter, or sender for SIM_AIR_END
+    uint32_t gen;                         // Stale SIM_TX_WAKE events are skipped
+    int state;                            // Server state for SIM_COMMAND
+    int len;
+    uint8_t frame[SIM_FRAME_LEN];
+} sim_event_t;
+
+typedef struct {
+    double x, y;
+    bool up;
+    double boot_time;                     // Its local clock counts from here
+    uint32_t nvs_epoch;
+    uint32_t epoch, seq;
+    uint32_t clock_offset;
+    beastsquib_standby_t sb;
+    int state;                            // Newest server state it has, -1 for none
+    beastsquib_tx_state_t data;           // and its bitmap
+    uint8_t dirty_pages;
+    uint8_t burst_pages;
+    int next_page;
+    bool held;
+    int burst_left;
+    uint32_t gen;
+    double command_at;                    // When the last command sent to it arrives
+    size_t frames;
+} sim_tx_t;
+
+typedef struct {
+    double x, y;
+    int page;
+    bool shadowed[SIM_TX];
+    beastsquib_rx_seq_t rx_seq;
+    double last_fresh;
+    int state;                            // State the page applied last came from
+    size_t heard;                         // Newest states applied, in order, and when
+    int *heard_state;
+    double *heard_at;
+} sim_board_t;
+
+typedef struct {
+    double *samples;
+    size_t count;
+} sim_samples_t;
+
+typedef struct {
+    int boards;
+    double width, height;
+    int loss_percent;
+    int shadow_percent;
+    int timeout_ms;
+    double outage_ms;
+    double close_ms;
+    double skew_ms;
+    double duration_ms;
+    uint32_t seed;
+} sim_params_t;
+
+static uint32_t sim_seed;
+static uint32_t sim_event_seed;           // State changes, so every run gets the same ones
+
+static sim_event_t *sim_heap;
+static size_t sim_heap_len;
+static size_t sim_heap_size;
+static double sim_channel_free;
+static double sim_airtime;
+
+static sim_tx_t sim_txs[SIM_TX];
+static bool sim_standby;
+
+/* Server states in order, and the page each change flipped. */
+static beastsquib_tx_state_t *sim_states;
+static int *sim_state_page;
+static double *sim_state_time;
+static int sim_state_count;
+
+static uint32_t sim_xorshift(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static uint32_t sim_rand(void)
+{
+    return sim_xorshift(&sim_seed);
+}
+
+static double sim_uniform(void)
+{
+    return (sim_rand() + 0.5) / 4294967296.0;
+}
+
+static void sim_push(const sim_event_t *evt)
+{
+    if (sim_heap_len == sim_heap_size) {
+        sim_heap_size = sim_heap_size ? 2 * sim_heap_size : 256;
+        sim_heap = realloc(sim_heap, sim_heap_size * sizeof(sim_event_t));
+    }
+
+    size_t i = sim_heap_len ++;
+    while (i > 0 && sim_heap[(i - 1) / 2].time > evt->time) {
+        sim_heap[i] = sim_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim_heap[i] = *evt;
+}
+
+static void sim_pop(sim_event_t *evt)
+{
+    *evt = sim_heap[0];
+    sim_event_t last = sim_heap[-- sim_heap_len];
+    size_t i = 0;
+
+    while (2 * i + 1 < sim_heap_len) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < sim_heap_len && sim_heap[child + 1].time < sim_heap[child].time) {
+            child ++;
+        }
+        if (last.time <= sim_heap[child].time) {
+            break;
+        }
+        sim_heap[i] = sim_heap[child];
+        i = child;
+    }
+    sim_heap[i] = last;
+}
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_sample(sim_samples_t *s, double value)
+{
+    if ((s->count & (s->count - 1)) == 0) {
+        s->samples = realloc(s->samples, (s->count ? 2 * s->count : 1) * sizeof(double));
+    }
+    s->samples[s->count ++] = value;
+}
+
+static void sim_report(const char *what, sim_samples_t *s)
+{
+    if (s->count == 0) {
+        return;
+    }
+    qsort(s->samples, s->count, sizeof(double), sim_compare_double);
+    printf("  %-22s p50 %6.1f  p90 %6.1f  p99 %6.1f  max %7.1f ms  (%zu)\n", what,
+           s->samples[(size_t)(0.50 * (s->count - 1))], s->samples[(size_t)(0.90 * (s->count - 1))],
+           s->samples[(size_t)(0.99 * (s->count - 1))], s->samples[s->count - 1], s->count);
+}
+
+/* Per-frame loss over a link of d metres on a field with diagonal diag. */
+static double sim_link_loss(double base, double d, double diag, bool shadowed)
+{
+    return shadowed ? 0.85 : base + 0.30 * (d / diag) * (d / diag);
+}
+
+static inline uint32_t sim_tx_local(const sim_tx_t *tx, double t)
+{
+    return (uint32_t)floor(t - tx->boot_time);
+}
+
+/* Puts a frame on the air as soon as the channel is free, after a short
+ * random contention window. 1 Mbit/s with the long preamble and about 43
+ * bytes of 802.11 and vendor action framing. */
+static void sim_send(int node, double ready, const uint8_t *frame, int len)
+{
+    sim_event_t evt;
+    double airtime = 0.192 + (len + 43) * 8 / 1000.0;
+    double start = fmax(ready, sim_channel_free) + 0.05 + 0.3 * sim_uniform();
+
+    sim_channel_free = start + airtime;
+    sim_airtime += airtime;
+
+    evt.time = sim_channel_free;
+    evt.type = SIM_AIR_END;
+    evt.node = node;
+    evt.gen = 0;
+    evt.len = len;
+    memcpy(evt.frame, frame, len);
+    sim_push(&evt);
+}
+
+static void sim_tx_boot(int i, double t)
+{
+    sim_tx_t *tx = &sim_txs[i];
+
+    tx->up = true;
+    tx->boot_time = t;
+    tx->nvs_epoch ++;
+    tx->epoch = tx->nvs_epoch;
+    tx->seq = 0;
+    tx->clock_offset = 0;
+    tx->state = -1;
+    memset(&tx->data, 0, sizeof(tx->data));
+    tx->dirty_pages = 0;
+    tx->burst_pages = 0;
+    tx->next_page = 0;
+    tx->held = false;
+    tx->burst_left = 0;
+    beastsquib_standby_init(&tx->sb, i, 0);
+}
+
+static void sim_tx_wait(int i, double t, double ms)
+{
+    sim_event_t evt = { .time = t + ms, .type = SIM_TX_WAKE, .node = i, .gen = ++ sim_txs[i].gen };
+    sim_push(&evt);
+}
+
+/* Page of server state, where -1 is the empty state a transmitter boots with. */
+static const uint8_t *sim_page(int state, int page)
+{
+    static const uint8_t empty[BEASTSQUIB_PAGE_BYTES];
+
+    return (state < 0) ? empty : sim_states[state].pyro_bits[page];
+}
+
+/* The server changes its state by flipping one bit of page. */
+static void sim_server_change(double t, int page, uint32_t bit)
+{
+    if ((sim_state_count & (sim_state_count - 1)) == 0) {
+        size_t size = sim_state_count ? 2 * sim_state_count : 1;
+        sim_states = realloc(sim_states, size * sizeof(beastsquib_tx_state_t));
+        sim_state_page = realloc(sim_state_page, size * sizeof(int));
+        sim_state_time = realloc(sim_state_time, size * sizeof(double));
+    }
+
+    beastsquib_tx_state_t *state = &sim_states[sim_state_count];
+    if (sim_state_count == 0) {
+        memset(state, 0, sizeof(*state));
+        state->armed = 1;
+    } else {
+        *state = sim_states[sim_state_count - 1];
+    }
+    bit %= BEASTSQUIB_PAGE_BITS;
+    state->pyro_bits[page][bit / 8] ^= 1 << (bit % 8);
+    sim_state_page[sim_state_count] = page;
+    sim_state_time[sim_state_count] = t;
+    sim_state_count ++;
+}
+
+/* One pass of tx_transmit_task: tx_standby_wait_ms, then tx_transmit_step,
+ * tx_build_frame and tx_schedule_next_ms. The frame carries the server
+ * state it was built from in fire_at_ms, which the boards use only to tell
+ * how new the page is. */
+static void sim_tx_wake(int i, double t, bool state_changed, const sim_params_t *p)
+{
+    sim_tx_t *tx = &sim_txs[i];
+    uint32_t now = sim_tx_local(tx, t);
+    bool on_duty = beastsquib_standby_poll(&tx->sb, now, p->timeout_ms);
+
+    if (!tx->sb.joined) {
+        tx->held |= state_changed;
+        sim_tx_wait(i, t, p->timeout_ms - (now - tx->sb.boot_ms));
+        return;
+    }
+    if (beastsquib_standby_holding(&tx->sb, now, p->timeout_ms)) {
+        tx->held |= state_changed;
+        sim_tx_wait(i, t, portTICK_RATE_MS);
+        return;
+    }
+    if (!on_duty && (tx->state < 0 || (sim_standby && !state_changed && !tx->held && tx->burst_left == 0))) {
+        tx->held |= state_changed;
+        sim_tx_wait(i, t, SIM_HEARTBEAT_MS);
+        return;
+    }
+    state_changed |= tx->held;
+    tx->held = false;
+
+    if (state_changed) {
+        tx->burst_pages |= tx->dirty_pages;
+        tx->dirty_pages = 0;
+    }
+    bool in_burst = state_changed || tx->burst_left > 0;
+    uint8_t pages = (in_burst && tx->burst_pages != 0) ? tx->burst_pages : (1 << SIM_PAGES) - 1;
+    int page = 0;
+    for (int k = 0; k < SIM_PAGES; k ++) {
+        page = (tx->next_page + k) % SIM_PAGES;
+        if (pages & (1 << page)) {
+            break;
+        }
+    }
+    tx->next_page = (page + 1) % SIM_PAGES;
+
+    uint8_t frame[SIM_FRAME_LEN];
+    beastsquib_espnow_frame_t *f = (beastsquib_espnow_frame_t *)frame;
+    memset(frame, 0, sizeof(frame));
+    f->magic = BEASTSQUIB_MAGIC_NUMBER;
+    f->version = BEASTSQUIB_PROTOCOL_VERSION;
+    f->encoding = BEASTSQUIB_ENCODING_BITMAP | (i << BEASTSQUIB_TX_ID_SHIFT) |
+                  (on_duty ? 0 : BEASTSQUIB_ENCODING_STANDBY);
+    f->armed = tx->data.armed;
+    f->epoch = tx->epoch;
+    f->seq = ++ tx->seq;
+    f->page = page;
+    f->time_ms = now + tx->clock_offset;
+    f->fire_at_ms = tx->state;
+    memcpy(f->payload, tx->data.pyro_bits[page], BEASTSQUIB_PAGE_BYTES);
+    f->crc = crc16_le(UINT16_MAX, frame, SIM_FRAME_LEN);
+    sim_send(i, t, frame, SIM_FRAME_LEN);
+    tx->frames ++;
+
+    if (state_changed) {
+        tx->burst_left = SIM_BURST_FRAMES * (tx->burst_pages ? __builtin_popcount(tx->burst_pages) : 1);
+    }
+    if (tx->burst_left > 0) {
+        tx->burst_left --;
+    }
+    if (tx->burst_left == 0) {
+        tx->burst_pages = 0;
+    }
+    sim_tx_wait(i, t, (tx->burst_left > 0) ? SIM_BURST_SPACING_MS : SIM_HEARTBEAT_MS);
+}
+
+/* The server sends its newest state to transmitter i. Each transmitter
+ * gets its commands in order, up to skew_ms after they were sent. */
+static void sim_tx_send_command(int i, double t, const sim_params_t *p)
+{
+    sim_tx_t *tx = &sim_txs[i];
+    sim_event_t cmd = { .type = SIM_COMMAND, .node = i, .state = sim_state_count - 1 };
+
+    // A line takes about 0.1 ms at the UART's speed, and keeps equal times apart in the heap
+    tx->command_at = fmax(t + p->skew_ms * sim_uniform(), tx->command_at + 0.1);
+    cmd.time = tx->command_at;
+    sim_push(&cmd);
+}
+
+/* A command from the server reaches transmitter i, as tx_state_set_pyro_page
+ * and tx_state_set_armed handle it. */
+static void sim_tx_command(int i, double t, int state, const sim_params_t *p)
+{
+    sim_tx_t *tx = &sim_txs[i];
+    const beastsquib_tx_state_t *to = &sim_states[state];
+    uint8_t changed = 0;
+
+    // A resend of the state the transmitter already has changes nothing
+    if (!tx->up || state == tx->state) {
+        return;
+    }
+
+    for (int page = 0; page < SIM_PAGES; page ++) {
+        if (memcmp(tx->data.pyro_bits[page], to->pyro_bits[page], BEASTSQUIB_PAGE_BYTES) != 0) {
+            changed |= 1 << page;
+        }
+    }
+    tx->dirty_pages |= changed;
+    if (tx->data.armed != to->armed) {
+        changed = UINT8_MAX;
+    }
+    tx->state = state;
+    tx->data = *to;
+    if (changed != 0) {
+        beastsquib_standby_changed(&tx->sb, changed, tx->seq);
+        sim_tx_wake(i, t, true, p);
+    }
+}
+
+static void sim_run(const sim_params_t *p, const char *name, int tx_count, bool standby, bool close, bool failover)
+{
+    sim_board_t *boards = calloc(p->boards, sizeof(sim_board_t));
+    sim_samples_t latency = { 0 }, gaps = { 0 }, takeover = { 0 };
+    size_t reached = 0, missed = 0, silences = 0, applied = 0, copies = 0, older = 0;
+    double disarmed_ms = 0, diag = hypot(p->width, p->height);
+    double loss = p->loss_percent / 100.0;
+
+    // The same field and commands for every run
+    sim_seed = p->seed;
+    sim_event_seed = p->seed ^ 0x9e3779b9;
+    sim_standby = standby;
+    sim_state_count = 0;
+    memset(sim_txs, 0, sizeof(sim_txs));
+    for (int i = 0; i < SIM_TX; i ++) {
+        sim_txs[i].x = (i == 0) ? 0 : p->width;
+        sim_txs[i].y = p->height / 2;
+        sim_txs[i].nvs_epoch = 10 + sim_rand() % 10;
+    }
+    for (int b = 0; b < p->boards; b ++) {
+        boards[b].x = sim_uniform() * p->width;
+        boards[b].y = sim_uniform() * p->height;
+        boards[b].page = b % SIM_PAGES;
+        for (int i = 0; i < SIM_TX; i ++) {
+            boards[b].shadowed[i] = (int)(sim_rand() % 100) < p->shadow_percent;
+        }
+        boards[b].state = -1;
+    }
+
+    sim_heap_len = 0;
+    sim_channel_free = 0;
+    sim_airtime = 0;
+
+    double down_at = p->duration_ms / 3, up_at = down_at + p->outage_ms;
+    sim_event_t evt;
+
+    for (int i = 0; i < tx_count; i ++) {
+        sim_tx_boot(i, 200.0 * i * sim_uniform());
+        // Without CONFIG_ESPNOW_TX_GROUP a lone transmitter sends at once
+        sim_txs[i].sb.joined = tx_count == 1;
+        sim_tx_wake(i, sim_txs[i].boot_time, false, p);
+    }
+    evt = (sim_event_t){ .time = 1000.0, .type = SIM_STATE };
+    sim_push(&evt);
+    evt = (sim_event_t){ .time = 1000.0 + SIM_RESEND_MS, .type = SIM_RESEND };
+    sim_push(&evt);
+    if (failover) {
+        evt = (sim_event_t){ .time = down_at, .type = SIM_TX_DOWN, .node = 0 };
+        sim_push(&evt);
+        evt = (sim_event_t){ .time = up_at, .type = SIM_TX_UP, .node = 0 };
+        sim_push(&evt);
+    }
+
+    while (sim_heap_len > 0) {
+        sim_pop(&evt);
+        double t = evt.time;
+        if (t > p->duration_ms) {
+            break;
+        }
+
+        switch (evt.type) {
+            case SIM_STATE:
+                sim_server_change(t, sim_xorshift(&sim_event_seed) % SIM_PAGES, sim_xorshift(&sim_event_seed));
+                if (close) {
+                    sim_event_t follow = { .time = t + p->close_ms, .type = SIM_FOLLOW };
+                    sim_push(&follow);
+                }
+                evt.time = t + 1200.0 - SIM_MEAN_EVENT_GAP_MS * log((sim_xorshift(&sim_event_seed) + 0.5) / 4294967296.0);
+                sim_push(&evt);
+                // fall through: the server sends the change to every transmitter
+            case SIM_RESEND:
+                for (int i = 0; i < tx_count; i ++) {
+                    sim_tx_send_command(i, t, p);
+                }
+                if (evt.type == SIM_RESEND) {
+                    evt.time = t + SIM_RESEND_MS;
+                    sim_push(&evt);
+                }
+                break;
+
+            case SIM_FOLLOW: {
+                // A change on another page close behind the last one
+                int page = (sim_state_page[sim_state_count - 1] + 1 + sim_rand() % (SIM_PAGES - 1)) % SIM_PAGES;
+                sim_server_change(t, page, sim_rand());
+                for (int i = 0; i < tx_count; i ++) {
+                    sim_tx_send_command(i, t, p);
+                }
+                break;
+            }
+
+            case SIM_COMMAND:
+                sim_tx_command(evt.node, t, evt.state, p);
+                break;
+
+            case SIM_TX_WAKE:
+                if (sim_txs[evt.node].up && evt.gen == sim_txs[evt.node].gen) {
+                    sim_tx_wake(evt.node, t, false, p);
+                }
+                break;
+
+            case SIM_TX_DOWN:
+                sim_txs[evt.node].up = false;
+                break;
+
+            case SIM_TX_UP:
+                sim_tx_boot(evt.node, t);
+                sim_tx_wake(evt.node, t, false, p);
+                break;
+
+            case SIM_AIR_END: {
+                const sim_tx_t *sender = &sim_txs[evt.node];
+                const beastsquib_espnow_frame_t *rx = (const beastsquib_espnow_frame_t *)evt.frame;
+
+                for (int i = 0; i < tx_count; i ++) {
+                    sim_tx_t *tx = &sim_txs[i];
+                    double d = hypot(tx->x - sender->x, tx->y - sender->y);
+                    if (i == evt.node || !tx->up || sim_uniform() < sim_link_loss(loss, d, diag, false)) {
+                        continue;
+                    }
+
+                    uint32_t now = sim_tx_local(tx, t);
+                    if (beastsquib_standby_heard(&tx->sb, rx, evt.len, &tx->data, now, p->timeout_ms,
+                                                 &tx->epoch, &tx->seq) && tx->sb.clock.synced) {
+                        tx->clock_offset = beastsquib_clock_to_tx(&tx->sb.clock, 0);
+                    }
+                }
+
+                for (int b = 0; b < p->boards; b ++) {
+                    sim_board_t *board = &boards[b];
+                    double d = hypot(board->x - sender->x, board->y - sender->y);
+                    if (sim_uniform() < sim_link_loss(loss, d, diag, board->shadowed[evt.node])) {
+                        continue;
+                    }
+
+                    bool own_page = rx->page == board->page;
+                    bool apply;
+                    rx_seq = board->rx_seq;
+                    rx_last_frame_at = (uint32_t)floor(board->last_fresh);
+                    bool fresh = beastsquib_espnow_frame_is_fresh(rx->epoch, rx->seq, BEASTSQUIB_FRAME_TX_ID(rx->encoding),
+                                                                  own_page, &apply, (uint32_t)floor(t));
+                    board->rx_seq = rx_seq;
+                    if (!fresh) {
+                        copies ++;
+                        continue;
+                    }
+                    applied ++;
+
+                    if (t - board->last_fresh > ESPNOW_SILENCE_TICKS_TIMEOUT) {
+                        silences ++;
+                        disarmed_ms += t - board->last_fresh - ESPNOW_SILENCE_TICKS_TIMEOUT;
+                    } else if (t > 2000.0) {
+                        sim_sample(&gaps, t - board->last_fresh);
+                    }
+                    if (failover && board->last_fresh < down_at && t >= down_at) {
+                        sim_sample(&takeover, t - board->last_fresh);
+                    }
+                    board->last_fresh = t;
+                    if (!apply || !own_page) {
+                        continue;
+                    }
+
+                    int state = (int)rx->fire_at_ms;
+                    if (state < board->state && memcmp(sim_page(state, board->page), sim_page(board->state, board->page),
+                                                       BEASTSQUIB_PAGE_BYTES) != 0) {
+                        older ++;
+                    }
+                    board->state = state;
+                    if (state >= 0 && (board->heard == 0 || state > board->heard_state[board->heard - 1])) {
+                        if ((board->heard & (board->heard - 1)) == 0) {
+                            board->heard_state = realloc(board->heard_state, (board->heard ? 2 * board->heard : 1) * sizeof(int));
+                            board->heard_at = realloc(board->heard_at, (board->heard ? 2 * board->heard : 1) * sizeof(double));
+                        }
+                        board->heard_state[board->heard] = state;
+                        board->heard_at[board->heard] = t;
+                        board->heard ++;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    // Each change counts once for every board of its page, if it had time to arrive
+    for (int e = 0; e < sim_state_count; e ++) {
+        if (sim_state_time[e] + ESPNOW_SILENCE_TICKS_TIMEOUT > p->duration_ms) {
+            continue;
+        }
+        for (int b = 0; b < p->boards; b ++) {
+            const sim_board_t *board = &boards[b];
+            if (board->page != sim_state_page[e]) {
+                continue;
+            }
+
+            size_t k = 0;
+            while (k < board->heard && board->heard_state[k] < e) {
+                k ++;
+            }
+            double after = (k < board->heard) ? board->heard_at[k] - sim_state_time[e] : INFINITY;
+            if (after <= ESPNOW_SILENCE_TICKS_TIMEOUT) {
+                reached ++;
+            } else {
+                missed ++;
+            }
+            if (k < board->heard) {
+                sim_sample(&latency, after);
+            }
+        }
+    }
+
+    // Time since the last frame at the end of the run counts as silence too
+    for (int b = 0; b < p->boards; b ++) {
+        if (p->duration_ms - boards[b].last_fresh > ESPNOW_SILENCE_TICKS_TIMEOUT) {
+            silences ++;
+            disarmed_ms += p->duration_ms - boards[b].last_fresh - ESPNOW_SILENCE_TICKS_TIMEOUT;
+        }
+    }
+
+    size_t events_total = reached + missed;
+    size_t frames = 0;
+    for (int i = 0; i < tx_count; i ++) {
+        frames += sim_txs[i].frames;
+    }
+
+    printf("%s\n", name);
+    printf("  %-22s %.2f%% of %zu board-changes\n", "reached within 1 s",
+           events_total ? 100.0 * reached / events_total : 0.0, events_total);
+    sim_report("state change latency", &latency);
+    sim_report("gap between frames", &gaps);
+    sim_report("gap at the failure", &takeover);
+    printf("  %-22s %.2f per board-minute, disarmed %.3f%% of the time\n", "silences over 1 s",
+           silences * 60000.0 / (p->boards * p->duration_ms), 100.0 * disarmed_ms / (p->boards * p->duration_ms));
+    printf("  %-22s %zu taken, %zu copies dropped, %zu older page applied\n", "frames at boards",
+           applied, copies, older);
+    printf("  %-22s %.1f/s, channel busy %.1f%%\n", "frames on air",
+           frames * 1000.0 / p->duration_ms, 100.0 * sim_airtime / p->duration_ms);
+    for (int i = 0; i < tx_count; i ++) {
+        printf("  %-22s %s, %u takeovers, %u handovers, %u holds, %zu frames sent\n", i == 0 ? "transmitters" : "",
+               sim_txs[i].sb.on_duty ? "on duty" : "standby", (unsigned)sim_txs[i].sb.takeovers,
+               (unsigned)sim_txs[i].sb.handovers, (unsigned)sim_txs[i].sb.holds, sim_txs[i].frames);
+    }
+
+    for (int b = 0; b < p->boards; b ++) {
+        free(boards[b].heard_state);
+        free(boards[b].heard_at);
+    }
+    free(latency.samples);
+    free(gaps.samples);
+    free(takeover.samples);
+    free(boards);
+}
+
+int main(int argc, char **argv)
+{
+    sim_params_t p = {
+        .boards = 200,
+        .width = 100,
+        .height = 50,
+        .loss_percent = 5,
+        .shadow_percent = 15,
+        .timeout_ms = CONFIG_ESPNOW_STANDBY_TIMEOUT,
+        .outage_ms = 20000,
+        .close_ms = 5,
+        .skew_ms = 20,
+        .duration_ms = 120000,
+        .seed = 0x5eed1234,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:W:H:p:x:T:o:c:k:d:s:")) != -1) {
+        switch (opt) {
+            case 'n': p.boards = atoi(optarg); break;
+            case 'W': p.width = atof(optarg); break;
+            case 'H': p.height = atof(optarg); break;
+            case 'p': p.loss_percent = atoi(optarg); break;
+            case 'x': p.shadow_percent = atoi(optarg); break;
+            case 'T': p.timeout_ms = atoi(optarg); break;
+            case 'o': p.outage_ms = atof(optarg) * 1000; break;
+            case 'c': p.close_ms = atof(optarg); break;
+            case 'k': p.skew_ms = atof(optarg); break;
+            case 'd': p.duration_ms = atof(optarg) * 1000; break;
+            case 's': p.seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n boards] [-W width_m] [-H height_m] [-p loss_percent] "
+                        "[-x shadow_percent] [-T timeout_ms] [-o outage_s] [-c close_ms] [-k skew_ms] [-d seconds] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (p.boards < 1 || p.width <= 0 || p.height <= 0 || p.loss_percent < 0 || p.loss_percent >= 70 ||
+        p.shadow_percent < 0 || p.shadow_percent > 100 || p.timeout_ms < 1 || p.outage_ms < 0 || p.close_ms < 0 || p.skew_ms < 0 ||
+        p.duration_ms < 10000 || p.duration_ms / 3 + p.outage_ms >= p.duration_ms || p.seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    printf("%d boards on %.0fx%.0f m, %d%% loss, %d%% of links shadowed, standby timeout %d ms\n",
+           p.boards, p.width, p.height, p.loss_percent, p.shadow_percent, p.timeout_ms);
+    sim_run(&p, "one transmitter", 1, false, false, false);
+    sim_run(&p, "two transmitters, hot standby", 2, true, false, false);
+    sim_run(&p, "two transmitters, both sending heartbeats", 2, false, false, false);
+    printf("(each change followed by one on another page %.0f ms later)\n", p.close_ms);
+    sim_run(&p, "two transmitters, hot standby, close changes", 2, true, true, false);
+    sim_run(&p, "two transmitters, both sending, close changes", 2, false, true, false);
+    printf("(transmitter 0 off from %.0f s to %.0f s)\n", p.duration_ms / 3000, (p.duration_ms / 3 + p.outage_ms) / 1000);
+    sim_run(&p, "two transmitters, failover", 2, true, false, true);
+
+    return 0;
+}
@@ -0,0 +1,735 @@
+/* Status back-channel simulation
+
+   Runs a fleet of receivers reporting their state to the transmitter in
+   the time slots given by their board IDs, and measures how long a status
+   round takes to cover the whole fleet and whether the reports slow the
+   state frames going the other way. Every run is done twice with the same
+   commands and the same state frames lost, without status reports and with
+   them, and fails if the reports hold up the detonations by more than
+   SIM_FIRE_MARGIN_MS at the 99th percentile or worst case.
+
+   The transmitter sends a heartbeat and a burst of three frames 10 ms
+   apart on every command, each one detonating a new board. Each receiver
+   follows the transmitter clock with beastsquib_clock_sample, as on the
+   board, with random crystal drift and receive delay, and loses each frame
+   with probability -p. It sends its report on the hw_timer tick
+   beastsquib_status_next_slot gives, plus up to 0.2 ms for the ESPNOW task
+   to be scheduled, unless rx_status_frame_heard would have it skip the
+   slot for a burst. Reports are broadcast and never acknowledged; one whose
+   flags changed is sent again BEASTSQUIB_STATUS_REPEAT_MS later, as
+   rx_status_poll does, and otherwise a report that is lost or collides
+   leaves the board's entry as it was until the next round. Reports reach
+   the transmitter through tx_status_receive on a virtual clock.
+
+   It also fails if fewer than SIM_CONFIRM_ONE_ROUND of the commands are
+   confirmed within a round and a slot, or SIM_CONFIRM_TWO_ROUNDS within
+   two: the board's slot comes round within one round, and only a report
+   lost twice over or skipped for a burst takes longer. Commands too close
+   to the end of the run for two rounds are left out.
+
+   Boards hear the transmitter and defer to its frames, and the
+   transmitter defers to reports on the air. Boards are assumed not to hear
+   each other, so any two reports that overlap are both lost.
+
+   Usage: sim_status [-n boards] [-S slots] [-L slot_ms] [-g guard_ms]
+                     [-p loss_percent] [-j jitter_ms] [-D drift_ppm]
+                     [-d seconds] [-s seed]
+*/
+
+#include "espnow_example_main.c"
+
+#include <getopt.h>
+#include <math.h>
+
+#define SIM_HEARTBEAT_MS 100.0
+#define SIM_BURST_FRAMES 3
+#define SIM_BURST_SPACING_MS 10.0
+#define SIM_MEAN_COMMAND_GAP_MS 2000.0
+#define SIM_WARMUP_MS 3000.0
+#define SIM_FRAME_LEN (sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES)
+#define SIM_MAX_ON_AIR 64
+#define SIM_MAX_COMMANDS 4096
+#define SIM_FIRE_MARGIN_MS 1.0            // About a state frame waiting out one report on the air
+#define SIM_CONFIRM_ONE_ROUND 0.90        // Detonations confirmed within a round and a slot
+#define SIM_CONFIRM_TWO_ROUNDS 0.98       // ... and within two
+
+typedef enum {
+    SIM_COMMAND,                          // A detonation reaches the transmitter
+    SIM_TX_SEND,                          // Transmitter sends its next frame
+    SIM_DOWN_END,                         // A state frame has been on the air
+    SIM_SLOT,                             // A board's status slot tick
+    SIM_REPEAT,                           // A changed report is due again
+    SIM_UP_END,                           // A report has been on the air
+    SIM_ROUND,                            // A status round ends
+} sim_event_type_t;
+
+typedef struct {
+    double time;
+    sim_event_type_t type;
+    int node;
+    uint32_t gen;                         // Stale SIM_TX_SEND/SIM_SLOT events are skipped
+    uint32_t seq;                         // SIM_DOWN_END: frame sequence number
+    uint32_t time_ms;                     // SIM_DOWN_END: transmitter clock stamped in the frame
+    int commands;                         // SIM_DOWN_END: commands the frame carries
+    int on_air;                           // SIM_UP_END: index into sim_on_air
+} sim_event_t;
+
+typedef struct {
+    double start;
+    double end;
+    bool used;
+    bool collided;
+} sim_on_air_t;
+
+typedef struct {
+    beastsquib_clock_t clock;
+    double boot_ms;
+    double rate;
+    double last_heard;
+    uint32_t frame_ms;                    // Transmitter clock of the last fresh frame
+    double quiet_until;                   // Slots before this are skipped
+    uint32_t seq;                         // Newest frame applied
+    int commands;                         // Commands applied
+    bool detonated;
+    bool slot_due;
+    uint32_t slot_gen;
+    uint8_t last_flags;                   // Flags of the last report sent
+    uint32_t heard;                       // Fresh frames since the last report
+    uint32_t last_seq;                    // Newest frame at the last report
+    beastsquib_status_frame_t report;     // Report being sent
+    int64_t reported_round;               // Status round of the last report received
+} sim_board_t;
+
+typedef struct {
+    double *samples;
+    size_t count;
+} sim_samples_t;
+
+typedef struct {
+    bool status;
+    int boards;
+    uint32_t slots;
+    uint32_t slot_ms;
+    uint32_t guard_ms;
+    double loss;
+    double jitter_ms;
+    double drift_ppm;
+    double duration_ms;
+} sim_config_t;
+
+typedef struct {
+    sim_samples_t air;                    // Command to first frame on the air
+    sim_samples_t fire;                   // Command to the board firing
+    sim_samples_t confirmed;              // Command to the transmitter hearing it fired
+    sim_samples_t current;                // Command to every board reporting a frame sent after it
+    uint64_t confirmable;                 // Commands two rounds and a slot before the end
+    uint64_t within[2];                   // ... of those, confirmed within one round and a slot, and two
+    uint64_t sent;
+    uint64_t repeated;
+    uint64_t skipped;
+    uint64_t collisions;
+    uint64_t lost;
+    uint64_t reported;                    // Boards reported, summed over complete rounds
+    uint64_t rounds;
+    double up_airtime;
+    double down_airtime;
+} sim_result_t;
+
+static uint32_t sim_seed;
+static uint32_t sim_command_seed;         // Commands, so both runs get the same ones
+
+static sim_event_t *sim_heap;
+static size_t sim_heap_len;
+static size_t sim_heap_size;
+static double sim_now;
+
+static sim_board_t *sim_boards;
+static sim_on_air_t sim_on_air[SIM_MAX_ON_AIR];
+static double sim_down_free;              // End of the last state frame on the air
+static uint32_t sim_tx_seq;
+static uint32_t sim_tx_gen;
+static int sim_burst_left;
+static int sim_commands;
+
+/* Per command: when it arrived, whom it detonated, the first frame after
+ * it, and how many boards have reported a frame at least that new. */
+static double sim_command_at[SIM_MAX_COMMANDS];
+static int sim_command_board[SIM_MAX_COMMANDS];
+static uint32_t sim_command_seq[SIM_MAX_COMMANDS];
+static int sim_command_current[SIM_MAX_COMMANDS];
+static bool sim_command_confirmed[SIM_MAX_COMMANDS];
+static int *sim_board_current;            // Per board: commands counted in sim_command_current
+
+static uint32_t sim_xorshift(uint32_t *seed)
+{
+    // xorshift32, deterministic for a given seed
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static double sim_uniform(void)
+{
+    return (sim_xorshift(&sim_seed) + 0.5) / 4294967296.0;
+}
+
+/* A draw fixed by the frame, the board and what it is for, so the runs
+ * with and without reports lose the same state frames. */
+static double sim_link_uniform(uint32_t seq, int board, uint32_t what)
+{
+    // splitmix64 finaliser
+    uint64_t x = ((uint64_t)sim_command_seed << 32) ^ ((uint64_t)seq << 20) ^ ((uint64_t)board << 2) ^ what;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return ((uint32_t)(x >> 32) + 0.5) / 4294967296.0;
+}
+
+static uint64_t sim_clock_ns(void)
+{
+    return (uint64_t)(sim_now * 1e6);
+}
+
+/* Events at the same time go in the order of their types, so that both
+ * runs see a command and a heartbeat due together the same way round. */
+static bool sim_before(const sim_event_t *a, const sim_event_t *b)
+{
+    return a->time < b->time || (a->time == b->time && a->type < b->type);
+}
+
+static void sim_push(const sim_event_t *evt)
+{
+    if (sim_heap_len == sim_heap_size) {
+        sim_heap_size = sim_heap_size ? 2 * sim_heap_size : 256;
+        sim_heap = realloc(sim_heap, sim_heap_size * sizeof(sim_event_t));
+    }
+
+    size_t i = sim_heap_len ++;
+    while (i > 0 && sim_before(evt, &sim_heap[(i - 1) / 2])) {
+        sim_heap[i] = sim_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim_heap[i] = *evt;
+}
+
+static void sim_pop(sim_event_t *evt)
+{
+    *evt = sim_heap[0];
+    sim_event_t last = sim_heap[-- sim_heap_len];
+    size_t i = 0;
+
+    while (2 * i + 1 < sim_heap_len) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < sim_heap_len && sim_before(&sim_heap[child + 1], &sim_heap[child])) {
+            child ++;
+        }
+        if (!sim_before(&sim_heap[child], &last)) {
+            break;
+        }
+        sim_heap[i] = sim_heap[child];
+        i = child;
+    }
+    sim_heap[i] = last;
+}
+
+static void sim_sample(sim_samples_t *s, double value)
+{
+    if ((s->count & (s->count - 1)) == 0) {
+        s->samples = realloc(s->samples, (s->count ? 2 * s->count : 1) * sizeof(double));
+    }
+    s->samples[s->count ++] = value;
+}
+
+static int sim_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_report(const char *what, sim_samples_t *s)
+{
+    if (s->count == 0) {
+        printf("  %-26s none\n", what);
+        return;
+    }
+    qsort(s->samples, s->count, sizeof(double), sim_compare_double);
+    printf("  %-26s p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f ms\n", what,
+           s->samples[(size_t)(0.50 * (s->count - 1))], s->samples[(size_t)(0.90 * (s->count - 1))],
+           s->samples[(size_t)(0.99 * (s->count - 1))], s->samples[s->count - 1]);
+}
+
+static uint32_t sim_local_ticks(const sim_board_t *board, double t)
+{
+    return (uint32_t)floor((t + board->boot_ms) * board->rate);
+}
+
+static double sim_tick_time(const sim_board_t *board, uint32_t tick)
+{
+    return tick / board->rate - board->boot_ms;
+}
+
+/* 1 Mbit/s with the long preamble and about 43 bytes of 802.11 and vendor
+ * action framing. */
+static double sim_airtime(int len)
+{
+    return 0.192 + (len + 43) * 8 / 1000.0;
+}
+
+/* Latest end of a report on the air, which the transmitter defers to. */
+static double sim_up_busy(void)
+{
+    double busy = 0;
+    for (int i = 0; i < SIM_MAX_ON_AIR; i ++) {
+        if (sim_on_air[i].used) {
+            busy = fmax(busy, sim_on_air[i].end);
+        }
+    }
+    return busy;
+}
+
+/* The first half of rx_status_poll: the next slot, while the board hears a transmitter. */
+static void sim_schedule_slot(const sim_config_t *config, int i, double t)
+{
+    sim_board_t *board = &sim_boards[i];
+    sim_event_t evt;
+
+    if (board->slot_due || t - board->last_heard > ESPNOW_SILENCE_TICKS_TIMEOUT) {
+        return;
+    }
+
+    uint32_t at = beastsquib_status_next_slot(&board->clock, i, sim_local_ticks(board, t),
+                                              config->slots, config->slot_ms);
+    board->slot_due = true;
+    memset(&evt, 0, sizeof(evt));
+    // Just past the tick boundary, so the board reads the tick as reached
+    evt.time = fmax(t, sim_tick_time(board, at) + 1e-6);
+    evt.type = SIM_SLOT;
+    evt.node = i;
+    evt.gen = ++ board->slot_gen;
+    sim_push(&evt);
+}
+
+/* Puts a report on the air once the board has finished deferring to the
+ * transmitter, and marks it and any report it overlaps as collided. */
+static void sim_send_report(sim_result_t *result, int i, double ready)
+{
+    double airtime = sim_airtime(sizeof(beastsquib_status_frame_t));
+    double start = fmax(ready, sim_down_free) + 0.05 + 0.3 * sim_uniform();
+    double end = start + airtime;
+    bool collided = false;
+    int slot = -1;
+    sim_event_t evt;
+
+    for (int k = 0; k < SIM_MAX_ON_AIR; k ++) {
+        if (!sim_on_air[k].used) {
+            slot = (slot < 0) ? k : slot;
+        } else if (sim_on_air[k].start < end && start < sim_on_air[k].end) {
+            sim_on_air[k].collided = true;
+            collided = true;
+        }
+    }
+    if (slot < 0) {
+        fprintf(stderr, "too many reports on the air\n");
+        exit(1);
+    }
+
+    sim_on_air[slot] = (sim_on_air_t){ .start = start, .end = end, .used = true, .collided = collided };
+    result->sent ++;
+    result->up_airtime += end - start;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.time = end;
+    evt.type = SIM_UP_END;
+    evt.node = i;
+    evt.on_air = slot;
+    sim_push(&evt);
+}
+
+/* rx_status_send, then the next slot. */
+static void sim_slot(const sim_config_t *config, sim_result_t *result, int i, double t)
+{
+    sim_board_t *board = &sim_boards[i];
+
+    if (t < board->quiet_until) {
+        board->slot_due = false;
+        result->skipped ++;
+        sim_schedule_slot(config, i, t);
+        return;
+    }
+    uint8_t flags = BEASTSQUIB_STATUS_ARMED | (board->detonated ? BEASTSQUIB_STATUS_DETONATED : 0);
+    uint32_t sent = board->seq - board->last_seq;
+    uint8_t link = (board->last_seq != 0 && sent != 0) ? (board->heard >= sent ? 100 : board->heard * 100 / sent) : 255;
+
+    board->slot_due = false;
+    board->heard = 0;
+    board->last_seq = board->seq;
+    beastsquib_status_prepare(&board->report, i, flags, 1, board->seq, link);
+
+    // The ESPNOW task runs a little after the tick interrupt
+    sim_send_report(result, i, t + 0.2 * sim_uniform());
+    // Like rx_status_due, the repeat holds off the next slot
+    if (flags != board->last_flags) {
+        board->slot_due = true;
+        sim_event_t evt;
+        memset(&evt, 0, sizeof(evt));
+        evt.time = t + config->slot_ms / 2;
+        evt.type = SIM_REPEAT;
+        evt.node = i;
+        sim_push(&evt);
+    } else {
+        sim_schedule_slot(config, i, t);
+    }
+    board->last_flags = flags;
+}
+
+/* The repeat of a changed report, then the next slot. */
+static void sim_repeat(const sim_config_t *config, sim_result_t *result, int i, double t)
+{
+    sim_board_t *board = &sim_boards[i];
+
+    board->slot_due = false;
+    if (t >= board->quiet_until) {
+        result->repeated ++;
+        sim_send_report(result, i, t + 0.2 * sim_uniform());
+    }
+    sim_schedule_slot(config, i, t);
+}
+
+static void sim_report_received(const sim_config_t *config, sim_result_t *result, int i, double t)
+{
+    sim_board_t *board = &sim_boards[i];
+    int c;
+
+    sim_now = t;
+    tx_status_receive((const uint8_t *)&board->report, sizeof(board->report));
+    board->reported_round = (int64_t)floor(t) / (config->slots * config->slot_ms);
+
+    // Count the board towards every command whose first frame it has now reported
+    const beastsquib_status_entry_t *entry = &tx_status[i];
+    for (c = sim_board_current[i]; c < sim_commands && sim_command_seq[c] != 0 && entry->seq >= sim_command_seq[c]; c ++) {
+        sim_command_current[c] ++;
+    }
+    sim_board_current[i] = c;
+}
+
+static void sim_tx_send(const sim_config_t *config, sim_result_t *result, double t)
+{
+    sim_event_t evt;
+    double airtime = sim_airtime(SIM_FRAME_LEN);
+    double start = fmax(fmax(t, sim_down_free), config->status ? sim_up_busy() : 0) + 0.05 + 0.3 * sim_uniform();
+
+    sim_down_free = start + airtime;
+    result->down_airtime += airtime;
+    sim_tx_seq ++;
+
+    for (int c = 0; c < sim_commands; c ++) {
+        if (sim_command_seq[c] == 0) {
+            sim_command_seq[c] = sim_tx_seq;
+            sim_sample(&result->air, start - sim_command_at[c]);
+        }
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    evt.time = sim_down_free;
+    evt.type = SIM_DOWN_END;
+    evt.seq = sim_tx_seq;
+    evt.time_ms = (uint32_t)floor(t);
+    evt.commands = sim_commands;
+    sim_push(&evt);
+
+    if (sim_burst_left > 0) {
+        sim_burst_left --;
+    }
+    memset(&evt, 0, sizeof(evt));
+    evt.time = t + ((sim_burst_left > 0) ? SIM_BURST_SPACING_MS : SIM_HEARTBEAT_MS);
+    evt.type = SIM_TX_SEND;
+    evt.gen = sim_tx_gen;
+    sim_push(&evt);
+}
+
+static void sim_down_end(const sim_config_t *config, sim_result_t *result, const sim_event_t *frame)
+{
+    for (int i = 0; i < config->boards; i ++) {
+        sim_board_t *board = &sim_boards[i];
+        if (sim_link_uniform(frame->seq, i, 0) < config->loss || frame->seq <= board->seq) {
+            continue;
+        }
+
+        double arrival = frame->time - config->jitter_ms * log(sim_link_uniform(frame->seq, i, 1));
+        beastsquib_clock_sample(&board->clock, frame->time_ms, sim_local_ticks(board, arrival));
+        // rx_status_frame_heard
+        if (config->guard_ms > 0 && beastsquib_status_in_burst(board->frame_ms, frame->time_ms, (uint32_t)SIM_HEARTBEAT_MS)) {
+            board->quiet_until = arrival + config->guard_ms;
+        }
+        board->frame_ms = frame->time_ms;
+        board->seq = frame->seq;
+        board->last_heard = arrival;
+        board->heard ++;
+
+        for (int c = board->commands; c < frame->commands; c ++) {
+            if (sim_command_board[c] == i) {
+                board->detonated = true;
+                sim_sample(&result->fire, arrival - sim_command_at[c]);
+            }
+        }
+        board->commands = frame->commands;
+
+        if (config->status) {
+            sim_schedule_slot(config, i, arrival);
+        }
+    }
+}
+
+static void sim_run(const sim_config_t *config, sim_result_t *result)
+{
+    sim_event_t evt;
+    uint32_t command_seed = sim_command_seed;
+    uint32_t round_ms = config->slots * config->slot_ms;
+    double confirm_by = config->duration_ms - 2 * round_ms - config->slot_ms;
+    bool *alive = host_malloc(config->boards * sizeof(bool));
+    int alive_count = config->boards;
+
+    memset(result, 0, sizeof(*result));
+    memset(sim_on_air, 0, sizeof(sim_on_air));
+    memset(tx_status, 0, sizeof(tx_status));
+    memset(sim_command_seq, 0, sizeof(sim_command_seq));
+    memset(sim_command_current, 0, sizeof(sim_command_current));
+    memset(sim_command_confirmed, 0, sizeof(sim_command_confirmed));
+    memset(sim_board_current, 0, config->boards * sizeof(int));
+    sim_heap_len = 0;
+    sim_down_free = 0;
+    sim_tx_seq = 0;
+    sim_tx_gen = 0;
+    sim_burst_left = 0;
+    sim_commands = 0;
+    tx_epoch = 1;
+
+    for (int i = 0; i < config->boards; i ++) {
+        sim_board_t *board = &sim_boards[i];
+        memset(board, 0, sizeof(*board));
+        board->boot_ms = sim_uniform() * 600000.0;
+        board->rate = 1.0 + (2.0 * sim_uniform() - 1.0) * config->drift_ppm * 1e-6;
+        board->last_heard = -1e9;
+        board->reported_round = -1;
+        alive[i] = true;
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    evt.type = SIM_TX_SEND;
+    sim_push(&evt);
+
+    evt.type = SIM_COMMAND;
+    evt.time = SIM_WARMUP_MS;
+    sim_push(&evt);
+
+    evt.type = SIM_ROUND;
+    evt.time = round_ms;
+    sim_push(&evt);
+
+    while (sim_heap_len > 0) {
+        sim_pop(&evt);
+        if (evt.time > config->duration_ms) {
+            break;
+        }
+
+        switch (evt.type) {
+            case SIM_COMMAND: {
+                if (sim_commands < SIM_MAX_COMMANDS && alive_count > 0) {
+                    int pick = sim_xorshift(&command_seed) % alive_count;
+                    int target = 0;
+                    for (int i = 0; i < config->boards; i ++) {
+                        if (alive[i] && pick -- == 0) {
+                            target = i;
+                            break;
+                        }
+                    }
+                    alive[target] = false;
+                    alive_count --;
+                    sim_command_at[sim_commands] = evt.time;
+                    sim_command_board[sim_commands] = target;
+                    sim_commands ++;
+                    result->confirmable += (evt.time <= confirm_by);
+
+                    // tx_state_changed wakes the transmit task for a burst
+                    sim_burst_left = SIM_BURST_FRAMES;
+                    sim_tx_gen ++;
+                    sim_tx_send(config, result, evt.time);
+                }
+                double gap = -SIM_MEAN_COMMAND_GAP_MS * log((sim_xorshift(&command_seed) + 0.5) / 4294967296.0);
+                evt.time += 200.0 + gap;
+                sim_push(&evt);
+                break;
+            }
+            case SIM_TX_SEND:
+                if (evt.gen == sim_tx_gen) {
+                    sim_tx_send(config, result, evt.time);
+                }
+                break;
+            case SIM_DOWN_END:
+                sim_down_end(config, result, &evt);
+                break;
+            case SIM_SLOT:
+                if (evt.gen == sim_boards[evt.node].slot_gen && sim_boards[evt.node].slot_due) {
+                    sim_slot(config, result, evt.node, evt.time);
+                }
+                break;
+            case SIM_REPEAT:
+                sim_repeat(config, result, evt.node, evt.time);
+                break;
+            case SIM_UP_END: {
+                sim_on_air_t *air = &sim_on_air[evt.on_air];
+                bool lost = sim_uniform() < config->loss;
+                air->used = false;
+                if (air->collided) {
+                    result->collisions ++;
+                } else if (lost) {
+                    result->lost ++;
+                } else {
+                    sim_report_received(config, result, evt.node, evt.time);
+                }
+                break;
+            }
+            case SIM_ROUND: {
+                // The round that just ended
+                int64_t round = (int64_t)floor(evt.time) / round_ms - 1;
+                int reported = 0;
+                for (int i = 0; i < config->boards; i ++) {
+                    reported += (sim_boards[i].reported_round == round);
+                }
+                if (evt.time - round_ms > SIM_WARMUP_MS && config->status) {
+                    result->rounds ++;
+                    result->reported += reported;
+                }
+                evt.time += round_ms;
+                sim_push(&evt);
+                break;
+            }
+        }
+
+        // Confirmations and fleet-wide status, as the server would poll them
+        if (config->status && evt.type == SIM_UP_END) {
+            for (int c = 0; c < sim_commands; c ++) {
+                if (!sim_command_confirmed[c] && (tx_status[sim_command_board[c]].flags & BEASTSQUIB_STATUS_DETONATED)) {
+                    double delay = evt.time - sim_command_at[c];
+                    sim_command_confirmed[c] = true;
+                    sim_sample(&result->confirmed, delay);
+                    if (sim_command_at[c] <= confirm_by) {
+                        result->within[0] += delay <= round_ms + config->slot_ms;
+                        result->within[1] += delay <= 2 * round_ms + config->slot_ms;
+                    }
+                }
+                if (sim_command_current[c] == config->boards) {
+                    sim_command_current[c] ++;
+                    sim_sample(&result->current, evt.time - sim_command_at[c]);
+                }
+            }
+        }
+    }
+
+    host_free(alive);
+}
+
+int main(int argc, char **argv)
+{
+    sim_config_t config = {
+        .boards = 456,
+        .slots = CONFIG_ESPNOW_STATUS_SLOTS,
+        .slot_ms = CONFIG_ESPNOW_STATUS_SLOT_MS,
+        .guard_ms = CONFIG_ESPNOW_STATUS_GUARD,
+        .loss = 0.10,
+        .jitter_ms = 0.5,
+        .drift_ppm = 40,
+        .duration_ms = 120000,
+    };
+    uint32_t seed = 0x5eed1234;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:S:L:g:p:j:D:d:s:")) != -1) {
+        switch (opt) {
+            case 'n': config.boards = atoi(optarg); break;
+            case 'S': config.slots = atoi(optarg); break;
+            case 'L': config.slot_ms = atoi(optarg); break;
+            case 'g': config.guard_ms = atoi(optarg); break;
+            case 'p': config.loss = atoi(optarg) / 100.0; break;
+            case 'j': config.jitter_ms = atof(optarg); break;
+            case 'D': config.drift_ppm = atof(optarg); break;
+            case 'd': config.duration_ms = atof(optarg) * 1000.0; break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n boards] [-S slots] [-L slot_ms] [-g guard_ms] [-p loss_percent] "
+                        "[-j jitter_ms] [-D drift_ppm] [-d seconds] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (config.boards < 1 || config.slots < (uint32_t)config.boards || config.slots > CONFIG_ESPNOW_STATUS_SLOTS ||
+        config.slot_ms < 1 || config.loss < 0 || config.loss >= 1 || config.jitter_ms < 0 ||
+        config.drift_ppm < 0 || config.duration_ms <= SIM_WARMUP_MS || seed == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    host_clock_ns = sim_clock_ns;
+    sim_boards = host_malloc(config.boards * sizeof(sim_board_t));
+    sim_board_current = host_malloc(config.boards * sizeof(int));
+
+    sim_result_t off, on;
+    sim_seed = seed;
+    sim_command_seed = seed ^ 0xc0ffee;
+    config.status = false;
+    sim_run(&config, &off);
+    sim_seed = seed;
+    config.status = true;
+    sim_run(&config, &on);
+
+    double duration_s = config.duration_ms / 1000.0;
+    printf("%d boards, %u slots of %u ms (%u ms round), %u ms guard, %.0f%% loss, %.0f s\n",
+           config.boards, (unsigned)config.slots, (unsigned)config.slot_ms,
+           (unsigned)(config.slots * config.slot_ms), (unsigned)config.guard_ms, config.loss * 100, duration_s);
+    printf("state frames               without reports / with reports\n");
+    sim_report("command-to-air, off", &off.air);
+    sim_report("command-to-air, on", &on.air);
+    sim_report("command-to-fire, off", &off.fire);
+    sim_report("command-to-fire, on", &on.fire);
+    printf("status reports\n");
+    sim_report("detonation confirmed", &on.confirmed);
+    sim_report("every board current", &on.current);
+    printf("  %-26s %.1f per round of %d boards\n", "boards reporting",
+           on.rounds ? (double)on.reported / on.rounds : 0.0, config.boards);
+    printf("  %-26s %llu sent, %llu repeated, %llu skipped for a burst, %llu collided, %llu lost\n", "reports",
+           (unsigned long long)on.sent, (unsigned long long)on.repeated, (unsigned long long)on.skipped,
+           (unsigned long long)on.collisions, (unsigned long long)on.lost);
+    printf("  %-26s reports %.1f%%, state frames %.1f%%\n", "airtime",
+           on.up_airtime / config.duration_ms * 100, on.down_airtime / config.duration_ms * 100);
+
+    if (off.fire.count == 0 || on.fire.count == 0) {
+        printf("no detonations\n");
+        return 1;
+    }
+    // sim_report left the samples sorted
+    double off_p99 = off.fire.samples[(size_t)(0.99 * (off.fire.count - 1))];
+    double on_p99 = on.fire.samples[(size_t)(0.99 * (on.fire.count - 1))];
+    double off_max = off.fire.samples[off.fire.count - 1];
+    double on_max = on.fire.samples[on.fire.count - 1];
+    bool held_up = on_p99 > off_p99 + SIM_FIRE_MARGIN_MS || on_max > off_max + SIM_FIRE_MARGIN_MS;
+    printf("command-to-fire with reports: p99 %+.1f ms, max %+.1f ms (at most %+.1f ms) %s\n",
+           on_p99 - off_p99, on_max - off_max, SIM_FIRE_MARGIN_MS, held_up ? "FAIL" : "ok");
+
+    // Out of every command, not just those confirmed at all. A report
+    // skipped for the board's own burst, or lost twice, waits a round
+    double one = on.confirmable ? (double)on.within[0] / on.confirmable : 0.0;
+    double two = on.confirmable ? (double)on.within[1] / on.confirmable : 0.0;
+    bool late = one < SIM_CONFIRM_ONE_ROUND || two < SIM_CONFIRM_TWO_ROUNDS;
+    printf("detonations confirmed within a round: %.1f%% (at least %.0f%%), two: %.1f%% (at least %.0f%%) %s\n",
+           one * 100, SIM_CONFIRM_ONE_ROUND * 100, two * 100, SIM_CONFIRM_TWO_ROUNDS * 100, late ? "FAIL" : "ok");
+
+    host_free(sim_board_current);
+    host_free(sim_boards);
+
+    return (held_up || late) ? 1 : 0;
+}
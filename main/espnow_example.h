@@ -10,6 +10,8 @@
 #ifndef BEASTSQUIB_H
 #define BEASTSQUIB_H
 
+#include <stddef.h>
+
 /* ESPNOW can work in both station and softap mode. It is configured in menuconfig. */
 #if CONFIG_STATION_MODE
 #define ESPNOW_WIFI_MODE WIFI_MODE_STA
@@ -21,11 +23,20 @@
 
 #define ESPNOW_QUEUE_SIZE           6
 
+/* Largest frame the receive path will copy. */
+#define ESPNOW_RX_SLOT_SIZE         ESP_NOW_MAX_DATA_LEN
+
+/* Source MACs of known transmitters. An empty allowlist admits any source. */
+#define ESPNOW_TX_ALLOWLIST_SIZE    4
+
+/* Event ring between the WiFi task and the ESPNOW task. One entry is always
+ * left empty to tell a full ring from an empty one. */
+#define ESPNOW_RING_SIZE            (ESPNOW_QUEUE_SIZE + 1)
+
 #define IS_BROADCAST_ADDR(addr) (memcmp(addr, beastsquib_broadcast_mac, ESP_NOW_ETH_ALEN) == 0)
 
 typedef enum {
     BEASTSQUIB_ESPNOW_SEND_CB,
-    BEASTSQUIB_ESPNOW_RECV_CB,
 } beastsquib_espnow_event_id_t;
 
 typedef struct {
@@ -33,15 +44,8 @@ typedef struct {
     esp_now_send_status_t status;
 } beastsquib_espnow_event_send_cb_t;
 
-typedef struct {
-    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
-    uint8_t *data;
-    int data_len;
-} beastsquib_espnow_event_recv_cb_t;
-
 typedef union {
     beastsquib_espnow_event_send_cb_t send_cb;
-    beastsquib_espnow_event_recv_cb_t recv_cb;
 } beastsquib_espnow_event_info_t;
 
 /* When ESPNOW sending or receiving callback function is called, post event to ESPNOW task. */
@@ -56,15 +60,502 @@ enum {
     beastsquib_ESPNOW_DATA_MAX,
 };
 
-/* User defined field of ESPNOW data in this example. */
+/* Reasons the receive callback turns a frame away before it is queued. */
+typedef enum {
+    BEASTSQUIB_RX_ADMIT,
+    BEASTSQUIB_RX_REJECT_SHORT,
+    BEASTSQUIB_RX_REJECT_LONG,
+    BEASTSQUIB_RX_REJECT_MAGIC,
+    BEASTSQUIB_RX_REJECT_VERSION,
+    BEASTSQUIB_RX_REJECT_SOURCE,
+    BEASTSQUIB_RX_REJECT_FORMAT,
+    BEASTSQUIB_RX_REJECT_MAX,
+} beastsquib_rx_admit_t;
+
+/* Board IDs are sent in pages of the pyro bitmap, each covering
+ * BEASTSQUIB_PAGE_BITS consecutive IDs. */
+#define BEASTSQUIB_PAGE_BYTES       64
+#define BEASTSQUIB_PAGE_BITS        (BEASTSQUIB_PAGE_BYTES * 8)
+#define BEASTSQUIB_MAX_PAGES        8
+#define BEASTSQUIB_MAX_BOARDS       (BEASTSQUIB_MAX_PAGES * BEASTSQUIB_PAGE_BITS)
+
+/* Version 0-2 frame.
+ *
+ * Version 2 appends the transmitter's boot epoch and a per-frame sequence
+ * number. Version 0/1 frames end after pyro_bits; version 0 is what
+ * transmitters sent before the version field existed. */
 typedef struct {
     uint16_t crc;
     uint32_t magic;
-    uint16_t padding;
+    uint8_t version;                      //Protocol version. Was padding, so older transmitters send 0.
+    uint8_t reserved;
     uint16_t armed;
     uint8_t pyro_bits[64];
+    uint32_t epoch;                       //Transmitter boot count, increases on every transmitter boot.
+    uint32_t seq;                         //Frame number within the epoch, increases on every frame.
 } __attribute__((packed)) beastsquib_espnow_data_t;
 
+/* Length of a version 0/1 frame, which has no epoch or sequence number. */
+#define BEASTSQUIB_V1_DATA_LEN offsetof(beastsquib_espnow_data_t, epoch)
+
+/* How a version 3 frame carries the pyro bitmap. */
+typedef enum {
+    BEASTSQUIB_ENCODING_BITMAP,           //Payload is one page of the bitmap, the one given by page.
+    BEASTSQUIB_ENCODING_SPARSE,           //Payload lists every set board ID as uint16_t, across all pages.
+    BEASTSQUIB_ENCODING_BITMAP_RECENT,    //One bitmap page, then board IDs set by recent changes as uint16_t.
+    BEASTSQUIB_ENCODING_BITMAP_TIMED,     //One bitmap page, then board IDs set by recent changes as beastsquib_timed_id_t.
+    BEASTSQUIB_ENCODING_MAX,
+} beastsquib_encoding_t;
+
+/* The encoding byte also carries, above the encoding, the ID of the
+ * transmitter that sent the frame and whether it is off duty (see
+ * beastsquib_standby_t). Both are 0 from older transmitters. */
+#define BEASTSQUIB_ENCODING_MASK    0x0F
+#define BEASTSQUIB_ENCODING_STANDBY 0x10
+#define BEASTSQUIB_TX_ID_SHIFT      5
+#define BEASTSQUIB_MAX_TX           8
+#define BEASTSQUIB_FRAME_ENCODING(encoding) ((encoding) & BEASTSQUIB_ENCODING_MASK)
+#define BEASTSQUIB_FRAME_TX_ID(encoding)    ((encoding) >> BEASTSQUIB_TX_ID_SHIFT)
+
+/* Version 3 frame. The header keeps the version 2 layout up to armed, with
+ * the reserved byte now giving the encoding, and the frame is only as long
+ * as its payload.
+ *
+ * time_ms is the transmitter's clock when the frame was sent, which
+ * receivers follow. A relay passing the frame on advances it by the time
+ * the frame spent waiting there and takes one off ttl. IDs newly set in the bitmap detonate when that clock
+ * reaches fire_at_ms, or straight away if it is 0 or already past. */
+typedef struct {
+    uint16_t crc;
+    uint32_t magic;
+    uint8_t version;
+    uint8_t encoding;                     //beastsquib_encoding_t, and the transmitter ID above it.
+    uint16_t armed;
+    uint32_t epoch;
+    uint32_t seq;
+    uint8_t page;                         //Bitmap page carried, 0 for sparse frames.
+    uint8_t ttl;                          //Times the frame may still be relayed. Was reserved, so 0 from older transmitters.
+    uint32_t time_ms;                     //Transmitter clock at send, unit: ms.
+    uint32_t fire_at_ms;                  //Transmitter clock to detonate at, 0 for straight away.
+    uint8_t payload[];
+} __attribute__((packed)) beastsquib_espnow_frame_t;
+
+/* A recently set board ID and when it detonates, after the page of a
+ * BEASTSQUIB_ENCODING_BITMAP_TIMED frame. A listed board fires at its own
+ * time rather than the frame's fire_at_ms, which is that of the newest
+ * change, so one that missed the frames of its own kill still fires on
+ * that kill's schedule. */
+typedef struct {
+    uint16_t id;
+    uint32_t fire_at_ms;                  //Transmitter clock to detonate at, 0 for straight away.
+} __attribute__((packed)) beastsquib_timed_id_t;
+
+/* Most board IDs a sparse frame can list. */
+#define BEASTSQUIB_SPARSE_MAX_IDS   ((ESP_NOW_MAX_DATA_LEN - sizeof(beastsquib_espnow_frame_t)) / sizeof(uint16_t))
+
+/* Recently set board IDs remembered by the transmitter for
+ * BEASTSQUIB_ENCODING_BITMAP_RECENT frames. */
+#define BEASTSQUIB_RECENT_HISTORY   64
+
+/* State the transmitter sends. */
+typedef struct {
+    uint16_t armed;
+    uint32_t fire_at_ms;                  //When the most recently set IDs detonate, 0 for straight away.
+    uint8_t pyro_bits[BEASTSQUIB_MAX_PAGES][BEASTSQUIB_PAGE_BYTES];
+} beastsquib_tx_state_t;
+
+/* A receiver's estimate of the transmitter clock, kept as the offset from
+ * local ticks. Frames arrive late by a varying amount, never early, so
+ * the estimate follows the least delayed frames: it moves up to a larger
+ * offset at once and drifts down slowly. */
+typedef struct {
+    bool synced;
+    uint32_t offset_ms;                   //Transmitter ms minus local ticks, whole part.
+    int32_t offset_frac;                  //Fractional part, unit: 1/256 ms, 0 to 255.
+} beastsquib_clock_t;
+
+/* Frames a relay remembers having passed on. */
+#define BEASTSQUIB_RELAY_CACHE_SIZE 8
+
+/* A receiver that passes state frames on. It holds at most one frame, the
+ * newest, until its back-off ends. */
+typedef struct {
+    bool pending;                         //frame is waiting to be passed on.
+    uint32_t rx_ticks;                    //Local tick the pending frame arrived on.
+    uint32_t send_at;                     //Local tick to pass the pending frame on.
+    uint16_t duplicates;                  //Copies of the pending frame heard since it arrived.
+    int len;
+    uint8_t frame[ESPNOW_RX_SLOT_SIZE];
+    uint32_t sent_epoch[BEASTSQUIB_RELAY_CACHE_SIZE];  //Frames already passed on, oldest overwritten first.
+    uint32_t sent_seq[BEASTSQUIB_RELAY_CACHE_SIZE];
+    uint8_t sent_tx[BEASTSQUIB_RELAY_CACHE_SIZE];  //ID of the transmitter that numbered each.
+    uint32_t sent_next;
+    uint32_t relayed;                     //Frames passed on.
+    uint32_t suppressed;                  //Frames dropped because enough other relays sent them.
+} beastsquib_relay_t;
+
+/* A transmitter's view of the others broadcasting the same game. One of
+ * them is on duty: the others flag their frames BEASTSQUIB_ENCODING_STANDBY,
+ * follow its clock and, in hot standby, leave heartbeats to it. One off
+ * duty takes over once it has heard none on duty for the standby timeout,
+ * and of two on duty the higher ID steps down. In a group
+ * (CONFIG_ESPNOW_TX_GROUP) a transmitter listens for a timeout after
+ * booting before it sends, so it joins a running group instead of taking
+ * it over; a lone one counts as joined from the start.
+ *
+ * The group shares one sequence number, so a transmitter that has not yet
+ * had the newest command could send its older state numbered after the
+ * newer one. Instead it holds back, for at most a timeout, once it hears a
+ * page unlike its own numbered after it last changed that page, until its
+ * own state changes or the two agree again. */
+typedef struct {
+    uint8_t id;                           //This transmitter's ID.
+    bool joined;                          //Has listened for a timeout since booting.
+    bool on_duty;
+    uint32_t boot_ms;                     //Local ms it started listening.
+    uint8_t duty_heard;                   //Bit per transmitter ID heard on duty since boot.
+    uint32_t duty_at[BEASTSQUIB_MAX_TX];  //Local ms each ID was last heard on duty.
+    uint32_t frames[BEASTSQUIB_MAX_TX];   //Frames heard, by ID.
+    beastsquib_clock_t clock;             //Clock of the transmitter on duty.
+    uint32_t takeovers;                   //Times this transmitter went on duty.
+    uint32_t handovers;                   //Times it stepped down for a lower ID.
+    uint32_t changed_seq[BEASTSQUIB_MAX_PAGES];  //seq when each page last changed here, 0 for an earlier epoch.
+    uint8_t differs;                      //Bit per page heard unlike this one's, numbered after it changed here.
+    uint32_t differs_at;                  //Local ms the last such page was heard.
+    uint32_t holds;                       //Times it held back for a newer state from another transmitter.
+} beastsquib_standby_t;
+
+/* Most WiFi channels a game can be spread over. */
+#define BEASTSQUIB_MAX_CHANNELS     4
+
+/* Traffic on one channel. */
+typedef struct {
+    uint32_t frames;                      //Frames sent (transmitter) or heard (receiver) on the channel.
+    uint32_t lost;                        //Frames missed while listening on it, from gaps in the sequence number.
+    uint32_t listen_ms;                   //Time spent on it, unit: ms.
+} beastsquib_channel_stats_t;
+
+/* Channel diversity. The transmitter sends each frame on the next channel
+ * of the list in turn, so every channel carries one frame in count. A
+ * receiver either hops along, moving to the next channel after each frame,
+ * or scans the channels and locks onto the one it hears best. Either way
+ * it moves on from a channel that goes quiet. */
+typedef struct {
+    uint8_t count;
+    uint8_t channel[BEASTSQUIB_MAX_CHANNELS];  //WiFi channel numbers.
+    bool hop;                             //Follow the transmitter from channel to channel instead of locking onto one.
+    bool locked;                          //Lock mode: has picked a channel since the last scan.
+    uint8_t current;                      //Index of the channel listened on.
+    uint32_t since;                       //Local ms listen_ms of the current channel counts from.
+    uint32_t window_at;                   //Local ms the current scan step or lock window started.
+    uint32_t heard_at;                    //Local ms of the last frame heard on the current channel.
+    bool expecting;                       //expect_seq is the next frame due on the current channel.
+    uint32_t expect_epoch;
+    uint32_t expect_seq;
+    uint32_t window_frames;               //Frames heard and missed in the current window.
+    uint32_t window_lost;
+    uint32_t scan_frames[BEASTSQUIB_MAX_CHANNELS];  //Frames heard and missed on each channel in the last scan.
+    uint32_t scan_lost[BEASTSQUIB_MAX_CHANNELS];
+    uint32_t switches;                    //Times the receiver changed channel.
+    uint32_t scans;                       //Scans started, lock mode only.
+    beastsquib_channel_stats_t stats[BEASTSQUIB_MAX_CHANNELS];
+} beastsquib_channels_t;
+
+/* Newest frame applied by a receiver. Transmitters of a group share the
+ * sequence number, so frames from two of them can carry the same one with
+ * different pages: each is taken once per transmitter, and the board's
+ * own page only from the first that carries it. */
+typedef struct {
+    bool synced;                          //False until the first version 2 frame, and after a silence timeout.
+    uint32_t epoch;
+    uint32_t seq;
+    uint8_t seq_from;                     //Bit per transmitter ID whose frame numbered seq was taken.
+    bool seq_page;                        //A frame numbered seq has carried this board's page.
+} beastsquib_rx_seq_t;
+
+/* Newest broadcast state frame for one bitmap page, handed from the WiFi
+ * task to the ESPNOW task. seq is odd while the WiFi task is writing the
+ * frame. */
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t order;                       //Frames published before this one, across every page.
+    uint32_t rx_ticks;                    //Local tick the frame arrived on.
+    uint32_t rx_cycles;                   //CPU cycle count when the receive callback was entered.
+    uint32_t published_cycles;            //CPU cycle count when the frame was handed off.
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    int data_len;
+    uint8_t data[ESPNOW_RX_SLOT_SIZE];
+} beastsquib_espnow_state_mailbox_t;
+
+/* Receive path counters. */
+typedef struct {
+    uint32_t admit[BEASTSQUIB_RX_REJECT_MAX];  //Frames admitted (BEASTSQUIB_RX_ADMIT) or rejected, by reason.
+    uint32_t ring_full;                   //Events dropped because the event ring was full.
+    uint32_t state_overwritten;           //State frames replaced by a newer one for the same page before being handled.
+    uint32_t crc_fail;                    //Admitted frames that failed the CRC check.
+    uint32_t stale;                       //Valid frames not newer than the last applied one.
+    uint32_t lost;                        //Frames missed, from gaps in the sequence number.
+    uint32_t status;                      //Status reports recorded (transmitter only).
+    uint32_t ring_peak;                   //Most events the event ring has held at once.
+    uint32_t silence_disarms;             //Times the board disarmed after a second without frames.
+    uint32_t from_tx[BEASTSQUIB_MAX_TX];  //Fresh version 3 frames applied, by transmitter ID.
+} beastsquib_rx_stats_t;
+
+/* Stages of booting, timed for #BPR. */
+typedef enum {
+    BEASTSQUIB_BOOT_NVS,
+    BEASTSQUIB_BOOT_GPIO,                 //Outputs and the hw_timer, receivers only.
+    BEASTSQUIB_BOOT_CONFIG,               //Board configuration, receivers only.
+    BEASTSQUIB_BOOT_WIFI,
+    BEASTSQUIB_BOOT_ESPNOW,
+    BEASTSQUIB_BOOT_UART,                 //In the boot_io task.
+    BEASTSQUIB_BOOT_STORAGE,              //SPIFFS mount, in the boot_io task, receivers only.
+    BEASTSQUIB_BOOT_FIRST_FRAME,          //From reset to the first frame applied.
+    BEASTSQUIB_BOOT_MAX,
+} beastsquib_boot_stage_t;
+
+/* When each stage began and ended, in us since reset; end is 0 until it has. */
+typedef struct {
+    uint32_t begin_us[BEASTSQUIB_BOOT_MAX];
+    uint32_t end_us[BEASTSQUIB_BOOT_MAX];
+} beastsquib_boot_profile_t;
+
+/* Board configuration, kept in NVS as a single blob and in RAM while the
+ * board runs. Later versions only add fields at the end, so an older
+ * record reads as a prefix with the rest left at their defaults. */
+#define BEASTSQUIB_CONFIG_VERSION   1
+#define BEASTSQUIB_CONFIG_RELAY     0x01  //Pass frames on (#RLY).
+
+typedef struct {
+    uint8_t version;                      //BEASTSQUIB_CONFIG_VERSION when written.
+    uint8_t flags;                        //BEASTSQUIB_CONFIG_ flags.
+    int16_t board_id;                     //Set with #SID.
+} beastsquib_board_config_t;
+
+/* Low power receive: the radio also listens BEASTSQUIB_RADIO_GUARD_MS
+ * before each heartbeat, to allow for clock error. */
+#define BEASTSQUIB_RADIO_GUARD_MS 5
+
+/* Time the radio sleeps for, against the window it listens in. */
+typedef struct {
+    uint32_t timer_irqs;                  //hw_timer interrupts taken.
+    uint32_t radio_sleeps;                //Times the radio was put in modem sleep.
+    uint32_t radio_sleep_ms;              //Total modem sleep asked for, unit: ms.
+} beastsquib_power_stats_t;
+
+/* ESP8266EX datasheet current with the radio receiving and in modem sleep,
+ * used by #PWR for its estimate. Unit: mA. */
+#define BEASTSQUIB_POWER_RX_MA          56
+#define BEASTSQUIB_POWER_MODEM_SLEEP_MA 15
+
+/* Flight recorder event types, see rx_log_put. */
+typedef enum {
+    BEASTSQUIB_LOG_BOOT,                  //value: board ID.
+    BEASTSQUIB_LOG_FRAME,                 //result: beastsquib_log_frame_t, value: sequence number, detail: epoch.
+    BEASTSQUIB_LOG_ARMED,
+    BEASTSQUIB_LOG_DISARMED,              //result: 1 after a silence timeout.
+    BEASTSQUIB_LOG_SCHEDULED,             //value: tick the board will fire on.
+    BEASTSQUIB_LOG_DETONATE,              //result: 1 on a scheduled tick.
+    BEASTSQUIB_LOG_REVIVE,
+    BEASTSQUIB_LOG_SILENCE,               //No frame for ESPNOW_SILENCE_TICKS_TIMEOUT ticks.
+    BEASTSQUIB_LOG_MAX,
+} beastsquib_log_type_t;
+
+typedef enum {
+    BEASTSQUIB_LOG_FRAME_APPLIED,
+    BEASTSQUIB_LOG_FRAME_STALE,
+    BEASTSQUIB_LOG_FRAME_CRC,
+} beastsquib_log_frame_t;
+
+/* One flight recorder event. */
+typedef struct {
+    uint32_t ticks;                       //Local tick it happened on.
+    uint32_t value;
+    uint16_t detail;
+    uint8_t type;
+    uint8_t result;
+} beastsquib_log_entry_t;
+
+/* Events kept from hw_timer_callback, which only records timeouts and scheduled detonations. */
+#define BEASTSQUIB_LOG_ISR_SIZE 16
+
+/* Flight recorder saved to flash, followed by both rings as they were. */
+typedef struct {
+    uint32_t magic;
+    uint32_t head;
+    uint32_t isr_head;
+    uint16_t size;
+    uint16_t isr_size;
+} beastsquib_log_snapshot_t;
+
+/* Receive path stages timed with the CPU cycle counter. */
+typedef enum {
+    BEASTSQUIB_LATENCY_ADMIT,             //Receive callback, from entry to the hand-off.
+    BEASTSQUIB_LATENCY_WAKE,              //Hand-off to the ESPNOW task taking the frame.
+    BEASTSQUIB_LATENCY_HANDLE,            //Taking the frame to having applied it.
+    BEASTSQUIB_LATENCY_FIRE,              //Receive callback to the pyro GPIO, for frames that fire at once.
+    BEASTSQUIB_LATENCY_MAX,
+} beastsquib_latency_stage_t;
+
+/* Bucket 0 holds times under 2^BEASTSQUIB_LATENCY_MIN_BITS cycles, bucket b
+ * times of 2^(b+MIN_BITS-1) cycles up to twice that, and the last bucket
+ * everything longer. */
+#define BEASTSQUIB_LATENCY_MIN_BITS 6
+#define BEASTSQUIB_LATENCY_BUCKETS  20
+
+/* Histogram of one stage. Each stage is written by a single task. */
+typedef struct {
+    uint32_t count;
+    uint32_t max;                         //Longest, in cycles.
+    uint32_t bucket[BEASTSQUIB_LATENCY_BUCKETS];
+} beastsquib_latency_hist_t;
+
+/* Status report a receiver sends back to the transmitter once per status
+ * round. A round is CONFIG_ESPNOW_STATUS_SLOTS slots of
+ * CONFIG_ESPNOW_STATUS_SLOT_MS on the transmitter clock, and each board
+ * sends in the slot given by its board ID, so the fleet takes turns
+ * instead of colliding. A board that has just heard a frame of a burst
+ * skips its slot, see CONFIG_ESPNOW_STATUS_GUARD. Broadcast, so a lost
+ * report is not retried into the next board's slot; a report whose flags
+ * changed is sent twice within its own slot instead. The magic tells it
+ * apart from state frames. */
+typedef struct {
+    uint16_t crc;
+    uint32_t magic;                       //BEASTSQUIB_STATUS_MAGIC.
+    uint8_t version;
+    uint8_t flags;                        //BEASTSQUIB_STATUS_ flags.
+    uint16_t board_id;
+    uint32_t epoch;                       //Newest state frame applied.
+    uint32_t seq;
+    uint8_t link;                         //Percentage of state frames heard since the last report, 255 if unknown.
+    uint8_t reserved;
+} __attribute__((packed)) beastsquib_status_frame_t;
+
+#define BEASTSQUIB_STATUS_ARMED        0x01
+#define BEASTSQUIB_STATUS_DETONATED    0x02
+#define BEASTSQUIB_STATUS_FIRE_PENDING 0x04  //Detonation scheduled, not fired yet.
+#define BEASTSQUIB_STATUS_HEARD        0x80  //Transmitter table only: a report has arrived.
+
+#define BEASTSQUIB_STATUS_ROUND_MS (CONFIG_ESPNOW_STATUS_SLOTS * CONFIG_ESPNOW_STATUS_SLOT_MS)
+#define BEASTSQUIB_STATUS_REPEAT_MS (CONFIG_ESPNOW_STATUS_SLOT_MS / 2)  //A changed report is sent again this far into its slot.
+
+/* Latest status report the transmitter has from one board. */
+typedef struct {
+    uint8_t flags;                        //BEASTSQUIB_STATUS_ flags.
+    uint8_t link;
+    uint16_t round;                       //Status round it arrived in, tx clock / BEASTSQUIB_STATUS_ROUND_MS.
+    uint32_t seq;                         //Newest frame the board had applied, 0 if from another epoch.
+} beastsquib_status_entry_t;
+
+/* Transmit schedule. A state change is sent as a burst of frames, after
+ * which the transmitter falls back to a slower heartbeat. */
+typedef struct {
+    uint16_t burst_count;                 //Frames sent for each state change.
+    uint16_t burst_spacing_ms;            //Delay between two frames of a burst, unit: ms.
+    uint16_t heartbeat_ms;                //Delay between frames when nothing changes, unit: ms.
+} beastsquib_tx_timing_t;
+
+/* Binary UART frames, which the transmitter accepts alongside the ASCII
+ * commands. On the wire a frame is COBS encoded between two 0x00 bytes,
+ * which never occur in ASCII commands. Decoded, it is
+ *
+ *   seq, type, payload..., crc16 (little endian, over seq to payload)
+ *
+ * and the board answers each one with an ACK or NAK frame carrying the
+ * same seq, instead of echoing it. */
+typedef enum {
+    BEASTSQUIB_UART_ARM = 0x01,           //uint8_t armed, 0 or 1.
+    BEASTSQUIB_UART_PAGE = 0x02,          //uint8_t page, then one page of the pyro bitmap.
+    BEASTSQUIB_UART_DELTA = 0x03,         //uint16_t board IDs to set, or to clear with bit 15 set.
+    BEASTSQUIB_UART_DELAY = 0x04,         //uint16_t detonation delay, unit: ms.
+    BEASTSQUIB_UART_ACK = 0x80,
+    BEASTSQUIB_UART_NAK = 0x81,           //uint8_t beastsquib_uart_nak_t.
+    BEASTSQUIB_UART_TRACE = 0x82,         //uint8_t beastsquib_trace_type_t, uint32_t local time in us, then the data.
+} beastsquib_uart_frame_type_t;
+
+/* Traces. A trace file is BEASTSQUIB_TRACE_MAGIC followed by records, each
+ * a beastsquib_trace_record_t and its data, in time order. transmit.py
+ * records what the server writes and, while #TRC,1; is on, the frames the
+ * board streams back as BEASTSQUIB_UART_TRACE frames; host/replay plays a
+ * trace back. The seq of a BEASTSQUIB_UART_TRACE frame counts every record
+ * the board made, so the frames it had to drop show as gaps. */
+#define BEASTSQUIB_TRACE_MAGIC      "BSQTRACE"
+#define BEASTSQUIB_TRACE_MAGIC_LEN  8
+#define BEASTSQUIB_TRACE_RING       8
+
+typedef enum {
+    BEASTSQUIB_TRACE_UART = 1,            //Bytes the server wrote to the board.
+    BEASTSQUIB_TRACE_TX = 2,              //Frame sent by tx_transmit_step.
+    BEASTSQUIB_TRACE_RX = 3,              //Sender MAC, then a frame heard by the receive callback.
+} beastsquib_trace_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t delta_us;                    //Time since the previous record, unit: us.
+    uint8_t type;                         //beastsquib_trace_type_t.
+    uint16_t len;                         //Bytes of data that follow.
+} beastsquib_trace_record_t;
+
+/* A record waiting on the board to be streamed. */
+typedef struct {
+    uint32_t time_us;                     //Local time, unit: us.
+    uint8_t type;                         //beastsquib_trace_type_t.
+    uint8_t seq;                          //Records made before this one, dropped or not.
+    uint16_t len;
+    uint8_t data[ESP_NOW_ETH_ALEN + ESP_NOW_MAX_DATA_LEN];
+} beastsquib_trace_entry_t;
+
+/* Why a binary UART frame was refused. */
+typedef enum {
+    BEASTSQUIB_UART_NAK_NONE,
+    BEASTSQUIB_UART_NAK_CRC,              //Bad COBS encoding or checksum.
+    BEASTSQUIB_UART_NAK_LENGTH,           //Payload too long or the wrong length for its type.
+    BEASTSQUIB_UART_NAK_TYPE,             //Unknown type.
+    BEASTSQUIB_UART_NAK_VALUE,            //Page, board ID or value out of range.
+} beastsquib_uart_nak_t;
+
+/* Longest binary UART frame payload, and longest COBS encoded frame
+ * without its 0x00 delimiters. */
+#define BEASTSQUIB_UART_MAX_PAYLOAD 128
+#define BEASTSQUIB_UART_MAX_ENCODED (BEASTSQUIB_UART_MAX_PAYLOAD + 4 + 2)
+#define BEASTSQUIB_UART_DELTA_CLEAR 0x8000
+
+/* Longest ASCII command after its '#': name, page, 128 hex digits and
+ * their commas (#DEP,0,<128 hex digits>), then the ';'. */
+#define BEASTSQUIB_UART_MAX_COMMAND 136
+#define BEASTSQUIB_UART_MAX_FIELDS  3
+
+/* Streaming parser for the ASCII commands, #NAM,field,field; with up to
+ * BEASTSQUIB_UART_MAX_FIELDS fields. Each byte costs the same: fields are
+ * classified and their hex digits decoded as they arrive, and the command
+ * runs on its ';'. A '#' always starts a new command; bytes outside a
+ * command are ignored. */
+typedef struct {
+    bool active;                          //Inside a command, after its '#'.
+    bool bad;                             //Seen a byte that cannot belong to any command.
+    uint8_t len;                          //Bytes since the '#'.
+    char text[BEASTSQUIB_UART_MAX_COMMAND];            //Bytes since the '#'.
+    uint8_t field_count;
+    uint8_t field_start[BEASTSQUIB_UART_MAX_FIELDS];   //Offset of each field in text.
+    uint8_t field_len[BEASTSQUIB_UART_MAX_FIELDS];
+    uint16_t field_value[BEASTSQUIB_UART_MAX_FIELDS];  //Decimal value, while the field is all digits.
+    uint8_t field_flags[BEASTSQUIB_UART_MAX_FIELDS];   //BEASTSQUIB_UART_FIELD_ flags.
+    uint8_t hex[BEASTSQUIB_PAGE_BYTES];   //Hex digits of the last field so far, decoded.
+} beastsquib_uart_parser_t;
+
+#define BEASTSQUIB_UART_FIELD_DECIMAL 0x01  //Only decimal digits.
+#define BEASTSQUIB_UART_FIELD_HEX     0x02  //Only hex digits, either case.
+
+/* Serial link counters. */
+typedef struct {
+    uint32_t ok;                          //ASCII commands run.
+    uint32_t unknown;                     //Commands with an unknown name.
+    uint32_t format;                      //Known commands with fields of the wrong number, length or characters.
+    uint32_t overlong;                    //Commands longer than BEASTSQUIB_UART_MAX_COMMAND.
+    uint32_t interrupted;                 //Commands cut off by the next '#' before their ';'.
+    uint32_t frames;                      //Binary frames acknowledged.
+    uint32_t naks;                        //Binary frames refused.
+} beastsquib_uart_stats_t;
+
 /* Parameters of sending ESPNOW data. */
 typedef struct {
     uint32_t magic;                       //Magic number which is used to determine which device to send unicast ESPNOW data.
@@ -21,28 +21,37 @@
 #include "freertos/semphr.h"
 #include "freertos/timers.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_event_loop.h"
 #include "tcpip_adapter.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_now.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
 #include "rom/ets_sys.h"
 #include "rom/crc.h"
 #include "espnow_example.h"
 #include "driver/gpio.h"
 #include "driver/hw_timer.h"
+#include "driver/soc.h"
 #include "driver/uart.h"
 #include "esp_spiffs.h"
 
 #define BEASTSQUIB_MAGIC_NUMBER 0xB3A57
+#define BEASTSQUIB_PROTOCOL_VERSION 3
+#define BEASTSQUIB_STATUS_MAGIC 0xB3A58
 
 static const char *TAG = "beast_squib";
-static xQueueHandle beastsquib_espnow_queue;
+static TaskHandle_t beastsquib_espnow_task_handle;
 static uint8_t beastsquib_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
+/* Select the board role here, or pass -DTX / -DRX from the build. */
 // #define TX
+#if !defined(TX) && !defined(RX)
 #define RX
+#endif
 
 #if defined(TX) && defined(RX)
 #error Cannot define both TX and RX
@@ -50,12 +59,185 @@ static uint8_t beastsquib_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF,
 
 int board_id = -1;
 uint16_t test_board_id = 433;
-beastsquib_espnow_data_t global_tx_data;
+beastsquib_tx_state_t global_tx_data;
+
+/* Transmit schedule, tunable at runtime with #TXS. */
+static beastsquib_tx_timing_t tx_timing = {
+    .burst_count = CONFIG_ESPNOW_SEND_COUNT,
+    .burst_spacing_ms = CONFIG_ESPNOW_SEND_DELAY,
+    .heartbeat_ms = CONFIG_ESPNOW_HEARTBEAT_PERIOD,
+};
+static uint16_t tx_burst_remaining = 0;
+static TaskHandle_t tx_transmit_task_handle;
+
+/* Bitmap paging. Pages in use grow with the highest page the server sets;
+ * pages changed since the last frame are repeated through the next burst. */
+static uint8_t tx_page_count = 1;
+static uint8_t tx_dirty_pages = 0;
+static uint8_t tx_burst_pages = 0;
+static uint8_t tx_next_page = 0;
+
+/* Board IDs set by recent changes, repeated in every bitmap frame while
+ * the bitmap spans several pages or their detonations are still to come.
+ * Entry i was set by change tx_recent_change[i] to fire at
+ * tx_recent_fire[i]. */
+#ifdef CONFIG_ESPNOW_FEC
+static bool tx_fec_enabled = true;
+static uint16_t tx_fec_depth = CONFIG_ESPNOW_FEC_DEPTH;
+#else
+static bool tx_fec_enabled = false;
+static uint16_t tx_fec_depth = 1;
+#endif
+static uint16_t tx_recent_ids[BEASTSQUIB_RECENT_HISTORY];
+static uint32_t tx_recent_change[BEASTSQUIB_RECENT_HISTORY];
+static uint32_t tx_recent_fire[BEASTSQUIB_RECENT_HISTORY];
+static uint32_t tx_recent_head = 0;
+static uint32_t tx_change_count = 0;
+
+/* Delay from a detonation arriving over UART to the boards firing, set with #DLY. */
+static uint16_t tx_detonate_delay_ms = CONFIG_ESPNOW_DETONATE_DELAY;
+
+/* Transmitter clock sent in every frame. tx_clock_offset moves it onto
+ * the clock of the transmitter on duty, see tx_standby_heard. */
+static uint32_t tx_clock_offset = 0;
+
+static inline uint32_t tx_clock_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000) + tx_clock_offset;
+}
+
+/* Sequence tracking: transmitter side stamps. */
+static uint32_t tx_epoch = 0;
+static uint32_t tx_seq = 0;
+
+/* Other transmitters of the same game, see beastsquib_standby_t. */
+static beastsquib_standby_t tx_standby;
+
+/* Records that pages of this transmitter's state changed while its
+ * sequence number was seq, which ends any hold for them. */
+static void beastsquib_standby_changed(beastsquib_standby_t *sb, uint8_t pages, uint32_t seq)
+{
+    for (int page = 0; page < BEASTSQUIB_MAX_PAGES; page ++) {
+        if (pages & (1 << page)) {
+            sb->changed_seq[page] = seq;
+        }
+    }
+    sb->differs &= ~pages;
+}
+
+/* Wakes the transmit task so a state change goes out without waiting for
+ * the next heartbeat. Does nothing on a receiver. */
+static void tx_state_changed(void)
+{
+    if (tx_transmit_task_handle != NULL) {
+        xTaskNotifyGive(tx_transmit_task_handle);
+    }
+}
+
+/* Whether the server has set the pyro bitmap and the armed state since
+ * boot. A transmitter off duty sends nothing until it has both, so one
+ * that reset mid-game does not broadcast an empty state. */
+static bool tx_pyro_commanded = false;
+static bool tx_armed_commanded = false;
+
+/* Transmitter clock a detonation commanded now fires at, or 0 for
+ * straight away. Frames carry 0 for straight away, so a time that lands
+ * on 0 as the clock wraps is moved on a millisecond. */
+static uint32_t tx_fire_time(void)
+{
+    if (tx_detonate_delay_ms == 0) {
+        return 0;
+    }
+    uint32_t fire_at_ms = tx_clock_ms() + tx_detonate_delay_ms;
+    return (fire_at_ms == 0) ? 1 : fire_at_ms;
+}
+
+/* Replaces one page of the transmitted pyro bitmap, waking the transmit task if it differs. */
+static void tx_state_set_pyro_page(int page, const uint8_t *pyro_bits)
+{
+    uint32_t fire_at_ms = tx_fire_time();
+    uint8_t old_bits[BEASTSQUIB_PAGE_BYTES];
+    bool newly_set = false;
+
+    memcpy(old_bits, global_tx_data.pyro_bits[page], BEASTSQUIB_PAGE_BYTES);
+    for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+        newly_set |= (pyro_bits[i] & ~old_bits[i]) != 0;
+    }
+
+    portENTER_CRITICAL();
+    bool changed = memcmp(global_tx_data.pyro_bits[page], pyro_bits, BEASTSQUIB_PAGE_BYTES) != 0;
+    memcpy(global_tx_data.pyro_bits[page], pyro_bits, BEASTSQUIB_PAGE_BYTES);
+    if (changed) {
+        tx_dirty_pages |= (1 << page);
+        beastsquib_standby_changed(&tx_standby, 1 << page, tx_seq);
+    }
+    if (newly_set) {
+        global_tx_data.fire_at_ms = fire_at_ms;
+
+        tx_change_count ++;
+        for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++) {
+            uint8_t bits = pyro_bits[i] & ~old_bits[i];
+            while (bits != 0) {
+                uint32_t slot = tx_recent_head ++ % BEASTSQUIB_RECENT_HISTORY;
+                tx_recent_ids[slot] = page * BEASTSQUIB_PAGE_BITS + i * 8 + __builtin_ctz(bits);
+                tx_recent_change[slot] = tx_change_count;
+                tx_recent_fire[slot] = fire_at_ms;
+                bits &= bits - 1;
+            }
+        }
+    }
+    if (page >= tx_page_count) {
+        tx_page_count = page + 1;
+    }
+    tx_pyro_commanded = true;
+    portEXIT_CRITICAL();
+
+    if (changed) {
+        tx_state_changed();
+    }
+}
+
+/* Replaces the transmitted armed state, waking the transmit task if it differs. */
+static void tx_state_set_armed(uint16_t armed)
+{
+    portENTER_CRITICAL();
+    bool changed = global_tx_data.armed != armed;
+    global_tx_data.armed = armed;
+    if (changed) {
+        // Every frame carries the armed state
+        beastsquib_standby_changed(&tx_standby, UINT8_MAX, tx_seq);
+    }
+    tx_armed_commanded = true;
+    portEXIT_CRITICAL();
+
+    if (changed) {
+        tx_state_changed();
+    }
+}
+
+/* Called after each frame is sent. Returns the delay before the next one.
+ * A change that takes several frames to carry gets a burst for each. */
+static uint32_t tx_schedule_next_ms(bool state_changed, uint16_t frames_per_state)
+{
+    if (state_changed) {
+        tx_burst_remaining = tx_timing.burst_count * frames_per_state;
+    }
+
+    if (tx_burst_remaining > 0) {
+        tx_burst_remaining --;
+    }
+
+    return (tx_burst_remaining > 0) ? tx_timing.burst_spacing_ms : tx_timing.heartbeat_ms;
+}
 
 /* Kill command variables. */
 bool pyro_armed = false;
 bool pyro_detonated = false;
 
+/* Scheduled detonation, fired by hw_timer_callback on local tick pyro_fire_at. */
+static volatile bool pyro_fire_pending = false;
+static volatile uint32_t pyro_fire_at = 0;
+
 // RX
 #define GPIO_OUTPUT_PYRO 15
 #define GPIO_OUTPUT_PYRO_MASK (1ULL << GPIO_OUTPUT_PYRO)
@@ -95,360 +277,3665 @@ static inline void REVIVE() {
     }
 }
 
-static uint64_t ticks_since_last_packet = 0;
-static uint64_t hw_timer_ticks = 0;
+#define ESPNOW_SILENCE_TICKS_TIMEOUT 1000
 
-/* WiFi should start before using ESPNOW */
-static void beastsquib_wifi_init(void)
+/* Local clock of a receiver, in ms ticks since boot. */
+static inline uint32_t rx_ticks_now(void)
 {
-    tcpip_adapter_init();
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+/* Boot profile, see beastsquib_boot_stage_t. Each stage is written by one task only. */
+static beastsquib_boot_profile_t beastsquib_boot;
+static const char *const beastsquib_boot_stage_names[BEASTSQUIB_BOOT_MAX] = {
+    "nvs", "gpio", "config", "wifi", "espnow", "uart", "storage", "first_frame"
+};
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
-    ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
-    ESP_ERROR_CHECK( esp_wifi_set_mode(ESPNOW_WIFI_MODE) );
-    esp_wifi_set_max_tx_power(84);
-    ESP_ERROR_CHECK( esp_wifi_start());
+static inline void beastsquib_boot_begin(beastsquib_boot_stage_t stage)
+{
+    beastsquib_boot.begin_us[stage] = (uint32_t)esp_timer_get_time();
+}
 
-    /* In order to simplify example, channel is set after WiFi started.
-     * This is not necessary in real application if the two devices have
-     * been already on the same channel.
-     */
-    ESP_ERROR_CHECK( esp_wifi_set_channel(CONFIG_ESPNOW_CHANNEL, 0) );
+/* Ends a stage of booting and logs when, and how long it took. */
+static void beastsquib_boot_end(beastsquib_boot_stage_t stage)
+{
+    uint32_t end_us = (uint32_t)esp_timer_get_time();
+
+    beastsquib_boot.end_us[stage] = (end_us != 0) ? end_us : 1;
+    ESP_LOGI(TAG, "boot: %s at %u us, took %u us", beastsquib_boot_stage_names[stage],
+             (unsigned)end_us, (unsigned)(end_us - beastsquib_boot.begin_us[stage]));
 }
 
-/* ESPNOW sending or receiving callback function is called in WiFi task.
- * Users should not do lengthy operations from this task. Instead, post
- * necessary data to a queue and handle it from a lower priority task. */
-static void beastsquib_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+/* Tick the last frame was applied on. hw_timer_callback sets rx_silent
+ * once ESPNOW_SILENCE_TICKS_TIMEOUT ticks pass without one. */
+static volatile uint32_t rx_last_frame_at = 0;
+static volatile bool rx_silent = false;
+
+static inline bool rx_silence_expired(uint32_t now)
 {
-    beastsquib_espnow_event_t evt;
-    beastsquib_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
+    return (uint32_t)(now - rx_last_frame_at) > ESPNOW_SILENCE_TICKS_TIMEOUT;
+}
 
-    if (mac_addr == NULL) {
-        ESP_LOGE(TAG, "Send cb arg error");
-        return;
+static inline void rx_frame_heard(uint32_t rx_ticks)
+{
+    static bool heard_since_boot = false;
+
+    rx_last_frame_at = rx_ticks;
+    rx_silent = false;
+    if (!heard_since_boot)
+    {
+        heard_since_boot = true;
+        beastsquib_boot_end(BEASTSQUIB_BOOT_FIRST_FRAME);
     }
+}
 
-    evt.id = BEASTSQUIB_ESPNOW_SEND_CB;
-    memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    send_cb->status = status;
-    if (xQueueSend(beastsquib_espnow_queue, &evt, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send send queue fail");
+/* hw_timer interrupts and modem sleep, for #PWR. */
+static beastsquib_power_stats_t rx_power;
+
+/* Low power: the radio sleeps until rx_radio_asleep_until, and once awake
+ * stays on until rx_radio_hold_until. Channel diversity also keeps the
+ * radio on its channel until then. */
+static uint32_t rx_radio_asleep_until = 0;
+static uint32_t rx_radio_hold_until = 0;
+
+/* Sequence tracking: receiver side last applied. */
+static beastsquib_rx_seq_t rx_seq;
+
+/* Channels the game is spread over, see beastsquib_channels_t, and the
+ * channel the radio is on. Both belong to the ESPNOW task on a receiver
+ * and to tx_transmit_task on a transmitter. */
+static beastsquib_channels_t espnow_channels;
+static uint8_t espnow_channel_tuned = 0;
+static uint8_t tx_channel_next = 0;
+
+static beastsquib_rx_stats_t rx_stats;
+
+/* Receive path latency, see beastsquib_latency_stage_t. rx_frame_cycles is
+ * when the frame being handled entered the receive callback. */
+static beastsquib_latency_hist_t rx_latency[BEASTSQUIB_LATENCY_MAX];
+static uint32_t rx_frame_cycles = 0;
+
+/* Adds one time to a stage's histogram. A count-leading-zeros and two
+ * increments, cheap enough to leave on in the field. */
+static inline void beastsquib_latency_record(beastsquib_latency_stage_t stage, uint32_t cycles)
+{
+#ifdef CONFIG_ESPNOW_LATENCY_STATS
+    beastsquib_latency_hist_t *hist = &rx_latency[stage];
+    int bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles) - BEASTSQUIB_LATENCY_MIN_BITS;
+
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= BEASTSQUIB_LATENCY_BUCKETS) {
+        bucket = BEASTSQUIB_LATENCY_BUCKETS - 1;
     }
+    hist->bucket[bucket] ++;
+    hist->count ++;
+    if (cycles > hist->max) {
+        hist->max = cycles;
+    }
+#endif
 }
 
-static void beastsquib_espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
+static inline uint32_t beastsquib_cycles(void)
 {
-    beastsquib_espnow_event_t evt;
-    beastsquib_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
+#ifdef CONFIG_ESPNOW_LATENCY_STATS
+    return soc_get_ccount();
+#else
+    return 0;
+#endif
+}
 
-    if (mac_addr == NULL || data == NULL || len <= 0) {
-        ESP_LOGE(TAG, "Receive cb arg error");
+/* Flight recorder: the last events on this board, for #FLR. The ESPNOW
+ * task and the hw_timer interrupt each write a ring of their own, so
+ * neither takes a lock; a head counts every event the ring was given. */
+#define BEASTSQUIB_LOG_SNAPSHOT_MAGIC 0x464C5231
+#define BEASTSQUIB_LOG_SNAPSHOT_PATH "/spiffs/flight.bin"
+
+#if (CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE & (CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE - 1)) != 0
+#error CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE must be a power of two
+#endif
+
+static beastsquib_log_entry_t rx_log[CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE];
+static volatile uint32_t rx_log_head = 0;
+static beastsquib_log_entry_t rx_log_isr[BEASTSQUIB_LOG_ISR_SIZE];
+static volatile uint32_t rx_log_isr_head = 0;
+
+/* Set on detonation; the ESPNOW task then saves the recorder once per boot. */
+static volatile bool rx_log_snapshot_due = false;
+
+/* SPIFFS holds the flight recorder copy, and the configuration of boards
+ * not yet moved to NVS. */
+static volatile bool rx_storage_mounted = false;
+static bool rx_log_snapshot_taken = false;
+
+static inline void rx_log_put(beastsquib_log_entry_t *ring, volatile uint32_t *head, uint32_t size,
+                              beastsquib_log_type_t type, uint8_t result, uint16_t detail, uint32_t value)
+{
+    uint32_t n = *head;
+    beastsquib_log_entry_t *entry = &ring[n & (size - 1)];
+
+    entry->ticks = rx_ticks_now();
+    entry->value = value;
+    entry->detail = detail;
+    entry->type = type;
+    entry->result = result;
+    __sync_synchronize();
+    *head = n + 1;
+}
+
+/* Records an event from the ESPNOW task. */
+static inline void rx_log_event(beastsquib_log_type_t type, uint8_t result, uint16_t detail, uint32_t value)
+{
+    rx_log_put(rx_log, &rx_log_head, CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE, type, result, detail, value);
+}
+
+/* Records an event from hw_timer_callback. */
+static inline void rx_log_event_from_isr(beastsquib_log_type_t type, uint8_t result, uint32_t value)
+{
+    rx_log_put(rx_log_isr, &rx_log_isr_head, BEASTSQUIB_LOG_ISR_SIZE, type, result, 0, value);
+}
+
+/* Trace streaming, switched on with #TRC,1;. The receive callback and the
+ * transmit task put records in the ring under a critical section, and
+ * trace_task writes them out as UART frames; records that find the ring
+ * full are dropped and counted. */
+#ifdef CONFIG_ESPNOW_TRACE
+static volatile bool trace_enabled = false;
+static beastsquib_trace_entry_t trace_ring[BEASTSQUIB_TRACE_RING];
+static volatile uint32_t trace_head = 0;
+static volatile uint32_t trace_tail = 0;
+static uint32_t trace_made = 0;
+static uint32_t trace_dropped = 0;
+static TaskHandle_t trace_task_handle;
+#endif
+
+/* Records a frame for the trace; mac is left out if NULL. */
+static void trace_put(beastsquib_trace_type_t type, const uint8_t *mac, const uint8_t *data, int len)
+{
+#ifdef CONFIG_ESPNOW_TRACE
+    if (!trace_enabled || trace_task_handle == NULL || len > ESP_NOW_MAX_DATA_LEN)
+    {
         return;
     }
 
-    evt.id = BEASTSQUIB_ESPNOW_RECV_CB;
-    memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    recv_cb->data = malloc(len);
-    if (recv_cb->data == NULL) {
-        ESP_LOGE(TAG, "Malloc receive data fail");
+    portENTER_CRITICAL();
+    uint8_t seq = trace_made ++;
+    if (trace_head - trace_tail >= BEASTSQUIB_TRACE_RING)
+    {
+        trace_dropped ++;
+        portEXIT_CRITICAL();
         return;
     }
+    beastsquib_trace_entry_t *entry = &trace_ring[trace_head % BEASTSQUIB_TRACE_RING];
+    entry->time_us = (uint32_t)esp_timer_get_time();
+    entry->type = type;
+    entry->seq = seq;
+    entry->len = 0;
+    if (mac != NULL)
+    {
+        memcpy(entry->data, mac, ESP_NOW_ETH_ALEN);
+        entry->len = ESP_NOW_ETH_ALEN;
+    }
+    memcpy(entry->data + entry->len, data, len);
+    entry->len += len;
+    trace_head ++;
+    portEXIT_CRITICAL();
+
+    xTaskNotifyGive(trace_task_handle);
+#endif
+}
+
+/* Receiver's estimate of the transmitter clock. */
+static beastsquib_clock_t rx_clock;
+
+/* Relaying, switched on per board with #RLY. */
+static bool rx_relay_enabled = false;
+static beastsquib_relay_t rx_relay;
 
-    memcpy(recv_cb->data, data, len);
-    recv_cb->data_len = len;
-    if (xQueueSend(beastsquib_espnow_queue, &evt, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGW(TAG, "Send receive queue fail");
-        free(recv_cb->data);
+/* Status reports. The ESPNOW task sets the tick of this board's next slot;
+ * hw_timer_callback wakes it on that tick to send. */
+static volatile bool rx_status_due = false;
+static volatile bool rx_status_ready = false;
+static volatile uint32_t rx_status_at = 0;
+static uint32_t rx_status_heard = 0;      // Fresh frames since the last report
+static uint32_t rx_status_last_epoch = 0;
+static uint32_t rx_status_last_seq = 0;
+static uint32_t rx_status_frame_ms = 0;   // Transmitter clock of the last fresh frame
+static uint32_t rx_status_quiet_until = 0;
+static uint8_t rx_status_last_flags = 0;  // Flags of the last report sent
+static bool rx_status_repeat = false;     // The slot due is the repeat of a changed report
+static beastsquib_status_frame_t rx_status_frame;
+
+/* Transmitter: latest report from each board, and the first frame sent
+ * after the latest state change. */
+#ifdef TX
+static beastsquib_status_entry_t tx_status[CONFIG_ESPNOW_STATUS_SLOTS];
+#endif
+static uint32_t tx_status_change_seq = 0;
+
+/* Arms the one-shot hw_timer for the earliest tick hw_timer_callback has
+ * work on: a scheduled detonation, a status slot or the silence timeout.
+ * Low power only; otherwise the timer runs every tick. */
+static void rx_timer_arm(uint32_t now)
+{
+#ifdef CONFIG_ESPNOW_LOW_POWER
+    int32_t wait = 1000;
+
+    if (!rx_silent)
+    {
+        int32_t silence = (int32_t)(rx_last_frame_at + ESPNOW_SILENCE_TICKS_TIMEOUT + 1 - now);
+        wait = (silence < wait) ? silence : wait;
+    }
+    if (pyro_fire_pending && (int32_t)(pyro_fire_at - now) < wait)
+    {
+        wait = (int32_t)(pyro_fire_at - now);
+    }
+    if (rx_status_due && (int32_t)(rx_status_at - now) < wait)
+    {
+        wait = (int32_t)(rx_status_at - now);
+    }
+    if (wait < 1)
+    {
+        wait = 1;
     }
+    hw_timer_alarm_us(wait * 1000, false);
+#endif
 }
 
-/* Parse received ESPNOW data. */
-int beastsquib_validate_espnow_data_checksum(uint8_t *data, uint16_t data_len)
+/* Re-arms the timer after the ESPNOW task sets an earlier deadline. */
+static void rx_timer_reschedule(void)
 {
-    beastsquib_espnow_data_t *buf = (beastsquib_espnow_data_t *)data;
-    uint16_t crc, crc_cal = 0;
+#ifdef CONFIG_ESPNOW_LOW_POWER
+    portENTER_CRITICAL();
+    rx_timer_arm(rx_ticks_now());
+    portEXIT_CRITICAL();
+#endif
+}
 
-    if (data_len < sizeof(beastsquib_espnow_data_t)) {
-        ESP_LOGE(TAG, "Receive ESPNOW data too short, len:%d", data_len);
-        return -1;
+/* Feeds one frame's transmit time and local arrival tick into the clock. */
+static void beastsquib_clock_sample(beastsquib_clock_t *clock, uint32_t tx_ms, uint32_t local_ticks)
+{
+    uint32_t sample = tx_ms - local_ticks;
+
+    // Start over on the first frame, or if the transmitter clock jumped by
+    // more than a second (a rebooted transmitter)
+    int32_t error_ms = (int32_t)(sample - clock->offset_ms);
+    if (!clock->synced || error_ms < -1000 || error_ms > 1000) {
+        clock->synced = true;
+        clock->offset_ms = sample;
+        clock->offset_frac = 0;
+        return;
     }
 
-    crc = buf->crc;
-    buf->crc = 0;
-    crc_cal = crc16_le(UINT16_MAX, (uint8_t const *)buf, data_len);
+    // A less delayed frame moves the offset up at once; otherwise it drifts
+    // down by 1/64 of the difference, which follows crystal drift but not
+    // the receive jitter
+    int32_t error = error_ms * 256 - clock->offset_frac;
+    int32_t step = (error > 0) ? error : error / 64;
+    int32_t frac = clock->offset_frac + step;
 
-    // Validate CRC and MAGIC
-    if ((crc_cal == crc) && (buf->magic == BEASTSQUIB_MAGIC_NUMBER)) {
-        return 0;
+    clock->offset_ms += frac >> 8;
+    clock->offset_frac = frac & 0xFF;
+}
+
+/* Converts a transmitter time into the local tick it falls on, rounded. */
+static uint32_t beastsquib_clock_to_local(const beastsquib_clock_t *clock, uint32_t tx_ms)
+{
+    return tx_ms - clock->offset_ms - ((clock->offset_frac >= 128) ? 1 : 0);
+}
+
+/* Converts a local tick into transmitter time, the inverse of beastsquib_clock_to_local. */
+static uint32_t beastsquib_clock_to_tx(const beastsquib_clock_t *clock, uint32_t local_ticks)
+{
+    return local_ticks + clock->offset_ms + ((clock->offset_frac >= 128) ? 1 : 0);
+}
+
+/* Returns the local tick this board's next status slot starts on, after
+ * now: slot id of each round of slots slots of slot_ms, on the transmitter
+ * clock. */
+static uint32_t beastsquib_status_next_slot(const beastsquib_clock_t *clock, int id, uint32_t now,
+                                            uint32_t slots, uint32_t slot_ms)
+{
+    // The inverse of beastsquib_clock_to_local, so on a slot's own tick
+    // the next slot is a whole round away
+    uint32_t round_ms = slots * slot_ms;
+    uint32_t tx_now = beastsquib_clock_to_tx(clock, now);
+    uint32_t phase = (id % slots) * slot_ms;
+    uint32_t since = (tx_now % round_ms + round_ms - phase) % round_ms;
+
+    return beastsquib_clock_to_local(clock, tx_now - since + round_ms);
+}
+
+/* Finds the listening window holding now, or the next one: from guard_ms
+ * before a heartbeat, every period_ms on the transmitter clock, until
+ * window_ms after it. Sets the local ticks it opens and closes on, and
+ * returns true if it is already open. */
+static bool beastsquib_radio_window(const beastsquib_clock_t *clock, uint32_t now, uint32_t period_ms,
+                                    uint32_t guard_ms, uint32_t window_ms, uint32_t *open, uint32_t *close)
+{
+    uint32_t tx_now = beastsquib_clock_to_tx(clock, now);
+    uint32_t last = tx_now - tx_now % period_ms;
+    uint32_t next = last + period_ms;
+
+    if (tx_now - last < window_ms)
+    {
+        *open = beastsquib_clock_to_local(clock, last) - guard_ms;
+        *close = beastsquib_clock_to_local(clock, last + window_ms);
+        return true;
     }
 
-    // Error parsing packet
-    return -1;
+    *open = beastsquib_clock_to_local(clock, next) - guard_ms;
+    *close = beastsquib_clock_to_local(clock, next + window_ms);
+    return (int32_t)(now - *open) >= 0;
 }
 
-/* Prepare ESPNOW data to be sent. */
-void beastsquib_espnow_data_prepare(beastsquib_espnow_send_param_t *send_param)
+/* Fills in a status report, ready to send. */
+static void beastsquib_status_prepare(beastsquib_status_frame_t *frame, uint16_t id, uint8_t flags,
+                                      uint32_t epoch, uint32_t seq, uint8_t link)
 {
-    beastsquib_espnow_data_t *send_buffer = (beastsquib_espnow_data_t *)send_param->buffer;
-    assert(send_param->len >= sizeof(beastsquib_espnow_data_t));
-    send_buffer->crc = 0;
-    send_buffer->magic = send_param->magic;
-    send_buffer->crc = crc16_le(UINT16_MAX, (uint8_t const *)send_buffer, send_param->len);
+    memset(frame, 0, sizeof(*frame));
+    frame->magic = BEASTSQUIB_STATUS_MAGIC;
+    frame->version = BEASTSQUIB_PROTOCOL_VERSION;
+    frame->flags = flags;
+    frame->board_id = id;
+    frame->epoch = epoch;
+    frame->seq = seq;
+    frame->link = link;
+    frame->crc = crc16_le(UINT16_MAX, (uint8_t const *)frame, sizeof(*frame));
 }
 
-static bool get_bit(uint8_t *bits_list)
+/* Records a validated report in the transmitter's table. Frames applied
+ * from an earlier transmitter boot count as none. */
+static void beastsquib_status_record(beastsquib_status_entry_t *table, const beastsquib_status_frame_t *frame,
+                                     uint16_t round, uint32_t epoch)
 {
-    if (board_id == -1) {
+    beastsquib_status_entry_t *entry = &table[frame->board_id];
+
+    entry->flags = (frame->flags & ~BEASTSQUIB_STATUS_HEARD) | BEASTSQUIB_STATUS_HEARD;
+    entry->link = frame->link;
+    entry->round = round;
+    entry->seq = (frame->epoch == epoch) ? frame->seq : 0;
+}
+
+/* Whether a table entry was reported in this status round or the last one. */
+static inline bool beastsquib_status_recent(const beastsquib_status_entry_t *entry, uint16_t round)
+{
+    return (entry->flags & BEASTSQUIB_STATUS_HEARD) && (uint16_t)(round - entry->round) <= 1;
+}
+
+/* Whether a state frame stamped time_ms, heard after one stamped last_ms,
+ * is part of a burst. Heartbeats come heartbeat_ms apart; the frames of a
+ * burst, the first one included, sooner. */
+static inline bool beastsquib_status_in_burst(uint32_t last_ms, uint32_t time_ms, uint32_t heartbeat_ms)
+{
+    return (uint32_t)(time_ms - last_ms) + portTICK_RATE_MS < heartbeat_ms;
+}
+
+#ifdef TX
+static inline uint16_t tx_status_round(void)
+{
+    return (uint16_t)(tx_clock_ms() / BEASTSQUIB_STATUS_ROUND_MS);
+}
+
+/* Checks and records a status report. Runs in the WiFi task. */
+static void tx_status_receive(const uint8_t *data, int len)
+{
+    beastsquib_status_frame_t frame;
+
+    if (len != sizeof(frame)) {
+        rx_stats.admit[(len < (int)sizeof(frame)) ? BEASTSQUIB_RX_REJECT_SHORT : BEASTSQUIB_RX_REJECT_LONG] ++;
+        return;
+    }
+
+    memcpy(&frame, data, sizeof(frame));
+    uint16_t crc = frame.crc;
+    frame.crc = 0;
+    if (crc16_le(UINT16_MAX, (uint8_t const *)&frame, sizeof(frame)) != crc) {
+        rx_stats.crc_fail ++;
+        return;
+    }
+
+    if (frame.board_id >= CONFIG_ESPNOW_STATUS_SLOTS) {
+        rx_stats.admit[BEASTSQUIB_RX_REJECT_FORMAT] ++;
+        return;
+    }
+
+    beastsquib_status_record(tx_status, &frame, tx_status_round(), tx_epoch);
+    rx_stats.status ++;
+}
+#endif
+
+/* Transmitters frames are admitted from, see ESPNOW_TX_ALLOWLIST_SIZE. */
+static uint8_t tx_allowlist[ESPNOW_TX_ALLOWLIST_SIZE][ESP_NOW_ETH_ALEN];
+static volatile int tx_allowlist_count = 0;
+
+/* Event hand-off from the WiFi task to beastsquib_espnow_task.
+ *
+ * The WiFi task is the only producer and beastsquib_espnow_task the only
+ * consumer, so nothing here takes a lock: every index and sequence number is
+ * written by one side only. Neither side blocks; the producer wakes the
+ * consumer with a task notification.
+ *
+ * Received broadcast state frames do not queue. Only the newest one for each
+ * bitmap page matters, so it is published into that page's mailbox,
+ * overwriting any frame for the page the handler has not picked up yet; the
+ * frames of a multi-page burst each carry a different page and all get
+ * through. Sparse and version 0-2 frames use the first page's mailbox.
+ * Other events go through the ring and are dropped when it is full. */
+static beastsquib_espnow_event_t espnow_ring[ESPNOW_RING_SIZE];
+static volatile uint32_t espnow_ring_head = 0;     // Written by the consumer only
+static volatile uint32_t espnow_ring_tail = 0;     // Written by the producer only
+
+static beastsquib_espnow_state_mailbox_t espnow_state_mailbox[BEASTSQUIB_MAX_PAGES];
+static volatile uint32_t espnow_state_taken_seq[BEASTSQUIB_MAX_PAGES];   // Written by the consumer only
+static uint32_t espnow_state_published = 0;    // Written by the producer only
+
+static bool espnow_ring_push(const beastsquib_espnow_event_t *evt)
+{
+    uint32_t tail = espnow_ring_tail;
+    uint32_t next = (tail + 1) % ESPNOW_RING_SIZE;
+    uint32_t depth = (next + ESPNOW_RING_SIZE - espnow_ring_head) % ESPNOW_RING_SIZE;
+
+    if (next == espnow_ring_head) {
         return false;
     }
+    if (depth > rx_stats.ring_peak) {
+        rx_stats.ring_peak = depth;
+    }
 
-    // Modulo 64 gets the index into the armed list
-    uint16_t idx = board_id / 8;
-    uint8_t offset = board_id % 8;
-    uint8_t bits = bits_list[idx];
-    bool set = ((bits & (1 << offset)) != 0);
-    
-    // ESP_LOGI(TAG, "idx '%i', offset '%i', bit '%s'", (int)idx, (int)offset, (set) ? "T" : "F");
+    espnow_ring[tail] = *evt;
+    __sync_synchronize();
+    espnow_ring_tail = next;
 
-    return set;
+    return true;
+}
+
+static bool espnow_ring_pop(beastsquib_espnow_event_t *evt)
+{
+    uint32_t head = espnow_ring_head;
+
+    if (head == espnow_ring_tail) {
+        return false;
+    }
+
+    __sync_synchronize();
+    *evt = espnow_ring[head];
+    __sync_synchronize();
+    espnow_ring_head = (head + 1) % ESPNOW_RING_SIZE;
+
+    return true;
+}
+
+/* Mailbox for an admitted frame: its bitmap page, or the first page's for
+ * frames that carry no page. */
+static int espnow_state_slot(const uint8_t *data, int len)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+
+    if (frame->version < 3 || BEASTSQUIB_FRAME_ENCODING(frame->encoding) == BEASTSQUIB_ENCODING_SPARSE) {
+        return 0;
+    }
+    return frame->page;
+}
+
+static void espnow_state_publish(const uint8_t *mac_addr, const uint8_t *data, int len, uint32_t rx_cycles)
+{
+    int slot = espnow_state_slot(data, len);
+    beastsquib_espnow_state_mailbox_t *mailbox = &espnow_state_mailbox[slot];
+    uint32_t seq = mailbox->seq;
+    uint32_t rx_ticks = rx_ticks_now();
+
+    if (seq != espnow_state_taken_seq[slot]) {
+        rx_stats.state_overwritten ++;
+    }
+
+    mailbox->seq = seq + 1;
+    __sync_synchronize();
+    mailbox->order = espnow_state_published ++;
+    mailbox->rx_ticks = rx_ticks;
+    mailbox->rx_cycles = rx_cycles;
+    memcpy(mailbox->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    memcpy(mailbox->data, data, len);
+    mailbox->data_len = len;
+    mailbox->published_cycles = beastsquib_cycles();
+    __sync_synchronize();
+    mailbox->seq = seq + 2;
+
+    beastsquib_latency_record(BEASTSQUIB_LATENCY_ADMIT, mailbox->published_cycles - rx_cycles);
 }
 
-static void print_bytes(uint8_t *bits_list) {
-    for (int i = 0; i < 64; i ++)
+/* Copies out the oldest state frame published since the last call, of the
+ * newest per page, and the tick it arrived on. Taking them oldest first
+ * keeps their sequence numbers rising, so none looks stale. Retries if the
+ * WiFi task rewrote the mailbox during the copy. Records how long the frame
+ * waited in the mailbox and leaves its arrival cycle count in
+ * rx_frame_cycles. */
+static bool espnow_state_take(uint8_t *data, int *len, uint32_t *rx_ticks)
+{
+    beastsquib_espnow_state_mailbox_t *mailbox = NULL;
+    int slot = 0;
+    uint32_t seq;
+    uint32_t rx_cycles;
+    uint32_t published_cycles;
+
+    // order may be mid-write here; at worst two frames go in the wrong order
+    for (int i = 0; i < BEASTSQUIB_MAX_PAGES; i ++) {
+        if (espnow_state_mailbox[i].seq != espnow_state_taken_seq[i] &&
+            (mailbox == NULL || (int32_t)(espnow_state_mailbox[i].order - mailbox->order) < 0)) {
+            mailbox = &espnow_state_mailbox[i];
+            slot = i;
+        }
+    }
+    if (mailbox == NULL) {
+        return false;
+    }
+
+    do {
+        seq = mailbox->seq;
+        __sync_synchronize();
+        *rx_ticks = mailbox->rx_ticks;
+        rx_cycles = mailbox->rx_cycles;
+        published_cycles = mailbox->published_cycles;
+        *len = mailbox->data_len;
+        memcpy(data, mailbox->data, *len);
+        __sync_synchronize();
+    } while ((seq & 1) || seq != mailbox->seq);
+
+    espnow_state_taken_seq[slot] = seq;
+    rx_frame_cycles = rx_cycles;
+    beastsquib_latency_record(BEASTSQUIB_LATENCY_WAKE, beastsquib_cycles() - published_cycles);
+
+    return true;
+}
+
+static inline void espnow_wake_task(void)
+{
+    if (beastsquib_espnow_task_handle != NULL) {
+        xTaskNotifyGive(beastsquib_espnow_task_handle);
+    }
+}
+
+/* Channel diversity. Reads a comma separated list of WiFi channels, keeping
+ * up to BEASTSQUIB_MAX_CHANNELS valid ones, or only fallback if there are
+ * none. A receiver in lock mode starts with a scan. */
+static void beastsquib_channels_init(beastsquib_channels_t *ch, const char *list, uint8_t fallback, bool hop,
+                                     uint32_t now)
+{
+    memset(ch, 0, sizeof(*ch));
+    while (*list != '\0' && ch->count < BEASTSQUIB_MAX_CHANNELS)
+    {
+        char *end;
+        long channel = strtol(list, &end, 10);
+        if (end == list)
+        {
+            list ++;
+            continue;
+        }
+        if (channel >= 1 && channel <= 13 && memchr(ch->channel, channel, ch->count) == NULL)
+        {
+            ch->channel[ch->count ++] = channel;
+        }
+        list = end;
+    }
+
+    if (ch->count == 0)
+    {
+        ch->channel[0] = fallback;
+        ch->count = 1;
+    }
+    ch->hop = hop;
+    ch->since = ch->window_at = ch->heard_at = now;
+    ch->scans = (!hop && ch->count > 1) ? 1 : 0;
+}
+
+/* Moves a receiver to the channel at index and starts a new window there. */
+static void beastsquib_channels_move(beastsquib_channels_t *ch, int index, uint32_t now)
+{
+    ch->stats[ch->current].listen_ms += now - ch->since;
+    if (index != ch->current)
+    {
+        ch->switches ++;
+    }
+    ch->current = index;
+    ch->since = ch->window_at = ch->heard_at = now;
+    ch->expecting = false;
+    ch->window_frames = 0;
+    ch->window_lost = 0;
+}
+
+/* Records a valid version 3 frame heard on the current channel. One later
+ * than the frame due there counts the frames between as lost; copies from
+ * relays and other transmitters are older and only counted as heard. In
+ * hop mode the receiver moves on to the channel the next frame goes out on. */
+static void beastsquib_channels_heard(beastsquib_channels_t *ch, uint32_t epoch, uint32_t seq, uint32_t now)
+{
+    beastsquib_channel_stats_t *stats = &ch->stats[ch->current];
+    bool in_order = !ch->expecting || epoch != ch->expect_epoch || (int32_t)(seq - ch->expect_seq) >= 0;
+    uint32_t lost = 0;
+
+    if (ch->expecting && epoch == ch->expect_epoch && in_order)
+    {
+        lost = (seq - ch->expect_seq) / ch->count;
+    }
+    stats->frames ++;
+    stats->lost += lost;
+    ch->window_frames ++;
+    ch->window_lost += lost;
+    ch->heard_at = now;
+    if (!in_order)
+    {
+        return;
+    }
+
+    if (ch->hop && ch->count > 1)
+    {
+        beastsquib_channels_move(ch, (ch->current + 1) % ch->count, now);
+        ch->expect_seq = seq + 1;
+    }
+    else
+    {
+        ch->expect_seq = seq + ch->count;
+    }
+    ch->expecting = true;
+    ch->expect_epoch = epoch;
+}
+
+/* Moves a receiver on from a channel that has gone quiet. In hop mode that
+ * is dwell_ms without a frame. In lock mode the receiver scans, listening
+ * on each channel for dwell_ms, then locks onto the one it heard most
+ * frames on, and scans again once it has heard nothing there for dwell_ms
+ * or has missed more frames than it heard in a dwell_ms window. Returns
+ * the ms until it next needs calling. */
+static uint32_t beastsquib_channels_poll(beastsquib_channels_t *ch, uint32_t now, uint32_t dwell_ms)
+{
+    if (ch->count < 2)
+    {
+        return UINT32_MAX;
+    }
+
+    uint32_t quiet = now - ch->heard_at;
+    if (ch->hop)
+    {
+        if (quiet >= dwell_ms)
+        {
+            beastsquib_channels_move(ch, (ch->current + 1) % ch->count, now);
+            return dwell_ms;
+        }
+        return dwell_ms - quiet;
+    }
+
+    uint32_t elapsed = now - ch->window_at;
+    if (!ch->locked)
+    {
+        if (elapsed < dwell_ms)
+        {
+            return dwell_ms - elapsed;
+        }
+
+        ch->scan_frames[ch->current] = ch->window_frames;
+        ch->scan_lost[ch->current] = ch->window_lost;
+        if (ch->current + 1 < ch->count)
+        {
+            beastsquib_channels_move(ch, ch->current + 1, now);
+            return dwell_ms;
+        }
+
+        int best = 0;
+        for (int i = 1; i < ch->count; i ++)
+        {
+            if (ch->scan_frames[i] > ch->scan_frames[best] ||
+                (ch->scan_frames[i] == ch->scan_frames[best] && ch->scan_lost[i] < ch->scan_lost[best]))
+            {
+                best = i;
+            }
+        }
+        beastsquib_channels_move(ch, best, now);
+        ch->locked = true;
+        return dwell_ms;
+    }
+
+    if (quiet >= dwell_ms || (elapsed >= dwell_ms && ch->window_lost > ch->window_frames))
+    {
+        ch->locked = false;
+        ch->scans ++;
+        beastsquib_channels_move(ch, 0, now);
+        return dwell_ms;
+    }
+    if (elapsed >= dwell_ms)
+    {
+        ch->window_at = now;
+        ch->window_frames = 0;
+        ch->window_lost = 0;
+        elapsed = 0;
+    }
+
+    uint32_t wait = dwell_ms - quiet;
+    return (dwell_ms - elapsed < wait) ? dwell_ms - elapsed : wait;
+}
+
+/* Puts the radio on a channel of the list, if it is not on it already. */
+static void espnow_channel_tune(int index)
+{
+    uint8_t channel = espnow_channels.channel[index];
+
+    if (channel != espnow_channel_tuned)
+    {
+        if (esp_wifi_set_channel(channel, 0) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "set channel fail");
+            return;
+        }
+        espnow_channel_tuned = channel;
+    }
+}
+
+/* WiFi should start before using ESPNOW */
+static void beastsquib_wifi_init(void)
+{
+    tcpip_adapter_init();
+
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
+    ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
+    ESP_ERROR_CHECK( esp_wifi_set_mode(ESPNOW_WIFI_MODE) );
+    esp_wifi_set_max_tx_power(84);
+    ESP_ERROR_CHECK( esp_wifi_start());
+
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+    const char *channels = CONFIG_ESPNOW_DIVERSITY_CHANNELS;
+#else
+    const char *channels = "";
+#endif
+#ifdef CONFIG_ESPNOW_DIVERSITY_HOP
+    bool hop = true;
+#else
+    bool hop = false;
+#endif
+    beastsquib_channels_init(&espnow_channels, channels, CONFIG_ESPNOW_CHANNEL, hop, rx_ticks_now());
+
+    /* In order to simplify example, channel is set after WiFi started.
+     * This is not necessary in real application if the two devices have
+     * been already on the same channel.
+     */
+    ESP_ERROR_CHECK( esp_wifi_set_channel(espnow_channels.channel[0], 0) );
+    espnow_channel_tuned = espnow_channels.channel[0];
+
+#if defined(RX) && defined(CONFIG_ESPNOW_LOW_POWER)
+    /* Forced modem sleep, entered by rx_radio_poll between listening windows. */
+    esp_wifi_fpm_set_sleep_type(WIFI_MODEM_SLEEP_T);
+    esp_wifi_fpm_open();
+#endif
+}
+
+/* ESPNOW sending or receiving callback function is called in WiFi task.
+ * Users should not do lengthy operations from this task. Instead, post
+ * necessary data to the ESPNOW task and handle it there. */
+static void beastsquib_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    beastsquib_espnow_event_t evt;
+    beastsquib_espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
+
+    if (mac_addr == NULL) {
+        ESP_LOGE(TAG, "Send cb arg error");
+        return;
+    }
+
+    evt.id = BEASTSQUIB_ESPNOW_SEND_CB;
+    memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    send_cb->status = status;
+    if (!espnow_ring_push(&evt)) {
+        rx_stats.ring_full ++;
+        return;
+    }
+
+    espnow_wake_task();
+}
+
+/* Constant-time admission check run in the WiFi task before a frame is
+ * handed on. The CRC is left to the ESPNOW task. */
+static beastsquib_rx_admit_t beastsquib_espnow_admit(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+
+    if (len < (int)sizeof(beastsquib_espnow_frame_t)) {
+        return BEASTSQUIB_RX_REJECT_SHORT;
+    }
+
+    if (len > ESPNOW_RX_SLOT_SIZE) {
+        return BEASTSQUIB_RX_REJECT_LONG;
+    }
+
+    if (frame->magic != BEASTSQUIB_MAGIC_NUMBER) {
+        return BEASTSQUIB_RX_REJECT_MAGIC;
+    }
+
+    if (frame->version > BEASTSQUIB_PROTOCOL_VERSION) {
+        return BEASTSQUIB_RX_REJECT_VERSION;
+    }
+
+#if !CONFIG_ESPNOW_ACCEPT_V1
+    if (frame->version < 2) {
+        return BEASTSQUIB_RX_REJECT_VERSION;
+    }
+#endif
+
+    int encoding = BEASTSQUIB_FRAME_ENCODING(frame->encoding);
+    if (frame->version < 3) {
+        int min_len = (frame->version < 2) ? BEASTSQUIB_V1_DATA_LEN : sizeof(beastsquib_espnow_data_t);
+        if (len < min_len) {
+            return BEASTSQUIB_RX_REJECT_SHORT;
+        }
+    } else if (encoding == BEASTSQUIB_ENCODING_BITMAP || encoding == BEASTSQUIB_ENCODING_BITMAP_RECENT ||
+               encoding == BEASTSQUIB_ENCODING_BITMAP_TIMED) {
+        int recent_len = len - (int)sizeof(beastsquib_espnow_frame_t) - BEASTSQUIB_PAGE_BYTES;
+        if (recent_len < 0) {
+            return BEASTSQUIB_RX_REJECT_SHORT;
+        }
+        if (frame->page >= BEASTSQUIB_MAX_PAGES ||
+            (encoding == BEASTSQUIB_ENCODING_BITMAP_RECENT && recent_len % sizeof(uint16_t) != 0) ||
+            (encoding == BEASTSQUIB_ENCODING_BITMAP_TIMED && recent_len % sizeof(beastsquib_timed_id_t) != 0)) {
+            return BEASTSQUIB_RX_REJECT_FORMAT;
+        }
+    } else if (encoding == BEASTSQUIB_ENCODING_SPARSE) {
+        if ((len - sizeof(beastsquib_espnow_frame_t)) % sizeof(uint16_t) != 0) {
+            return BEASTSQUIB_RX_REJECT_FORMAT;
+        }
+    } else {
+        return BEASTSQUIB_RX_REJECT_FORMAT;
+    }
+
+    int count = tx_allowlist_count;
+    if (count == 0) {
+        return BEASTSQUIB_RX_ADMIT;
+    }
+
+    for (int i = 0; i < count; i ++) {
+        if (memcmp(tx_allowlist[i], mac_addr, ESP_NOW_ETH_ALEN) == 0) {
+            return BEASTSQUIB_RX_ADMIT;
+        }
+    }
+
+    return BEASTSQUIB_RX_REJECT_SOURCE;
+}
+
+static void beastsquib_espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    uint32_t rx_cycles = beastsquib_cycles();
+
+    if (mac_addr == NULL || data == NULL || len <= 0) {
+        ESP_LOGE(TAG, "Receive cb arg error");
+        return;
+    }
+
+    /* The transmitter records status reports here; they are small and never
+     * queued. Receivers hear each other's and drop them. Neither traces
+     * them, as a fleet's worth would swamp the UART. */
+    if (len >= (int)(offsetof(beastsquib_status_frame_t, magic) + sizeof(uint32_t)) &&
+        ((const beastsquib_status_frame_t *)data)->magic == BEASTSQUIB_STATUS_MAGIC) {
+#ifdef TX
+        tx_status_receive(data, len);
+#endif
+        return;
+    }
+
+    trace_put(BEASTSQUIB_TRACE_RX, mac_addr, data, len);
+
+    beastsquib_rx_admit_t admit = beastsquib_espnow_admit(mac_addr, data, len);
+    rx_stats.admit[admit] ++;
+    if (admit != BEASTSQUIB_RX_ADMIT) {
+        return;
+    }
+
+    /* Every admitted frame is broadcast state, so it goes to the mailbox. */
+    espnow_state_publish(mac_addr, data, len, rx_cycles);
+    espnow_wake_task();
+}
+
+/* Parse received ESPNOW data. */
+int beastsquib_validate_espnow_data_checksum(uint8_t *data, uint16_t data_len)
+{
+    beastsquib_espnow_data_t *buf = (beastsquib_espnow_data_t *)data;
+    uint16_t crc, crc_cal = 0;
+
+    if (data_len < sizeof(beastsquib_espnow_frame_t)) {
+        ESP_LOGE(TAG, "Receive ESPNOW data too short, len:%d", data_len);
+        return -1;
+    }
+
+    crc = buf->crc;
+    buf->crc = 0;
+    crc_cal = crc16_le(UINT16_MAX, (uint8_t const *)buf, data_len);
+
+    // Validate CRC and MAGIC
+    if ((crc_cal == crc) && (buf->magic == BEASTSQUIB_MAGIC_NUMBER)) {
+        return 0;
+    }
+
+    // Error parsing packet
+    rx_stats.crc_fail ++;
+    return -1;
+}
+
+/* Prepare ESPNOW data to be sent. The caller fills in the encoding, armed
+ * state, page and payload; the encoding is tagged with this transmitter's
+ * ID and duty. A frame may be prepared again to send it once more. */
+void beastsquib_espnow_data_prepare(beastsquib_espnow_send_param_t *send_param)
+{
+    beastsquib_espnow_frame_t *send_buffer = (beastsquib_espnow_frame_t *)send_param->buffer;
+    assert(send_param->len >= sizeof(beastsquib_espnow_frame_t));
+    send_buffer->crc = 0;
+    send_buffer->magic = send_param->magic;
+    send_buffer->version = BEASTSQUIB_PROTOCOL_VERSION;
+    send_buffer->encoding = BEASTSQUIB_FRAME_ENCODING(send_buffer->encoding) |
+                            (CONFIG_ESPNOW_TX_ID << BEASTSQUIB_TX_ID_SHIFT) |
+                            (tx_standby.on_duty ? 0 : BEASTSQUIB_ENCODING_STANDBY);
+    send_buffer->ttl = CONFIG_ESPNOW_RELAY_TTL;
+    portENTER_CRITICAL();
+    send_buffer->epoch = tx_epoch;
+    send_buffer->seq = ++tx_seq;
+    portEXIT_CRITICAL();
+    send_buffer->time_ms = tx_clock_ms();
+    send_buffer->crc = crc16_le(UINT16_MAX, (uint8_t const *)send_buffer, send_param->len);
+}
+
+static bool get_bit(const uint8_t *bits_list)
+{
+    if (board_id == -1) {
+        return false;
+    }
+
+    // bits_list is the page holding this board, so index within the page
+    uint16_t idx = (board_id % BEASTSQUIB_PAGE_BITS) / 8;
+    uint8_t offset = board_id % 8;
+    uint8_t bits = bits_list[idx];
+    bool set = ((bits & (1 << offset)) != 0);
+    
+    // ESP_LOGI(TAG, "idx '%i', offset '%i', bit '%s'", (int)idx, (int)offset, (set) ? "T" : "F");
+
+    return set;
+}
+
+/* Called when a broadcast packet is received. page_bits is the bitmap page
+ * holding this board's ID, or NULL if the frame carried a different page.
+ * fire_at is the local tick to detonate on, or NULL for straight away. */
+static void espnow_broadcast_packet_recv_cb(uint16_t armed_state, const uint8_t *page_bits, const uint32_t *fire_at) {
+#ifdef RX
+    // Only touch the outputs when the state actually changes
+    bool armed = (armed_state == 1);
+    if (armed != pyro_armed)
+    {
+        if (armed)
+        {
+            ESP_LOGI(TAG, "ARMED");
+            SET_ARMED();
+            rx_log_event(BEASTSQUIB_LOG_ARMED, 0, 0, 0);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "DISARMED");
+            SET_DISARMED();
+            rx_log_event(BEASTSQUIB_LOG_DISARMED, 0, 0, 0);
+        }
+    }
+
+    if (page_bits == NULL)
+    {
+        return;
+    }
+
+    // Gets pyro bit associated with this board ID. While disarmed neither
+    // DETONATE nor REVIVE has any effect, so the request stays pending.
+    bool detonate = get_bit(page_bits);
+    if (detonate != pyro_detonated)
+    {
+        if (detonate)
+        {
+            if (fire_at == NULL || (int32_t)(*fire_at - rx_ticks_now()) <= 0)
+            {
+                DETONATE();
+                if (pyro_detonated)
+                {
+                    beastsquib_latency_record(BEASTSQUIB_LATENCY_FIRE, beastsquib_cycles() - rx_frame_cycles);
+                    rx_log_event(BEASTSQUIB_LOG_DETONATE, 0, 0, 0);
+                    rx_log_snapshot_due = true;
+                }
+                ESP_LOGI(TAG, "DETONATE");
+            }
+            else if (!pyro_fire_pending)
+            {
+                ESP_LOGI(TAG, "DETONATE at %u", (unsigned)*fire_at);
+                pyro_fire_at = *fire_at;
+                pyro_fire_pending = true;
+                rx_timer_reschedule();
+                rx_log_event(BEASTSQUIB_LOG_SCHEDULED, 0, 0, *fire_at);
+            }
+        }
+        else
+        {
+            pyro_fire_pending = false;
+            REVIVE();
+            if (!pyro_detonated)
+            {
+                rx_log_event(BEASTSQUIB_LOG_REVIVE, 0, 0, 0);
+            }
+        }
+    }
+#endif
+}
+
+/* Returns true if a validated version 2+ frame from transmitter tx_id,
+ * arrived on rx_ticks, has not been taken before: it is newer than the
+ * last one, or another transmitter's with the same number. own_page says
+ * whether it carries this board's page. Sets *apply if its state is to be
+ * applied, which for a frame numbered like one already taken is only if
+ * it brings this board's page and none of the others did (see
+ * beastsquib_rx_seq_t). */
+static bool beastsquib_espnow_frame_is_fresh(uint32_t epoch, uint32_t seq, int tx_id, bool own_page, bool *apply,
+                                             uint32_t rx_ticks)
+{
+    *apply = true;
+
+    // Resynchronise on a newer transmitter boot, or after a silence long
+    // enough to have disarmed us (e.g. a transmitter whose NVS was erased).
+    if (!rx_seq.synced || epoch > rx_seq.epoch || rx_silence_expired(rx_ticks)) {
+        rx_seq.synced = true;
+        rx_seq.epoch = epoch;
+        rx_seq.seq = seq;
+        rx_seq.seq_from = 1 << tx_id;
+        rx_seq.seq_page = own_page;
+        return true;
+    }
+
+    if (epoch == rx_seq.epoch && seq == rx_seq.seq && (rx_seq.seq_from & (1 << tx_id)) == 0) {
+        rx_seq.seq_from |= 1 << tx_id;
+        *apply = own_page && !rx_seq.seq_page;
+        rx_seq.seq_page |= own_page;
+        return true;
+    }
+
+    if (epoch < rx_seq.epoch || seq <= rx_seq.seq) {
+        rx_stats.stale ++;
+        return false;
+    }
+
+    rx_stats.lost += seq - rx_seq.seq - 1;
+    rx_seq.seq = seq;
+    rx_seq.seq_from = 1 << tx_id;
+    rx_seq.seq_page = own_page;
+    return true;
+}
+
+/* Unpacks the IDs of a uint16_t list that fall in this board's page. */
+static const uint8_t *beastsquib_unpack_ids(const uint8_t *ids, int count, int own_page)
+{
+    static uint8_t page_bits[BEASTSQUIB_PAGE_BYTES];
+
+    memset(page_bits, 0, sizeof(page_bits));
+    for (int i = 0; i < count; i ++)
+    {
+        uint16_t id = ids[2*i] | (ids[2*i + 1] << 8);
+        if (id / BEASTSQUIB_PAGE_BITS == own_page)
+        {
+            id %= BEASTSQUIB_PAGE_BITS;
+            page_bits[id / 8] |= (1 << (id % 8));
+        }
+    }
+
+    return page_bits;
+}
+
+/* Finds the bitmap page holding this board's ID in a version 3 frame, or
+ * NULL if the frame carries another page. A sparse frame lists every set
+ * ID, so it is unpacked into this board's page; looking up the board's own
+ * bit stays a single index either way.
+ *
+ * The recent IDs after another page only ever set bits, so they stand in
+ * for this board's page only when they list this board. A timed frame
+ * that lists this board also gives its detonation time in *fire_at_ms,
+ * which otherwise keeps the frame's. */
+static const uint8_t *beastsquib_espnow_frame_page(const beastsquib_espnow_frame_t *frame, int len, uint32_t *fire_at_ms)
+{
+    int own_page = (board_id < 0) ? 0 : board_id / BEASTSQUIB_PAGE_BITS;
+    int payload_len = len - sizeof(beastsquib_espnow_frame_t);
+    int encoding = BEASTSQUIB_FRAME_ENCODING(frame->encoding);
+
+    if (encoding == BEASTSQUIB_ENCODING_SPARSE)
+    {
+        return beastsquib_unpack_ids(frame->payload, payload_len / sizeof(uint16_t), own_page);
+    }
+
+    if (encoding == BEASTSQUIB_ENCODING_BITMAP_TIMED && board_id >= 0)
+    {
+        const beastsquib_timed_id_t *timed = (const beastsquib_timed_id_t *)(frame->payload + BEASTSQUIB_PAGE_BYTES);
+        int count = (payload_len - BEASTSQUIB_PAGE_BYTES) / sizeof(beastsquib_timed_id_t);
+        for (int i = 0; i < count; i ++)
+        {
+            if (timed[i].id == board_id)
+            {
+                *fire_at_ms = timed[i].fire_at_ms;
+                uint8_t id[2] = { board_id & 0xFF, board_id >> 8 };
+                return beastsquib_unpack_ids(id, 1, own_page);
+            }
+        }
+    }
+
+    if (frame->page == own_page)
+    {
+        return frame->payload;
+    }
+
+    if (encoding == BEASTSQUIB_ENCODING_BITMAP_RECENT)
+    {
+        const uint8_t *recent = beastsquib_unpack_ids(frame->payload + BEASTSQUIB_PAGE_BYTES,
+                                                      (payload_len - BEASTSQUIB_PAGE_BYTES) / sizeof(uint16_t),
+                                                      own_page);
+        return get_bit(recent) ? recent : NULL;
+    }
+
+    return NULL;
+}
+
+/* Relaying. A relay passes each fresh version 3 frame on once, after a
+ * random back-off. It drops the frame if enough other relays pass it on
+ * first, and never sends the same frame twice, so a crowd of relays does
+ * not multiply the traffic. Only the newest frame waits; a fresher one
+ * replaces it. A frame is known by its epoch, sequence number and the
+ * transmitter that sent it, since a group shares the sequence number. */
+static bool beastsquib_relay_was_sent(const beastsquib_relay_t *relay, const beastsquib_espnow_frame_t *frame)
+{
+    uint8_t tx_id = BEASTSQUIB_FRAME_TX_ID(frame->encoding);
+
+    for (int i = 0; i < BEASTSQUIB_RELAY_CACHE_SIZE; i ++)
+    {
+        if (relay->sent_seq[i] == frame->seq && relay->sent_epoch[i] == frame->epoch && relay->sent_tx[i] == tx_id &&
+            frame->seq != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Offers a fresh, validated frame to be passed on backoff_ms after it arrived. */
+static void beastsquib_relay_offer(beastsquib_relay_t *relay, const uint8_t *data, int len,
+                                   uint32_t rx_ticks, uint32_t backoff_ms)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+
+    if (frame->ttl == 0 || beastsquib_relay_was_sent(relay, frame))
+    {
+        return;
+    }
+
+    memcpy(relay->frame, data, len);
+    relay->len = len;
+    relay->rx_ticks = rx_ticks;
+    relay->send_at = rx_ticks + backoff_ms;
+    relay->duplicates = 0;
+    relay->pending = true;
+}
+
+/* Counts a copy of the pending frame heard again from another relay. */
+static void beastsquib_relay_duplicate(beastsquib_relay_t *relay, const beastsquib_espnow_frame_t *copy)
+{
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)relay->frame;
+
+    if (relay->pending && frame->seq == copy->seq && frame->epoch == copy->epoch &&
+        BEASTSQUIB_FRAME_TX_ID(frame->encoding) == BEASTSQUIB_FRAME_TX_ID(copy->encoding))
+    {
+        relay->duplicates ++;
+    }
+}
+
+/* Returns true once the pending frame is due and should be sent from
+ * relay->frame, after taking a hop off its ttl and advancing its clock by
+ * the time it waited here. Drops it instead if at least suppress copies
+ * were heard meanwhile. */
+static bool beastsquib_relay_take(beastsquib_relay_t *relay, uint32_t now, uint16_t suppress)
+{
+    beastsquib_espnow_frame_t *frame = (beastsquib_espnow_frame_t *)relay->frame;
+
+    if (!relay->pending || (int32_t)(now - relay->send_at) < 0)
+    {
+        return false;
+    }
+
+    relay->pending = false;
+    if (relay->duplicates >= suppress)
+    {
+        relay->suppressed ++;
+        return false;
+    }
+
+    relay->sent_epoch[relay->sent_next] = frame->epoch;
+    relay->sent_seq[relay->sent_next] = frame->seq;
+    relay->sent_tx[relay->sent_next] = BEASTSQUIB_FRAME_TX_ID(frame->encoding);
+    relay->sent_next = (relay->sent_next + 1) % BEASTSQUIB_RELAY_CACHE_SIZE;
+    relay->relayed ++;
+
+    frame->ttl --;
+    frame->time_ms += now - relay->rx_ticks;
+    frame->crc = 0;
+    frame->crc = crc16_le(UINT16_MAX, (uint8_t const *)frame, relay->len);
+
+    return true;
+}
+
+/* Returns how long until the pending frame is due, 0 if it is overdue, or
+ * -1 if nothing is waiting. */
+static int32_t beastsquib_relay_wait_ms(const beastsquib_relay_t *relay, uint32_t now)
+{
+    if (!relay->pending)
+    {
+        return -1;
+    }
+
+    int32_t wait_ms = (int32_t)(relay->send_at - now);
+    return (wait_ms > 0) ? wait_ms : 0;
+}
+
+/* Passes the pending frame on once it is due. Returns how long the ESPNOW
+ * task may block before calling again. */
+static TickType_t rx_relay_poll(void)
+{
+#ifdef RX
+    uint32_t now = rx_ticks_now();
+
+    if (beastsquib_relay_take(&rx_relay, now, CONFIG_ESPNOW_RELAY_SUPPRESS))
+    {
+        if (esp_now_send(beastsquib_broadcast_mac, rx_relay.frame, rx_relay.len) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "relay send fail");
+        }
+    }
+
+    int32_t wait_ms = beastsquib_relay_wait_ms(&rx_relay, now);
+    if (wait_ms >= 0)
+    {
+        // Round up to whole ticks, and never spin
+        TickType_t wait = (wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+        return (wait == 0) ? 1 : wait;
+    }
+#endif
+
+    return portMAX_DELAY;
+}
+
+/* Transmitter groups. Every transmitter listens to the others and moves
+ * its epoch and sequence number up to any newer frame it hears, so the
+ * group numbers its frames as one and a receiver applies each number
+ * once, from whichever transmitter it hears first. */
+static void beastsquib_standby_init(beastsquib_standby_t *sb, uint8_t id, uint32_t now)
+{
+    memset(sb, 0, sizeof(*sb));
+    sb->id = id;
+    sb->boot_ms = now;
+}
+
+/* Returns the lowest other transmitter ID heard on duty within timeout_ms,
+ * or BEASTSQUIB_MAX_TX if there is none. */
+static int beastsquib_standby_duty_peer(const beastsquib_standby_t *sb, uint32_t now, uint32_t timeout_ms)
+{
+    for (int id = 0; id < BEASTSQUIB_MAX_TX; id ++)
+    {
+        if (id != sb->id && (sb->duty_heard & (1 << id)) && now - sb->duty_at[id] <= timeout_ms)
+        {
+            return id;
+        }
+    }
+
+    return BEASTSQUIB_MAX_TX;
+}
+
+/* Returns the pages of state that a version 3 frame of len bytes carries
+ * unlike state, and sets *carried to the pages it carries. A sparse frame
+ * carries every page, and armed is part of each. */
+static uint8_t beastsquib_standby_unlike(const beastsquib_espnow_frame_t *frame, int len,
+                                         const beastsquib_tx_state_t *state, uint8_t *carried)
+{
+    int payload_len = len - sizeof(beastsquib_espnow_frame_t);
+    uint8_t unlike = 0;
+
+    if (BEASTSQUIB_FRAME_ENCODING(frame->encoding) == BEASTSQUIB_ENCODING_SPARSE)
+    {
+        int listed[BEASTSQUIB_MAX_PAGES] = { 0 };
+
+        // The list holds each set ID once, so a page matches if every ID
+        // listed in it is set here and none more are
+        for (int i = 0; i < payload_len / (int)sizeof(uint16_t); i ++)
+        {
+            uint16_t id = frame->payload[2*i] | (frame->payload[2*i + 1] << 8);
+            int page = id / BEASTSQUIB_PAGE_BITS;
+            if (page >= BEASTSQUIB_MAX_PAGES)
+            {
+                continue;
+            }
+            listed[page] ++;
+            id %= BEASTSQUIB_PAGE_BITS;
+            if ((state->pyro_bits[page][id / 8] & (1 << (id % 8))) == 0)
+            {
+                unlike |= 1 << page;
+            }
+        }
+        for (int page = 0; page < BEASTSQUIB_MAX_PAGES; page ++)
+        {
+            int set = 0;
+            for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++)
+            {
+                set += __builtin_popcount(state->pyro_bits[page][i]);
+            }
+            if (set != listed[page])
+            {
+                unlike |= 1 << page;
+            }
+        }
+        *carried = UINT8_MAX;
+    }
+    else if (frame->page < BEASTSQUIB_MAX_PAGES && payload_len >= BEASTSQUIB_PAGE_BYTES)
+    {
+        *carried = 1 << frame->page;
+        if (memcmp(frame->payload, state->pyro_bits[frame->page], BEASTSQUIB_PAGE_BYTES) != 0)
+        {
+            unlike = *carried;
+        }
+    }
+    else
+    {
+        *carried = 0;
+    }
+
+    if (frame->armed != state->armed)
+    {
+        unlike = *carried;
+    }
+
+    return unlike;
+}
+
+/* Records a validated version 3 frame of len bytes from another
+ * transmitter, heard directly or through a relay. Holds back, as
+ * beastsquib_standby_t describes, if it carries pages unlike state that
+ * were numbered after they last changed here. Moves epoch and seq up to
+ * the frame's if it is newer, and while this transmitter is off duty
+ * follows the clock of the one on duty. Returns false for this
+ * transmitter's own frames, which relays pass back. */
+static bool beastsquib_standby_heard(beastsquib_standby_t *sb, const beastsquib_espnow_frame_t *frame, int len,
+                                     const beastsquib_tx_state_t *state, uint32_t now, uint32_t timeout_ms,
+                                     uint32_t *epoch, uint32_t *seq)
+{
+    int id = BEASTSQUIB_FRAME_TX_ID(frame->encoding);
+
+    if (id == sb->id)
+    {
+        return false;
+    }
+
+    sb->frames[id] ++;
+    if (frame->epoch >= *epoch)
+    {
+        uint8_t carried;
+        uint8_t unlike = beastsquib_standby_unlike(frame, len, state, &carried);
+        uint8_t newer = 0;
+
+        for (int page = 0; page < BEASTSQUIB_MAX_PAGES; page ++)
+        {
+            if ((unlike & (1 << page)) && (frame->epoch > *epoch || frame->seq > sb->changed_seq[page]))
+            {
+                newer |= 1 << page;
+            }
+        }
+        if (newer != 0)
+        {
+            if (sb->differs == 0 || now - sb->differs_at >= timeout_ms)
+            {
+                sb->holds ++;
+            }
+            sb->differs_at = now;
+        }
+        sb->differs = (sb->differs & ~carried) | newer;
+    }
+
+    if (frame->epoch > *epoch || (frame->epoch == *epoch && frame->seq > *seq))
+    {
+        if (frame->epoch > *epoch)
+        {
+            // Every change here was before the group's new epoch
+            memset(sb->changed_seq, 0, sizeof(sb->changed_seq));
+        }
+        *epoch = frame->epoch;
+        *seq = frame->seq;
+    }
+
+    if ((frame->encoding & BEASTSQUIB_ENCODING_STANDBY) == 0)
+    {
+        sb->duty_heard |= 1 << id;
+        sb->duty_at[id] = now;
+        if (!sb->on_duty && id == beastsquib_standby_duty_peer(sb, now, timeout_ms))
+        {
+            beastsquib_clock_sample(&sb->clock, frame->time_ms, now);
+        }
+    }
+
+    return true;
+}
+
+/* Returns whether this transmitter is holding back for a newer state sent
+ * by another, as beastsquib_standby_t describes. */
+static bool beastsquib_standby_holding(const beastsquib_standby_t *sb, uint32_t now, uint32_t timeout_ms)
+{
+    return sb->differs != 0 && now - sb->differs_at < timeout_ms;
+}
+
+/* Returns whether this transmitter is on duty, taking over or stepping
+ * down as beastsquib_standby_t describes. */
+static bool beastsquib_standby_poll(beastsquib_standby_t *sb, uint32_t now, uint32_t timeout_ms)
+{
+    if (!sb->joined && now - sb->boot_ms >= timeout_ms)
+    {
+        sb->joined = true;
+    }
+
+    int peer = beastsquib_standby_duty_peer(sb, now, timeout_ms);
+    bool on_duty = sb->joined && (sb->on_duty ? peer > sb->id : peer == BEASTSQUIB_MAX_TX);
+    if (on_duty != sb->on_duty)
+    {
+        if (on_duty)
+        {
+            sb->takeovers ++;
+        }
+        else
+        {
+            sb->handovers ++;
+        }
+        sb->on_duty = on_duty;
+    }
+
+    return on_duty;
+}
+
+#ifdef TX
+/* Follows a frame of len bytes from another transmitter, see
+ * beastsquib_standby_heard. Runs in the ESPNOW task. */
+static void tx_standby_heard(const beastsquib_espnow_frame_t *frame, int len, uint32_t rx_ticks)
+{
+    portENTER_CRITICAL();
+    if (beastsquib_standby_heard(&tx_standby, frame, len, &global_tx_data, rx_ticks, CONFIG_ESPNOW_STANDBY_TIMEOUT,
+                                 &tx_epoch, &tx_seq) &&
+        tx_standby.clock.synced)
+    {
+        tx_clock_offset = beastsquib_clock_to_tx(&tx_standby.clock, 0);
+    }
+    portEXIT_CRITICAL();
+}
+#endif
+
+/* Sends this board's status report. Returns true if its flags changed
+ * since the last report sent, which is then sent again. */
+static bool rx_status_send(void)
+{
+    uint8_t flags = 0;
+    uint8_t link = 255;
+
+    if (pyro_armed)
+    {
+        flags |= BEASTSQUIB_STATUS_ARMED;
+    }
+    if (pyro_detonated)
+    {
+        flags |= BEASTSQUIB_STATUS_DETONATED;
+    }
+    if (pyro_fire_pending)
+    {
+        flags |= BEASTSQUIB_STATUS_FIRE_PENDING;
+    }
+
+    // Frames heard against frames sent since the last report
+    uint32_t sent = rx_seq.seq - rx_status_last_seq;
+    if (rx_status_last_epoch == rx_seq.epoch && rx_status_last_seq != 0 && sent != 0)
+    {
+        link = (rx_status_heard >= sent) ? 100 : rx_status_heard * 100 / sent;
+    }
+    rx_status_heard = 0;
+    rx_status_last_epoch = rx_seq.epoch;
+    rx_status_last_seq = rx_seq.seq;
+
+    beastsquib_status_prepare(&rx_status_frame, board_id, flags, rx_seq.epoch, rx_seq.seq, link);
+    if (esp_now_send(beastsquib_broadcast_mac, (const uint8_t *)&rx_status_frame, sizeof(rx_status_frame)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "status send fail");
+    }
+
+    bool changed = flags != rx_status_last_flags;
+    rx_status_last_flags = flags;
+    return changed;
+}
+
+/* Sends the last report again, unchanged. */
+static void rx_status_send_repeat(void)
+{
+    if (esp_now_send(beastsquib_broadcast_mac, (const uint8_t *)&rx_status_frame, sizeof(rx_status_frame)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "status send fail");
+    }
+}
+
+/* Keeps this board's report off the air for CONFIG_ESPNOW_STATUS_GUARD ms
+ * after it hears a frame of a burst, leaving the air to the rest of it. */
+static void rx_status_frame_heard(uint32_t time_ms, uint32_t rx_ticks)
+{
+    if (beastsquib_status_in_burst(rx_status_frame_ms, time_ms, CONFIG_ESPNOW_HEARTBEAT_PERIOD))
+    {
+        rx_status_quiet_until = rx_ticks + CONFIG_ESPNOW_STATUS_GUARD;
+    }
+    rx_status_frame_ms = time_ms;
+}
+
+/* Sends the status report once hw_timer_callback says its slot has come,
+ * unless a burst is on the air, and sets the tick of the next slot. A
+ * report whose flags changed goes out again BEASTSQUIB_STATUS_REPEAT_MS
+ * into the same slot, so one lost report does not hold up a detonation's
+ * confirmation by a round. Boards report while they follow the
+ * transmitter clock and have a board ID below CONFIG_ESPNOW_STATUS_SLOTS. */
+static void rx_status_poll(void)
+{
+#if defined(RX) && defined(CONFIG_ESPNOW_STATUS)
+    uint32_t now = rx_ticks_now();
+    if (rx_status_ready)
+    {
+        bool repeat = rx_status_repeat;
+
+        rx_status_ready = false;
+        rx_status_repeat = false;
+        // A skipped slot is reported in the next round, still as a change
+        if ((int32_t)(rx_status_quiet_until - now) <= 0)
+        {
+            // On the first channel, where the transmitter waits between frames
+            espnow_channel_tune(0);
+            if (repeat)
+            {
+                rx_status_send_repeat();
+            }
+            else if (rx_status_send())
+            {
+                rx_status_at = now + BEASTSQUIB_STATUS_REPEAT_MS;
+                rx_status_repeat = true;
+                __sync_synchronize();
+                rx_status_due = true;
+                rx_timer_reschedule();
+            }
+            // Let the report go out before the radio sleeps again
+            rx_radio_hold_until = now + BEASTSQUIB_RADIO_GUARD_MS;
+        }
+    }
+
+    if (!rx_status_due && rx_clock.synced &&
+        board_id >= 0 && board_id < CONFIG_ESPNOW_STATUS_SLOTS && !rx_silence_expired(now))
+    {
+        rx_status_at = beastsquib_status_next_slot(&rx_clock, board_id, now,
+                                                   CONFIG_ESPNOW_STATUS_SLOTS, CONFIG_ESPNOW_STATUS_SLOT_MS);
+        __sync_synchronize();
+        rx_status_due = true;
+        rx_timer_reschedule();
+    }
+#endif
+}
+
+static inline TickType_t rx_ms_to_ticks(uint32_t ms)
+{
+    TickType_t ticks = (ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+    return (ticks == 0) ? 1 : ticks;
+}
+
+/* Low power: puts the radio in modem sleep between the windows it listens
+ * in around each heartbeat, and wakes it in time for a status slot.
+ * Relays and boards that do not follow the transmitter clock keep
+ * listening. Returns how long the ESPNOW task may wait before calling
+ * again. */
+static TickType_t rx_radio_poll(void)
+{
+#if defined(RX) && defined(CONFIG_ESPNOW_LOW_POWER)
+    uint32_t now = rx_ticks_now();
+    uint32_t open, close;
+
+    if ((int32_t)(rx_radio_asleep_until - now) > 0)
+    {
+        return rx_ms_to_ticks(rx_radio_asleep_until - now);
+    }
+    if (rx_relay_enabled || !rx_clock.synced || rx_silent)
+    {
+        return portMAX_DELAY;
+    }
+
+    bool listening = beastsquib_radio_window(&rx_clock, now, CONFIG_ESPNOW_HEARTBEAT_PERIOD,
+                                             BEASTSQUIB_RADIO_GUARD_MS, CONFIG_ESPNOW_LOW_POWER_WINDOW,
+                                             &open, &close);
+    if (rx_status_due && (int32_t)(rx_status_at - BEASTSQUIB_RADIO_GUARD_MS - open) < 0)
+    {
+        open = rx_status_at - BEASTSQUIB_RADIO_GUARD_MS;
+        listening |= (int32_t)(now - open) >= 0;
+    }
+
+    if (listening || (int32_t)(rx_radio_hold_until - now) > 0)
+    {
+        uint32_t until = listening ? close : rx_radio_hold_until;
+        return rx_ms_to_ticks(until - now);
+    }
+
+    // The SDK sleeps for 10 ms at least
+    uint32_t sleep_ms = open - now;
+    if (sleep_ms >= 10)
+    {
+        if (esp_wifi_fpm_do_sleep(sleep_ms * 1000) == ESP_OK)
+        {
+            rx_power.radio_sleeps ++;
+            rx_power.radio_sleep_ms += sleep_ms;
+            rx_radio_asleep_until = open;
+        }
+    }
+    return rx_ms_to_ticks(close - now);
+#else
+    return portMAX_DELAY;
+#endif
+}
+
+/* Channel diversity: puts the radio on the channel the receiver has moved
+ * to, once a status report has gone out. Returns how long the ESPNOW task
+ * may wait before calling again. */
+static TickType_t rx_channel_poll(void)
+{
+#if defined(RX) && defined(CONFIG_ESPNOW_CHANNEL_DIVERSITY)
+    uint32_t now = rx_ticks_now();
+
+    if ((int32_t)(rx_radio_hold_until - now) > 0)
+    {
+        return rx_ms_to_ticks(rx_radio_hold_until - now);
+    }
+
+    uint32_t wait_ms = beastsquib_channels_poll(&espnow_channels, now, CONFIG_ESPNOW_DIVERSITY_DWELL);
+    espnow_channel_tune(espnow_channels.current);
+    return (wait_ms == UINT32_MAX) ? portMAX_DELAY : rx_ms_to_ticks(wait_ms);
+#else
+    return portMAX_DELAY;
+#endif
+}
+
+/* Handles one received frame in the ESPNOW task. */
+static void beastsquib_espnow_handle_frame(uint8_t *data, int len, uint32_t rx_ticks)
+{
+    if (beastsquib_validate_espnow_data_checksum(data, len) != 0)
+    {
+        rx_log_event(BEASTSQUIB_LOG_FRAME, BEASTSQUIB_LOG_FRAME_CRC, 0, 0);
+        return;
+    }
+
+    const beastsquib_espnow_data_t *legacy = (const beastsquib_espnow_data_t *)data;
+    if (legacy->version < 3)
+    {
+        // Version 0/1 frames carry no sequence number and are always applied
+        bool own_page = board_id < BEASTSQUIB_PAGE_BITS;
+        bool apply;
+        bool fresh = legacy->version < 2 ||
+                     beastsquib_espnow_frame_is_fresh(legacy->epoch, legacy->seq, 0, own_page, &apply, rx_ticks);
+        rx_log_event(BEASTSQUIB_LOG_FRAME, fresh ? BEASTSQUIB_LOG_FRAME_APPLIED : BEASTSQUIB_LOG_FRAME_STALE,
+                     (legacy->version >= 2) ? (uint16_t)legacy->epoch : 0, (legacy->version >= 2) ? legacy->seq : 0);
+        if (!fresh)
+        {
+            return;
+        }
+
+        // Older frames carry the first bitmap page only
+        rx_frame_heard(rx_ticks);
+        espnow_broadcast_packet_recv_cb(legacy->armed, own_page ? legacy->pyro_bits : NULL, NULL);
+        return;
+    }
+
+    const beastsquib_espnow_frame_t *frame = (const beastsquib_espnow_frame_t *)data;
+#ifdef TX
+    tx_standby_heard(frame, len, rx_ticks);
+    return;
+#endif
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+    beastsquib_channels_heard(&espnow_channels, frame->epoch, frame->seq, rx_ticks);
+#endif
+    uint32_t fire_at_ms = frame->fire_at_ms;
+    const uint8_t *page_bits = beastsquib_espnow_frame_page(frame, len, &fire_at_ms);
+    bool apply;
+    bool fresh = beastsquib_espnow_frame_is_fresh(frame->epoch, frame->seq, BEASTSQUIB_FRAME_TX_ID(frame->encoding),
+                                                  page_bits != NULL, &apply, rx_ticks);
+    rx_log_event(BEASTSQUIB_LOG_FRAME, fresh ? BEASTSQUIB_LOG_FRAME_APPLIED : BEASTSQUIB_LOG_FRAME_STALE,
+                 (uint16_t)frame->epoch, frame->seq);
+    if (fresh)
+    {
+        rx_frame_heard(rx_ticks);
+        rx_stats.from_tx[BEASTSQUIB_FRAME_TX_ID(frame->encoding)] ++;
+        beastsquib_clock_sample(&rx_clock, frame->time_ms, rx_ticks);
+        rx_status_frame_heard(frame->time_ms, rx_ticks);
+
+        if (apply)
+        {
+            uint32_t fire_at = beastsquib_clock_to_local(&rx_clock, fire_at_ms);
+            espnow_broadcast_packet_recv_cb(frame->armed, page_bits, (fire_at_ms != 0) ? &fire_at : NULL);
+        }
+        rx_status_heard ++;
+
+        if (rx_relay_enabled)
+        {
+            beastsquib_relay_offer(&rx_relay, data, len, rx_ticks, esp_random() % (CONFIG_ESPNOW_RELAY_BACKOFF + 1));
+        }
+    }
+    else
+    {
+        beastsquib_relay_duplicate(&rx_relay, frame);
+    }
+}
+
+/* Saves the flight recorder to flash the first time the board detonates,
+ * so it can be read back with #FLS after the board is recovered. */
+static void rx_log_snapshot(void)
+{
+#ifdef CONFIG_ESPNOW_FLIGHT_SNAPSHOT
+    beastsquib_log_snapshot_t header = {
+        .magic = BEASTSQUIB_LOG_SNAPSHOT_MAGIC,
+        .head = rx_log_head,
+        .isr_head = rx_log_isr_head,
+        .size = CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE,
+        .isr_size = BEASTSQUIB_LOG_ISR_SIZE,
+    };
+
+    rx_log_snapshot_due = false;
+    if (rx_log_snapshot_taken)
+    {
+        return;
+    }
+    rx_log_snapshot_taken = true;
+
+    FILE* f = fopen(BEASTSQUIB_LOG_SNAPSHOT_PATH, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open file for writing");
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(rx_log, sizeof(rx_log), 1, f);
+    fwrite(rx_log_isr, sizeof(rx_log_isr), 1, f);
+    fclose(f);
+#else
+    rx_log_snapshot_due = false;
+#endif
+}
+
+static void beastsquib_espnow_task(void *pvParameter)
+{
+    static uint8_t state_frame[ESPNOW_RX_SLOT_SIZE];
+    beastsquib_espnow_event_t evt;
+    uint32_t state_rx_ticks;
+    int state_len;
+    TickType_t wait = portMAX_DELAY;
+
+    /* A timeout only ends the wait while a relayed frame, a listening
+     * window or a channel change is due. A status slot ends it with a
+     * notification. */
+    while (ulTaskNotifyTake(pdTRUE, wait) != 0 || wait != portMAX_DELAY) {
+        while (espnow_ring_pop(&evt)) {
+            switch (evt.id) {
+                case BEASTSQUIB_ESPNOW_SEND_CB:
+                {
+                    /* SENT DATA */
+                    break;
+                }
+                default:
+                    ESP_LOGE(TAG, "Callback type error: %d", evt.id);
+                    break;
+            }
+        }
+
+        /* Newest broadcast state for each page that got any since the last
+         * wake-up. */
+        while (espnow_state_take(state_frame, &state_len, &state_rx_ticks)) {
+            uint32_t taken_cycles = beastsquib_cycles();
+            beastsquib_espnow_handle_frame(state_frame, state_len, state_rx_ticks);
+            beastsquib_latency_record(BEASTSQUIB_LATENCY_HANDLE, beastsquib_cycles() - taken_cycles);
+        }
+
+        if (rx_log_snapshot_due && rx_storage_mounted) {
+            rx_log_snapshot();
+        }
+
+        /* Status reports are woken by hw_timer_callback, relayed frames
+         * and the radio's listening windows by the timeout. */
+        rx_status_poll();
+        TickType_t radio_wait = rx_radio_poll();
+        TickType_t channel_wait = rx_channel_poll();
+        wait = rx_relay_poll();
+        wait = (radio_wait < wait) ? radio_wait : wait;
+        wait = (channel_wait < wait) ? channel_wait : wait;
+    }
+}
+
+static void beastsquib_espnow_deinit(beastsquib_espnow_send_param_t *send_param)
+{
+    free(send_param->buffer);
+    free(send_param);
+    esp_now_deinit();
+}
+
+#ifdef TX
+
+/* Bumps the boot epoch kept in NVS so receivers can tell frames from this
+ * boot from older ones. Falls back to a random epoch if NVS is unusable;
+ * receivers then resynchronise after their silence timeout. */
+static void tx_epoch_init(void)
+{
+    nvs_handle handle;
+    uint32_t epoch = 0;
+
+    esp_err_t err = nvs_open("beastsquib", NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        nvs_get_u32(handle, "tx_epoch", &epoch);
+        epoch ++;
+        err = nvs_set_u32(handle, "tx_epoch", epoch);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store tx epoch (%s)", esp_err_to_name(err));
+        epoch = esp_random();
+    }
+
+    tx_epoch = epoch;
+    tx_seq = 0;
+    ESP_LOGI(TAG, "tx epoch: %u", (unsigned)tx_epoch);
+}
+
+/* Lists the set board IDs into a sparse payload, stopping once there are
+ * more than a frame can hold. Returns the number listed. */
+static int tx_list_ids(const uint8_t *pyro_bits, int page_count, uint8_t *payload)
+{
+    int count = 0;
+
+    for (int i = 0; i < page_count * BEASTSQUIB_PAGE_BYTES; i ++) {
+        uint8_t bits = pyro_bits[i];
+        while (bits != 0) {
+            if (count == BEASTSQUIB_SPARSE_MAX_IDS) {
+                return count + 1;
+            }
+            uint16_t id = i * 8 + __builtin_ctz(bits);
+            payload[2*count] = id & 0xFF;
+            payload[2*count + 1] = id >> 8;
+            count ++;
+            bits &= bits - 1;
+        }
+    }
+
+    return count;
+}
+
+/* Lists the IDs set by the last tx_fec_depth changes that are still set
+ * and not on the page being sent, newest first, as many as fit within
+ * CONFIG_ESPNOW_SEND_LEN. Returns the number listed. */
+static int tx_list_recent(const beastsquib_tx_state_t *state, int page, uint8_t *payload)
+{
+    int room = (CONFIG_ESPNOW_SEND_LEN - (int)sizeof(beastsquib_espnow_frame_t) - BEASTSQUIB_PAGE_BYTES) / (int)sizeof(uint16_t);
+    int count = 0;
+
+    portENTER_CRITICAL();
+    uint32_t head = tx_recent_head;
+    uint32_t oldest_change = tx_change_count - tx_fec_depth;
+
+    for (uint32_t i = 0; i < BEASTSQUIB_RECENT_HISTORY && i < head && count < room; i ++) {
+        uint32_t slot = (head - 1 - i) % BEASTSQUIB_RECENT_HISTORY;
+        if ((int32_t)(tx_recent_change[slot] - oldest_change) <= 0) {
+            break;
+        }
+
+        uint16_t id = tx_recent_ids[slot];
+        if (id / BEASTSQUIB_PAGE_BITS == page ||
+            (state->pyro_bits[id / BEASTSQUIB_PAGE_BITS][(id % BEASTSQUIB_PAGE_BITS) / 8] & (1 << (id % 8))) == 0) {
+            continue;
+        }
+
+        payload[2*count] = id & 0xFF;
+        payload[2*count + 1] = id >> 8;
+        count ++;
+    }
+    portEXIT_CRITICAL();
+
+    return count;
+}
+
+/* Most entries a timed frame can carry within CONFIG_ESPNOW_SEND_LEN. */
+#define TX_TIMED_MAX ((CONFIG_ESPNOW_SEND_LEN - (int)sizeof(beastsquib_espnow_frame_t) - BEASTSQUIB_PAGE_BYTES) / \
+                      (int)sizeof(beastsquib_timed_id_t))
+
+/* Lists recently set IDs that are still set, newest first, each with its
+ * own detonation time, or 0 once that has passed: those whose time is not
+ * the frame's and, with FEC on several pages, those of the last
+ * tx_fec_depth changes. Sets *needed if any board listed would fire at the
+ * wrong time from the frame's alone. Returns the number listed. */
+static int tx_list_timed(const beastsquib_tx_state_t *state, int page_count, uint32_t now_ms,
+                         beastsquib_timed_id_t *timed, bool *needed)
+{
+    bool fec = page_count > 1 && tx_fec_enabled;
+    int count = 0;
+
+    *needed = false;
+    portENTER_CRITICAL();
+    uint32_t head = tx_recent_head;
+    uint32_t oldest_change = tx_change_count - tx_fec_depth;
+
+    for (uint32_t i = 0; i < BEASTSQUIB_RECENT_HISTORY && i < head && count < TX_TIMED_MAX; i ++) {
+        uint32_t slot = (head - 1 - i) % BEASTSQUIB_RECENT_HISTORY;
+        uint16_t id = tx_recent_ids[slot];
+        uint32_t fire_at_ms = tx_recent_fire[slot];
+        bool own_time = fire_at_ms != state->fire_at_ms;
+
+        if ((state->pyro_bits[id / BEASTSQUIB_PAGE_BITS][(id % BEASTSQUIB_PAGE_BITS) / 8] & (1 << (id % 8))) == 0 ||
+            (!own_time && !(fec && (int32_t)(tx_recent_change[slot] - oldest_change) > 0))) {
+            continue;
+        }
+
+        // An ID set again since only counts from its newest change
+        bool listed = false;
+        for (int k = 0; k < count && !listed; k ++) {
+            listed = timed[k].id == id;
+        }
+        if (listed) {
+            continue;
+        }
+
+        if (fire_at_ms != 0 && (int32_t)(fire_at_ms - now_ms) <= 0) {
+            fire_at_ms = 0;
+        }
+        timed[count].id = id;
+        timed[count].fire_at_ms = fire_at_ms;
+        count ++;
+        *needed |= own_time;
+    }
+    portEXIT_CRITICAL();
+
+    return count;
+}
+
+/* Builds the next frame of the current state in send_param and returns
+ * how many frames it takes to carry a change.
+ *
+ * The state goes out as a list of set IDs while that is smaller than the
+ * bitmap, otherwise one bitmap page per frame. Pages take turns; during a
+ * burst only the pages that changed are sent. */
+static uint16_t tx_build_frame(beastsquib_espnow_send_param_t *send_param, bool state_changed)
+{
+    static beastsquib_tx_state_t state;
+    beastsquib_espnow_frame_t *frame = (beastsquib_espnow_frame_t *)send_param->buffer;
+    uint16_t frames_per_state = 1;
+    int page_count;
+
+    portENTER_CRITICAL();
+    page_count = tx_page_count;
+    state.armed = global_tx_data.armed;
+    state.fire_at_ms = global_tx_data.fire_at_ms;
+    memcpy(state.pyro_bits, global_tx_data.pyro_bits, page_count * BEASTSQUIB_PAGE_BYTES);
+    if (state_changed) {
+        tx_burst_pages |= tx_dirty_pages;
+        tx_dirty_pages = 0;
+    }
+    portEXIT_CRITICAL();
+
+    /* While the newest change has yet to fire, boards set by an earlier
+     * change must not take its time from the frame, so bitmap frames list
+     * them with their own. */
+    beastsquib_timed_id_t timed[TX_TIMED_MAX];
+    int timed_count = 0;
+    bool timed_needed = false;
+    uint32_t now_ms = tx_clock_ms();
+    if (state.fire_at_ms != 0 && (int32_t)(state.fire_at_ms - now_ms) > 0) {
+        timed_count = tx_list_timed(&state, page_count, now_ms, timed, &timed_needed);
+    }
+
+    int count = tx_list_ids((const uint8_t *)state.pyro_bits, page_count, frame->payload);
+    if (!timed_needed && count <= BEASTSQUIB_SPARSE_MAX_IDS && count * sizeof(uint16_t) < page_count * BEASTSQUIB_PAGE_BYTES) {
+        frame->encoding = BEASTSQUIB_ENCODING_SPARSE;
+        frame->page = 0;
+        send_param->len = sizeof(beastsquib_espnow_frame_t) + count * sizeof(uint16_t);
+    } else {
+        bool in_burst = state_changed || tx_burst_remaining > 0;
+        uint8_t pages = (in_burst && tx_burst_pages != 0) ? tx_burst_pages : (1 << page_count) - 1;
+        int page = 0;
+
+        for (int i = 0; i < page_count; i ++) {
+            page = (tx_next_page + i) % page_count;
+            if (pages & (1 << page)) {
+                break;
+            }
+        }
+        tx_next_page = (page + 1) % page_count;
+
+        if (tx_burst_pages != 0) {
+            frames_per_state = __builtin_popcount(tx_burst_pages);
+        }
+
+        frame->encoding = BEASTSQUIB_ENCODING_BITMAP;
+        frame->page = page;
+        memcpy(frame->payload, state.pyro_bits[page], BEASTSQUIB_PAGE_BYTES);
+        send_param->len = sizeof(beastsquib_espnow_frame_t) + BEASTSQUIB_PAGE_BYTES;
+
+        int recent = (page_count > 1 && tx_fec_enabled && !timed_needed) ?
+                     tx_list_recent(&state, page, frame->payload + BEASTSQUIB_PAGE_BYTES) : 0;
+        if (timed_needed) {
+            frame->encoding = BEASTSQUIB_ENCODING_BITMAP_TIMED;
+            memcpy(frame->payload + BEASTSQUIB_PAGE_BYTES, timed, timed_count * sizeof(beastsquib_timed_id_t));
+            send_param->len += timed_count * sizeof(beastsquib_timed_id_t);
+        } else if (recent > 0) {
+            frame->encoding = BEASTSQUIB_ENCODING_BITMAP_RECENT;
+            send_param->len += recent * sizeof(uint16_t);
+        }
+    }
+    frame->armed = state.armed;
+    frame->fire_at_ms = state.fire_at_ms;
+
+    return frames_per_state;
+}
+
+/* Sends the current state once and returns the delay before the next frame.
+ *
+ * With channel diversity each frame goes out on every channel in turn
+ * before the next one is built, unless the state changes first. Bursts
+ * and heartbeats are counted per channel, so each channel still gets a
+ * whole burst and a heartbeat every heartbeat period. */
+static uint32_t tx_transmit_step(beastsquib_espnow_send_param_t *send_param, bool state_changed)
+{
+    beastsquib_espnow_frame_t *frame = (beastsquib_espnow_frame_t *)send_param->buffer;
+    uint16_t frames_per_state = 1;
+    int channels = espnow_channels.count > 0 ? espnow_channels.count : 1;
+
+    if (state_changed || tx_channel_next == 0) {
+        frames_per_state = tx_build_frame(send_param, state_changed);
+    }
+
+    beastsquib_espnow_data_prepare(send_param);
+    if (state_changed) {
+        tx_status_change_seq = frame->seq;
+    }
+
+    if (channels > 1) {
+        espnow_channel_tune(tx_channel_next);
+        espnow_channels.stats[tx_channel_next].frames ++;
+        tx_channel_next = (tx_channel_next + 1) % channels;
+    }
+
+    /* Send some data to the broadcast address. */
+    if (esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len) != ESP_OK) {
+        // Maybe WATCHDOG here?
+        ESP_LOGE(TAG, "send fail");
+    }
+    trace_put(BEASTSQUIB_TRACE_TX, NULL, send_param->buffer, send_param->len);
+
+    uint32_t wait_ms = tx_schedule_next_ms(state_changed, frames_per_state * channels);
+    if (tx_burst_remaining == 0) {
+        tx_burst_pages = 0;
+        wait_ms /= channels;
+    }
+
+    return wait_ms;
+}
+
+#ifdef CONFIG_ESPNOW_LOW_POWER
+/* Low power receivers only listen around every CONFIG_ESPNOW_HEARTBEAT_PERIOD
+ * ms of the transmitter clock. Returns the ms to the next heartbeat, or 0
+ * within a tick after one. */
+static uint32_t tx_ms_to_heartbeat(void)
+{
+    uint32_t since = tx_clock_ms() % CONFIG_ESPNOW_HEARTBEAT_PERIOD;
+    return (since < portTICK_RATE_MS) ? 0 : CONFIG_ESPNOW_HEARTBEAT_PERIOD - since;
+}
+#endif
+
+/* Returns 0 if a frame may be sent now, or how long to wait before asking
+ * again: in a group until the transmitter has listened to the others for
+ * a standby timeout after booting, while another has sent a newer state,
+ * and while off duty until the server has set the whole state or, in hot
+ * standby, between state changes. */
+static uint32_t tx_standby_wait_ms(bool state_changed)
+{
+    uint32_t now = rx_ticks_now();
+
+    portENTER_CRITICAL();
+    bool on_duty = beastsquib_standby_poll(&tx_standby, now, CONFIG_ESPNOW_STANDBY_TIMEOUT);
+    bool joined = tx_standby.joined;
+    bool holding = beastsquib_standby_holding(&tx_standby, now, CONFIG_ESPNOW_STANDBY_TIMEOUT);
+    bool commanded = tx_pyro_commanded && tx_armed_commanded;
+    portEXIT_CRITICAL();
+
+#ifdef CONFIG_ESPNOW_TX_GROUP
+    if (!joined)
+    {
+        return CONFIG_ESPNOW_STANDBY_TIMEOUT - (now - tx_standby.boot_ms);
+    }
+#endif
+    if (holding)
+    {
+        // Ends once this state changes or the other sends it back unchanged
+        return portTICK_RATE_MS;
+    }
+    if (!on_duty && !commanded)
+    {
+        return tx_timing.heartbeat_ms;
+    }
+#ifdef CONFIG_ESPNOW_STANDBY
+    if (!on_duty && !state_changed && tx_burst_remaining == 0)
+    {
+        return tx_timing.heartbeat_ms;
+    }
+#endif
+    return 0;
+}
+
+/* Sends immediately when woken by tx_state_changed, then keeps sending on
+ * the schedule returned by tx_schedule_next_ms. In low power, heartbeats
+ * and the start of each burst wait for the receivers' next window. */
+static void tx_transmit_task(void *pvParameter)
+{
+    beastsquib_espnow_send_param_t *send_param = (beastsquib_espnow_send_param_t *)pvParameter;
+    TickType_t wait = 0;
+    bool held = false;
+
+    while (1)
+    {
+        bool state_changed = ulTaskNotifyTake(pdTRUE, wait) != 0;
+        uint32_t standby_ms = tx_standby_wait_ms(state_changed || held);
+        if (standby_ms != 0)
+        {
+            held |= state_changed;
+            wait = (standby_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+            continue;
+        }
+#ifdef CONFIG_ESPNOW_LOW_POWER
+        uint32_t to_heartbeat = tx_ms_to_heartbeat();
+        if ((state_changed || held || tx_burst_remaining == 0) && to_heartbeat != 0)
+        {
+            held |= state_changed;
+            wait = (to_heartbeat + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+            continue;
+        }
+#endif
+        state_changed |= held;
+        held = false;
+        uint32_t wait_ms = tx_transmit_step(send_param, state_changed);
+#ifdef CONFIG_ESPNOW_LOW_POWER
+        if (tx_burst_remaining == 0)
+        {
+            wait_ms = CONFIG_ESPNOW_HEARTBEAT_PERIOD - tx_clock_ms() % CONFIG_ESPNOW_HEARTBEAT_PERIOD;
+        }
+#endif
+
+        // Round up to whole ticks, and never spin
+        wait = (wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+        if (wait == 0) {
+            wait = 1;
+        }
+#ifdef CONFIG_ESPNOW_CHANNEL_DIVERSITY
+        /* Wait on the first channel, where status reports and the other
+         * transmitters are heard, once the frame has had a tick to go out. */
+        if (espnow_channel_tuned != espnow_channels.channel[0] && wait > 1) {
+            vTaskDelay(1);
+            espnow_channel_tune(0);
+            wait --;
+        }
+#endif
+    }
+}
+
+#endif
+
+static esp_err_t beastsquib_espnow_init(void)
+{
+    beastsquib_espnow_send_param_t *send_param;
+
+    /* Initialize ESPNOW and register sending and receiving callback function. */
+    ESP_ERROR_CHECK( esp_now_init() );
+    ESP_ERROR_CHECK( esp_now_register_send_cb(beastsquib_espnow_send_cb) );
+    ESP_ERROR_CHECK( esp_now_register_recv_cb(beastsquib_espnow_recv_cb) );
+    ESP_ERROR_CHECK( esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK) );
+
+    /* Add broadcast peer information to peer list. */
+    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
+    if (peer == NULL) {
+        ESP_LOGE(TAG, "Malloc peer information fail");
+        esp_now_deinit();
+        return ESP_FAIL;
+    }
+
+    memset(peer, 0, sizeof(esp_now_peer_info_t));
+    // Channel 0 sends on whichever channel the radio is on
+    peer->channel = (espnow_channels.count > 1) ? 0 : espnow_channels.channel[0];
+    peer->ifidx = ESPNOW_WIFI_IF;
+    peer->encrypt = false;
+    memcpy(peer->peer_addr, beastsquib_broadcast_mac, ESP_NOW_ETH_ALEN);
+    ESP_ERROR_CHECK( esp_now_add_peer(peer) );
+    free(peer);
+
+    /* Initialize sending parameters. */
+    send_param = malloc(sizeof(beastsquib_espnow_send_param_t));
+    if (send_param == NULL) {
+        ESP_LOGE(TAG, "Malloc send parameter fail");
+        esp_now_deinit();
+        return ESP_FAIL;
+    }
+    memset(send_param, 0, sizeof(beastsquib_espnow_send_param_t));
+
+    // Configure dest mac, magic number, send length, and buffer
+    memcpy(send_param->dest_mac, beastsquib_broadcast_mac, ESP_NOW_ETH_ALEN);
+    send_param->magic = BEASTSQUIB_MAGIC_NUMBER;
+    send_param->len = ESP_NOW_MAX_DATA_LEN;
+    send_param->buffer = malloc(ESP_NOW_MAX_DATA_LEN);
+
+    if (send_param->buffer == NULL) {
+        ESP_LOGE(TAG, "Malloc send buffer fail");
+        free(send_param);
+        esp_now_deinit();
+        return ESP_FAIL;
+    }
+
+    xTaskCreate(beastsquib_espnow_task, "beastsquib_espnow_task", 2048, NULL, 4, &beastsquib_espnow_task_handle);
+  
+#ifdef TX
+    tx_epoch_init();
+    beastsquib_standby_init(&tx_standby, CONFIG_ESPNOW_TX_ID, rx_ticks_now());
+#ifndef CONFIG_ESPNOW_TX_GROUP
+    // Alone on the air, so there is no group to listen for
+    tx_standby.joined = true;
+#endif
+    xTaskCreate(tx_transmit_task, "tx_transmit_task", 2048, send_param, 4, &tx_transmit_task_handle);
+#endif
+
+    return ESP_OK;
+}
+
+#define EX_UART_NUM UART_NUM_0
+#define BUF_SIZE (1024)
+#define RD_BUF_SIZE (BUF_SIZE)
+static QueueHandle_t uart0_queue;
+
+/* ASCII command being received. */
+static beastsquib_uart_parser_t uart_parser;
+static beastsquib_uart_stats_t uart_stats;
+
+/* Binary frame being received, see beastsquib_uart_frame_type_t. */
+static bool uart_frame_open = false;
+static int uart_frame_len = 0;
+static uint8_t uart_frame_buf[BEASTSQUIB_UART_MAX_ENCODED];
+static bool uart_frame_have_last = false;
+static uint8_t uart_frame_last_seq;
+static uint16_t uart_frame_last_crc;
+
+/* Board configuration, loaded from NVS at boot. */
+static beastsquib_board_config_t rx_config = {
+    .version = BEASTSQUIB_CONFIG_VERSION,
+    .flags = 0,
+    .board_id = -1,
+};
+
+/* Mounts SPIFFS once. Formats a partition that will not mount only if format is set. */
+static bool rx_storage_mount(bool format)
+{
+    if (rx_storage_mounted) {
+        return true;
+    }
+
+    esp_vfs_spiffs_conf_t conf = {
+      .base_path = "/spiffs",
+      .partition_label = NULL,
+      .max_files = 5,
+      .format_if_mount_failed = format
+    };
+
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    if (ret != ESP_OK) {
+        if (ret == ESP_FAIL) {
+            ESP_LOGE(TAG, "Failed to mount or format filesystem");
+        } else if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
+        } else {
+            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
+        }
+        return false;
+    }
+
+    rx_storage_mounted = true;
+    return true;
+}
+
+/* Saves the board configuration to NVS. */
+static void rx_config_save(void)
+{
+    nvs_handle handle;
+
+    rx_config.version = BEASTSQUIB_CONFIG_VERSION;
+    esp_err_t err = nvs_open("beastsquib", NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, "board_cfg", &rx_config, sizeof(rx_config));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store board config (%s)", esp_err_to_name(err));
+    }
+}
+
+/* Reads the board ID and relay setting older firmware kept as text files
+ * in SPIFFS. Leaves a partition that will not mount alone and returns
+ * false, so the next boot tries again. */
+static bool rx_config_migrate(void)
+{
+    if (!rx_storage_mount(false)) {
+        return false;
+    }
+
+    FILE* f = fopen("/spiffs/boardid.txt", "r");
+    if (f != NULL) {
+        char line[8];
+        if (fgets(line, sizeof(line), f) != NULL) {
+            rx_config.board_id = atoi(line);
+        }
+        fclose(f);
+    }
+
+    f = fopen("/spiffs/relay.txt", "r");
+    if (f != NULL) {
+        if (fgetc(f) == '1') {
+            rx_config.flags |= BEASTSQUIB_CONFIG_RELAY;
+        }
+        fclose(f);
+    }
+    ESP_LOGI(TAG, "Moved board config from SPIFFS");
+    return true;
+}
+
+/* Loads the board configuration from NVS, or on the first boot after an
+ * update from SPIFFS, saving it to NVS for the next boot. A board with
+ * neither keeps board ID -1, which never fires, until #SID. */
+static void rx_config_load(void)
+{
+    // Room for records from later versions, which only add fields
+    uint8_t record[64];
+    size_t len = sizeof(record);
+    nvs_handle handle;
+
+    esp_err_t err = nvs_open("beastsquib", NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, "board_cfg", record, &len);
+        nvs_close(handle);
+    }
+
+    if (err == ESP_OK && len >= sizeof(rx_config.version) && record[0] != 0) {
+        memcpy(&rx_config, record, (len < sizeof(rx_config)) ? len : sizeof(rx_config));
+    } else if (rx_config_migrate()) {
+        rx_config_save();
+    }
+
+    board_id = rx_config.board_id;
+    rx_relay_enabled = (rx_config.flags & BEASTSQUIB_CONFIG_RELAY) != 0;
+    ESP_LOGI(TAG, "board_id: '%i', relay: %i", board_id, rx_relay_enabled);
+#ifdef CONFIG_ESPNOW_STATUS
+    if (board_id >= CONFIG_ESPNOW_STATUS_SLOTS)
+    {
+        ESP_LOGW(TAG, "board_id %i has no status slot (%i slots), it will not report", board_id,
+                 CONFIG_ESPNOW_STATUS_SLOTS);
+    }
+#endif
+}
+
+/* Takes up the board ID last saved with #SID. */
+static void read_board_id_cb(void)
+{
+    board_id = rx_config.board_id;
+    ESP_LOGI(TAG, "board_id: '%i'", board_id);
+}
+
+/* Switches relaying on or off for this board, as given by #RLY, and saves it. */
+static void uart_store_relay(bool enabled)
+{
+    rx_relay_enabled = enabled;
+    rx_relay.pending = false;
+
+    if (enabled) {
+        rx_config.flags |= BEASTSQUIB_CONFIG_RELAY;
+    } else {
+        rx_config.flags &= ~BEASTSQUIB_CONFIG_RELAY;
+    }
+    rx_config_save();
+
+    char line[16];
+    int len = snprintf(line, sizeof(line), "#RLY,%i;\r\n", rx_relay_enabled);
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes the receive path counters as a single #RXS line. */
+static void uart_report_rx_stats(void)
+{
+    char line[256];
+    int len = snprintf(line, sizeof(line),
+                       "#RXS,ok=%u,short=%u,long=%u,magic=%u,version=%u,source=%u,format=%u,"
+                       "ring_full=%u,overwritten=%u,crc=%u,stale=%u,lost=%u,relayed=%u,suppressed=%u,status=%u;\r\n",
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_ADMIT],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_SHORT],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_LONG],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_MAGIC],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_VERSION],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_SOURCE],
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_FORMAT],
+                       (unsigned)rx_stats.ring_full,
+                       (unsigned)rx_stats.state_overwritten,
+                       (unsigned)rx_stats.crc_fail,
+                       (unsigned)rx_stats.stale,
+                       (unsigned)rx_stats.lost,
+                       (unsigned)rx_relay.relayed,
+                       (unsigned)rx_relay.suppressed,
+                       (unsigned)rx_stats.status);
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Saves the board id given by #SID, as 3 or 4 digits. #RID takes it up.
+ * Returns false for an ID past the last bitmap page, which could never fire. */
+static bool uart_store_board_id(const void *digits, int len)
+{
+    // Parse the board id buffer
+    char board_id[5];
+    memset(board_id, 0, 5);
+    memcpy(board_id, digits, len);
+    ESP_LOGI(TAG, "board_id: %s", board_id);
+
+    int id = atoi(board_id);
+    if (id >= BEASTSQUIB_MAX_BOARDS)
+    {
+        return false;
+    }
+    rx_config.board_id = id;
+    rx_config_save();
+    return true;
+}
+
+/* Writes the serial link counters as a single #UST line. */
+static void uart_report_uart_stats(void)
+{
+    char line[160];
+    int len = snprintf(line, sizeof(line),
+                       "#UST,ok=%u,unknown=%u,format=%u,overlong=%u,interrupted=%u,frames=%u,naks=%u;\r\n",
+                       (unsigned)uart_stats.ok,
+                       (unsigned)uart_stats.unknown,
+                       (unsigned)uart_stats.format,
+                       (unsigned)uart_stats.overlong,
+                       (unsigned)uart_stats.interrupted,
+                       (unsigned)uart_stats.frames,
+                       (unsigned)uart_stats.naks);
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes the receive path counters and latency histograms as #LAT lines:
+ * one with the counters, then one per stage with the count, the longest
+ * time in cycles and the bucket counts up to the last non-empty one.
+ * clear starts the histograms again. */
+static void uart_report_latency(bool clear)
+{
+    static const char *const stage_names[BEASTSQUIB_LATENCY_MAX] = { "admit", "wake", "handle", "fire" };
+    char line[256];
+    int len = snprintf(line, sizeof(line),
+                       "#LAT,cpu=%u,ok=%u,crc=%u,magic=%u,ring_full=%u,ring_peak=%u,overwritten=%u,silence=%u;\r\n",
+                       (unsigned)CONFIG_ESP8266_DEFAULT_CPU_FREQ_MHZ,
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_ADMIT],
+                       (unsigned)rx_stats.crc_fail,
+                       (unsigned)rx_stats.admit[BEASTSQUIB_RX_REJECT_MAGIC],
+                       (unsigned)rx_stats.ring_full,
+                       (unsigned)rx_stats.ring_peak,
+                       (unsigned)rx_stats.state_overwritten,
+                       (unsigned)rx_stats.silence_disarms);
+    uart_write_bytes(EX_UART_NUM, line, len);
+
+    for (int stage = 0; stage < BEASTSQUIB_LATENCY_MAX; stage ++)
+    {
+        beastsquib_latency_hist_t hist = rx_latency[stage];
+        int used = BEASTSQUIB_LATENCY_BUCKETS;
+        while (used > 1 && hist.bucket[used - 1] == 0)
+        {
+            used --;
+        }
+
+        len = snprintf(line, sizeof(line), "#LAT,%s,n=%u,max=%u,", stage_names[stage],
+                       (unsigned)hist.count, (unsigned)hist.max);
+        for (int i = 0; i < used; i ++)
+        {
+            len += snprintf(line + len, sizeof(line) - len, (i == 0) ? "%u" : ".%u", (unsigned)hist.bucket[i]);
+        }
+        len += snprintf(line + len, sizeof(line) - len, ";\r\n");
+        uart_write_bytes(EX_UART_NUM, line, len);
+    }
+
+    if (clear)
+    {
+        memset(rx_latency, 0, sizeof(rx_latency));
+    }
+}
+
+/* Writes the timer interrupt count and the time the radio slept as a #PWR
+ * line, with an estimate of the average current from the datasheet
+ * figures. */
+static void uart_report_power(void)
+{
+    beastsquib_power_stats_t power = rx_power;
+    uint32_t uptime_ms = rx_ticks_now();
+    uint32_t sleep_ms = (power.radio_sleep_ms < uptime_ms) ? power.radio_sleep_ms : uptime_ms;
+    uint32_t on_ms = uptime_ms - sleep_ms;
+    uint32_t uptime_s = (uptime_ms > 1000) ? uptime_ms / 1000 : 1;
+    uint32_t radio_on = (uptime_ms > 0) ? (uint32_t)((uint64_t)on_ms * 100 / uptime_ms) : 100;
+    uint32_t est_ma = (uptime_ms > 0) ?
+        (uint32_t)(((uint64_t)on_ms * BEASTSQUIB_POWER_RX_MA + (uint64_t)sleep_ms * BEASTSQUIB_POWER_MODEM_SLEEP_MA) / uptime_ms) :
+        BEASTSQUIB_POWER_RX_MA;
+    char line[192];
+#ifdef CONFIG_ESPNOW_LOW_POWER
+    int low_power = 1;
+#else
+    int low_power = 0;
+#endif
+    int len = snprintf(line, sizeof(line),
+                       "#PWR,low_power=%d,uptime=%u,irqs=%u,irq_per_s=%u,sleeps=%u,sleep_ms=%u,radio_on=%u,est_ma=%u;\r\n",
+                       low_power,
+                       (unsigned)uptime_ms,
+                       (unsigned)power.timer_irqs,
+                       (unsigned)(power.timer_irqs / uptime_s),
+                       (unsigned)power.radio_sleeps,
+                       (unsigned)sleep_ms,
+                       (unsigned)radio_on,
+                       (unsigned)est_ma);
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes why the board last reset and the boot profile as a single #BPR
+ * line: each stage as its start and length in us since reset, or - if it
+ * has not finished. */
+static void uart_report_boot(void)
+{
+    static const char *const reset_names[] = {
+        "unknown", "poweron", "ext", "sw", "panic", "int_wdt", "task_wdt", "wdt", "deepsleep", "brownout", "sdio",
+    };
+    esp_reset_reason_t reason = esp_reset_reason();
+    char line[320];
+    int len = snprintf(line, sizeof(line), "#BPR,reset=%s",
+                       ((unsigned)reason < sizeof(reset_names) / sizeof(reset_names[0])) ? reset_names[reason] : "other");
+
+    for (int stage = 0; stage < BEASTSQUIB_BOOT_MAX; stage ++)
+    {
+        uint32_t begin_us = beastsquib_boot.begin_us[stage];
+        uint32_t end_us = beastsquib_boot.end_us[stage];
+
+        if (end_us == 0)
+        {
+            len += snprintf(line + len, sizeof(line) - len, ",%s=-", beastsquib_boot_stage_names[stage]);
+        }
+        else
+        {
+            len += snprintf(line + len, sizeof(line) - len, ",%s=%u+%u", beastsquib_boot_stage_names[stage],
+                            (unsigned)begin_us, (unsigned)(end_us - begin_us));
+        }
+    }
+    len += snprintf(line + len, sizeof(line) - len, ";\r\n");
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes the transmitter group as a single #TXG line: on a transmitter its
+ * ID, whether it is on duty and the frames heard from each other ID, on a
+ * receiver the frames applied from each ID. */
+static void uart_report_group(void)
+{
+    char line[256];
+    int len;
+#ifdef TX
+    portENTER_CRITICAL();
+    beastsquib_standby_t sb = tx_standby;
+    uint32_t epoch = tx_epoch;
+    uint32_t seq = tx_seq;
+    portEXIT_CRITICAL();
+    const uint32_t *frames = sb.frames;
+#ifdef CONFIG_ESPNOW_STANDBY
+    int standby = 1;
+#else
+    int standby = 0;
+#endif
+
+    len = snprintf(line, sizeof(line), "#TXG,id=%u,standby=%d,duty=%d,takeovers=%u,handovers=%u,holds=%u,epoch=%u,seq=%u",
+                   (unsigned)sb.id, standby, sb.on_duty ? 1 : 0, (unsigned)sb.takeovers, (unsigned)sb.handovers,
+                   (unsigned)sb.holds, (unsigned)epoch, (unsigned)seq);
+#else
+    const uint32_t *frames = rx_stats.from_tx;
+
+    len = snprintf(line, sizeof(line), "#TXG,epoch=%u,seq=%u", (unsigned)rx_seq.epoch, (unsigned)rx_seq.seq);
+#endif
+    for (int id = 0; id < BEASTSQUIB_MAX_TX; id ++)
+    {
+        len += snprintf(line + len, sizeof(line) - len, ",tx%d=%u", id, (unsigned)frames[id]);
+    }
+    len += snprintf(line + len, sizeof(line) - len, ";\r\n");
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes the channels the game is spread over as #CHS lines: first the
+ * channel the radio is on, how often the receiver changed channel and
+ * scanned, then for each channel the frames sent or heard, those missed
+ * while listening and how long the receiver listened there. */
+static void uart_report_channels(void)
+{
+    beastsquib_channels_t ch;
+    char line[128];
+    int len;
+
+    portENTER_CRITICAL();
+    ch = espnow_channels;
+    uint8_t tuned = espnow_channel_tuned;
+    portEXIT_CRITICAL();
+    ch.stats[ch.current].listen_ms += rx_ticks_now() - ch.since;
+
+    len = snprintf(line, sizeof(line), "#CHS,count=%u,hop=%d,locked=%d,channel=%u,switches=%u,scans=%u;\r\n",
+                   (unsigned)ch.count, ch.hop ? 1 : 0, ch.locked ? 1 : 0, (unsigned)tuned, (unsigned)ch.switches,
+                   (unsigned)ch.scans);
+    uart_write_bytes(EX_UART_NUM, line, len);
+
+    for (int i = 0; i < ch.count; i ++)
+    {
+        len = snprintf(line, sizeof(line), "#CHS,%u,frames=%u,lost=%u,listen_ms=%u;\r\n", (unsigned)ch.channel[i],
+                       (unsigned)ch.stats[i].frames, (unsigned)ch.stats[i].lost, (unsigned)ch.stats[i].listen_ms);
+        uart_write_bytes(EX_UART_NUM, line, len);
+    }
+}
+
+/* Switches trace streaming on or off and writes whether it is on, the
+ * records made since boot and those dropped because the UART fell behind
+ * as a #TRC line. A build without CONFIG_ESPNOW_TRACE always says off. */
+static void uart_report_trace(int enable)
+{
+    uint32_t made = 0, dropped = 0;
+    bool on = false;
+    char line[64];
+
+#ifdef CONFIG_ESPNOW_TRACE
+    if (enable >= 0)
+    {
+        trace_enabled = enable != 0;
+    }
+    portENTER_CRITICAL();
+    made = trace_made;
+    dropped = trace_dropped;
+    portEXIT_CRITICAL();
+    on = trace_enabled;
+#endif
+
+    int len = snprintf(line, sizeof(line), "#TRC,on=%d,made=%u,dropped=%u;\r\n", on ? 1 : 0, (unsigned)made,
+                       (unsigned)dropped);
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Flight recorder copies, used by the UART task only. */
+static beastsquib_log_entry_t uart_log_copy[CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE];
+static beastsquib_log_entry_t uart_log_isr_copy[BEASTSQUIB_LOG_ISR_SIZE];
+
+/* Copies the events still in a ring, oldest first, leaving out any the
+ * writer overwrote during the copy and the slot it may be writing next.
+ * Returns how many it copied. */
+static uint32_t rx_log_copy(beastsquib_log_entry_t *out, const beastsquib_log_entry_t *ring,
+                            const volatile uint32_t *head, uint32_t size)
+{
+    uint32_t end = *head;
+    uint32_t start = (end > size) ? end - size : 0;
+
+    __sync_synchronize();
+    for (uint32_t n = start; n < end; n ++)
+    {
+        out[n - start] = ring[n & (size - 1)];
+    }
+    __sync_synchronize();
+
+    // The writer may be part way through the event after its head, too
+    uint32_t now = *head + 1;
+    uint32_t first = (now > size) ? now - size : 0;
+    if (first <= start)
+    {
+        return end - start;
+    }
+    if (first >= end)
+    {
+        return 0;
+    }
+    memmove(out, out + (first - start), (end - first) * sizeof(*out));
+    return end - first;
+}
+
+/* Writes one flight recorder event as a line. */
+static int rx_log_format(char *line, int size, const char *name, const beastsquib_log_entry_t *entry)
+{
+    static const char *const frame_results[] = { "applied", "stale", "crc" };
+    int len = snprintf(line, size, "#%s,%u,", name, (unsigned)entry->ticks);
+
+    switch (entry->type)
+    {
+        case BEASTSQUIB_LOG_BOOT:
+            len += snprintf(line + len, size - len, "boot,%i", (int)entry->value);
+            break;
+        case BEASTSQUIB_LOG_FRAME:
+            len += snprintf(line + len, size - len, "frame,%s,%u,%u",
+                            frame_results[entry->result < 3 ? entry->result : BEASTSQUIB_LOG_FRAME_CRC],
+                            (unsigned)entry->detail, (unsigned)entry->value);
+            break;
+        case BEASTSQUIB_LOG_ARMED:
+            len += snprintf(line + len, size - len, "armed");
+            break;
+        case BEASTSQUIB_LOG_DISARMED:
+            len += snprintf(line + len, size - len, entry->result ? "disarmed,silence" : "disarmed");
+            break;
+        case BEASTSQUIB_LOG_SCHEDULED:
+            len += snprintf(line + len, size - len, "scheduled,%u", (unsigned)entry->value);
+            break;
+        case BEASTSQUIB_LOG_DETONATE:
+            len += snprintf(line + len, size - len, entry->result ? "detonate,scheduled" : "detonate");
+            break;
+        case BEASTSQUIB_LOG_REVIVE:
+            len += snprintf(line + len, size - len, "revive");
+            break;
+        case BEASTSQUIB_LOG_SILENCE:
+            len += snprintf(line + len, size - len, "silence");
+            break;
+        default:
+            len += snprintf(line + len, size - len, "unknown,%u", (unsigned)entry->type);
+            break;
+    }
+    len += snprintf(line + len, size - len, ";\r\n");
+    return len;
+}
+
+/* Writes the events of both rings in the order they happened, one line
+ * each, then the number written. */
+static void uart_report_log(const char *name, uint32_t count, uint32_t isr_count)
+{
+    char line[64];
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    while (a < count || b < isr_count)
+    {
+        const beastsquib_log_entry_t *entry;
+        if (b == isr_count || (a < count && (int32_t)(uart_log_copy[a].ticks - uart_log_isr_copy[b].ticks) <= 0))
+        {
+            entry = &uart_log_copy[a ++];
+        }
+        else
+        {
+            entry = &uart_log_isr_copy[b ++];
+        }
+        int len = rx_log_format(line, sizeof(line), name, entry);
+        uart_write_bytes(EX_UART_NUM, line, len);
+    }
+
+    int len = snprintf(line, sizeof(line), "#%s,end,%u;\r\n", name, (unsigned)(count + isr_count));
+    uart_write_bytes(EX_UART_NUM, line, len);
+}
+
+/* Writes the flight recorder as #FLR lines. */
+static void uart_report_flight_recorder(void)
+{
+    uint32_t count = rx_log_copy(uart_log_copy, rx_log, &rx_log_head, CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE);
+    uint32_t isr_count = rx_log_copy(uart_log_isr_copy, rx_log_isr, &rx_log_isr_head, BEASTSQUIB_LOG_ISR_SIZE);
+
+    uart_report_log("FLR", count, isr_count);
+}
+
+static void rx_log_reverse(beastsquib_log_entry_t *entries, uint32_t count)
+{
+    for (uint32_t i = 0; i < count / 2; i ++)
+    {
+        beastsquib_log_entry_t held = entries[i];
+        entries[i] = entries[count - 1 - i];
+        entries[count - 1 - i] = held;
+    }
+}
+
+/* Puts a ring read back from flash in order, oldest first, in place.
+ * Leaves out the slot an interrupt may have been writing, as rx_log_copy
+ * does. Returns how many events are left. */
+static uint32_t rx_log_unwrap(beastsquib_log_entry_t *ring, uint32_t head, uint32_t size)
+{
+    if (head <= size)
+    {
+        return head;
+    }
+
+    // Rotate left so the oldest slot comes first, then drop it
+    uint32_t shift = head & (size - 1);
+    rx_log_reverse(ring, shift);
+    rx_log_reverse(ring + shift, size - shift);
+    rx_log_reverse(ring, size);
+    memmove(ring, ring + 1, (size - 1) * sizeof(*ring));
+    return size - 1;
+}
+
+/* Writes the flight recorder saved on the first detonation as #FLS lines. */
+static void uart_report_flight_snapshot(void)
+{
+    beastsquib_log_snapshot_t header;
+    FILE* f = fopen(BEASTSQUIB_LOG_SNAPSHOT_PATH, "rb");
+    bool ok = false;
+
+    if (f != NULL)
+    {
+        ok = fread(&header, sizeof(header), 1, f) == 1 &&
+             header.magic == BEASTSQUIB_LOG_SNAPSHOT_MAGIC &&
+             header.size == CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE && header.isr_size == BEASTSQUIB_LOG_ISR_SIZE &&
+             fread(uart_log_copy, sizeof(uart_log_copy), 1, f) == 1 &&
+             fread(uart_log_isr_copy, sizeof(uart_log_isr_copy), 1, f) == 1;
+        fclose(f);
+    }
+    if (!ok)
+    {
+        uart_write_bytes(EX_UART_NUM, "#FLS,none;\r\n", 12);
+        return;
+    }
+
+    uint32_t count = rx_log_unwrap(uart_log_copy, header.head, CONFIG_ESPNOW_FLIGHT_RECORDER_SIZE);
+    uint32_t isr_count = rx_log_unwrap(uart_log_isr_copy, header.isr_head, BEASTSQUIB_LOG_ISR_SIZE);
+    uart_report_log("FLS", count, isr_count);
+}
+
+/* Writes which boards of one bitmap page reported being detonated, and
+ * which reported at all, in this status round or the last, as #CFM with
+ * two bitmaps laid out like #DEP, then the number of status slots: boards
+ * from that ID on have no slot and never report. */
+static void uart_report_confirmed(int page)
+{
+#ifdef TX
+    static const char digits[] = "0123456789abcdef";
+    uint8_t confirmed[BEASTSQUIB_PAGE_BYTES];
+    uint8_t heard[BEASTSQUIB_PAGE_BYTES];
+    char line[24 + 4 * BEASTSQUIB_PAGE_BYTES];
+    uint16_t round = tx_status_round();
+
+    memset(confirmed, 0, sizeof(confirmed));
+    memset(heard, 0, sizeof(heard));
+    for (int i = 0; i < BEASTSQUIB_PAGE_BITS; i ++)
+    {
+        int id = page * BEASTSQUIB_PAGE_BITS + i;
+        if (id >= CONFIG_ESPNOW_STATUS_SLOTS)
+        {
+            break;
+        }
+
+        beastsquib_status_entry_t entry = tx_status[id];
+        if (beastsquib_status_recent(&entry, round))
+        {
+            heard[i / 8] |= 1 << (i % 8);
+            if (entry.flags & BEASTSQUIB_STATUS_DETONATED)
+            {
+                confirmed[i / 8] |= 1 << (i % 8);
+            }
+        }
+    }
+
+    int len = snprintf(line, sizeof(line), "#CFM,%i,", page);
+    for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++)
+    {
+        line[len ++] = digits[confirmed[i] >> 4];
+        line[len ++] = digits[confirmed[i] & 0xf];
+    }
+    line[len ++] = ',';
+    for (int i = 0; i < BEASTSQUIB_PAGE_BYTES; i ++)
+    {
+        line[len ++] = digits[heard[i] >> 4];
+        line[len ++] = digits[heard[i] & 0xf];
+    }
+    len += snprintf(line + len, sizeof(line) - len, ",%i;\r\n", CONFIG_ESPNOW_STATUS_SLOTS);
+    uart_write_bytes(EX_UART_NUM, line, len);
+#endif
+}
+
+/* Writes the last status report from one board as #BST. rounds is the
+ * number of status rounds since it arrived; current is whether the board
+ * had applied a frame sent after the latest state change. Boards without
+ * a status slot reply noslot. */
+static void uart_report_board_status(int id)
+{
+#ifdef TX
+    char line[96];
+    int len;
+
+    if (id >= CONFIG_ESPNOW_STATUS_SLOTS)
+    {
+        len = snprintf(line, sizeof(line), "#BST,%04i,noslot;\r\n", id);
+    }
+    else if (!(tx_status[id].flags & BEASTSQUIB_STATUS_HEARD))
+    {
+        len = snprintf(line, sizeof(line), "#BST,%04i,none;\r\n", id);
+    }
+    else
+    {
+        beastsquib_status_entry_t entry = tx_status[id];
+        len = snprintf(line, sizeof(line),
+                       "#BST,%04i,rounds=%u,armed=%i,detonated=%i,pending=%i,current=%i,link=%u;\r\n",
+                       id,
+                       (unsigned)(uint16_t)(tx_status_round() - entry.round),
+                       (entry.flags & BEASTSQUIB_STATUS_ARMED) != 0,
+                       (entry.flags & BEASTSQUIB_STATUS_DETONATED) != 0,
+                       (entry.flags & BEASTSQUIB_STATUS_FIRE_PENDING) != 0,
+                       entry.seq != 0 && entry.seq >= tx_status_change_seq,
+                       (unsigned)entry.link);
+    }
+    uart_write_bytes(EX_UART_NUM, line, len);
+#endif
+}
+
+/* Whether field i of the command has one of the given lengths and only
+ * the given kind of characters. */
+static bool uart_field_is(const beastsquib_uart_parser_t *parser, int i, uint8_t flags, int min_len, int max_len)
+{
+    return i < parser->field_count && (parser->field_flags[i] & flags) == flags &&
+           parser->field_len[i] >= min_len && parser->field_len[i] <= max_len;
+}
+
+/* Runs a complete command. Returns false if its fields do not match its name. */
+static bool uart_command_run(beastsquib_uart_parser_t *parser)
+{
+    const char *name = parser->text;
+    int fields = parser->field_count;
+
+    // #SID,000; or #SID,0000;
+    if (memcmp(name, "SID", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 3, 4) ||
+            !uart_store_board_id(parser->text + parser->field_start[0], parser->field_len[0]))
+        {
+            return false;
+        }
+    }
+    // #RID,;
+    else if (memcmp(name, "RID", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        read_board_id_cb();
+    }
+    // #RXS,;
+    else if (memcmp(name, "RXS", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_rx_stats();
+    }
+    // #UST,;
+    else if (memcmp(name, "UST", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_uart_stats();
+    }
+    // #FLR,;
+    else if (memcmp(name, "FLR", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_flight_recorder();
+    }
+    // #FLS,;
+    else if (memcmp(name, "FLS", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_flight_snapshot();
+    }
+    // #LAT,; or #LAT,1; to clear the histograms after reading them
+    else if (memcmp(name, "LAT", 3) == 0)
+    {
+        if (fields != 1 || (parser->field_len[0] != 0 &&
+            (!uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) || parser->field_value[0] != 1)))
+        {
+            return false;
+        }
+        uart_report_latency(parser->field_len[0] != 0);
+    }
+    // #BPR,;
+    else if (memcmp(name, "BPR", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_boot();
+    }
+    // #TXG,;
+    else if (memcmp(name, "TXG", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_group();
+    }
+    // #CHS,;
+    else if (memcmp(name, "CHS", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_channels();
+    }
+    // #TRC,; or #TRC,1; to stream frames, #TRC,0; to stop
+    else if (memcmp(name, "TRC", 3) == 0)
+    {
+        if (fields != 1 || (parser->field_len[0] != 0 &&
+            (!uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) || parser->field_value[0] > 1)))
+        {
+            return false;
+        }
+        uart_report_trace((parser->field_len[0] != 0) ? (int)parser->field_value[0] : -1);
+    }
+    // #PWR,;
+    else if (memcmp(name, "PWR", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        uart_report_power();
+    }
+    // #RLY,1;
+    else if (memcmp(name, "RLY", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) ||
+            parser->field_value[0] > 1)
+        {
+            return false;
+        }
+        uart_store_relay(parser->field_value[0] == 1);
+    }
+    // #TXA,240ac4000001;
+    else if (memcmp(name, "TXA", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_HEX, 2 * ESP_NOW_ETH_ALEN, 2 * ESP_NOW_ETH_ALEN))
+        {
+            return false;
+        }
+
+        int count = tx_allowlist_count;
+        if (count < ESPNOW_TX_ALLOWLIST_SIZE)
+        {
+            memcpy(tx_allowlist[count], parser->hex, ESP_NOW_ETH_ALEN);
+            tx_allowlist_count = count + 1;
+            ESP_LOGI(TAG, "tx allowlist: " MACSTR, MAC2STR(tx_allowlist[count]));
+        }
+        else
+        {
+            ESP_LOGE(TAG, "tx allowlist full");
+        }
+    }
+    // #TXC,;
+    else if (memcmp(name, "TXC", 3) == 0)
+    {
+        if (fields != 1 || parser->field_len[0] != 0)
+        {
+            return false;
+        }
+        tx_allowlist_count = 0;
+        ESP_LOGI(TAG, "tx allowlist cleared");
+    }
+    // #TXS,03,010,0100;
+    else if (memcmp(name, "TXS", 3) == 0)
+    {
+        if (fields != 3 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 2, 2) ||
+            !uart_field_is(parser, 1, BEASTSQUIB_UART_FIELD_DECIMAL, 3, 3) ||
+            !uart_field_is(parser, 2, BEASTSQUIB_UART_FIELD_DECIMAL, 4, 4))
+        {
+            return false;
+        }
+
+        if (parser->field_value[0] >= 1 && parser->field_value[2] >= 10)
+        {
+            tx_timing.burst_count = parser->field_value[0];
+            tx_timing.burst_spacing_ms = parser->field_value[1];
+            tx_timing.heartbeat_ms = parser->field_value[2];
+        }
+
+        char line[32];
+        int len = snprintf(line, sizeof(line), "#TXS,%02u,%03u,%04u;\r\n",
+                           tx_timing.burst_count, tx_timing.burst_spacing_ms, tx_timing.heartbeat_ms);
+        uart_write_bytes(EX_UART_NUM, line, len);
+    }
+    // #DLY,0100;
+    else if (memcmp(name, "DLY", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 4, 4))
+        {
+            return false;
+        }
+        tx_detonate_delay_ms = parser->field_value[0];
+
+        char line[16];
+        int len = snprintf(line, sizeof(line), "#DLY,%04u;\r\n", tx_detonate_delay_ms);
+        uart_write_bytes(EX_UART_NUM, line, len);
+    }
+    // #TID,000; or #TID,0000;
+    else if (memcmp(name, "TID", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 3, 4))
+        {
+            return false;
+        }
+        test_board_id = parser->field_value[0];
+        ESP_LOGI(TAG, "test_board_id: %i", test_board_id);
+    }
+    // #CFM,0;
+    else if (memcmp(name, "CFM", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) ||
+            parser->field_value[0] >= BEASTSQUIB_MAX_PAGES)
+        {
+            return false;
+        }
+        uart_report_confirmed(parser->field_value[0]);
+    }
+    // #BST,000; or #BST,0000;
+    else if (memcmp(name, "BST", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 3, 4))
+        {
+            return false;
+        }
+        uart_report_board_status(parser->field_value[0]);
+    }
+    // #ARM,0;
+    else if (memcmp(name, "ARM", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) ||
+            parser->field_value[0] > 1)
+        {
+            return false;
+        }
+        tx_state_set_armed(parser->field_value[0]);
+        ESP_LOGI(TAG, "global_armed_state: %i", global_tx_data.armed);
+    }
+    // #DET,<128 hex digits>; sets the first page
+    else if (memcmp(name, "DET", 3) == 0)
+    {
+        if (fields != 1 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_HEX, 2 * BEASTSQUIB_PAGE_BYTES, 2 * BEASTSQUIB_PAGE_BYTES))
+        {
+            return false;
+        }
+        tx_state_set_pyro_page(0, parser->hex);
+        ESP_LOGI(TAG, "updated pyro data");
+    }
+    // #DEP,0,<128 hex digits>; sets any page
+    else if (memcmp(name, "DEP", 3) == 0)
+    {
+        if (fields != 2 || !uart_field_is(parser, 0, BEASTSQUIB_UART_FIELD_DECIMAL, 1, 1) ||
+            parser->field_value[0] >= BEASTSQUIB_MAX_PAGES ||
+            !uart_field_is(parser, 1, BEASTSQUIB_UART_FIELD_HEX, 2 * BEASTSQUIB_PAGE_BYTES, 2 * BEASTSQUIB_PAGE_BYTES))
+        {
+            return false;
+        }
+        tx_state_set_pyro_page(parser->field_value[0], parser->hex);
+        ESP_LOGI(TAG, "updated pyro page %i", parser->field_value[0]);
+    }
+    else
+    {
+        uart_stats.unknown ++;
+        return true;
+    }
+
+    uart_stats.ok ++;
+    return true;
+}
+
+/* Feeds one received byte to the command parser. */
+static void uart_parser_feed_byte(beastsquib_uart_parser_t *parser, uint8_t c)
+{
+    if (c == '#')
+    {
+        if (parser->active)
+        {
+            uart_stats.interrupted ++;
+        }
+        parser->active = true;
+        parser->bad = false;
+        parser->len = 0;
+        parser->field_count = 0;
+        return;
+    }
+
+    if (!parser->active)
+    {
+        return;
+    }
+
+    if (c == ';')
+    {
+        parser->active = false;
+        if (parser->len < 3 || parser->bad || !uart_command_run(parser))
+        {
+            uart_stats.format ++;
+        }
+        return;
+    }
+
+    if (parser->len == sizeof(parser->text))
+    {
+        parser->active = false;
+        uart_stats.overlong ++;
+        return;
+    }
+
+    uint8_t len = parser->len ++;
+    parser->text[len] = c;
+
+    // The three letter name, then fields after a ',' each
+    if (len < 3)
+    {
+        return;
+    }
+
+    if (c == ',')
+    {
+        if (parser->field_count == BEASTSQUIB_UART_MAX_FIELDS)
+        {
+            parser->bad = true;
+            return;
+        }
+
+        int i = parser->field_count ++;
+        parser->field_start[i] = len + 1;
+        parser->field_len[i] = 0;
+        parser->field_value[i] = 0;
+        parser->field_flags[i] = BEASTSQUIB_UART_FIELD_DECIMAL | BEASTSQUIB_UART_FIELD_HEX;
+        return;
+    }
+
+    if (parser->field_count == 0)
+    {
+        parser->bad = true;
+        return;
+    }
+
+    int i = parser->field_count - 1;
+    int nibble = -1;
+    if (c >= '0' && c <= '9')
+    {
+        nibble = c - '0';
+        parser->field_value[i] = parser->field_value[i] * 10 + nibble;
+    }
+    else
+    {
+        parser->field_flags[i] &= ~BEASTSQUIB_UART_FIELD_DECIMAL;
+        if (c >= 'a' && c <= 'f')
+        {
+            nibble = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            nibble = c - 'A' + 10;
+        }
+    }
+
+    if (nibble < 0)
+    {
+        parser->field_flags[i] &= ~BEASTSQUIB_UART_FIELD_HEX;
+    }
+    else if (parser->field_len[i] < 2 * BEASTSQUIB_PAGE_BYTES)
+    {
+        uint8_t *byte = &parser->hex[parser->field_len[i] / 2];
+        *byte = (parser->field_len[i] % 2 == 0) ? (nibble << 4) : (*byte | nibble);
+    }
+    parser->field_len[i] ++;
+}
+
+/* Feeds received UART bytes through the command parser. */
+static void uart_command_feed(const uint8_t *dtmp, size_t size)
+{
+    for (size_t i = 0; i < size; i ++)
+    {
+        uart_parser_feed_byte(&uart_parser, dtmp[i]);
+    }
+}
+
+/* COBS encodes len bytes into dst, which needs room for len + len / 254 + 1
+ * bytes. Returns the encoded length. */
+static int uart_cobs_encode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int code_at = 0;
+    int out = 1;
+    uint8_t code = 1;
+
+    for (int i = 0; i < len; i ++)
     {
-        ESP_LOGI(TAG, "byte 0x%02x", *(uint8_t *)(bits_list + i));
+        if (src[i] == 0)
+        {
+            dst[code_at] = code;
+            code_at = out ++;
+            code = 1;
+            continue;
+        }
+
+        dst[out ++] = src[i];
+        if (++ code == 0xFF)
+        {
+            dst[code_at] = code;
+            code_at = out ++;
+            code = 1;
+        }
     }
-}
+    dst[code_at] = code;
 
-/* Called when a broadcast packet is received. */
-static void espnow_broadcast_packet_recv_cb(beastsquib_espnow_data_t *data) {
-#ifdef RX
-    // ESP_LOGI(TAG, "idx '%d'", data[0]);
+    return out;
+}
 
-    // ESP_LOGI(TAG, "armed_bits: ");
-    // print_bytes(data->armed_bits);
-    // ESP_LOGI(TAG, "pyro_bits: ");
-    // print_bytes(data->pyro_bits);
+/* Decodes a COBS block in place. Returns the decoded length, or -1 if the
+ * block is malformed. */
+static int uart_cobs_decode(uint8_t *buf, int len)
+{
+    int in = 0;
+    int out = 0;
 
-    // Gets armed bit associated with this board ID
-    if (data->armed == 1)
+    while (in < len)
     {
-        ESP_LOGI(TAG, "ARMED");
-        SET_ARMED();
-    }
-    else
-    {
-        SET_DISARMED();
+        uint8_t code = buf[in ++];
+        if (code == 0 || in + code - 1 > len)
+        {
+            return -1;
+        }
+
+        for (int i = 1; i < code; i ++)
+        {
+            buf[out ++] = buf[in ++];
+        }
+        if (code != 0xFF && in < len)
+        {
+            buf[out ++] = 0;
+        }
     }
 
-    if (get_bit(data->pyro_bits))
+    return out;
+}
+
+/* Answers a binary frame with an ACK, or a NAK giving the reason. */
+static void uart_frame_reply(uint8_t seq, beastsquib_uart_nak_t reason)
+{
+    uint8_t raw[5];
+    uint8_t out[8];
+    int len = 0;
+
+    if (reason != BEASTSQUIB_UART_NAK_NONE)
     {
-        ESP_LOGI(TAG, "DETONATE");
-        DETONATE();
+        uart_stats.naks ++;
     }
-    else
+
+    raw[len ++] = seq;
+    raw[len ++] = (reason == BEASTSQUIB_UART_NAK_NONE) ? BEASTSQUIB_UART_ACK : BEASTSQUIB_UART_NAK;
+    if (reason != BEASTSQUIB_UART_NAK_NONE)
     {
-        REVIVE();
+        raw[len ++] = reason;
     }
-#endif
+    uint16_t crc = crc16_le(UINT16_MAX, raw, len);
+    raw[len ++] = crc & 0xFF;
+    raw[len ++] = crc >> 8;
+
+    int out_len = 0;
+    out[out_len ++] = 0;
+    out_len += uart_cobs_encode(raw, len, out + out_len);
+    out[out_len ++] = 0;
+    uart_write_bytes(EX_UART_NUM, (const char *)out, out_len);
 }
 
-static void beastsquib_espnow_task(void *pvParameter)
+#ifdef CONFIG_ESPNOW_TRACE
+/* Streams the trace ring to the server, one BEASTSQUIB_UART_TRACE frame per
+ * record. It runs below the radio tasks, so it only takes the CPU they
+ * leave. */
+static void trace_task(void *pvParameter)
 {
-    beastsquib_espnow_event_t evt;
+    static uint8_t raw[2 + 1 + sizeof(uint32_t) + sizeof(((beastsquib_trace_entry_t *)0)->data) + 2];
+    static uint8_t out[sizeof(raw) + sizeof(raw) / 254 + 3];
 
-    while (xQueueReceive(beastsquib_espnow_queue, &evt, portMAX_DELAY) == pdTRUE) {
-        switch (evt.id) {
-            case BEASTSQUIB_ESPNOW_SEND_CB:
-            {
-                /* SENT DATA */
-                break;
-            }
-            case BEASTSQUIB_ESPNOW_RECV_CB:
-            {
-                /* RECEIVED DATA */
-                ticks_since_last_packet = 0;
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-                beastsquib_espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
-                if (beastsquib_validate_espnow_data_checksum(recv_cb->data, recv_cb->data_len) == 0)
-                {
-                    espnow_broadcast_packet_recv_cb(recv_cb->data);
-                }
+        while (trace_tail != trace_head)
+        {
+            const beastsquib_trace_entry_t *entry = &trace_ring[trace_tail % BEASTSQUIB_TRACE_RING];
+            int len = 0;
 
-                free(recv_cb->data);
+            raw[len ++] = entry->seq;
+            raw[len ++] = BEASTSQUIB_UART_TRACE;
+            raw[len ++] = entry->type;
+            memcpy(raw + len, &entry->time_us, sizeof(entry->time_us));
+            len += sizeof(entry->time_us);
+            memcpy(raw + len, entry->data, entry->len);
+            len += entry->len;
+            __sync_synchronize();
+            trace_tail ++;
 
-                break;
-            }
-            default:
-                ESP_LOGE(TAG, "Callback type error: %d", evt.id);
-                break;
+            uint16_t crc = crc16_le(UINT16_MAX, raw, len);
+            raw[len ++] = crc & 0xFF;
+            raw[len ++] = crc >> 8;
+
+            int out_len = 0;
+            out[out_len ++] = 0;
+            out_len += uart_cobs_encode(raw, len, out + out_len);
+            out[out_len ++] = 0;
+            uart_write_bytes(EX_UART_NUM, (const char *)out, out_len);
         }
     }
 }
+#endif
 
-static void beastsquib_espnow_deinit(beastsquib_espnow_send_param_t *send_param)
+/* Sets and clears board IDs listed in a DELTA frame, a page at a time. */
+static beastsquib_uart_nak_t uart_apply_delta(const uint8_t *entries, int count)
 {
-    free(send_param->buffer);
-    free(send_param);
-    vSemaphoreDelete(beastsquib_espnow_queue);
-    esp_now_deinit();
-}
-
-#ifdef TX
+    static uint8_t pages[BEASTSQUIB_MAX_PAGES][BEASTSQUIB_PAGE_BYTES];
+    uint8_t touched = 0;
 
-static void tx_transmit_task(void *pvParameter)
-{
-    while (1)
+    for (int i = 0; i < count; i ++)
     {
-        vTaskDelay(100 / portTICK_RATE_MS);
+        uint16_t id = (entries[2*i] | (entries[2*i + 1] << 8)) & ~BEASTSQUIB_UART_DELTA_CLEAR;
+        if (id >= BEASTSQUIB_MAX_BOARDS)
+        {
+            return BEASTSQUIB_UART_NAK_VALUE;
+        }
+    }
 
-        // ESP_LOGI(TAG, "ticks %d", ticks_since_last_packet);
+    portENTER_CRITICAL();
+    memcpy(pages, global_tx_data.pyro_bits, sizeof(pages));
+    portEXIT_CRITICAL();
 
-        beastsquib_espnow_send_param_t *send_param = (beastsquib_espnow_send_param_t *)pvParameter;
-        beastsquib_espnow_data_t *data = send_param->buffer;
+    for (int i = 0; i < count; i ++)
+    {
+        uint16_t entry = entries[2*i] | (entries[2*i + 1] << 8);
+        uint16_t id = entry & ~BEASTSQUIB_UART_DELTA_CLEAR;
+        uint8_t *byte = &pages[id / BEASTSQUIB_PAGE_BITS][(id % BEASTSQUIB_PAGE_BITS) / 8];
 
-        memcpy(data, &global_tx_data, sizeof(global_tx_data));
+        if (entry & BEASTSQUIB_UART_DELTA_CLEAR)
+        {
+            *byte &= ~(1 << (id % 8));
+        }
+        else
+        {
+            *byte |= 1 << (id % 8);
+        }
+        touched |= 1 << (id / BEASTSQUIB_PAGE_BITS);
+    }
 
-        /* Arm or disarm all the boards */
-        // data->armed = 1;
+    for (int page = 0; page < BEASTSQUIB_MAX_PAGES; page ++)
+    {
+        if (touched & (1 << page))
+        {
+            tx_state_set_pyro_page(page, pages[page]);
+        }
+    }
 
-        /* Trigger the test_board_id */
-        // uint8_t test_board_idx = test_board_id / 8;
-        // uint8_t test_board_offset = test_board_id % 8;
-        // data->pyro_bits[test_board_idx] = (1 << test_board_offset);
+    return BEASTSQUIB_UART_NAK_NONE;
+}
 
-        // ESP_LOGI(TAG, "armed_bits: ");
-        // print_bytes(data->armed_bits);
-        // ESP_LOGI(TAG, "pyro_bits: ");
-        // print_bytes(data->pyro_bits);
+/* Applies the command in a checked binary frame. */
+static beastsquib_uart_nak_t uart_frame_apply(uint8_t type, const uint8_t *payload, int len)
+{
+    switch (type)
+    {
+        case BEASTSQUIB_UART_ARM:
+            if (len != 1)
+            {
+                return BEASTSQUIB_UART_NAK_LENGTH;
+            }
+            if (payload[0] > 1)
+            {
+                return BEASTSQUIB_UART_NAK_VALUE;
+            }
+            tx_state_set_armed(payload[0]);
+            return BEASTSQUIB_UART_NAK_NONE;
 
-        // ESP_LOGI(TAG, "idx '%i', offset '%i'", (int)test_board_idx, (int)test_board_offset);
+        case BEASTSQUIB_UART_PAGE:
+            if (len != 1 + BEASTSQUIB_PAGE_BYTES)
+            {
+                return BEASTSQUIB_UART_NAK_LENGTH;
+            }
+            if (payload[0] >= BEASTSQUIB_MAX_PAGES)
+            {
+                return BEASTSQUIB_UART_NAK_VALUE;
+            }
+            tx_state_set_pyro_page(payload[0], payload + 1);
+            return BEASTSQUIB_UART_NAK_NONE;
 
-        beastsquib_espnow_data_prepare(send_param);
+        case BEASTSQUIB_UART_DELTA:
+            if (len % sizeof(uint16_t) != 0)
+            {
+                return BEASTSQUIB_UART_NAK_LENGTH;
+            }
+            return uart_apply_delta(payload, len / sizeof(uint16_t));
 
-        /* Send some data to the broadcast address. */
-        if (esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len) != ESP_OK) {
-            // Maybe WATCHDOG here?
-            ESP_LOGE(TAG, "send fail");
+        case BEASTSQUIB_UART_DELAY:
+        {
+            if (len != sizeof(uint16_t))
+            {
+                return BEASTSQUIB_UART_NAK_LENGTH;
+            }
+            uint16_t delay_ms = payload[0] | (payload[1] << 8);
+            if (delay_ms > 9999)
+            {
+                return BEASTSQUIB_UART_NAK_VALUE;
+            }
+            tx_detonate_delay_ms = delay_ms;
+            return BEASTSQUIB_UART_NAK_NONE;
         }
 
-        // ESP_LOGI(TAG, "sent data");
+        default:
+            return BEASTSQUIB_UART_NAK_TYPE;
     }
 }
 
-#endif
-
-static esp_err_t beastsquib_espnow_init(void)
+/* Checks, applies and answers one received binary frame, still COBS encoded.
+ * A repeat of the last frame applied (same seq and checksum, so the ACK was
+ * lost and the host sent it again) is only acknowledged. */
+static void uart_frame_handle(uint8_t *buf, int len)
 {
-    beastsquib_espnow_send_param_t *send_param;
-
-    beastsquib_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(beastsquib_espnow_event_t));
-    if (beastsquib_espnow_queue == NULL) {
-        ESP_LOGE(TAG, "Create mutex fail");
-        return ESP_FAIL;
+    int raw_len = uart_cobs_decode(buf, len);
+    if (raw_len < 4)
+    {
+        uart_frame_reply((raw_len > 0) ? buf[0] : 0, BEASTSQUIB_UART_NAK_CRC);
+        return;
     }
 
-    /* Initialize ESPNOW and register sending and receiving callback function. */
-    ESP_ERROR_CHECK( esp_now_init() );
-    ESP_ERROR_CHECK( esp_now_register_send_cb(beastsquib_espnow_send_cb) );
-    ESP_ERROR_CHECK( esp_now_register_recv_cb(beastsquib_espnow_recv_cb) );
-    ESP_ERROR_CHECK( esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK) );
-
-    /* Add broadcast peer information to peer list. */
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-    if (peer == NULL) {
-        ESP_LOGE(TAG, "Malloc peer information fail");
-        vSemaphoreDelete(beastsquib_espnow_queue);
-        esp_now_deinit();
-        return ESP_FAIL;
+    uint8_t seq = buf[0];
+    uint16_t crc = buf[raw_len - 2] | (buf[raw_len - 1] << 8);
+    if (crc16_le(UINT16_MAX, buf, raw_len - 2) != crc)
+    {
+        uart_frame_reply(seq, BEASTSQUIB_UART_NAK_CRC);
+        return;
     }
 
-    memset(peer, 0, sizeof(esp_now_peer_info_t));
-    peer->channel = CONFIG_ESPNOW_CHANNEL;
-    peer->ifidx = ESPNOW_WIFI_IF;
-    peer->encrypt = false;
-    memcpy(peer->peer_addr, beastsquib_broadcast_mac, ESP_NOW_ETH_ALEN);
-    ESP_ERROR_CHECK( esp_now_add_peer(peer) );
-    free(peer);
-
-    /* Initialize sending parameters. */
-    send_param = malloc(sizeof(beastsquib_espnow_send_param_t));
-    if (send_param == NULL) {
-        ESP_LOGE(TAG, "Malloc send parameter fail");
-        vSemaphoreDelete(beastsquib_espnow_queue);
-        esp_now_deinit();
-        return ESP_FAIL;
+    if (uart_frame_have_last && seq == uart_frame_last_seq && crc == uart_frame_last_crc)
+    {
+        uart_frame_reply(seq, BEASTSQUIB_UART_NAK_NONE);
+        return;
     }
-    memset(send_param, 0, sizeof(beastsquib_espnow_send_param_t));
-
-    // Configure dest mac, magic number, send length, and buffer
-    memcpy(send_param->dest_mac, beastsquib_broadcast_mac, ESP_NOW_ETH_ALEN);
-    send_param->magic = BEASTSQUIB_MAGIC_NUMBER;
-    send_param->len = 200;
-    send_param->buffer = malloc(200);
 
-    if (send_param->buffer == NULL) {
-        ESP_LOGE(TAG, "Malloc send buffer fail");
-        free(send_param);
-        vSemaphoreDelete(beastsquib_espnow_queue);
-        esp_now_deinit();
-        return ESP_FAIL;
+    beastsquib_uart_nak_t reason = uart_frame_apply(buf[1], buf + 2, raw_len - 4);
+    if (reason == BEASTSQUIB_UART_NAK_NONE)
+    {
+        uart_stats.frames ++;
+        uart_frame_have_last = true;
+        uart_frame_last_seq = seq;
+        uart_frame_last_crc = crc;
     }
-
-    xTaskCreate(beastsquib_espnow_task, "beastsquib_espnow_task", 2048, NULL, 4, NULL);
-  
-#ifdef TX
-    xTaskCreate(tx_transmit_task, "tx_transmit_task", 2048, send_param, 4, NULL);
-#endif
-
-    return ESP_OK;
+    uart_frame_reply(seq, reason);
 }
 
-#define EX_UART_NUM UART_NUM_0
-#define BUF_SIZE (1024)
-#define RD_BUF_SIZE (BUF_SIZE)
-static QueueHandle_t uart0_queue;
-char uart_command_buffer[128+6];
-
-static void read_board_id_cb(void)
+/* Takes binary frames out of received UART bytes and handles them. The
+ * remaining text is moved to the front of data for the ASCII commands;
+ * returns its length. A frame too long for the buffer is dropped whole. */
+static size_t uart_frame_feed(uint8_t *data, size_t size)
 {
-    // Check if destination file exists before reading
-    struct stat st;
-    if (stat("/spiffs/boardid.txt", &st) == 0) {
-        // Open renamed file for reading
-        ESP_LOGI(TAG, "Reading file");
-        FILE* f = fopen("/spiffs/boardid.txt", "r");
-        if (f == NULL) {
-            ESP_LOGE(TAG, "Failed to open file for reading");
-            return;
-        }
-        char line[64];
-        fgets(line, sizeof(line), f);
-        fclose(f);
-        // strip newline
-        char* pos = strchr(line, '\n');
-        if (pos) {
-            *pos = '\0';
-        }
+    size_t text_len = 0;
 
-        board_id = atoi(line);
-
-        ESP_LOGI(TAG, "board_id: '%i'", board_id);
-    }
-    else
+    for (size_t i = 0; i < size; i ++)
     {
-        ESP_LOGE(TAG, "No board_id file found");
+        uint8_t byte = data[i];
+
+        if (byte == 0)
+        {
+            // Closes a frame, or opens one if none is open (0x00 0x00 opens too)
+            if (uart_frame_open && uart_frame_len > 0)
+            {
+                uart_frame_handle(uart_frame_buf, uart_frame_len);
+                uart_frame_open = false;
+            }
+            else
+            {
+                uart_frame_open = true;
+            }
+            uart_frame_len = 0;
+        }
+        else if (uart_frame_open)
+        {
+            if (uart_frame_len < (int)sizeof(uart_frame_buf))
+            {
+                uart_frame_buf[uart_frame_len ++] = byte;
+            }
+            else
+            {
+                uart_frame_open = false;
+                uart_frame_len = 0;
+            }
+        }
+        else
+        {
+            data[text_len ++] = byte;
+        }
     }
+
+    return text_len;
 }
 
 static void uart_event_task(void *pvParameters)
 {
     uart_event_t event;
     uint8_t *dtmp = (uint8_t *) malloc(RD_BUF_SIZE);
+    size_t text_len;
 
     for (;;) {
         // Waiting for UART event.
@@ -461,84 +3948,10 @@ static void uart_event_task(void *pvParameters)
                 // other types of events. If we take too much time on data event, the queue might be full.
                 case UART_DATA:
                     uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-
-                    for (uint16_t i = 0; i < event.size; i ++)
-                    {
-                        memmove(uart_command_buffer, uart_command_buffer + 1, sizeof(uart_command_buffer) - 1);
-                        uart_command_buffer[sizeof(uart_command_buffer) - 1] = dtmp[i];
-
-                        void *end_buffer = uart_command_buffer + sizeof(uart_command_buffer) - 1;
-
-                        // #SID,000;
-                        if (memcmp(end_buffer-8, "#SID,", 4) == 0 && *(uint8_t *)end_buffer == ';')
-                        {
-                            // Parse the board id buffer
-                            char board_id[4];
-                            memset(board_id, 0, 4);
-                            memcpy(board_id, end_buffer-3, 3);
-                            ESP_LOGI(TAG, "board_id: %s", board_id);
-
-                            struct stat st;
-                            if (stat("/spiffs/boardid.txt", &st) == 0) {
-                                // Delete it if it exists
-                                unlink("/spiffs/boardid.txt");
-                            }
-
-                            ESP_LOGI(TAG, "Opening file");
-                            FILE* f = fopen("/spiffs/boardid.txt", "w");
-                            if (f == NULL) {
-                                ESP_LOGE(TAG, "Failed to open file for writing");
-                                return;
-                            }
-
-                            fprintf(f, "%s\n", board_id);
-                            fclose(f);
-                            ESP_LOGI(TAG, "File written");
-                        }
-                        
-                        // #RID,;
-                        if (memcmp(end_buffer-5, "#RID,", 4) == 0 && *(uint8_t *)end_buffer == ';')
-                        {
-                            read_board_id_cb();
-                        }
-
-                        // #TID,000;
-                        if (memcmp(end_buffer-8, "#TID,", 4) == 0 && *(uint8_t *)end_buffer == ';')
-                        {
-                            char board_id[4];
-                            memset(board_id, 0, 4);
-                            memcpy(board_id, end_buffer-3, 3);
-                            test_board_id = atoi(board_id);
-                            ESP_LOGI(TAG, "test_board_id: %i", test_board_id);
-                        }
-
-                        // #ARM,0;
-                        if (memcmp(end_buffer-6, "#ARM,", 4) == 0 && *(uint8_t *)end_buffer == ';')
-                        {
-                            // Parse the board id buffer
-                            char armed_bit[2];
-                            memset(armed_bit, 0, 2);
-                            memcpy(armed_bit, end_buffer-1, 1);
-                            global_tx_data.armed = atoi(armed_bit);
-                            ESP_LOGI(TAG, "global_armed_state: %i", global_tx_data.armed);
-                        }
-
-                        if (memcmp(uart_command_buffer, "#DET,", 4) == 0 && *(uint8_t *)end_buffer == ';')
-                        {
-                            void *start_hex = uart_command_buffer + 5;
-                            char byte[3];
-                            memset(byte, 0, 3);
-
-                            for (int i = 0; i < 64; i ++)
-                            {
-                                memcpy(byte, start_hex + 2*i, 2);
-                                global_tx_data.pyro_bits[i] = strtol(byte, NULL, 16);
-                            }
-
-                            ESP_LOGI(TAG, "updated pyro data");
-                        }
-                    }
-                    uart_write_bytes(EX_UART_NUM, (const char *) dtmp, event.size);
+                    // Binary frames are answered with ACK/NAK, only text is echoed
+                    text_len = uart_frame_feed(dtmp, event.size);
+                    uart_command_feed(dtmp, text_len);
+                    uart_write_bytes(EX_UART_NUM, (const char *) dtmp, text_len);
                     break;
 
                 // Event of HW FIFO overflow detected
@@ -582,46 +3995,144 @@ static void uart_event_task(void *pvParameters)
     vTaskDelete(NULL);
 }
 
-#define ESPNOW_SILENCE_TICKS_TIMEOUT 1000
-
-/* Hardware timer keeps track of the number of ticks since the last received espnow packet
-   If more than 100 ticks have elapsed, disarm the board.
-*/
-void hw_timer_callback(void *arg)
+/* Sets the armed LED: solid when detonated, toggled on each blink while
+ * armed. Left alone while silent, when SET_DISARMED owns it. */
+static void rx_led_update(bool blink)
 {
-    hw_timer_ticks ++;
-    ticks_since_last_packet ++;
-
     static int blink_state = 0;
 
-    if (ticks_since_last_packet > ESPNOW_SILENCE_TICKS_TIMEOUT)
+    if (rx_silent)
     {
-        SET_DISARMED();
+        return;
     }
-    else if (pyro_detonated)
+    if (pyro_detonated)
     {
         // Solid on for detonated
         gpio_set_level(GPIO_OUTPUT_ARMED_LED, LOW);
     }
-    else if (pyro_armed && (hw_timer_ticks % 200 == 0))
+    else if (pyro_armed && blink)
     {
         // Blink for armed
         blink_state ^= 1;
-        // Set LED
         gpio_set_level(GPIO_OUTPUT_ARMED_LED, blink_state);
     }
-    else
+}
+
+/* Low power: blinks the LED from a FreeRTOS timer instead of the hw_timer. */
+static void rx_led_timer_callback(TimerHandle_t timer)
+{
+    rx_led_update(true);
+}
+
+/* Hardware timer fires scheduled detonations and status slots, and
+   disarms the board after ESPNOW_SILENCE_TICKS_TIMEOUT ticks without a
+   frame. It runs every tick, or in low power only when one of those is
+   due.
+*/
+void hw_timer_callback(void *arg)
+{
+    uint32_t now = rx_ticks_now();
+
+    rx_power.timer_irqs ++;
+
+    if (pyro_fire_pending && (int32_t)(now - pyro_fire_at) >= 0)
+    {
+        pyro_fire_pending = false;
+        DETONATE();
+        if (pyro_detonated)
+        {
+            rx_log_event_from_isr(BEASTSQUIB_LOG_DETONATE, 1, 0);
+            rx_log_snapshot_due = true;
+        }
+    }
+
+    // This board's status slot has come; the ESPNOW task sends the report
+    if (rx_status_due && (int32_t)(now - rx_status_at) >= 0)
+    {
+        BaseType_t woken = pdFALSE;
+
+        rx_status_due = false;
+        rx_status_ready = true;
+        vTaskNotifyGiveFromISR(beastsquib_espnow_task_handle, &woken);
+        if (woken == pdTRUE)
+        {
+            portYIELD_FROM_ISR();
+        }
+    }
+
+    if (!rx_silent && rx_silence_expired(now))
+    {
+        rx_silent = true;
+        rx_log_event_from_isr(BEASTSQUIB_LOG_SILENCE, 0, 0);
+    }
+
+    if (rx_silent)
     {
+        if (pyro_armed)
+        {
+            rx_stats.silence_disarms ++;
+            rx_log_event_from_isr(BEASTSQUIB_LOG_DISARMED, 1, 0);
+        }
+        SET_DISARMED();
+    }
 
+#ifdef CONFIG_ESPNOW_LOW_POWER
+    rx_timer_arm(now);
+#else
+    static uint32_t blink_at = 0;
+    bool blink = (now - blink_at) >= 200;
+    if (blink)
+    {
+        blink_at = now;
     }
+    rx_led_update(blink);
+#endif
+}
+
+/* Brings up the UART link and, on a receiver, SPIFFS while app_main starts
+ * the radio. It runs at the lowest priority, so on the single core it only
+ * gets the CPU while the WiFi bring-up waits. */
+static void boot_io_task(void *pvParameter)
+{
+    // Configure parameters of an UART driver
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_UART);
+    uart_config_t uart_config = {
+        .baud_rate = CONFIG_ESPNOW_UART_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
+    };
+
+    // Install UART driver, and get the queue.
+    ESP_LOGI(TAG, "Initialize UART");
+    uart_param_config(EX_UART_NUM, &uart_config);
+    uart_driver_install(EX_UART_NUM, BUF_SIZE * 2, BUF_SIZE * 2, 100, &uart0_queue, 0);
+    xTaskCreate(uart_event_task, "uart_event_task", 2048, NULL, 12, NULL);
+#ifdef CONFIG_ESPNOW_TRACE
+    xTaskCreate(trace_task, "trace_task", 2048, NULL, 2, &trace_task_handle);
+#endif
+    beastsquib_boot_end(BEASTSQUIB_BOOT_UART);
+
+#ifdef RX
+    // Only the flight recorder copy needs SPIFFS, so mounting it, and
+    // formatting a blank partition, can wait for the radio
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_STORAGE);
+    rx_storage_mount(true);
+    beastsquib_boot_end(BEASTSQUIB_BOOT_STORAGE);
+#endif
+
+    vTaskDelete(NULL);
 }
 
 void app_main()
 {
     // Initialize NVS
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_NVS);
     ESP_ERROR_CHECK( nvs_flash_init() );
+    beastsquib_boot_end(BEASTSQUIB_BOOT_NVS);
 
-    /* Only the receiver enables GPIO pins and the SPI filesystem. */
+    /* Only the receiver enables GPIO pins and loads a board configuration. */
 #ifdef RX
 
     gpio_config_t gpio_armed_pin_config = {
@@ -633,6 +4144,7 @@ void app_main()
     };
 
     ESP_LOGI(TAG, "Initialize GPIO");
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_GPIO);
     gpio_config(&gpio_armed_pin_config);
 
     gpio_config_t gpio_pyro_pin_config = {
@@ -647,66 +4159,36 @@ void app_main()
 
     ESP_LOGI(TAG, "Initialize TIMER");
     hw_timer_init(hw_timer_callback, NULL);
-    hw_timer_alarm_us(1000, true);
-
-    // Get board ID
-    esp_vfs_spiffs_conf_t conf = {
-      .base_path = "/spiffs",
-      .partition_label = NULL,
-      .max_files = 5,
-      .format_if_mount_failed = true
-    };
-    
-    // Use settings defined above to initialize and mount SPIFFS filesystem.
-    // Note: esp_vfs_spiffs_register is an all-in-one convenience function.
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-
-    if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount or format filesystem");
-        } else if (ret == ESP_ERR_NOT_FOUND) {
-            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
-        }
-        return;
+#ifdef CONFIG_ESPNOW_LOW_POWER
+    // One-shot, re-armed by hw_timer_callback for its next deadline
+    hw_timer_alarm_us(1000, false);
+    TimerHandle_t led_timer = xTimerCreate("rx_led", 200 / portTICK_RATE_MS, pdTRUE, NULL, rx_led_timer_callback);
+    if (led_timer == NULL || xTimerStart(led_timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "LED timer create fail");
     }
+#else
+    hw_timer_alarm_us(1000, true);
+#endif
 
-    // Create the boardid file if it does not exist.
-    struct stat st;
-    if (stat("/spiffs/boardid.txt", &st) != 0) {
-        ESP_LOGI(TAG, "Opening file");
-        FILE* f = fopen("/spiffs/boardid.txt", "w");
-        if (f == NULL) {
-            ESP_LOGE(TAG, "Failed to open file for writing");
-            return;
-        }
-        fprintf(f, "000\n");
-        fclose(f);
-        ESP_LOGI(TAG, "File written");
-    }
+    beastsquib_boot_end(BEASTSQUIB_BOOT_GPIO);
 
-    read_board_id_cb();
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_CONFIG);
+    rx_config_load();
+    beastsquib_boot_end(BEASTSQUIB_BOOT_CONFIG);
+    rx_log_event(BEASTSQUIB_LOG_BOOT, 0, 0, (uint32_t)board_id);
 
 #endif
 
-    // Configure parameters of an UART driver
-    uart_config_t uart_config = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
-    };
-    
-    // Install UART driver, and get the queue.
-    ESP_LOGI(TAG, "Initialize UART");
-    uart_param_config(EX_UART_NUM, &uart_config);
-    uart_driver_install(EX_UART_NUM, BUF_SIZE * 2, BUF_SIZE * 2, 100, &uart0_queue, 0);
-    xTaskCreate(uart_event_task, "uart_event_task", 2048, NULL, 12, NULL);
-
     memset(&global_tx_data, 0, sizeof(global_tx_data));
 
+    // The radio comes up first; the serial link and storage follow alongside
+    xTaskCreate(boot_io_task, "boot_io_task", 2048, NULL, 1, NULL);
+
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_WIFI);
     beastsquib_wifi_init();
+    beastsquib_boot_end(BEASTSQUIB_BOOT_WIFI);
+
+    beastsquib_boot_begin(BEASTSQUIB_BOOT_ESPNOW);
     beastsquib_espnow_init();
+    beastsquib_boot_end(BEASTSQUIB_BOOT_ESPNOW);
 }